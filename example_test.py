@@ -1,18 +1,65 @@
 from __future__ import print_function
 
+import json
+import os
+import subprocess
+import sys
+
 import ttfw_idf
 
-STATS_TASK_ITERS = 3
+# Partida a frio (o ttfw reinicia a placa): o GSM_C reinicia o modem pelo PWRKEY
+BOOT_EXPECT = 'Reset Modem GSM'
+# As estatisticas so saem no fim de cada janela do modem (gsm_end), nao em periodo fixo
 STATS_TASK_EXPECT = 'Real time stats obtained'
+# Da subida do PDP ao fim da primeira janela: publicacao, celula e XTRA, ou o
+# prazo do LTE (GSM_LTE_MS, 5 min) se a rede cair no meio
+STATS_TASK_TIMEOUT = 360
+
+# Com LOGQ_MODEM_PORT definido (porta USB-serial ligada a UART2 da placa) o
+# teste sobe o simulador do SIM7070 nessa porta e acompanha o ciclo do modem.
+MODEM_PORT_ENV = 'LOGQ_MODEM_PORT'
+MODEM_PDP_EXPECT = 'PDP ativo em'
+MODEM_TIMEOUT = 180
+
+
+def start_modem_sim(port, report):
+    sim = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'tools', 'sim7070_sim.py')
+    cmd = [sys.executable, sim, '--port', port, '--report-json', report,
+           '--duration', str(MODEM_TIMEOUT + STATS_TASK_TIMEOUT)]
+    return subprocess.Popen(cmd)
+
+
+def print_modem_report(report):
+    with open(report) as f:
+        data = json.load(f)
+    for i, cycle in enumerate(data.get('cycles', [])):
+        print('Ciclo {}: TTFF {} s, primeira publicacao {} s, {} bytes'.format(
+            i + 1, cycle['time_to_first_fix_s'], cycle['time_to_first_publish_s'], cycle['bytes_total']))
 
 
 @ttfw_idf.idf_example_test(env_tag='Example_GENERIC', target=['esp32', 'esp32c3'])
 def test_real_time_stats_example(env, extra_data):
     dut = env.get_dut('real_time_stats', 'examples/system/freertos/real_time_stats')
-    dut.start_app()
+    modem_port = os.environ.get(MODEM_PORT_ENV)
+    sim = None
+    report = os.path.join(env.log_path if hasattr(env, 'log_path') else '.', 'sim7070_report.json')
+
+    if modem_port:
+        sim = start_modem_sim(modem_port, report)
+    try:
+        dut.start_app()
+        dut.expect(BOOT_EXPECT)
 
-    for iteration in range(0, STATS_TASK_ITERS):
-        dut.expect(STATS_TASK_EXPECT)
+        # Sem o simulador o modem nao responde e a primeira janela nao termina
+        if sim:
+            dut.expect(MODEM_PDP_EXPECT, timeout=MODEM_TIMEOUT)
+            dut.expect(STATS_TASK_EXPECT, timeout=STATS_TASK_TIMEOUT)
+    finally:
+        if sim:
+            sim.terminate()
+            sim.wait()
+    if sim and os.path.exists(report):
+        print_modem_report(report)
 
 
 if __name__ == '__main__':
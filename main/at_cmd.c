@@ -0,0 +1,206 @@
+/* Motor assincrono de comandos AT
+
+   A task do motor retira um comando por vez da fila de submissao, reserva a
+   UART, envia o comando e consome as linhas ate a condicao final. Ao liberar
+   a UART chama a callback e ja parte para o proximo comando.
+*/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "string.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "dlog.h"
+#include "at_health.h"
+#include "at_cmd.h"
+
+static QueueHandle_t at_cmd_queue;
+
+//at_cmd_cancel(): dos proximos at_cmd_skip retirados da fila, os com essa callback nao saem
+static portMUX_TYPE at_cmd_lock = portMUX_INITIALIZER_UNLOCKED;
+static at_cmd_cb_t at_cmd_skip_cb;
+static UBaseType_t at_cmd_skip;
+
+//Ultima linha de informacao do comando em andamento
+static char at_cmd_info[AT_LINE_MAX];
+
+static int at_cmd_is_error(const char *line)
+{
+    return (strcmp(line, "ERROR") == 0) ||
+           (strncmp(line, "+CME ERROR", 10) == 0) ||
+           (strncmp(line, "+CMS ERROR", 10) == 0);
+}
+
+static at_result_t at_cmd_exec(const at_cmd_t *cmd)
+{
+    at_line_t *line;
+    at_result_t res = AT_RES_TIMEOUT;
+    size_t plen = strlen(cmd->prefix);
+    TickType_t start = xTaskGetTickCount();
+    TickType_t limit = pdMS_TO_TICKS(cmd->timeout_ms);
+    TickType_t spent;
+    bool data_sent = false;
+    bool info_kept = false;
+
+    at_cmd_info[0] = '\0';
+    at_uart_flush();
+    at_uart_expect_prompt(cmd->data != NULL);
+    DLOGS(AT_TX, cmd->cmd);
+    at_uart_write(cmd->cmd, strlen(cmd->cmd));
+
+    while ((spent = xTaskGetTickCount() - start) < limit) {
+        line = at_uart_take_line(limit - spent);
+        if (line == NULL) {
+            break;
+        }
+        DLOGS(AT_RX, line->txt);
+
+        if (cmd->data != NULL && !data_sent && strcmp(line->txt, ">") == 0) {
+            at_uart_write((const char *)cmd->data, cmd->data_len);
+            data_sent = true;
+        } else if (at_cmd_is_error(line->txt)) {
+            memcpy(at_cmd_info, line->txt, line->len + 1);
+            res = AT_RES_ERROR;
+        } else if (cmd->final == AT_FINAL_PREFIX) {
+            if (strncmp(line->txt, cmd->prefix, plen) == 0) {
+                memcpy(at_cmd_info, line->txt, line->len + 1);
+                res = AT_RES_OK;
+            }
+        } else if (strcmp(line->txt, "OK") == 0) {
+            res = AT_RES_OK;
+        } else if (line->len > 1 && !info_kept) {
+            //Linha de informacao ou eco: a mais recente, ou a primeira com o prefixo
+            memcpy(at_cmd_info, line->txt, line->len + 1);
+            info_kept = (plen > 0 && strncmp(line->txt, cmd->prefix, plen) == 0);
+        }
+        at_uart_release_line(line);
+
+        if (res != AT_RES_TIMEOUT) {
+            break;
+        }
+    }
+    at_uart_expect_prompt(false);
+    return res;
+}
+
+static bool at_cmd_cancelled(const at_cmd_t *cmd)
+{
+    bool skip = false;
+
+    portENTER_CRITICAL(&at_cmd_lock);
+    if (at_cmd_skip > 0) {
+        at_cmd_skip--;
+        skip = (cmd->cb != NULL && cmd->cb == at_cmd_skip_cb);
+    }
+    portEXIT_CRITICAL(&at_cmd_lock);
+    return skip;
+}
+
+static void at_cmd_task(void *arg)
+{
+    at_cmd_t cmd;
+    at_result_t res;
+    int64_t t0;
+
+    while (1) {
+        if (xQueueReceive(at_cmd_queue, &cmd, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        if (at_cmd_cancelled(&cmd)) {
+            cmd.cb(&cmd, AT_RES_CANCELLED, "", cmd.arg);
+            continue;
+        }
+        at_uart_lock(portMAX_DELAY);
+        t0 = esp_timer_get_time();
+        res = at_cmd_exec(&cmd);
+        at_uart_unlock();
+        at_health_record(cmd.cmd, res, (uint32_t)((esp_timer_get_time() - t0) / 1000), cmd.retry);
+
+        if (cmd.cb != NULL) {
+            cmd.cb(&cmd, res, at_cmd_info, cmd.arg);
+        }
+    }
+}
+
+esp_err_t at_cmd_init(void)
+{
+    at_cmd_queue = xQueueCreate(AT_CMD_QUEUE_LEN, sizeof(at_cmd_t));
+    if (at_cmd_queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreatePinnedToCore(at_cmd_task, "atCmd", 3072, NULL, AT_CMD_TASK_PRIO, NULL, tskNO_AFFINITY) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t at_cmd_enqueue(const char *cmd, at_final_t final, const char *prefix,
+                                const uint8_t *data, size_t data_len, bool retry,
+                                uint32_t timeout_ms, at_cmd_cb_t cb, void *arg)
+{
+    at_cmd_t req;
+
+    if (strlen(cmd) >= AT_CMD_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (prefix == NULL) {
+        prefix = "";
+    }
+    if (strlen(prefix) >= AT_CMD_PREFIX_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    strcpy(req.cmd, cmd);
+    strcpy(req.prefix, prefix);
+    req.final = final;
+    req.timeout_ms = timeout_ms;
+    req.cb = cb;
+    req.arg = arg;
+    req.data = data;
+    req.data_len = data_len;
+    req.retry = retry;
+
+    if (xQueueSend(at_cmd_queue, &req, 0) != pdTRUE) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t at_cmd_submit(const char *cmd, at_final_t final, const char *prefix,
+                        uint32_t timeout_ms, at_cmd_cb_t cb, void *arg)
+{
+    return at_cmd_enqueue(cmd, final, prefix, NULL, 0, false, timeout_ms, cb, arg);
+}
+
+esp_err_t at_cmd_submit_retry(const char *cmd, at_final_t final, const char *prefix,
+                              uint32_t timeout_ms, bool retry, at_cmd_cb_t cb, void *arg)
+{
+    return at_cmd_enqueue(cmd, final, prefix, NULL, 0, retry, timeout_ms, cb, arg);
+}
+
+esp_err_t at_cmd_submit_data(const char *cmd, const uint8_t *data, size_t data_len,
+                             uint32_t timeout_ms, at_cmd_cb_t cb, void *arg)
+{
+    return at_cmd_enqueue(cmd, AT_FINAL_OK, NULL, data, data_len, false, timeout_ms, cb, arg);
+}
+
+void at_cmd_cancel_all(void)
+{
+    at_cmd_t cmd;
+
+    while (xQueueReceive(at_cmd_queue, &cmd, 0) == pdTRUE) {
+        if (cmd.cb != NULL) {
+            cmd.cb(&cmd, AT_RES_CANCELLED, "", cmd.arg);
+        }
+    }
+}
+
+void at_cmd_cancel(at_cmd_cb_t cb)
+{
+    portENTER_CRITICAL(&at_cmd_lock);
+    at_cmd_skip_cb = cb;
+    at_cmd_skip = uxQueueMessagesWaiting(at_cmd_queue);
+    portEXIT_CRITICAL(&at_cmd_lock);
+}
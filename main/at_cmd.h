@@ -0,0 +1,123 @@
+/* Motor assincrono de comandos AT
+
+   Comandos sao enfileirados com o resultado final esperado, um timeout e uma
+   callback de conclusao. A task do motor envia o proximo comando assim que o
+   anterior termina (OK, ERROR, prefixo esperado ou timeout), sem esperas fixas
+   entre eles.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "at_uart.h"
+
+#define AT_CMD_MAX          128     //Texto do comando, com '\r'
+#define AT_CMD_PREFIX_MAX   32
+#define AT_CMD_QUEUE_LEN    16
+#define AT_CMD_TASK_PRIO    3
+
+typedef enum {
+    AT_FINAL_OK = 0,    //Termina no "OK" (ou erro); com prefixo, a informacao e a primeira linha com ele
+    AT_FINAL_PREFIX,    //Termina na primeira linha que comeca com o prefixo (ou erro)
+} at_final_t;
+
+typedef enum {
+    AT_RES_OK = 0,
+    AT_RES_ERROR,       //"ERROR", "+CME ERROR" ou "+CMS ERROR"
+    AT_RES_TIMEOUT,
+    AT_RES_CANCELLED,   //Descartado por at_cmd_cancel_all() ou at_cmd_cancel()
+} at_result_t;
+
+typedef struct at_cmd at_cmd_t;
+
+/**
+ * @brief   Callback de conclusao, chamada no contexto da task do motor.
+ *
+ * @param   cmd     Comando concluido
+ * @param   res     Resultado
+ * @param   info    Ultima linha de informacao recebida (ex.: "+CPSI: ...") ou
+ *                  a linha com o prefixo esperado; "" se nenhuma. So e valida
+ *                  durante a chamada.
+ * @param   arg     Argumento registrado no envio
+ */
+typedef void (*at_cmd_cb_t)(const at_cmd_t *cmd, at_result_t res, const char *info, void *arg);
+
+struct at_cmd {
+    char cmd[AT_CMD_MAX];
+    char prefix[AT_CMD_PREFIX_MAX];
+    at_final_t final;
+    uint32_t timeout_ms;
+    at_cmd_cb_t cb;
+    void *arg;
+    const uint8_t *data;    //Enviado apos o prompt "> " (NULL se o comando nao tem dados)
+    size_t data_len;
+    bool retry;             //Repete um envio que nao deu o resultado (tentativas do at_health)
+};
+
+/**
+ * @brief   Cria a fila de submissao e a task do motor.
+ *
+ * Requer at_uart_init() ja executado.
+ */
+esp_err_t at_cmd_init(void);
+
+/**
+ * @brief   Enfileira um comando.
+ *
+ * @param   cmd         Texto do comando, terminado em '\r'
+ * @param   final       Condicao de termino
+ * @param   prefix      Prefixo esperado para AT_FINAL_PREFIX; em AT_FINAL_OK escolhe
+ *                      a linha de informacao da callback (NULL: a ultima recebida)
+ * @param   timeout_ms  Prazo total para a resposta final
+ * @param   cb          Callback de conclusao (pode ser NULL)
+ * @param   arg         Argumento da callback
+ *
+ * @return
+ *  - ESP_OK                Comando enfileirado
+ *  - ESP_ERR_INVALID_SIZE  Comando ou prefixo longos demais
+ *  - ESP_ERR_NO_MEM        Fila de submissao cheia
+ */
+esp_err_t at_cmd_submit(const char *cmd, at_final_t final, const char *prefix,
+                        uint32_t timeout_ms, at_cmd_cb_t cb, void *arg);
+
+/**
+ * @brief   Como at_cmd_submit(), para a repeticao de um comando que ainda nao
+ *          deu o resultado (prazo, "ainda nao" ou perfil que falhou).
+ *
+ * @param   retry   true: conta como tentativa alem da primeira no at_health
+ *
+ * @return  Os mesmos de at_cmd_submit()
+ */
+esp_err_t at_cmd_submit_retry(const char *cmd, at_final_t final, const char *prefix,
+                              uint32_t timeout_ms, bool retry, at_cmd_cb_t cb, void *arg);
+
+/**
+ * @brief   Enfileira um comando com fase de dados (ex.: AT+SMPUB).
+ *
+ * O motor envia o comando, aguarda o prompt "> ", envia data_len bytes de
+ * data e espera o "OK" final. data nao e copiado e deve permanecer valido ate
+ * a callback.
+ *
+ * @return  Os mesmos de at_cmd_submit()
+ */
+esp_err_t at_cmd_submit_data(const char *cmd, const uint8_t *data, size_t data_len,
+                             uint32_t timeout_ms, at_cmd_cb_t cb, void *arg);
+
+/**
+ * @brief   Descarta os comandos ainda nao enviados, chamando suas callbacks
+ *          com AT_RES_CANCELLED. O comando em andamento nao e afetado.
+ */
+void at_cmd_cancel_all(void);
+
+/**
+ * @brief   Descarta os comandos ja enfileirados com a callback cb (os passos
+ *          de uma sequencia), chamando-a com AT_RES_CANCELLED quando cada um
+ *          chegaria ao motor. Os demais comandos e os enviados depois seguem
+ *          normalmente, na ordem.
+ *
+ * Feita para a callback de um passo que falhou (task do motor). Um
+ * cancelamento por vez: o seguinte substitui o anterior.
+ */
+void at_cmd_cancel(at_cmd_cb_t cb);
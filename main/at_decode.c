@@ -0,0 +1,324 @@
+/* Decodificador de respostas AT guiado por tabela
+
+   Os esquemas abaixo descrevem cada resposta campo a campo. at_decode()
+   avanca pela linha uma unica vez: para cada campo do esquema localiza a
+   proxima virgula, converte o trecho no lugar e escreve na saida.
+*/
+
+#include "string.h"
+#include "at_decode.h"
+
+#define AT_FIELD(type, st, member)  { type, offsetof(st, member), 0, NULL }
+#define AT_ENUM(st, member, tab)    { AT_F_ENUM, offsetof(st, member), 0, tab }
+#define AT_SCHEMA(pfx, tab)         { pfx, tab, sizeof(tab) / sizeof(tab[0]) }
+
+//Tabelas de texto
+
+static const at_enum_t at_sys_modes[] = {
+    {"NO SERVICE",  AT_SYS_NO_SERVICE},
+    {"GSM",         AT_SYS_GSM},
+    {"LTE CAT-M1",  AT_SYS_CATM},
+    {"LTE NB-IOT",  AT_SYS_NBIOT},
+    {NULL, 0},
+};
+
+static const at_enum_t at_op_modes[] = {
+    {"Online",              AT_OP_ONLINE},
+    {"Offline",             AT_OP_OFFLINE},
+    {"Factory Test Mode",   AT_OP_TEST},
+    {"Reset",               AT_OP_RESET},
+    {"Low Power Mode",      AT_OP_LOW_POWER},
+    {NULL, 0},
+};
+
+static const at_enum_t at_rats[] = {
+    {"CAT-M",   AT_RAT_CATM},
+    {"NB-IOT",  AT_RAT_NBIOT},
+    {NULL, 0},
+};
+
+//Esquemas
+
+static const at_field_t at_cpsi_fields[] = {
+    AT_ENUM(at_cpsi_t, sys_mode, at_sys_modes),
+    AT_ENUM(at_cpsi_t, op_mode, at_op_modes),
+    { AT_F_MCCMNC, offsetof(at_cpsi_t, mcc), offsetof(at_cpsi_t, mnc), NULL },
+    AT_FIELD(AT_F_HEX32, at_cpsi_t, tac),
+    AT_FIELD(AT_F_U32,   at_cpsi_t, cell_id),
+    AT_FIELD(AT_F_U16,   at_cpsi_t, pcell_id),
+    AT_FIELD(AT_F_BAND,  at_cpsi_t, band),
+    AT_FIELD(AT_F_U32,   at_cpsi_t, earfcn),
+    AT_FIELD(AT_F_U8,    at_cpsi_t, dl_bw),
+    AT_FIELD(AT_F_U8,    at_cpsi_t, ul_bw),
+    AT_FIELD(AT_F_I16,   at_cpsi_t, rsrq),
+    AT_FIELD(AT_F_I16,   at_cpsi_t, rsrp),
+    AT_FIELD(AT_F_I16,   at_cpsi_t, rssi),
+    AT_FIELD(AT_F_I16,   at_cpsi_t, sinr),
+};
+
+static const at_field_t at_cbandcfg_fields[] = {
+    AT_ENUM(at_cbandcfg_t, rat, at_rats),
+    { AT_F_U8_LIST, offsetof(at_cbandcfg_t, bands), offsetof(at_cbandcfg_t, nbands), NULL },
+};
+
+static const at_field_t at_cgreg_fields[] = {
+    AT_FIELD(AT_F_U8,    at_cgreg_t, n),
+    AT_FIELD(AT_F_U8,    at_cgreg_t, stat),
+    AT_FIELD(AT_F_HEX32, at_cgreg_t, lac),
+    AT_FIELD(AT_F_HEX32, at_cgreg_t, ci),
+};
+
+static const at_field_t at_cnact_fields[] = {
+    AT_FIELD(AT_F_U8,   at_cnact_t, pdp_idx),
+    AT_FIELD(AT_F_U8,   at_cnact_t, status),
+    AT_FIELD(AT_F_IPV4, at_cnact_t, ip),
+};
+
+static const at_field_t at_csq_fields[] = {
+    AT_FIELD(AT_F_U8, at_csq_t, rssi),
+    AT_FIELD(AT_F_U8, at_csq_t, ber),
+};
+
+static const at_schema_t at_cpsi_schema = AT_SCHEMA("+CPSI:", at_cpsi_fields);
+static const at_schema_t at_cbandcfg_schema = AT_SCHEMA("+CBANDCFG:", at_cbandcfg_fields);
+static const at_schema_t at_cgreg_schema = AT_SCHEMA("+CGREG:", at_cgreg_fields);
+static const at_schema_t at_cnact_schema = AT_SCHEMA("+CNACT:", at_cnact_fields);
+static const at_schema_t at_csq_schema = AT_SCHEMA("+CSQ:", at_csq_fields);
+
+//Conversores; recebem o campo ja sem espacos e aspas
+
+static int at_dec_uint(const char *p, const char *end, int base, uint32_t *out)
+{
+    uint32_t v = 0;
+    int d;
+
+    if (base == 16 && end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        p += 2;
+    }
+    if (p == end) {
+        return -1;
+    }
+    for (; p < end; p++) {
+        if (*p >= '0' && *p <= '9') {
+            d = *p - '0';
+        } else if (base == 16 && *p >= 'a' && *p <= 'f') {
+            d = *p - 'a' + 10;
+        } else if (base == 16 && *p >= 'A' && *p <= 'F') {
+            d = *p - 'A' + 10;
+        } else {
+            return -1;
+        }
+        if (v > (UINT32_MAX - d) / base) {
+            return -1;
+        }
+        v = v * base + d;
+    }
+    *out = v;
+    return 0;
+}
+
+static int at_dec_int(const char *p, const char *end, int32_t *out)
+{
+    uint32_t v;
+    int neg = (p < end && *p == '-');
+
+    if (at_dec_uint(p + neg, end, 10, &v) != 0 || v > INT32_MAX) {
+        return -1;
+    }
+    *out = neg ? -(int32_t)v : (int32_t)v;
+    return 0;
+}
+
+static int at_dec_ipv4(const char *p, const char *end, uint32_t *out)
+{
+    uint32_t ip = 0;
+    uint32_t octet;
+    const char *q;
+
+    for (int i = 0; i < 4; i++) {
+        for (q = p; q < end && *q != '.'; q++) {
+        }
+        if ((i < 3) != (q < end) || at_dec_uint(p, q, 10, &octet) != 0 || octet > 255) {
+            return -1;
+        }
+        ip = (ip << 8) | octet;
+        p = q + 1;
+    }
+    *out = ip;
+    return 0;
+}
+
+static int at_dec_enum(const at_enum_t *tab, const char *p, const char *end, uint8_t *out)
+{
+    size_t len = end - p;
+
+    for (; tab->txt != NULL; tab++) {
+        if (strlen(tab->txt) == len && memcmp(tab->txt, p, len) == 0) {
+            *out = tab->val;
+            return 0;
+        }
+    }
+    //Texto desconhecido nao invalida a linha
+    *out = 0;
+    return 0;
+}
+
+static int at_dec_field(const at_field_t *f, const char *p, const char *end, uint8_t *out)
+{
+    uint32_t u;
+    int32_t i;
+    const char *q;
+
+    switch (f->type) {
+    case AT_F_SKIP:
+        return 0;
+    case AT_F_U8:
+        if (at_dec_uint(p, end, 10, &u) != 0 || u > UINT8_MAX) {
+            return -1;
+        }
+        out[f->offset] = (uint8_t)u;
+        return 0;
+    case AT_F_U16:
+        if (at_dec_uint(p, end, 10, &u) != 0 || u > UINT16_MAX) {
+            return -1;
+        }
+        *(uint16_t *)(out + f->offset) = (uint16_t)u;
+        return 0;
+    case AT_F_I16:
+        if (at_dec_int(p, end, &i) != 0 || i < INT16_MIN || i > INT16_MAX) {
+            return -1;
+        }
+        *(int16_t *)(out + f->offset) = (int16_t)i;
+        return 0;
+    case AT_F_U32:
+    case AT_F_HEX32:
+        if (at_dec_uint(p, end, f->type == AT_F_HEX32 ? 16 : 10, &u) != 0) {
+            return -1;
+        }
+        *(uint32_t *)(out + f->offset) = u;
+        return 0;
+    case AT_F_ENUM:
+        return at_dec_enum(f->enums, p, end, &out[f->offset]);
+    case AT_F_IPV4:
+        if (at_dec_ipv4(p, end, &u) != 0) {
+            return -1;
+        }
+        *(uint32_t *)(out + f->offset) = u;
+        return 0;
+    case AT_F_MCCMNC:
+        for (q = p; q < end && *q != '-'; q++) {
+        }
+        if (q == end || at_dec_uint(p, q, 10, &u) != 0 || u > UINT16_MAX) {
+            return -1;
+        }
+        *(uint16_t *)(out + f->offset) = (uint16_t)u;
+        if (at_dec_uint(q + 1, end, 10, &u) != 0 || u > UINT16_MAX) {
+            return -1;
+        }
+        *(uint16_t *)(out + f->aux) = (uint16_t)u;
+        return 0;
+    case AT_F_BAND:
+        //Numero no fim do texto: "EUTRAN-BAND28"
+        for (q = end; q > p && q[-1] >= '0' && q[-1] <= '9'; q--) {
+        }
+        if (at_dec_uint(q, end, 10, &u) != 0 || u > UINT8_MAX) {
+            return -1;
+        }
+        out[f->offset] = (uint8_t)u;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+//Remove espacos e aspas das pontas do campo
+static void at_trim(const char **p, const char **end)
+{
+    while (*p < *end && (**p == ' ' || **p == '"')) {
+        (*p)++;
+    }
+    while (*end > *p && ((*end)[-1] == ' ' || (*end)[-1] == '"')) {
+        (*end)--;
+    }
+}
+
+int at_decode(const at_schema_t *schema, const char *line, size_t len, void *out, size_t out_size)
+{
+    const char *p = line;
+    const char *end = line + len;
+    const char *fend;
+    size_t plen = strlen(schema->prefix);
+    uint8_t *dst = out;
+    int n;
+
+    memset(out, 0, out_size);
+    if (len < plen || memcmp(line, schema->prefix, plen) != 0) {
+        return AT_DEC_ERR_PREFIX;
+    }
+    p += plen;
+
+    for (n = 0; n < schema->nfields && p < end; n++) {
+        const at_field_t *f = &schema->fields[n];
+
+        if (f->type == AT_F_U8_LIST) {
+            //Lista ocupa o resto da linha
+            uint8_t cnt = 0;
+            size_t cap = f->aux - f->offset;
+            while (p < end) {
+                for (fend = p; fend < end && *fend != ','; fend++) {
+                }
+                const char *fp = p;
+                const char *fe = fend;
+                uint32_t u;
+                at_trim(&fp, &fe);
+                if (at_dec_uint(fp, fe, 10, &u) != 0 || u > UINT8_MAX) {
+                    return AT_DEC_ERR_FIELD;
+                }
+                if (cnt < cap) {
+                    dst[f->offset + cnt++] = (uint8_t)u;
+                }
+                p = (fend < end) ? fend + 1 : end;
+            }
+            dst[f->aux] = cnt;
+            n++;
+            break;
+        }
+
+        for (fend = p; fend < end && *fend != ','; fend++) {
+        }
+        const char *fp = p;
+        const char *fe = fend;
+        at_trim(&fp, &fe);
+        //Campo vazio fica zerado
+        if (fp < fe && at_dec_field(f, fp, fe, dst) != 0) {
+            return AT_DEC_ERR_FIELD;
+        }
+        p = (fend < end) ? fend + 1 : end;
+    }
+    return n;
+}
+
+int at_decode_cpsi(const char *line, size_t len, at_cpsi_t *out)
+{
+    return at_decode(&at_cpsi_schema, line, len, out, sizeof(*out));
+}
+
+int at_decode_cbandcfg(const char *line, size_t len, at_cbandcfg_t *out)
+{
+    return at_decode(&at_cbandcfg_schema, line, len, out, sizeof(*out));
+}
+
+int at_decode_cgreg(const char *line, size_t len, at_cgreg_t *out)
+{
+    return at_decode(&at_cgreg_schema, line, len, out, sizeof(*out));
+}
+
+int at_decode_cnact(const char *line, size_t len, at_cnact_t *out)
+{
+    return at_decode(&at_cnact_schema, line, len, out, sizeof(*out));
+}
+
+int at_decode_csq(const char *line, size_t len, at_csq_t *out)
+{
+    return at_decode(&at_csq_schema, line, len, out, sizeof(*out));
+}
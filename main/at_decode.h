@@ -0,0 +1,143 @@
+/* Decodificador de respostas AT guiado por tabela
+
+   Cada resposta tem um esquema estatico (prefixo + lista de campos com tipo
+   e posicao na estrutura de saida). Um unico decodificador generico percorre
+   a linha uma vez e escreve cada campo direto na estrutura, sem copias e com
+   tempo limitado ao tamanho da linha.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+//Codigos de retorno negativos de at_decode
+#define AT_DEC_ERR_PREFIX   -1  //Linha de outra resposta
+#define AT_DEC_ERR_FIELD    -2  //Campo invalido para o tipo do esquema
+
+#define AT_BANDS_MAX        24
+
+typedef enum {
+    AT_F_SKIP = 0,      //Campo ignorado
+    AT_F_U8,
+    AT_F_I16,
+    AT_F_U16,
+    AT_F_U32,
+    AT_F_HEX32,         //Hexadecimal, com ou sem "0x" e aspas
+    AT_F_ENUM,          //Texto mapeado para uint8_t pela tabela do campo
+    AT_F_IPV4,          //"a.b.c.d" para uint32_t (a no byte mais alto)
+    AT_F_MCCMNC,        //"724-05": MCC em offset, MNC em aux (uint16_t)
+    AT_F_BAND,          //"EUTRAN-BAND28" para uint8_t
+    AT_F_U8_LIST,       //Consome os campos restantes: array de offset ate aux, contagem (uint8_t) em aux
+} at_ftype_t;
+
+typedef struct {
+    const char *txt;
+    uint8_t val;
+} at_enum_t;
+
+typedef struct {
+    uint8_t type;
+    uint16_t offset;
+    uint16_t aux;
+    const at_enum_t *enums;     //AT_F_ENUM: tabela terminada com txt NULL
+} at_field_t;
+
+typedef struct {
+    const char *prefix;         //Ex.: "+CPSI:"
+    const at_field_t *fields;
+    uint8_t nfields;
+} at_schema_t;
+
+/**
+ * @brief   Decodifica uma linha segundo o esquema.
+ *
+ * A saida e zerada antes da decodificacao; campos ausentes no fim da linha
+ * ficam com zero.
+ *
+ * @param   out         Estrutura de saida do esquema
+ * @param   out_size    sizeof da estrutura
+ *
+ * @return  Numero de campos decodificados ou AT_DEC_ERR_*
+ */
+int at_decode(const at_schema_t *schema, const char *line, size_t len, void *out, size_t out_size);
+
+//Respostas conhecidas
+
+typedef enum {
+    AT_SYS_UNKNOWN = 0,
+    AT_SYS_NO_SERVICE,
+    AT_SYS_GSM,
+    AT_SYS_CATM,
+    AT_SYS_NBIOT,
+} at_sys_mode_t;
+
+typedef enum {
+    AT_OP_UNKNOWN = 0,
+    AT_OP_ONLINE,
+    AT_OP_OFFLINE,
+    AT_OP_TEST,
+    AT_OP_RESET,
+    AT_OP_LOW_POWER,
+} at_op_mode_t;
+
+typedef enum {
+    AT_RAT_UNKNOWN = 0,
+    AT_RAT_CATM,
+    AT_RAT_NBIOT,
+} at_rat_t;
+
+//+CPSI: <modo>,<operacao>,<MCC>-<MNC>,<TAC>,<SCellID>,<PCellID>,<banda>,<earfcn>,<dlbw>,<ulbw>,<RSRQ>,<RSRP>,<RSSI>,<RSSNR>
+typedef struct {
+    uint32_t tac;
+    uint32_t cell_id;
+    uint32_t earfcn;
+    uint16_t mcc;
+    uint16_t mnc;
+    uint16_t pcell_id;
+    int16_t rsrq;
+    int16_t rsrp;
+    int16_t rssi;
+    int16_t sinr;
+    uint8_t sys_mode;           //at_sys_mode_t
+    uint8_t op_mode;            //at_op_mode_t
+    uint8_t band;
+    uint8_t dl_bw;
+    uint8_t ul_bw;
+} at_cpsi_t;
+
+//+CBANDCFG: "CAT-M",1,2,3,...
+typedef struct {
+    uint8_t rat;                //at_rat_t
+    uint8_t bands[AT_BANDS_MAX];
+    uint8_t nbands;             //Logo apos bands (ver AT_F_U8_LIST)
+} at_cbandcfg_t;
+
+//+CGREG: <n>,<stat>[,<lac>,<ci>]
+typedef struct {
+    uint32_t lac;
+    uint32_t ci;
+    uint8_t n;
+    uint8_t stat;               //1 = registrado, 5 = roaming
+} at_cgreg_t;
+
+//+CNACT: <pdpidx>,<status>,<endereco>
+typedef struct {
+    uint32_t ip;
+    uint8_t pdp_idx;
+    uint8_t status;             //1 = ativo
+} at_cnact_t;
+
+//+CSQ: <rssi>,<ber>
+typedef struct {
+    uint8_t rssi;               //0..31, 99 = desconhecido
+    uint8_t ber;
+} at_csq_t;
+
+#define AT_CGREG_REGISTERED(r)  ((r)->stat == 1 || (r)->stat == 5)
+#define AT_CSQ_DBM(q)           (-113 + 2 * (int)(q)->rssi)
+
+int at_decode_cpsi(const char *line, size_t len, at_cpsi_t *out);
+int at_decode_cbandcfg(const char *line, size_t len, at_cbandcfg_t *out);
+int at_decode_cgreg(const char *line, size_t len, at_cgreg_t *out);
+int at_decode_cnact(const char *line, size_t len, at_cnact_t *out);
+int at_decode_csq(const char *line, size_t len, at_csq_t *out);
@@ -0,0 +1,233 @@
+/* Saude do modem: latencia e falhas por familia de comando AT
+
+   A tabela e procurada linearmente pelo nome: sao poucas dezenas de
+   familias e cada comando leva milissegundos no modem. A contagem e a
+   copia da tabela ficam sob um spinlock curto, porque o motor AT e o
+   GSM_C registram de tasks diferentes; ordenacao e impressao sao feitas
+   sobre a copia.
+*/
+
+#include <stdio.h>
+#include "string.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "at_health.h"
+
+_Static_assert(sizeof(telem_at_t) <= 48, "telem_at_t nao cabe em um registro do tlog");
+
+static portMUX_TYPE ah_lock = portMUX_INITIALIZER_UNLOCKED;
+static at_health_fam_t ah_fam[AT_HEALTH_FAMS];
+static uint8_t ah_nfam;
+static uint32_t ah_resets;              //Do periodo corrente
+static at_health_t ah_total;
+static at_health_fam_t ah_copy[AT_HEALTH_FAMS];     //Area do print e do to_telem (uma task por vez)
+
+//"AT+CPSI?\r" -> "CPSI", "ATE0\r" -> "E0", "AT\r" -> "AT"
+static void ah_family(const char *cmd, char *name)
+{
+    size_t n = 0;
+
+    if (strncmp(cmd, "AT", 2) == 0) {
+        cmd += 2;
+        if (*cmd == '+' || *cmd == '&') {
+            cmd++;
+        }
+    }
+    while (n < AT_HEALTH_NAME - 1 && ((*cmd >= 'A' && *cmd <= 'Z') || (*cmd >= '0' && *cmd <= '9'))) {
+        name[n++] = *cmd++;
+    }
+    if (n == 0) {
+        memcpy(name, "AT", 3);
+        return;
+    }
+    name[n] = '\0';
+}
+
+static inline int ah_bucket(uint32_t ms)
+{
+    int b = (ms < 2) ? 0 : 31 - __builtin_clz(ms);
+
+    return b < AT_HEALTH_BUCKETS ? b : AT_HEALTH_BUCKETS - 1;
+}
+
+//Chamada com ah_lock
+static at_health_fam_t *ah_find(const char *name)
+{
+    for (int i = 0; i < ah_nfam; i++) {
+        if (strcmp(ah_fam[i].name, name) == 0) {
+            return &ah_fam[i];
+        }
+    }
+    if (ah_nfam < AT_HEALTH_FAMS - 1) {
+        strcpy(ah_fam[ah_nfam].name, name);
+        return &ah_fam[ah_nfam++];
+    }
+    //Tabela cheia: excesso na ultima
+    if (ah_nfam == AT_HEALTH_FAMS - 1) {
+        strcpy(ah_fam[ah_nfam++].name, "*");
+    }
+    return &ah_fam[AT_HEALTH_FAMS - 1];
+}
+
+void at_health_record(const char *cmd, at_result_t res, uint32_t ms, uint32_t retries)
+{
+    char name[AT_HEALTH_NAME];
+    at_health_fam_t *f;
+    int b = ah_bucket(ms);
+
+    if (res != AT_RES_OK && res != AT_RES_ERROR && res != AT_RES_TIMEOUT) {
+        return;
+    }
+    ah_family(cmd, name);
+
+    portENTER_CRITICAL(&ah_lock);
+    f = ah_find(name);
+    f->n++;
+    f->timeouts += (res == AT_RES_TIMEOUT);
+    f->errors += (res == AT_RES_ERROR);
+    f->retries += retries;
+    f->sum_ms += ms;
+    f->max_ms = ms > f->max_ms ? ms : f->max_ms;
+    if (f->hist[b] < UINT16_MAX) {
+        f->hist[b]++;
+    }
+    ah_total.cmds++;
+    ah_total.timeouts += (res == AT_RES_TIMEOUT);
+    ah_total.errors += (res == AT_RES_ERROR);
+    ah_total.retries += retries;
+    portEXIT_CRITICAL(&ah_lock);
+}
+
+void at_health_modem_reset(void)
+{
+    portENTER_CRITICAL(&ah_lock);
+    ah_resets++;
+    ah_total.resets++;
+    portEXIT_CRITICAL(&ah_lock);
+}
+
+void at_health_get(at_health_t *out)
+{
+    portENTER_CRITICAL(&ah_lock);
+    *out = ah_total;
+    portEXIT_CRITICAL(&ah_lock);
+}
+
+uint32_t at_health_quantile(const at_health_fam_t *f, uint32_t pct)
+{
+    uint32_t want = (f->n * pct + 99) / 100;
+    uint32_t acc = 0;
+
+    for (int b = 0; b < AT_HEALTH_BUCKETS - 1; b++) {
+        acc += f->hist[b];
+        if (acc >= want) {
+            uint32_t top = 2u << b;
+            return top < f->max_ms ? top : f->max_ms;
+        }
+    }
+    return f->max_ms;
+}
+
+//Copia o periodo corrente; com reset, comeca outro
+static int ah_snapshot(uint32_t *resets, bool reset)
+{
+    int n;
+
+    portENTER_CRITICAL(&ah_lock);
+    n = ah_nfam;
+    memcpy(ah_copy, ah_fam, n * sizeof(ah_fam[0]));
+    *resets = ah_resets;
+    if (reset) {
+        memset(ah_fam, 0, n * sizeof(ah_fam[0]));
+        ah_nfam = 0;
+        ah_resets = 0;
+        ah_total.periods++;
+    }
+    portEXIT_CRITICAL(&ah_lock);
+    return n;
+}
+
+void at_health_print(void)
+{
+    uint32_t resets;
+    int n = ah_snapshot(&resets, false);
+
+    printf("| AT health | Familias %d | Resets do modem %u\n", n, resets);
+    for (int i = 0; i < n; i++) {
+        const at_health_fam_t *f = &ah_copy[i];
+
+        printf("| AT | %-7s | n %4u | p50 %5u | p95 %5u | max %5u ms | timeout %u | error %u | retry %u |",
+               f->name, f->n, at_health_quantile(f, 50), at_health_quantile(f, 95), f->max_ms,
+               f->timeouts, f->errors, f->retries);
+        for (int b = 0; b < AT_HEALTH_BUCKETS; b++) {
+            printf(" %u", f->hist[b]);
+        }
+        printf("\n");
+    }
+}
+
+static inline uint16_t ah_sat16(uint32_t v)
+{
+    return v > UINT16_MAX ? UINT16_MAX : (uint16_t)v;
+}
+
+//Mais falhas primeiro; empate: mais tempo de modem
+static bool ah_worse(const at_health_fam_t *a, const at_health_fam_t *b)
+{
+    uint32_t fa = a->timeouts + a->errors;
+    uint32_t fb = b->timeouts + b->errors;
+
+    return fa != fb ? fa > fb : a->sum_ms > b->sum_ms;
+}
+
+esp_err_t at_health_to_telem(telem_at_t *out, uint32_t utc)
+{
+    uint32_t resets;
+    uint32_t cmds = 0, timeouts = 0, errors = 0, retries = 0;
+    int top[TELEM_AT_TOP];
+    int ntop = 0;
+    int n = ah_snapshot(&resets, true);
+
+    memset(out, 0, sizeof(*out));
+    if (n == 0 && resets == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    for (int i = 0; i < n; i++) {
+        const at_health_fam_t *f = &ah_copy[i];
+        int k;
+
+        cmds += f->n;
+        timeouts += f->timeouts;
+        errors += f->errors;
+        retries += f->retries;
+        //Insercao nas TELEM_AT_TOP piores
+        for (k = ntop; k > 0 && ah_worse(f, &ah_copy[top[k - 1]]); k--) {
+            if (k < TELEM_AT_TOP) {
+                top[k] = top[k - 1];
+            }
+        }
+        if (k < TELEM_AT_TOP) {
+            top[k] = i;
+            ntop += (ntop < TELEM_AT_TOP);
+        }
+    }
+
+    out->utc = utc;
+    out->resets = ah_sat16(resets);
+    out->cmds = ah_sat16(cmds);
+    out->timeouts = ah_sat16(timeouts);
+    out->errors = ah_sat16(errors);
+    out->retries = ah_sat16(retries);
+    out->nfam = (uint8_t)ntop;
+    for (int i = 0; i < ntop; i++) {
+        const at_health_fam_t *f = &ah_copy[top[i]];
+
+        strncpy(out->fam[i].name, f->name, TELEM_AT_NAME);
+        out->fam[i].n = ah_sat16(f->n);
+        out->fam[i].p50_ms = ah_sat16(at_health_quantile(f, 50));
+        out->fam[i].p95_ms = ah_sat16(at_health_quantile(f, 95));
+        out->fam[i].max_ms = ah_sat16(f->max_ms);
+        out->fam[i].fails = ah_sat16(f->timeouts + f->errors);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,81 @@
+/* Saude do modem: latencia e falhas por familia de comando AT
+
+   Cada comando concluido pelo motor AT (consultas do GSM_C, do modem_cfg
+   e do mqtt_pub) e contado na familia do seu nome ("AT+CPSI?" -> CPSI,
+   "AT+SMPUB=..." -> SMPUB): histograma de latencia em faixas de potencia
+   de 2 ms, timeouts, ERROR e tentativas repetidas. Os resets do modem
+   vem dos pulsos no PWRKEY.
+
+   Memoria fixa: AT_HEALTH_FAMS familias; quando a tabela enche, as novas
+   vao para a ultima, "*". Os contadores sao do periodo corrente, fechado
+   por at_health_to_telem() (fim de cada janela de relatorio); o total
+   desde o boot fica em at_health_get().
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "at_cmd.h"
+#include "telem.h"
+
+#define AT_HEALTH_FAMS      32      //Familias distintas (a ultima recebe o excesso)
+#define AT_HEALTH_NAME      8       //Nome da familia, com terminador
+#define AT_HEALTH_BUCKETS   14      //Faixa b: [2^b, 2^(b+1)) ms; a 0 comeca em 0 e a ultima nao tem fim
+
+typedef struct {
+    char name[AT_HEALTH_NAME];
+    uint32_t n;                 //Comandos concluidos (qualquer resultado)
+    uint32_t timeouts;
+    uint32_t errors;            //ERROR, +CME ERROR ou +CMS ERROR
+    uint32_t retries;           //Tentativas alem da primeira
+    uint32_t sum_ms;
+    uint32_t max_ms;
+    uint16_t hist[AT_HEALTH_BUCKETS];   //Satura em 65535
+} at_health_fam_t;
+
+typedef struct {
+    uint32_t cmds;              //Desde o boot
+    uint32_t timeouts;
+    uint32_t errors;
+    uint32_t retries;
+    uint32_t resets;            //Resets do modem (PWRKEY)
+    uint32_t periods;           //Periodos fechados por at_health_to_telem()
+} at_health_t;
+
+/**
+ * @brief   Conta um comando concluido.
+ *
+ * @param   cmd     Texto do comando (ex.: "AT+CPSI?\r")
+ * @param   res     AT_RES_OK, AT_RES_ERROR ou AT_RES_TIMEOUT (outros sao ignorados)
+ * @param   ms      Do envio ate a resposta final ou o timeout
+ * @param   retries Tentativas alem da primeira
+ */
+void at_health_record(const char *cmd, at_result_t res, uint32_t ms, uint32_t retries);
+
+/**
+ * @brief   Modem reiniciado pelo PWRKEY.
+ */
+void at_health_modem_reset(void);
+
+void at_health_get(at_health_t *out);
+
+/**
+ * @brief   Latencia em que a fracao pct (0-100) dos comandos da familia ja
+ *          terminou: limite superior da faixa do histograma, no maximo max_ms.
+ */
+uint32_t at_health_quantile(const at_health_fam_t *f, uint32_t pct);
+
+/**
+ * @brief   Imprime o periodo corrente por familia (uma task por vez).
+ */
+void at_health_print(void);
+
+/**
+ * @brief   Resume o periodo corrente no registro de telemetria e comeca
+ *          outro: as TELEM_AT_TOP familias com mais falhas e, depois, mais
+ *          tempo de modem.
+ *
+ * @return  ESP_OK ou ESP_ERR_NOT_FOUND se nenhum comando foi contado
+ */
+esp_err_t at_health_to_telem(telem_at_t *out, uint32_t utc);
@@ -0,0 +1,82 @@
+/* Montagem de linhas das respostas do modem
+
+   O laco e o mesmo que antes rodava sobre o buffer circular da leitora:
+   um passo por byte, sem chamada ao driver nem ao FreeRTOS.
+*/
+
+#include "string.h"
+#include "at_line.h"
+
+void at_line_init(at_line_asm_t *a, at_line_get_t get, at_line_emit_t emit, void *arg)
+{
+    memset(a, 0, sizeof(*a));
+    a->get = get;
+    a->emit = emit;
+    a->arg = arg;
+}
+
+void at_line_reset(at_line_asm_t *a)
+{
+    if (a->cur != NULL) {
+        a->cur->len = 0;
+    }
+    a->discard = false;
+}
+
+//Fecha a linha em montagem; se o chamador ficou com o slot, o proximo vem do get
+static void at_line_close(at_line_asm_t *a)
+{
+    if (a->cur != NULL && a->cur->len > 0 && !a->discard) {
+        a->cur->txt[a->cur->len] = '\0';
+        if (a->emit(a->cur, a->arg)) {
+            a->cur = NULL;
+        }
+    }
+    at_line_reset(a);
+}
+
+void at_line_feed(at_line_asm_t *a, const uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        char c = (char)buf[i];
+
+        if (c == '\r' || c == '\n') {
+            at_line_close(a);
+            continue;
+        }
+        if (c == '\0' || a->discard) {
+            continue;
+        }
+        if (c == '>' && a->prompt && (a->cur == NULL || a->cur->len == 0)) {
+            //O prompt nao tem terminador: entrega ">" ja e ignora o resto da linha
+            a->prompt = false;
+            if (a->cur == NULL) {
+                a->cur = a->get(a->arg);
+            }
+            if (a->cur != NULL) {
+                a->cur->txt[a->cur->len++] = c;
+                at_line_close(a);
+            } else {
+                a->dropped++;
+            }
+            a->discard = true;
+            continue;
+        }
+        if (a->cur == NULL) {
+            a->cur = a->get(a->arg);
+            if (a->cur == NULL) {
+                //Consumidores seguram todos os slots: perde esta linha
+                a->dropped++;
+                a->discard = true;
+                continue;
+            }
+        }
+        if (a->cur->len < AT_LINE_MAX - 1) {
+            a->cur->txt[a->cur->len++] = c;
+        } else {
+            //Linha maior que o slot: descarta ate o proximo terminador
+            a->dropped++;
+            a->discard = true;
+        }
+    }
+}
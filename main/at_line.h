@@ -0,0 +1,59 @@
+/* Montagem de linhas das respostas do modem
+
+   Funcao pura sobre os bytes recebidos: fecha uma linha a cada '\r' ou
+   '\n' (linhas vazias nao saem), ignora '\0', descarta a linha que nao cabe
+   no slot e, com o prompt armado, entrega o '>' do inicio de uma linha
+   como a linha ">" sem esperar terminador. Os slots vem e voltam pelas
+   callbacks do chamador; o estado fica todo em at_line_asm_t.
+
+   A task leitora do at_uart monta as linhas com ela; nao depende do
+   ESP-IDF, compila tambem no host (tools/at_uart_bench.c).
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define AT_LINE_MAX         256     //Tamanho maximo de uma linha de resposta (com '\0')
+
+typedef struct {
+    uint16_t len;
+    char txt[AT_LINE_MAX];
+} at_line_t;
+
+/**
+ * @brief   Slot livre para a proxima linha (len ja zerado), NULL sem slot.
+ */
+typedef at_line_t *(*at_line_get_t)(void *arg);
+
+/**
+ * @brief   Linha completa, com '\0'.
+ *
+ * @return  true se o slot passou ao chamador; false o devolve ao montador,
+ *          que o reutiliza na proxima linha
+ */
+typedef bool (*at_line_emit_t)(at_line_t *line, void *arg);
+
+typedef struct {
+    at_line_get_t get;
+    at_line_emit_t emit;
+    void *arg;
+    at_line_t *cur;             //Slot em montagem
+    bool discard;               //Ignora ate o proximo terminador
+    bool prompt;                //Aguardando o "> " de um comando com dados
+    uint32_t dropped;           //Linhas perdidas por falta de slot ou tamanho excessivo
+} at_line_asm_t;
+
+void at_line_init(at_line_asm_t *a, at_line_get_t get, at_line_emit_t emit, void *arg);
+
+/**
+ * @brief   Descarta a linha em montagem (o slot continua com o montador).
+ */
+void at_line_reset(at_line_asm_t *a);
+
+/**
+ * @brief   Monta linhas com len bytes recebidos; a linha sem terminador
+ *          continua na proxima chamada.
+ */
+void at_line_feed(at_line_asm_t *a, const uint8_t *buf, size_t len);
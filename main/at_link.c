@@ -0,0 +1,334 @@
+/* Enlace serial com o SIM7070: baud rate e flow control RTS/CTS
+
+   Toda a troca e feita direto no at_uart, antes do motor AT ter comandos
+   na fila; o AT+IPR responde OK ainda no baud antigo e so entao o modem
+   muda.
+*/
+
+#include <stdio.h>
+#include "string.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "at_uart.h"
+#include "at_link.h"
+
+#define AT_LINK_NVS_NS      "link"
+#define AT_LINK_NVS_KEY     "cfg"
+#define AT_LINK_REF_MAX     64      //Resposta do ATI de referencia
+
+typedef struct {
+    uint32_t baud;
+    uint8_t flow;
+} at_link_nvs_t;
+
+static const uint32_t link_bauds[] = AT_LINK_BAUDS;
+static const uint32_t link_scan[] = AT_LINK_SCAN;
+#define LINK_NBAUDS (sizeof(link_bauds) / sizeof(link_bauds[0]))
+#define LINK_NSCAN  (sizeof(link_scan) / sizeof(link_scan[0]))
+
+static at_link_stats_t link_st;
+static uint32_t link_max;
+static int link_rts = -1;
+static int link_cts = -1;
+static uint32_t link_err0;              //Erros da UART na ultima checagem
+static char link_ref[AT_LINK_REF_MAX];
+static at_line_t link_line;
+
+static uint32_t link_uart_errors(void)
+{
+    at_uart_stats_t st;
+
+    at_uart_get_stats(&st);
+    return st.rx_errors + st.overflows + st.dropped;
+}
+
+static esp_err_t link_set(uint32_t baud, bool flow)
+{
+    esp_err_t ret = at_uart_set_link(baud, flow, link_rts, link_cts);
+
+    if (ret == ESP_OK) {
+        link_st.baud = baud;
+        link_st.flow = flow;
+    }
+    return ret;
+}
+
+static void link_send(const char *cmd)
+{
+    at_uart_write(cmd, strlen(cmd));
+}
+
+//Espera o OK (ou ERROR) do comando; eco e linhas de informacao sao ignorados
+static bool link_wait_ok(uint32_t ms)
+{
+    int64_t end = esp_timer_get_time() + (int64_t)ms * 1000;
+    int64_t left;
+
+    while ((left = end - esp_timer_get_time()) > 0) {
+        if (at_uart_read_line(&link_line, pdMS_TO_TICKS(left / 1000) + 1) < 0) {
+            break;
+        }
+        if (strcmp(link_line.txt, "OK") == 0) {
+            return true;
+        }
+        if (strstr(link_line.txt, "ERROR") != NULL) {
+            return false;
+        }
+    }
+    return false;
+}
+
+static bool link_cmd(const char *cmd, uint32_t ms)
+{
+    at_uart_flush();
+    link_send(cmd);
+    return link_wait_ok(ms);
+}
+
+static bool link_probe(void)
+{
+    for (int i = 0; i < AT_LINK_PROBE_TRIES; i++) {
+        if (link_cmd("AT\r", AT_LINK_PROBE_MS)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//Resposta do ATI concatenada, sem o eco
+static bool link_ati(char *out, size_t size)
+{
+    int64_t end = esp_timer_get_time() + (int64_t)AT_LINK_VERIFY_MS * 1000;
+    int64_t left;
+    size_t n = 0;
+
+    at_uart_flush();
+    link_send("ATI\r");
+    out[0] = '\0';
+    while ((left = end - esp_timer_get_time()) > 0) {
+        if (at_uart_read_line(&link_line, pdMS_TO_TICKS(left / 1000) + 1) < 0) {
+            break;
+        }
+        if (strcmp(link_line.txt, "OK") == 0) {
+            return true;
+        }
+        if (strcmp(link_line.txt, "ATI") == 0) {
+            continue;
+        }
+        if (n < size) {
+            n += snprintf(out + n, size - n, "%s|", link_line.txt);
+        }
+    }
+    return false;
+}
+
+//Rajada de comandos e ATI de referencia, sem nenhum erro na UART
+static bool link_verify(void)
+{
+    char ati[AT_LINK_REF_MAX];
+    char burst[3 * AT_LINK_BURST + 1];
+    uint32_t err0 = link_uart_errors();
+    int64_t end;
+    int64_t left;
+    int ok = 0;
+
+    for (int i = 0; i < AT_LINK_BURST; i++) {
+        memcpy(&burst[3 * i], "AT\r", 3);
+    }
+    burst[3 * AT_LINK_BURST] = '\0';
+    at_uart_flush();
+    link_send(burst);
+    end = esp_timer_get_time() + (int64_t)AT_LINK_VERIFY_MS * 1000;
+    while (ok < AT_LINK_BURST && (left = end - esp_timer_get_time()) > 0) {
+        if (at_uart_read_line(&link_line, pdMS_TO_TICKS(left / 1000) + 1) < 0) {
+            break;
+        }
+        ok += (strcmp(link_line.txt, "OK") == 0);
+    }
+    if (ok < AT_LINK_BURST || !link_ati(ati, sizeof(ati))) {
+        return false;
+    }
+    return (link_ref[0] == '\0' || strcmp(ati, link_ref) == 0) && link_uart_errors() == err0;
+}
+
+//Procura o baud atual do modem; tambem desliga o flow control dele
+static bool link_scan_modem(void)
+{
+    for (int i = 0; i < LINK_NSCAN; i++) {
+        link_set(link_scan[i], false);
+        //Modem com RTS/CTS ligado nao transmite com o nosso RTS solto
+        link_send("AT+IFC=0,0\r");
+        vTaskDelay(pdMS_TO_TICKS(AT_LINK_SETTLE_MS));
+        if (link_probe()) {
+            printf("Link: modem responde em %u\n", link_scan[i]);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool link_flow(bool on)
+{
+    if (!link_cmd(on ? "AT+IFC=2,2\r" : "AT+IFC=0,0\r", AT_LINK_VERIFY_MS)) {
+        return false;
+    }
+    link_set(link_st.baud, on);
+    if (!on || link_verify()) {
+        return true;
+    }
+    //CTS sem ligacao ou modem sem RTS: volta os dois lados
+    link_set(link_st.baud, false);
+    link_cmd("AT+IFC=0,0\r", AT_LINK_VERIFY_MS);
+    return false;
+}
+
+//Troca o baud dos dois lados e verifica; em falha tenta voltar ao anterior
+static bool link_switch(uint32_t to)
+{
+    char cmd[24];
+    uint32_t from = link_st.baud;
+    bool flow = link_st.flow;
+
+    snprintf(cmd, sizeof(cmd), "AT+IPR=%u\r", to);
+    if (!link_cmd(cmd, AT_LINK_VERIFY_MS)) {
+        return false;
+    }
+    vTaskDelay(pdMS_TO_TICKS(AT_LINK_SETTLE_MS));
+    link_set(to, flow);
+    if (link_verify()) {
+        return true;
+    }
+    printf("Link: %u falhou na verificacao\n", to);
+    //O modem pode ter trocado e a linha nao aguentar, ou nem ter trocado
+    if (link_probe()) {
+        snprintf(cmd, sizeof(cmd), "AT+IPR=%u\r", from);
+        link_cmd(cmd, AT_LINK_VERIFY_MS);
+        vTaskDelay(pdMS_TO_TICKS(AT_LINK_SETTLE_MS));
+    }
+    link_set(from, flow);
+    return false;
+}
+
+static esp_err_t link_save(void)
+{
+    at_link_nvs_t cfg = {.baud = link_st.baud, .flow = link_st.flow};
+    nvs_handle_t h;
+    esp_err_t ret = nvs_open(AT_LINK_NVS_NS, NVS_READWRITE, &h);
+
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = nvs_set_blob(h, AT_LINK_NVS_KEY, &cfg, sizeof(cfg));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(h);
+    }
+    nvs_close(h);
+    return ret;
+}
+
+static bool link_restore(void)
+{
+    at_link_nvs_t cfg;
+    size_t len = sizeof(cfg);
+    nvs_handle_t h;
+    esp_err_t ret = nvs_open(AT_LINK_NVS_NS, NVS_READONLY, &h);
+
+    if (ret == ESP_OK) {
+        ret = nvs_get_blob(h, AT_LINK_NVS_KEY, &cfg, &len);
+        nvs_close(h);
+    }
+    if (ret != ESP_OK || len != sizeof(cfg) || cfg.baud > link_max || (cfg.flow && link_rts < 0)) {
+        return false;
+    }
+    link_set(cfg.baud, cfg.flow);
+    return link_probe();
+}
+
+//Autobaud, flow control e subida ate o degrau mais rapido que passar
+static esp_err_t link_negotiate(void)
+{
+    link_st.negotiations++;
+    if (!link_scan_modem()) {
+        return ESP_ERR_TIMEOUT;
+    }
+    //Sem eco a rajada da verificacao cabe no pool de linhas
+    link_cmd("ATE0\r", AT_LINK_VERIFY_MS);
+    link_ref[0] = '\0';
+    if (!link_ati(link_ref, sizeof(link_ref))) {
+        link_ref[0] = '\0';
+    }
+    if (link_rts >= 0 && link_cts >= 0 && !link_flow(true)) {
+        printf("Link: sem RTS/CTS\n");
+    }
+    for (int i = 0; i < LINK_NBAUDS; i++) {
+        if (link_bauds[i] > link_max || link_bauds[i] <= link_st.baud) {
+            continue;
+        }
+        if (link_switch(link_bauds[i])) {
+            break;
+        }
+    }
+    link_save();
+    return ESP_OK;
+}
+
+esp_err_t at_link_start(uint32_t max_baud, int rts, int cts)
+{
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t ret = ESP_OK;
+
+    link_max = max_baud;
+    link_rts = rts;
+    link_cts = cts;
+    at_uart_lock(portMAX_DELAY);
+    link_st.from_nvs = link_restore();
+    if (!link_st.from_nvs) {
+        ret = link_negotiate();
+    }
+    at_uart_unlock();
+    link_err0 = link_uart_errors();
+    link_st.setup_ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+    if (ret == ESP_OK) {
+        printf("Link: %u baud%s, %s em %u ms\n", link_st.baud, link_st.flow ? " RTS/CTS" : "",
+               link_st.from_nvs ? "da NVS" : "negociado", link_st.setup_ms);
+    }
+    return ret;
+}
+
+esp_err_t at_link_check(void)
+{
+    uint32_t errs = link_uart_errors();
+    uint32_t delta = errs - link_err0;
+    esp_err_t ret = ESP_OK;
+    int i = 0;
+
+    link_err0 = errs;
+    if (delta < AT_LINK_ERR_MAX) {
+        return ESP_OK;
+    }
+    //Proximo degrau abaixo do atual
+    while (i < LINK_NBAUDS && link_bauds[i] >= link_st.baud) {
+        i++;
+    }
+    printf("Link: %u erros em %u, descendo\n", delta, link_st.baud);
+    link_st.fallbacks++;
+    at_uart_lock(portMAX_DELAY);
+    if (i == LINK_NBAUDS || !link_switch(link_bauds[i])) {
+        if (!link_probe()) {
+            ret = link_negotiate();
+        }
+    }
+    if (ret == ESP_OK) {
+        link_save();
+    }
+    at_uart_unlock();
+    link_err0 = link_uart_errors();
+    return ret;
+}
+
+void at_link_get_stats(at_link_stats_t *stats)
+{
+    *stats = link_st;
+}
@@ -0,0 +1,64 @@
+/* Enlace serial com o SIM7070: baud rate e flow control RTS/CTS
+
+   Na partida o enlace gravado na NVS e testado com um AT; se o modem
+   responder, nada e negociado. Senao:
+     - autobaud: o ESP32 percorre AT_LINK_SCAN ate o modem responder (o
+       SIM7070 de fabrica detecta o baud pelo proprio "AT");
+     - com os pinos RTS/CTS configurados, liga o flow control nos dois
+       lados (AT+IFC=2,2) ainda no baud baixo;
+     - sobe pelos degraus de AT_LINK_BAUDS (AT+IPR), do mais rapido ate
+       o limite configurado, e fica no primeiro que passar na verificacao:
+       rajada de AT_LINK_BURST comandos e a resposta do ATI igual a obtida
+       no baud inicial, sem erro de quadro, overflow ou linha perdida;
+     - grava o resultado na NVS.
+
+   Em operacao, at_link_check() olha os erros da UART desde a ultima
+   chamada e desce um degrau (ou renegocia) se passarem de AT_LINK_ERR_MAX.
+
+   Usa a UART pelo at_uart (segurando at_uart_lock()); requer
+   nvs_flash_init().
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define AT_LINK_BAUDS       {921600, 460800, 230400, 115200}    //Degraus de subida
+#define AT_LINK_SCAN        {9600, 115200, 921600, 460800, 230400, 57600, 38400, 19200}
+#define AT_LINK_PROBE_TRIES 3
+#define AT_LINK_PROBE_MS    150     //Espera por resposta de cada AT
+#define AT_LINK_BURST       6       //Abaixo do pool de linhas do at_uart
+#define AT_LINK_VERIFY_MS   1000
+#define AT_LINK_SETTLE_MS   20      //Depois do OK do AT+IPR, antes de trocar o baud
+#define AT_LINK_ERR_MAX     8       //Erros da UART entre checagens que derrubam um degrau
+
+typedef struct {
+    uint32_t baud;
+    bool flow;                  //RTS/CTS ligado nos dois lados
+    bool from_nvs;              //Restaurado sem negociar
+    uint32_t negotiations;
+    uint32_t fallbacks;         //Degraus perdidos por erros
+    uint32_t setup_ms;          //Duracao do ultimo at_link_start()
+} at_link_stats_t;
+
+/**
+ * @brief   Restaura ou negocia o enlace.
+ *
+ * @param   max_baud    Limite de velocidade
+ * @param   rts         Pino RTS do ESP32 (-1: sem flow control)
+ * @param   cts         Pino CTS do ESP32 (-1: sem flow control)
+ *
+ * @return  ESP_OK ou ESP_ERR_TIMEOUT se o modem nao respondeu em nenhum baud
+ */
+esp_err_t at_link_start(uint32_t max_baud, int rts, int cts);
+
+/**
+ * @brief   Desce um degrau se a UART acumulou erros desde a ultima chamada.
+ *          Chamar com o modem acordado.
+ *
+ * @return  ESP_OK (mantido ou rebaixado) ou ESP_ERR_TIMEOUT se perdeu o modem
+ */
+esp_err_t at_link_check(void);
+
+void at_link_get_stats(at_link_stats_t *stats);
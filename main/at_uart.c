@@ -0,0 +1,299 @@
+/* Leitura orientada a eventos da UART do modem SIM7070
+
+   O driver avisa pela fila de eventos quando chegam dados (FIFO cheia ou
+   timeout de recepcao) e, gracas a deteccao de padrao, assim que um '\n' e
+   recebido. A task leitora le tudo o que estiver disponivel de uma so vez
+   para o buffer circular e passa o trecho lido ao montador de linhas
+   (at_line.c), sem chamadas por byte.
+*/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "string.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "ring.h"
+#include "at_uart.h"
+
+static uart_port_t at_port;
+static QueueHandle_t at_evt_queue;
+static ring_mpsc_t at_free;             //Indices de slots livres: devolvidos por qualquer task, lidos pela leitora
+static ring_cell_t at_free_cells[RING_CAP(AT_LINE_POOL)];
+static QueueHandle_t at_ready_queue;    //Indices de linhas prontas, em ordem de chegada (consumidor espera com timeout)
+static SemaphoreHandle_t at_bus_mutex;
+
+//Buffer circular alimentado pelo driver; so a task leitora mexe nele
+static uint8_t at_ring[AT_UART_RING_SIZE];
+static uint16_t at_ring_wr;
+
+//Pool de linhas; o montador (de posse da leitora) guarda o slot em montagem
+static at_line_t at_pool[AT_LINE_POOL];
+static at_line_asm_t at_asm;
+static volatile bool at_discard_partial;
+static volatile bool at_prompt_armed;  //Aguardando o "> " de um comando com dados
+static at_uart_urc_t at_urc;
+
+static volatile uint32_t at_lines;
+static volatile uint32_t at_pool_min_free = AT_LINE_POOL;
+static volatile uint32_t at_rx_errors;
+static volatile uint32_t at_overflows;
+static volatile uint32_t at_urcs;
+
+static at_line_t *at_uart_slot_get(void *arg)
+{
+    uint32_t idx;
+
+    if (!ring_mpsc_pop(&at_free, &idx)) {
+        return NULL;
+    }
+    uint32_t livres = ring_mpsc_count(&at_free);
+    if (livres < at_pool_min_free) {
+        at_pool_min_free = livres;
+    }
+    at_pool[idx].len = 0;
+    return &at_pool[idx];
+}
+
+//O ring e a fila comportam o pool inteiro, a devolucao nunca falha
+static void at_uart_slot_free(uint8_t idx)
+{
+    ring_mpsc_push(&at_free, idx);
+}
+
+static void at_uart_slot_ready(at_line_t *line)
+{
+    uint8_t idx = (uint8_t)(line - at_pool);
+
+    xQueueSend(at_ready_queue, &idx, 0);
+}
+
+//Linha montada: URC sem transacao em curso fica com o montador, o resto vai aos consumidores
+static bool at_uart_emit_line(at_line_t *line, void *arg)
+{
+    if (at_urc != NULL && at_urc(line->txt, line->len) && xSemaphoreGetMutexHolder(at_bus_mutex) == NULL) {
+        //Ninguem vai ler: o slot fica para a proxima linha
+        at_urcs++;
+        return false;
+    }
+    at_uart_slot_ready(line);
+    at_lines++;
+    return true;
+}
+
+//Monta as linhas do trecho recem-lido do buffer circular
+static void at_uart_assemble(const uint8_t *buf, size_t len)
+{
+    bool armed = at_prompt_armed;
+
+    if (at_discard_partial) {
+        at_discard_partial = false;
+        at_line_reset(&at_asm);
+    }
+    at_asm.prompt = armed;
+    at_line_feed(&at_asm, buf, len);
+    //So o prompt consumido desarma; um armar no meio da montagem nao se perde
+    if (armed && !at_asm.prompt) {
+        at_prompt_armed = false;
+    }
+}
+
+//Le ate len bytes do driver em blocos contiguos do buffer circular
+static void at_uart_drain(size_t len)
+{
+    while (len > 0) {
+        size_t span = AT_UART_RING_SIZE - at_ring_wr;
+        if (span > len) {
+            span = len;
+        }
+        int rd = uart_read_bytes(at_port, &at_ring[at_ring_wr], span, 0);
+        if (rd <= 0) {
+            break;
+        }
+        at_uart_assemble(&at_ring[at_ring_wr], rd);
+        at_ring_wr = (at_ring_wr + rd) % AT_UART_RING_SIZE;
+        len -= rd;
+    }
+}
+
+static void at_uart_task(void *arg)
+{
+    uart_event_t event;
+    size_t buffered;
+
+    while (1) {
+        if (xQueueReceive(at_evt_queue, &event, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        switch (event.type) {
+        case UART_DATA:
+            at_uart_drain(event.size);
+            break;
+        case UART_PATTERN_DET:
+            {
+                int pos = uart_pattern_pop_pos(at_port);
+                if (pos >= 0) {
+                    //Le ate o '\n' inclusive; o restante fica para o proximo evento
+                    at_uart_drain(pos + 1);
+                } else {
+                    //Posicao ja consumida por um UART_DATA anterior
+                    uart_get_buffered_data_len(at_port, &buffered);
+                    at_uart_drain(buffered);
+                }
+            }
+            break;
+        case UART_FRAME_ERR:
+        case UART_PARITY_ERR:
+            //Baud rate errado ou linha ruim; a linha em montagem nao vale mais
+            at_rx_errors++;
+            at_line_reset(&at_asm);
+            break;
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            at_overflows++;
+            printf("\tAT: overflow na UART, descartando entrada\n");
+            uart_flush_input(at_port);
+            xQueueReset(at_evt_queue);
+            at_line_reset(&at_asm);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+esp_err_t at_uart_init(uart_port_t port, const uart_config_t *cfg, int tx, int rx)
+{
+    esp_err_t ret;
+
+    at_port = port;
+    at_ready_queue = xQueueCreate(AT_LINE_POOL, sizeof(uint8_t));
+    at_bus_mutex = xSemaphoreCreateMutex();
+    if (at_ready_queue == NULL || at_bus_mutex == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    at_line_init(&at_asm, at_uart_slot_get, at_uart_emit_line, NULL);
+    ring_mpsc_init(&at_free, at_free_cells, RING_CAP(AT_LINE_POOL));
+    for (uint8_t i = 0; i < AT_LINE_POOL; i++) {
+        at_uart_slot_free(i);
+    }
+
+    ret = uart_param_config(port, cfg);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = uart_set_pin(port, tx, rx, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = uart_driver_install(port, AT_UART_RX_BUF, 0, AT_UART_EVT_QUEUE, &at_evt_queue, 0);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    //Evento imediato a cada '\n' recebido
+    uart_enable_pattern_det_baud_intr(port, '\n', 1, 1, 0, 0);
+    uart_pattern_queue_reset(port, AT_UART_EVT_QUEUE);
+
+    if (xTaskCreatePinnedToCore(at_uart_task, "atUart", 3072, NULL, AT_UART_TASK_PRIO, NULL, tskNO_AFFINITY) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t at_uart_set_link(uint32_t baud, bool flow, int rts, int cts)
+{
+    esp_err_t ret;
+
+    //Flow control desligado antes da troca: com o CTS solto a transmissao travaria
+    uart_wait_tx_done(at_port, pdMS_TO_TICKS(100));
+    ret = uart_set_hw_flow_ctrl(at_port, UART_HW_FLOWCTRL_DISABLE, 0);
+    if (ret == ESP_OK) {
+        ret = uart_set_baudrate(at_port, baud);
+    }
+    if (ret == ESP_OK && flow) {
+        ret = uart_set_pin(at_port, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, rts, cts);
+        if (ret == ESP_OK) {
+            ret = uart_set_hw_flow_ctrl(at_port, UART_HW_FLOWCTRL_CTS_RTS, AT_UART_RTS_THRESH);
+        }
+    }
+    uart_flush_input(at_port);
+    at_uart_flush();
+    return ret;
+}
+
+int at_uart_write(const char *data, size_t len)
+{
+    return uart_write_bytes(at_port, data, len);
+}
+
+at_line_t *at_uart_take_line(TickType_t xTicksToWait)
+{
+    uint8_t idx;
+
+    if (xQueueReceive(at_ready_queue, &idx, xTicksToWait) != pdTRUE) {
+        return NULL;
+    }
+    return &at_pool[idx];
+}
+
+void at_uart_release_line(at_line_t *line)
+{
+    if (line != NULL) {
+        at_uart_slot_free((uint8_t)(line - at_pool));
+    }
+}
+
+int at_uart_read_line(at_line_t *line, TickType_t xTicksToWait)
+{
+    at_line_t *slot = at_uart_take_line(xTicksToWait);
+
+    if (slot == NULL) {
+        return -1;
+    }
+    line->len = slot->len;
+    memcpy(line->txt, slot->txt, slot->len + 1);
+    at_uart_release_line(slot);
+    return line->len;
+}
+
+void at_uart_flush(void)
+{
+    uint8_t idx;
+
+    at_discard_partial = true;
+    while (xQueueReceive(at_ready_queue, &idx, 0) == pdTRUE) {
+        at_uart_slot_free(idx);
+    }
+}
+
+void at_uart_expect_prompt(bool armed)
+{
+    at_prompt_armed = armed;
+}
+
+BaseType_t at_uart_lock(TickType_t xTicksToWait)
+{
+    return xSemaphoreTake(at_bus_mutex, xTicksToWait);
+}
+
+void at_uart_unlock(void)
+{
+    xSemaphoreGive(at_bus_mutex);
+}
+
+void at_uart_set_urc(at_uart_urc_t urc)
+{
+    at_urc = urc;
+}
+
+void at_uart_get_stats(at_uart_stats_t *stats)
+{
+    stats->lines = at_lines;
+    stats->dropped = at_asm.dropped;
+    stats->pool_min_free = at_pool_min_free;
+    stats->rx_errors = at_rx_errors;
+    stats->overflows = at_overflows;
+    stats->urcs = at_urcs;
+}
@@ -0,0 +1,144 @@
+/* Leitura orientada a eventos da UART do modem SIM7070
+
+   Uma task leitora consome a fila de eventos do driver da UART (com deteccao
+   de padrao em '\n'), copia os bytes em blocos para um buffer circular e
+   entrega linhas completas aos consumidores assim que o "\r\n" final chega.
+
+   As linhas sao montadas direto em slots de um pool fixo. A leitora so
+   escreve em slots livres; ao fechar a linha o indice passa para a fila de
+   prontas e o slot pertence ao consumidor ate at_uart_release_line(), que
+   devolve o indice por um ring sem trava (qualquer task pode liberar).
+   Nenhuma alocacao de heap e feita depois do at_uart_init().
+
+   Cada linha passa antes pelo observador de URCs (at_uart_set_urc()).
+   URC reconhecida fora de uma transacao (UART sem dono) e consumida ali:
+   o slot volta ao pool em vez de esperar na fila de prontas pelo proximo
+   flush. Durante uma transacao a linha segue tambem para o dono, que pode
+   estar esperando por ela (ex.: "+APP PDP" do AT+CNACT).
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "driver/uart.h"
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "at_line.h"
+
+#ifdef CONFIG_LOGQ_AT_LINE_POOL
+#define AT_LINE_POOL        CONFIG_LOGQ_AT_LINE_POOL
+#else
+#define AT_LINE_POOL        8       //Slots de linha (montagem + prontas + em uso)
+#endif
+#define AT_UART_RX_BUF      2048    //Buffer de recepcao do driver
+#define AT_UART_EVT_QUEUE   20      //Profundidade da fila de eventos do driver
+#define AT_UART_RING_SIZE   512     //Buffer circular entre o driver e o montador de linhas
+#define AT_UART_TASK_PRIO   4       //Acima da task GSM para nao perder eventos
+#define AT_UART_RTS_THRESH  100     //Bytes na FIFO de 128 que levantam o RTS
+
+typedef struct {
+    uint32_t lines;         //Linhas entregues aos consumidores
+    uint32_t dropped;       //Linhas perdidas por falta de slot ou tamanho excessivo
+    uint32_t pool_min_free; //Menor numero de slots livres ja observado
+    uint32_t rx_errors;     //Erros de quadro/paridade
+    uint32_t overflows;     //FIFO ou buffer do driver cheios
+    uint32_t urcs;          //URCs consumidas fora de transacao
+} at_uart_stats_t;
+
+/**
+ * @brief   Observador de linhas: true se a linha e uma URC conhecida.
+ *          Roda na task leitora; nao deve bloquear.
+ */
+typedef bool (*at_uart_urc_t)(const char *line, size_t len);
+
+/**
+ * @brief   Configura a UART do modem e cria a task leitora.
+ *
+ * @param   port    UART ligada ao SIM7070
+ * @param   cfg     Parametros seriais
+ * @param   tx      Pino TX
+ * @param   rx      Pino RX
+ *
+ * @return
+ *  - ESP_OK            Sucesso
+ *  - ESP_ERR_NO_MEM    Falha ao criar fila ou task
+ *  - Outros            Erros repassados pelo driver da UART
+ */
+esp_err_t at_uart_init(uart_port_t port, const uart_config_t *cfg, int tx, int rx);
+
+/**
+ * @brief   Troca o baud rate e o flow control RTS/CTS da UART do modem.
+ *
+ * Espera a transmissao pendente terminar e descarta o que foi recebido
+ * (bytes na velocidade antiga sao lixo).
+ *
+ * @param   flow    Liga RTS/CTS nos pinos rts e cts; false desliga
+ */
+esp_err_t at_uart_set_link(uint32_t baud, bool flow, int rts, int cts);
+
+/**
+ * @brief   Envia bytes crus ao modem.
+ */
+int at_uart_write(const char *data, size_t len);
+
+/**
+ * @brief   Aguarda a proxima linha completa recebida do modem.
+ *
+ * O slot devolvido pertence ao chamador ate ser liberado com
+ * at_uart_release_line(); enquanto isso a leitora nao o reutiliza.
+ *
+ * @return  Slot com a linha ou NULL em timeout
+ */
+at_line_t *at_uart_take_line(TickType_t xTicksToWait);
+
+/**
+ * @brief   Devolve ao pool um slot obtido com at_uart_take_line().
+ */
+void at_uart_release_line(at_line_t *line);
+
+/**
+ * @brief   Versao com copia de at_uart_take_line(), para quem precisa
+ *          guardar a linha alem da proxima leitura.
+ *
+ * @return  Tamanho da linha (sem terminador) ou -1 em timeout
+ */
+int at_uart_read_line(at_line_t *line, TickType_t xTicksToWait);
+
+/**
+ * @brief   Descarta linhas pendentes e bytes ainda nao terminados.
+ */
+void at_uart_flush(void);
+
+/**
+ * @brief   Habilita a deteccao do prompt "> " de comandos com dados
+ *          (AT+SMPUB, AT+CASEND...).
+ *
+ * Armado antes de enviar o comando, o proximo '>' no inicio de uma linha e
+ * entregue como a linha ">" sem esperar terminador, e o restante da linha e
+ * descartado. Desarma sozinho apos o prompt.
+ */
+void at_uart_expect_prompt(bool armed);
+
+/**
+ * @brief   Reserva a UART do modem para uma transacao comando/resposta.
+ *
+ * Quem envia um comando e consome as respostas (motor de comandos AT,
+ * at_link) deve segurar a UART ate o fim, para que duas transacoes nao
+ * roubem linhas uma da outra.
+ *
+ * @return  pdTRUE se obteve a UART dentro do prazo
+ */
+BaseType_t at_uart_lock(TickType_t xTicksToWait);
+
+void at_uart_unlock(void);
+
+/**
+ * @brief   Registra o observador de URCs (NULL desliga).
+ */
+void at_uart_set_urc(at_uart_urc_t urc);
+
+/**
+ * @brief   Contadores do pool de linhas.
+ */
+void at_uart_get_stats(at_uart_stats_t *stats);
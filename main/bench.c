@@ -0,0 +1,416 @@
+/* Benchmark reproduzivel das rotinas do firmware
+
+   As entradas sao geradas uma vez por carga, fora da medicao, com um gerador
+   congruente de semente fixa e aritmetica inteira, para serem identicas no
+   ESP32 e no host. Cada repeticao e medida separadamente e o resultado e a
+   melhor delas: interrupcoes e trocas de contexto so aumentam o tempo, entao
+   o minimo e o valor mais estavel entre execucoes.
+*/
+
+#include <stdio.h>
+#include "string.h"
+#include "bench.h"
+#include "at_decode.h"
+#include "gnss.h"
+#include "telem.h"
+#include "vib.h"
+#include "evt.h"
+#include "ring.h"
+#include "dlog.h"
+
+#define BENCH_LINE_LOOPS    64      //Passadas pelas linhas canonicas por repeticao
+#define BENCH_TELEM_N       64      //Fixes (e resumos de vibracao) por repeticao
+#define BENCH_PAYLOAD_MAX   1024    //MQTT_PAYLOAD_MAX
+#define BENCH_IMU_N         2048    //Amostras de IMU por repeticao (~2 s)
+#define BENCH_RING_LEN      1024    //IMU_RING_LEN
+#define BENCH_RING_N        4096    //Amostras empurradas por repeticao
+#define BENCH_RING_BURST    16      //IMU_CHUNK_FRAMES
+#define BENCH_RING_POP      64      //Leitura da task de vibracao
+#define BENCH_LOG_N         64      //Registros de log por repeticao
+#define BENCH_LOG_LINE      160     //Linha do console (dlog_emit)
+
+typedef struct {
+    const char *name;
+    void (*setup)(void);
+    uint32_t (*run)(uint32_t *chk);     //Devolve as operacoes feitas
+} bench_load_t;
+
+//Mesmo layout de imu_sample_t, sem depender do driver
+typedef struct {
+    uint32_t t_us;
+    int16_t acc[3];
+    int16_t gyr[3];
+} bench_sample_t;
+
+static const char *const bench_at_lines[] = {
+    "+CPSI: LTE CAT-M1,Online,724-05,0x5A1E,187214780,257,EUTRAN-BAND28,9410,3,3,-10,-95,-65,12",
+    "+CGREG: 0,5",
+    "+CNACT: 0,1,\"10.170.3.5\"",
+    "+CBANDCFG: \"CAT-M\",1,2,3,4,5,8,12,13,18,19,20,25,26,27,28,66,85",
+};
+
+static const char *const bench_gnss_lines[] = {
+    "+CGNSINF: 1,1,20220212223745.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+    "+CGNSINF: 1,0,,,,,,,,,,,,,,,,",
+    "+CGNSINF: 1,1,20220212223815.000,-23.549980,-46.632101,758.400,51.02,179.9,1,,0.8,1.2,0.9,,12,8,,,33,,",
+    //Linhas cortadas pela UART e campos corrompidos: o caminho de erro tambem conta
+    "+CGNSINF: 1,1,20220212223845.000,-23.54",
+    "+CGNSINF: 1,1,20220212223915.000,-23.5x9980,-46.632101,758.400,51.02,179.9,1,,0.8,1.2,0.9,,12,8,,,33,,",
+    "+CGNSINF: 1,1,20220212223945.000,-23.549980,-46.632101,758.400,51.02,360.50,1,,0.8,1.2,0.9,,12,8,,,33,,",
+    "+CGNSIN",
+};
+
+static uint32_t bench_seed;
+
+static uint32_t bench_rand(void)
+{
+    bench_seed = bench_seed * 1664525u + 1013904223u;
+    return bench_seed >> 8;
+}
+
+//FNV-1a
+static uint32_t bench_hash(uint32_t h, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+static uint32_t bench_mix(uint32_t h, uint32_t v)
+{
+    return bench_hash(h, &v, sizeof(v));
+}
+
+//---------------------------------------------------------------- at_decode
+
+static size_t bench_at_len[sizeof(bench_at_lines) / sizeof(bench_at_lines[0])];
+
+static void bench_at_setup(void)
+{
+    for (size_t i = 0; i < sizeof(bench_at_lines) / sizeof(bench_at_lines[0]); i++) {
+        bench_at_len[i] = strlen(bench_at_lines[i]);
+    }
+}
+
+static uint32_t bench_at_run(uint32_t *chk)
+{
+    at_cpsi_t cpsi;
+    at_cgreg_t cgreg;
+    at_cnact_t cnact;
+    at_cbandcfg_t band;
+    uint32_t acc = 0;
+
+    for (int k = 0; k < BENCH_LINE_LOOPS; k++) {
+        acc += (uint32_t)at_decode_cpsi(bench_at_lines[0], bench_at_len[0], &cpsi) + (uint32_t)cpsi.rsrp;
+        acc += (uint32_t)at_decode_cgreg(bench_at_lines[1], bench_at_len[1], &cgreg) + cgreg.stat;
+        acc += (uint32_t)at_decode_cnact(bench_at_lines[2], bench_at_len[2], &cnact) + cnact.ip;
+        acc += (uint32_t)at_decode_cbandcfg(bench_at_lines[3], bench_at_len[3], &band) + band.nbands;
+    }
+    *chk = bench_mix(*chk, acc);
+    return BENCH_LINE_LOOPS * 4;
+}
+
+//---------------------------------------------------------------- gnss
+
+static size_t bench_gnss_len[sizeof(bench_gnss_lines) / sizeof(bench_gnss_lines[0])];
+
+static void bench_gnss_setup(void)
+{
+    for (size_t i = 0; i < sizeof(bench_gnss_lines) / sizeof(bench_gnss_lines[0]); i++) {
+        bench_gnss_len[i] = strlen(bench_gnss_lines[i]);
+    }
+}
+
+static uint32_t bench_gnss_run(uint32_t *chk)
+{
+    const int nlines = sizeof(bench_gnss_lines) / sizeof(bench_gnss_lines[0]);
+    gnss_fix_t fix;
+    uint32_t acc = 0;
+
+    for (int k = 0; k < BENCH_LINE_LOOPS; k++) {
+        for (int i = 0; i < nlines; i++) {
+            acc += (uint32_t)gnss_parse_cgnsinf(bench_gnss_lines[i], bench_gnss_len[i], &fix);
+            acc += fix.present + (uint32_t)fix.lat_e6 + (uint32_t)fix.lon_e6 + fix.utc;
+        }
+    }
+    *chk = bench_mix(*chk, acc);
+    return BENCH_LINE_LOOPS * nlines;
+}
+
+//---------------------------------------------------------------- telem
+
+static telem_fix_t bench_fixes[BENCH_TELEM_N];
+static telem_vib_t bench_vibs[BENCH_TELEM_N];
+static uint8_t bench_payload[BENCH_PAYLOAD_MAX];
+
+static void bench_telem_setup(void)
+{
+    int32_t lat = -23550520, lon = -46633308, alt = 76000;
+    uint32_t t = 1644705465;
+
+    bench_seed = 1;
+    for (int i = 0; i < BENCH_TELEM_N; i++) {
+        lat += (int32_t)(bench_rand() % 4000) - 1000;
+        lon += (int32_t)(bench_rand() % 4000) - 1000;
+        alt += (int32_t)(bench_rand() % 200) - 100;
+        t += 30;
+        memset(&bench_fixes[i], 0, sizeof(bench_fixes[i]));
+        bench_fixes[i].utc = t;
+        bench_fixes[i].lat_e6 = lat;
+        bench_fixes[i].lon_e6 = lon;
+        bench_fixes[i].alt_cm = alt;
+        bench_fixes[i].speed_kmh_x100 = 5000 + bench_rand() % 2000;
+        bench_fixes[i].course_x100 = bench_rand() % 36000;
+        bench_fixes[i].hdop_x100 = 80 + bench_rand() % 60;
+        bench_fixes[i].sats = 6 + bench_rand() % 6;
+        bench_fixes[i].fix_mode = 1;
+
+        memset(&bench_vibs[i], 0, sizeof(bench_vibs[i]));
+        bench_vibs[i].utc = t + 1;
+        bench_vibs[i].axis = i % 3;
+        bench_vibs[i].rms_mg = 40 + bench_rand() % 40;
+        bench_vibs[i].peak_mg = 200 + bench_rand() % 400;
+        bench_vibs[i].crest_x100 = 300 + bench_rand() % 300;
+        bench_vibs[i].kurtosis_x100 = 250 + bench_rand() % 500;
+        bench_vibs[i].nbands = TELEM_VIB_BANDS;
+        for (int b = 0; b < TELEM_VIB_BANDS; b++) {
+            bench_vibs[i].band[b] = bench_rand() % 5000;
+        }
+    }
+}
+
+static uint32_t bench_telem_run(uint32_t *chk)
+{
+    telem_enc_t enc;
+    uint32_t h = *chk;
+
+    telem_enc_init(&enc, bench_payload, sizeof(bench_payload));
+    for (int i = 0; i < BENCH_TELEM_N; i++) {
+        //Lote cheio: fecha (confere) e abre outro, como o mqtt_pub
+        if (telem_enc_fix(&enc, &bench_fixes[i]) == TELEM_ERR_FULL) {
+            h = bench_hash(h, bench_payload, enc.len);
+            telem_enc_init(&enc, bench_payload, sizeof(bench_payload));
+            telem_enc_fix(&enc, &bench_fixes[i]);
+        }
+        if (telem_enc_vib(&enc, &bench_vibs[i]) == TELEM_ERR_FULL) {
+            h = bench_hash(h, bench_payload, enc.len);
+            telem_enc_init(&enc, bench_payload, sizeof(bench_payload));
+            telem_enc_vib(&enc, &bench_vibs[i]);
+        }
+    }
+    *chk = bench_hash(h, bench_payload, enc.len);
+    return BENCH_TELEM_N * 2;
+}
+
+//---------------------------------------------------------------- imu
+
+static int16_t bench_acc[BENCH_IMU_N][VIB_AXES];
+static vib_t bench_vib;
+static evt_t bench_evt;
+static uint32_t bench_t_us;
+
+static void bench_imu_setup(void)
+{
+    const vib_cfg_t vcfg = VIB_CFG_DEFAULT;
+    const evt_cfg_t ecfg = EVT_CFG_DEFAULT;
+
+    //Estrada: gravidade em z, triangulos de ~12 e ~47 Hz, ruido e um choque
+    bench_seed = 7;
+    for (int i = 0; i < BENCH_IMU_N; i++) {
+        for (int a = 0; a < VIB_AXES; a++) {
+            int32_t p12 = (i * 12 + a * 20) % VIB_RATE_HZ;
+            int32_t p47 = (i * 47 + a * 90) % VIB_RATE_HZ;
+            int32_t v = (a == 2) ? VIB_LSB_PER_G : 0;
+
+            v += (p12 < VIB_RATE_HZ / 2 ? p12 : VIB_RATE_HZ - p12) * 1600 / VIB_RATE_HZ - 400;
+            v += (p47 < VIB_RATE_HZ / 2 ? p47 : VIB_RATE_HZ - p47) * 800 / VIB_RATE_HZ - 200;
+            v += (int32_t)(bench_rand() % 400) - 200;
+            if (a == 1 && i >= 1500 && i < 1506) {
+                v += 4 * VIB_LSB_PER_G;
+            }
+            bench_acc[i][a] = (int16_t)v;
+        }
+    }
+    vib_init(&bench_vib, &vcfg);
+    evt_init(&bench_evt, &ecfg);
+    bench_t_us = 0;
+}
+
+static uint32_t bench_imu_run(uint32_t *chk)
+{
+    telem_evt_t ev;
+    telem_vib_t rep[VIB_AXES];
+    uint32_t acc = 0;
+
+    for (int i = 0; i < BENCH_IMU_N; i++) {
+        vib_add(&bench_vib, bench_acc[i]);
+        if (evt_add(&bench_evt, bench_acc[i], bench_t_us, &ev)) {
+            acc += ev.kind + ev.peak_mg;
+        }
+        bench_t_us += 1000000 / VIB_RATE_HZ;
+    }
+    if (vib_report(&bench_vib, 0, rep) == VIB_AXES) {
+        for (int a = 0; a < VIB_AXES; a++) {
+            acc += rep[a].rms_mg + rep[a].peak_mg + rep[a].band[3];
+        }
+    }
+    *chk = bench_mix(*chk, acc);
+    return BENCH_IMU_N;
+}
+
+//---------------------------------------------------------------- ring
+
+static bench_sample_t bench_ring_buf[BENCH_RING_LEN];
+static bench_sample_t bench_burst[BENCH_RING_BURST];
+static bench_sample_t bench_out[BENCH_RING_POP];
+static ring_t bench_ring;
+
+static void bench_ring_setup(void)
+{
+    ring_init(&bench_ring, bench_ring_buf, sizeof(bench_sample_t), BENCH_RING_LEN);
+    memset(bench_burst, 0, sizeof(bench_burst));
+}
+
+static uint32_t bench_ring_run(uint32_t *chk)
+{
+    uint32_t acc = 0;
+    size_t n;
+
+    for (int i = 0; i < BENCH_RING_N; i += BENCH_RING_BURST) {
+        for (int k = 0; k < BENCH_RING_BURST; k++) {
+            bench_burst[k].t_us = i + k;
+        }
+        ring_push(&bench_ring, bench_burst, BENCH_RING_BURST);
+        //O consumidor le em blocos quando ha um bloco inteiro
+        while (ring_count(&bench_ring) >= BENCH_RING_POP) {
+            n = ring_pop(&bench_ring, bench_out, BENCH_RING_POP);
+            acc += bench_out[n - 1].t_us;
+        }
+    }
+    *chk = bench_mix(*chk, acc + bench_ring.dropped);
+    return BENCH_RING_N;
+}
+
+//---------------------------------------------------------------- dlog e printf
+
+/*
+ * Mesmas linhas do caminho quente (um registro de inteiros e uma linha AT)
+ * pelo dlog e pelo snprintf. No dlog entra a escrita no ring e a leitura
+ * pelo consumidor, sem a formatacao, que fica para a task de prioridade
+ * baixa ou para o host. O snprintf e o piso do printf: nao inclui a espera
+ * pela UART, que no firmware domina.
+ */
+
+static char bench_log_line[BENCH_LOG_LINE];
+
+static void bench_log_setup(void)
+{
+    dlog_rec_t rec;
+
+    dlog_set_level(DLOG_MOD_BENCH, DLOG_LVL_INFO);
+    while (dlog_pop(DLOG_CORE(), &rec)) {
+    }
+}
+
+static uint32_t bench_dlog_run(uint32_t *chk)
+{
+    const int nlines = sizeof(bench_at_lines) / sizeof(bench_at_lines[0]);
+    dlog_rec_t rec;
+    uint32_t acc = 0;
+
+    for (int i = 0; i < BENCH_LOG_N; i++) {
+        DLOG(BENCH_INT, i & 3, 5, -23550520 + i, -46633308 - i);
+        DLOGS(BENCH_STR, bench_at_lines[i % nlines]);
+        //Consumidor a cada 8 chamadas, como a task do dlog esvaziando o ring
+        if ((i & 7) == 7) {
+            while (dlog_pop(DLOG_CORE(), &rec)) {
+                acc += rec.id + rec.len;
+            }
+        }
+    }
+    *chk = bench_mix(*chk, acc);
+    return BENCH_LOG_N * 2;
+}
+
+static uint32_t bench_printf_run(uint32_t *chk)
+{
+    const int nlines = sizeof(bench_at_lines) / sizeof(bench_at_lines[0]);
+    uint32_t acc = 0;
+
+    for (int i = 0; i < BENCH_LOG_N; i++) {
+        acc += (uint32_t)snprintf(bench_log_line, sizeof(bench_log_line), "+CGREG: %u,%u lat %d lon %d",
+                                  i & 3, 5, -23550520 + i, -46633308 - i);
+        acc += (uint32_t)snprintf(bench_log_line, sizeof(bench_log_line), "%s", bench_at_lines[i % nlines]);
+    }
+    *chk = bench_mix(*chk, acc);
+    return BENCH_LOG_N * 2;
+}
+
+//---------------------------------------------------------------- conjunto
+
+static const bench_load_t bench_loads[] = {
+    {"at_decode", bench_at_setup, bench_at_run},
+    {"gnss", bench_gnss_setup, bench_gnss_run},
+    {"telem", bench_telem_setup, bench_telem_run},
+    {"imu", bench_imu_setup, bench_imu_run},
+    {"ring", bench_ring_setup, bench_ring_run},
+    {"dlog", bench_log_setup, bench_dlog_run},
+    {"printf", bench_log_setup, bench_printf_run},
+};
+
+_Static_assert(sizeof(bench_loads) / sizeof(bench_loads[0]) <= BENCH_MAX, "BENCH_MAX pequeno demais");
+
+static uint32_t bench_min(const uint32_t *v, int n)
+{
+    uint32_t m = v[0];
+
+    for (int i = 1; i < n; i++) {
+        m = v[i] < m ? v[i] : m;
+    }
+    return m;
+}
+
+size_t bench_run(const bench_port_t *port, bench_result_t *out, size_t max)
+{
+    size_t n = 0;
+
+    for (size_t l = 0; l < sizeof(bench_loads) / sizeof(bench_loads[0]) && n < max; l++) {
+        const bench_load_t *b = &bench_loads[l];
+        uint32_t cyc[BENCH_REPEAT];
+        uint32_t ns[BENCH_REPEAT];
+        uint32_t chk = 2166136261u;
+        uint32_t ops = 0;
+        int32_t heap0;
+
+        b->setup();
+        b->run(&chk);               //Aquecimento (caches, primeira janela)
+        heap0 = port->heap_used ? port->heap_used() : 0;
+        for (int r = 0; r < BENCH_REPEAT; r++) {
+            uint32_t c0 = port->cycles();
+            uint64_t t0 = port->time_ns();
+
+            ops = b->run(&chk);
+            cyc[r] = port->cycles() - c0;
+            ns[r] = (uint32_t)(port->time_ns() - t0);
+        }
+
+        out[n].name = b->name;
+        out[n].ops = ops;
+        out[n].cycles_op = bench_min(cyc, BENCH_REPEAT) / ops;
+        out[n].ns_op = bench_min(ns, BENCH_REPEAT) / ops;
+        out[n].heap_op = port->heap_used ? (port->heap_used() - heap0) / (int32_t)(ops * BENCH_REPEAT) : 0;
+        out[n].checksum = chk;
+        n++;
+    }
+    return n;
+}
+
+void bench_print(const bench_result_t *r)
+{
+    printf("| Bench | %-9s | ops %5u | cycles/op %7u | ns/op %7u | heap/op %d | chk %08x\n",
+           r->name, (unsigned)r->ops, (unsigned)r->cycles_op, (unsigned)r->ns_op, (int)r->heap_op,
+           (unsigned)r->checksum);
+}
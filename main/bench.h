@@ -0,0 +1,53 @@
+/* Benchmark reproduzivel das rotinas do firmware
+
+   Cargas com nome e entrada fixa (gerada por semente), as mesmas no ESP32 e
+   no host:
+     - at_decode: respostas do modem (+CPSI, +CGREG, +CNACT, +CBANDCFG);
+     - gnss:      linhas +CGNSINF (fix, sem fix, SIM7000);
+     - telem:     codificacao de fixes e resumos de vibracao em lotes;
+     - imu:       analise de vibracao e deteccao de eventos por amostra;
+     - ring:      vazao do ring SPSC em rajadas de amostras da IMU;
+     - dlog:      log diferido das linhas do caminho quente (escrita e leitura);
+     - printf:    as mesmas linhas formatadas com snprintf, para comparar.
+
+   Cada carga devolve um checksum do que produziu, para conferir que as
+   duas plataformas fizeram o mesmo trabalho. Relogio, ciclos e heap vem da
+   plataforma por bench_port_t (no firmware, build com CONFIG_LOGQ_BENCHMARK;
+   no host, tools/bench_host.c).
+
+   Nao depende do ESP-IDF.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BENCH_REPEAT        20      //Repeticoes medidas de cada carga (apos uma de aquecimento)
+#define BENCH_MAX           8       //Cargas no conjunto
+
+typedef struct {
+    uint32_t (*cycles)(void);       //Contador de ciclos (pode dar a volta)
+    uint64_t (*time_ns)(void);
+    int32_t (*heap_used)(void);     //Bytes em uso no heap; NULL se nao medido
+} bench_port_t;
+
+typedef struct {
+    const char *name;
+    uint32_t ops;                   //Operacoes por repeticao
+    uint32_t cycles_op;             //Melhor repeticao, por operacao
+    uint32_t ns_op;
+    int32_t heap_op;                //Variacao do heap por operacao (bytes)
+    uint32_t checksum;
+} bench_result_t;
+
+/**
+ * @brief   Roda todas as cargas.
+ *
+ * @return  Numero de resultados escritos em out
+ */
+size_t bench_run(const bench_port_t *port, bench_result_t *out, size_t max);
+
+/**
+ * @brief   Imprime um resultado no formato comum ao firmware e ao host.
+ */
+void bench_print(const bench_result_t *r);
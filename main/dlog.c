@@ -0,0 +1,248 @@
+/* Log binario diferido: rings por nucleo, formatacao e task de saida
+
+   head e tail crescem livremente, como no ring.c; a posicao de um slot e
+   (pos & mascara). Um registro ocupa 1 + ncont slots consecutivos (com
+   volta) e so o primeiro leva seq: os de continuacao sao dados crus, e o
+   consumidor zera o seq deles ao ler.
+*/
+
+#include <stdio.h>
+#include "string.h"
+#include "dlog.h"
+
+typedef struct {
+    uint32_t head;              //Proximo slot a reservar (produtores, CAS)
+    uint32_t tail;              //Proximo slot a ler (so o consumidor)
+    uint32_t written;
+    uint32_t dropped;
+    uint32_t high_water;
+    dlog_slot_t slots[DLOG_RING_LEN];
+} dlog_ring_t;
+
+static dlog_ring_t dlog_rings[DLOG_CORES];
+
+uint8_t dlog_level[DLOG_MODS] = {
+    [0 ... DLOG_MODS - 1] = DLOG_LEVEL_DEFAULT,
+};
+
+static const char *const dlog_fmts[DLOG_IDS] = {
+#define DLOG_FMT(id, mod, lvl, fmt) fmt,
+#include "dlog_fmt.h"
+#undef DLOG_FMT
+};
+
+#ifdef ESP_PLATFORM
+static TaskHandle_t dlog_task_handle;
+#endif
+
+//Reserva n slots; devolve a posicao do primeiro ou false com o ring cheio
+static bool dlog_reserve(dlog_ring_t *r, uint32_t n, uint32_t *pos)
+{
+    uint32_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+
+    do {
+        if (head + n - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) > DLOG_RING_LEN) {
+            __atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&r->head, &head, head + n, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    *pos = head;
+    return true;
+}
+
+static void dlog_commit(dlog_ring_t *r, uint32_t pos, uint16_t id, const void *data, size_t len)
+{
+    dlog_slot_t *s = &r->slots[pos & (DLOG_RING_LEN - 1)];
+    const uint8_t *p = data;
+    size_t first = len < DLOG_HEAD_DATA ? len : DLOG_HEAD_DATA;
+    uint8_t ncont = 0;
+
+    memcpy(s->data, p, first);
+    for (size_t off = first; off < len; off += DLOG_SLOT) {
+        size_t n = len - off < DLOG_SLOT ? len - off : DLOG_SLOT;
+
+        ncont++;
+        memcpy(&r->slots[(pos + ncont) & (DLOG_RING_LEN - 1)], p + off, n);
+    }
+    s->tick = DLOG_TICK();
+    s->id = id;
+    s->ncont = ncont;
+    s->len = (uint8_t)len;
+    __atomic_fetch_add(&r->written, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+#ifdef ESP_PLATFORM
+    //Este registro passou da metade do ring: adianta a task, se nao estiver em ISR
+    if (dlog_task_handle != NULL && !xPortInIsrContext()) {
+        uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+
+        if (pos - tail < DLOG_RING_LEN / 2 && pos + 1 + ncont - tail >= DLOG_RING_LEN / 2) {
+            xTaskNotifyGive(dlog_task_handle);
+        }
+    }
+#endif
+}
+
+static inline uint32_t dlog_slots(size_t len)
+{
+    return len <= DLOG_HEAD_DATA ? 1 : 1 + (len - DLOG_HEAD_DATA + DLOG_SLOT - 1) / DLOG_SLOT;
+}
+
+void dlog_write(uint16_t id, const uint32_t *args, size_t n)
+{
+    dlog_ring_t *r = &dlog_rings[DLOG_CORE()];
+    uint32_t pos;
+
+    if (n > DLOG_ARGS_MAX) {
+        n = DLOG_ARGS_MAX;
+    }
+    if (dlog_reserve(r, dlog_slots(n * 4), &pos)) {
+        dlog_commit(r, pos, id, args, n * 4);
+    }
+}
+
+void dlog_write_str(uint16_t id, const char *s)
+{
+    dlog_ring_t *r = &dlog_rings[DLOG_CORE()];
+    size_t len = strnlen(s, DLOG_PAYLOAD_MAX - 1);
+    uint32_t pos;
+
+    if (dlog_reserve(r, dlog_slots(len), &pos)) {
+        dlog_commit(r, pos, id | DLOG_ID_STR, s, len);
+    }
+}
+
+void dlog_set_level(dlog_mod_t mod, dlog_level_t level)
+{
+    if (mod < DLOG_MODS) {
+        dlog_level[mod] = level;
+    }
+}
+
+bool dlog_pop(int core, dlog_rec_t *rec)
+{
+    dlog_ring_t *r = &dlog_rings[core];
+    uint32_t tail = r->tail;
+    const dlog_slot_t *s = &r->slots[tail & (DLOG_RING_LEN - 1)];
+    uint32_t used = __atomic_load_n(&r->head, __ATOMIC_RELAXED) - tail;
+    size_t first;
+
+    if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != tail + 1) {
+        return false;
+    }
+    if (used > r->high_water) {
+        r->high_water = used;
+    }
+    rec->core = (uint8_t)core;
+    rec->tick = s->tick;
+    rec->id = s->id & ~DLOG_ID_STR;
+    rec->str = (s->id & DLOG_ID_STR) != 0;
+    rec->len = s->len;
+    rec->nslots = 1 + s->ncont;
+    first = rec->len < DLOG_HEAD_DATA ? rec->len : DLOG_HEAD_DATA;
+    memcpy(rec->d.str, s->data, first);
+    for (int c = 1; c <= s->ncont; c++) {
+        size_t off = DLOG_HEAD_DATA + (c - 1) * DLOG_SLOT;
+        size_t n = rec->len - off < DLOG_SLOT ? rec->len - off : DLOG_SLOT;
+        dlog_slot_t *cs = &r->slots[(tail + c) & (DLOG_RING_LEN - 1)];
+
+        memcpy(rec->d.str + off, cs, n);
+        //Dado cru no lugar do seq nao pode parecer publicado quando o slot voltar a ser o primeiro
+        cs->seq = 0;
+    }
+    rec->d.str[rec->len] = '\0';
+    //Libera os slots para os produtores so depois da copia
+    __atomic_store_n(&r->tail, tail + rec->nslots, __ATOMIC_RELEASE);
+    return true;
+}
+
+int dlog_format(const dlog_rec_t *rec, char *out, size_t size)
+{
+    const uint32_t *a = rec->d.args;
+    uint32_t v[DLOG_ARGS_MAX] = {0};
+
+    if (rec->id >= DLOG_IDS) {
+        return snprintf(out, size, "dlog: id %u desconhecido", rec->id);
+    }
+    if (rec->str) {
+        return snprintf(out, size, dlog_fmts[rec->id], rec->d.str);
+    }
+    //Argumentos que faltam (formato mudou) saem como 0
+    memcpy(v, a, rec->len < sizeof(v) ? rec->len : sizeof(v));
+    return snprintf(out, size, dlog_fmts[rec->id], v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7]);
+}
+
+void dlog_get_stats(dlog_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (int c = 0; c < DLOG_CORES; c++) {
+        stats->written += dlog_rings[c].written;
+        stats->dropped += dlog_rings[c].dropped;
+        if (dlog_rings[c].high_water > stats->high_water) {
+            stats->high_water = dlog_rings[c].high_water;
+        }
+    }
+}
+
+#ifdef ESP_PLATFORM
+static void dlog_emit(const dlog_rec_t *rec)
+{
+#if CONFIG_LOGQ_DLOG_BINARY
+    //Quadro: sync, nucleo, tamanho, tick e id (little-endian) e os dados
+    uint8_t hdr[10] = {DLOG_SYNC0, DLOG_SYNC1, rec->core, rec->len};
+    uint16_t id = rec->id | (rec->str ? DLOG_ID_STR : 0);
+
+    memcpy(&hdr[4], &rec->tick, 4);
+    memcpy(&hdr[8], &id, 2);
+    fwrite(hdr, 1, sizeof(hdr), stdout);
+    fwrite(rec->d.str, 1, rec->len, stdout);
+#else
+    static char line[160];
+
+    dlog_format(rec, line, sizeof(line));
+    puts(line);
+#endif
+}
+
+static void dlog_task(void *arg)
+{
+    static dlog_rec_t rec;
+    uint32_t dropped = 0;
+    dlog_stats_t st;
+    bool any;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        do {
+            any = false;
+            for (int c = 0; c < DLOG_CORES; c++) {
+                if (dlog_pop(c, &rec)) {
+                    dlog_emit(&rec);
+                    any = true;
+                }
+            }
+        } while (any);
+        dlog_get_stats(&st);
+        if (st.dropped != dropped) {
+            printf("dlog: %u registros perdidos (ring cheio)\n", st.dropped - dropped);
+            dropped = st.dropped;
+        }
+        fflush(stdout);
+    }
+}
+
+esp_err_t dlog_start(void)
+{
+    if (xTaskCreatePinnedToCore(dlog_task, "dlog", 3072, NULL, DLOG_TASK_PRIO, &dlog_task_handle,
+                                tskNO_AFFINITY) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void dlog_flush(void)
+{
+    if (dlog_task_handle != NULL) {
+        xTaskNotifyGive(dlog_task_handle);
+    }
+}
+#endif
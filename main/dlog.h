@@ -0,0 +1,186 @@
+/* Log binario diferido para o caminho quente (AT, GSM_C, GNSS)
+
+   A chamada DLOG(id, ...) grava so o id do formato, o tick e os argumentos
+   crus em um ring do proprio nucleo; a formatacao fica para a task do
+   dlog, de prioridade baixa, ou para o host (tools/dlog_decode.py) com a
+   saida binaria. Os formatos ficam em dlog_fmt.h.
+
+   Ring por nucleo em slots de DLOG_SLOT bytes: o produtor reserva os slots
+   do registro com um compare-and-swap no head (tasks do mesmo nucleo e ISRs
+   podem se interromper), preenche e publica o primeiro slot com o numero
+   de sequencia (release). O consumidor so avanca ate o primeiro registro
+   ainda nao publicado. Ring cheio descarta o registro e conta em dropped;
+   o produtor nunca espera.
+
+   O nivel e filtrado por modulo em tempo de execucao (dlog_set_level()),
+   antes de qualquer acesso ao ring.
+
+   A task nao tem periodo: dorme ate o ring passar da metade ou ate
+   dlog_flush() (fim da janela do modem), para nao acordar o sistema entre
+   as janelas.
+
+   O nucleo do dlog (rings, escrita, leitura e formatacao) nao depende do
+   ESP-IDF e compila no host; a task so existe no firmware.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "sdkconfig.h"
+#endif
+
+#ifdef CONFIG_LOGQ_DLOG_RING_LEN
+#define DLOG_RING_LEN       CONFIG_LOGQ_DLOG_RING_LEN
+#else
+#define DLOG_RING_LEN       256     //Slots por nucleo (potencia de 2)
+#endif
+#ifdef CONFIG_LOGQ_DLOG_LEVEL
+#define DLOG_LEVEL_DEFAULT  CONFIG_LOGQ_DLOG_LEVEL
+#else
+#define DLOG_LEVEL_DEFAULT  DLOG_LVL_INFO
+#endif
+#ifdef ESP_PLATFORM
+#define DLOG_CORES          portNUM_PROCESSORS
+#define DLOG_CORE()         xPortGetCoreID()
+#define DLOG_TICK()         xTaskGetTickCount()
+#else
+#define DLOG_CORES          1
+#define DLOG_CORE()         0
+#define DLOG_TICK()         0
+#endif
+
+#define DLOG_SLOT           32      //Bytes por slot
+#define DLOG_HEAD_DATA      20      //Dados no primeiro slot do registro
+#define DLOG_CONT_MAX       3       //Slots de continuacao por registro
+#define DLOG_PAYLOAD_MAX    (DLOG_HEAD_DATA + DLOG_CONT_MAX * DLOG_SLOT)
+#define DLOG_ARGS_MAX       8
+#define DLOG_ID_STR         0x8000  //No id gravado: dados sao uma string
+#define DLOG_TASK_PRIO      1
+#define DLOG_SYNC0          0xA5    //Inicio de quadro da saida binaria
+#define DLOG_SYNC1          0x5A
+
+typedef enum {
+    DLOG_LVL_OFF = 0,
+    DLOG_LVL_ERROR,
+    DLOG_LVL_WARN,
+    DLOG_LVL_INFO,
+    DLOG_LVL_DEBUG,
+} dlog_level_t;
+
+typedef enum {
+    DLOG_MOD_AT = 0,
+    DLOG_MOD_GSM,
+    DLOG_MOD_GNSS,
+    DLOG_MOD_BENCH,
+    DLOG_MOD_IMU,
+    DLOG_MODS,
+} dlog_mod_t;
+
+typedef enum {
+#define DLOG_FMT(id, mod, lvl, fmt) DLOG_##id,
+#include "dlog_fmt.h"
+#undef DLOG_FMT
+    DLOG_IDS,
+} dlog_id_t;
+
+//Modulo e nivel de cada id, constantes para o filtro do DLOG()
+enum {
+#define DLOG_FMT(id, mod, lvl, fmt) DLOG_M_##id = DLOG_MOD_##mod, DLOG_L_##id = DLOG_LVL_##lvl,
+#include "dlog_fmt.h"
+#undef DLOG_FMT
+};
+
+typedef struct {
+    uint32_t seq;               //Posicao + 1 quando publicado
+    uint32_t tick;
+    uint16_t id;                //dlog_id_t, com DLOG_ID_STR
+    uint8_t ncont;              //Slots de continuacao que seguem
+    uint8_t len;                //Bytes de dados
+    uint8_t data[DLOG_HEAD_DATA];
+} dlog_slot_t;
+
+_Static_assert(sizeof(dlog_slot_t) == DLOG_SLOT, "slot do dlog fora do tamanho");
+_Static_assert((DLOG_RING_LEN & (DLOG_RING_LEN - 1)) == 0, "DLOG_RING_LEN deve ser potencia de 2");
+_Static_assert(DLOG_ARGS_MAX * 4 <= DLOG_PAYLOAD_MAX, "argumentos nao cabem no registro");
+_Static_assert(DLOG_IDS < DLOG_ID_STR, "ids demais");
+
+//Registro lido do ring
+typedef struct {
+    uint8_t core;
+    uint32_t tick;
+    uint16_t id;
+    bool str;
+    uint8_t len;
+    uint8_t nslots;
+    union {
+        uint32_t args[DLOG_PAYLOAD_MAX / 4];
+        char str[DLOG_PAYLOAD_MAX + 1];
+    } d;
+} dlog_rec_t;
+
+typedef struct {
+    uint32_t written;
+    uint32_t dropped;           //Ring cheio
+    uint32_t high_water;        //Maior ocupacao vista pelo consumidor (slots)
+} dlog_stats_t;
+
+extern uint8_t dlog_level[DLOG_MODS];
+
+//Valores crus: inteiros ate 32 bits (com sinal ou nao)
+#define DLOG(id, ...) do {                                                          \
+        if (DLOG_L_##id <= dlog_level[DLOG_M_##id]) {                               \
+            const uint32_t dlog_a_[] = {0, ##__VA_ARGS__};                          \
+            dlog_write(DLOG_##id, dlog_a_ + 1, sizeof(dlog_a_) / 4 - 1);            \
+        }                                                                           \
+    } while (0)
+
+//String copiada para o registro (ate DLOG_PAYLOAD_MAX - 1 caracteres)
+#define DLOGS(id, s) do {                                                           \
+        if (DLOG_L_##id <= dlog_level[DLOG_M_##id]) {                               \
+            dlog_write_str(DLOG_##id, (s));                                         \
+        }                                                                           \
+    } while (0)
+
+/**
+ * @brief   Grava um registro no ring do nucleo corrente (tambem de ISR).
+ */
+void dlog_write(uint16_t id, const uint32_t *args, size_t n);
+
+void dlog_write_str(uint16_t id, const char *s);
+
+void dlog_set_level(dlog_mod_t mod, dlog_level_t level);
+
+/**
+ * @brief   Consumidor: le o proximo registro publicado do nucleo core.
+ *
+ * @return  false se nao ha registro publicado
+ */
+bool dlog_pop(int core, dlog_rec_t *rec);
+
+/**
+ * @brief   Formata um registro como o printf da chamada original faria.
+ *
+ * @return  Tamanho da linha (sem '\n'), como o snprintf
+ */
+int dlog_format(const dlog_rec_t *rec, char *out, size_t size);
+
+void dlog_get_stats(dlog_stats_t *stats);
+
+#ifdef ESP_PLATFORM
+/**
+ * @brief   Cria a task que esvazia os rings no console: texto ou, com
+ *          CONFIG_LOGQ_DLOG_BINARY, quadros binarios para o
+ *          tools/dlog_decode.py.
+ */
+esp_err_t dlog_start(void);
+
+/**
+ * @brief   Acorda a task para esvaziar os rings agora, sem esperar por ela.
+ */
+void dlog_flush(void);
+#endif
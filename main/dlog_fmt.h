@@ -0,0 +1,35 @@
+/* Tabela de formatos do dlog
+
+   DLOG_FMT(id, modulo, nivel, formato). O id vira DLOG_<id>, na ordem
+   desta lista: so acrescentar no fim, para que o tools/dlog_decode.py
+   (que le este arquivo) continue decodificando capturas antigas.
+
+   Formato com um unico %s leva uma string (DLOGS); os demais ate
+   DLOG_ARGS_MAX inteiros de 32 bits (DLOG). Sem '\n' no fim.
+
+   Sem #pragma once: incluido mais de uma vez pelo dlog.h e dlog.c.
+*/
+
+DLOG_FMT(AT_TX,         AT,     DEBUG,  "%s")
+DLOG_FMT(AT_RX,         AT,     DEBUG,  "\t%s")
+DLOG_FMT(AT_RETRY,      AT,     DEBUG,  "\t(Tentativa %d)")
+DLOG_FMT(GSM_STATUS,    GSM,    DEBUG,  "Status GPS:\n%s")
+DLOG_FMT(GSM_NOSERV,    GSM,    INFO,   "Msg: NO SERVICE")
+DLOG_FMT(GSM_CELL,      GSM,    INFO,   "Rede %d, %u-%u, banda %u, RSRP %d, RSRQ %d, SINR %d")
+DLOG_FMT(GSM_CATM,      GSM,    INFO,   "Msg: CAT-M, %u bandas")
+DLOG_FMT(GSM_NOCMP,     GSM,    WARN,   "No Compare %s")
+DLOG_FMT(GSM_REG,       GSM,    INFO,   "Registrado (stat %u)")
+DLOG_FMT(GSM_REG_WAIT,  GSM,    DEBUG,  "Aguardando registro (stat %u)")
+DLOG_FMT(GSM_PDP_UP,    GSM,    INFO,   "PDP %u ativo, IP %u.%u.%u.%u")
+DLOG_FMT(GSM_PDP_DOWN,  GSM,    WARN,   "PDP inativo")
+DLOG_FMT(GSM_CELL_ID,   GSM,    DEBUG,  "Celula %u TAC %x, RSRP %d")
+DLOG_FMT(GNSS_SYNC,     GNSS,   DEBUG,  "Sincronizando GPS... (fix %u, HDOP %u, Sats %u)")
+DLOG_FMT(BENCH_INT,     BENCH,  INFO,   "+CGREG: %u,%u lat %d lon %d")
+DLOG_FMT(BENCH_STR,     BENCH,  INFO,   "%s")
+DLOG_FMT(GSM_STATE,     GSM,    DEBUG,  "GSM: %u -> %u (evento %u)")
+DLOG_FMT(NET_REG,       GSM,    INFO,   "Rede: EPS %u, GPRS %u, TAC %x, celula %x")
+DLOG_FMT(NET_PDP,       GSM,    INFO,   "Rede: PDP %u")
+DLOG_FMT(NET_MQTT,      GSM,    INFO,   "Rede: MQTT %u")
+DLOG_FMT(REPORT_PLAN,   GSM,    INFO,   "Relatorio: modo %u, publica %u, proximo fix em %u s, %u m do ultimo publicado")
+DLOG_FMT(GSM_BOOT,      GSM,    INFO,   "GSM: partida (despertar %u, modem mantido %u)")
+DLOG_FMT(EVT,           IMU,    INFO,   "Evento 0x%02x: pico %u mg, queda %u ms, inclinacao %u graus")
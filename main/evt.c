@@ -0,0 +1,188 @@
+/* Deteccao de eventos de movimento: choque, queda livre e tombamento
+
+   Por amostra so ha somas, comparacoes e o filtro da gravidade; o angulo
+   de inclinacao (com raiz e arco-cosseno em float) e calculado uma vez por
+   bloco de EVT_BIN_MS.
+*/
+
+#include <math.h>
+#include "string.h"
+#include "evt.h"
+
+#define EVT_SETTLE_SAMPLES  (EVT_SETTLE_MS * VIB_RATE_HZ / 1000)
+#define EVT_RAD_TO_DEG      57.29578f
+
+static uint32_t evt_lsb(uint32_t mg)
+{
+    return (mg * VIB_LSB_PER_G + 500) / 1000;
+}
+
+static uint16_t evt_mg(uint32_t lsb)
+{
+    uint32_t mg = (lsb * 1000 + VIB_LSB_PER_G / 2) / VIB_LSB_PER_G;
+    return mg > 65535 ? 65535 : (uint16_t)mg;
+}
+
+void evt_init(evt_t *e, const evt_cfg_t *cfg)
+{
+    uint32_t ff = evt_lsb(cfg->freefall_mg);
+
+    memset(e, 0, sizeof(*e));
+    e->cfg = *cfg;
+    e->shock_lsb = evt_lsb(cfg->shock_mg);
+    e->ff_lsb2 = ff * ff;
+    e->armed = TELEM_EVT_SHOCK | TELEM_EVT_FREEFALL | TELEM_EVT_TILT;
+}
+
+//Inclinacao do bloco; devolve TELEM_EVT_TILT se o tombamento se confirmou
+static uint8_t evt_tilt(evt_t *e, uint32_t t_us)
+{
+    float g[VIB_AXES];
+    float norm = 0;
+    float c = 0;
+    float deg;
+
+    for (int a = 0; a < VIB_AXES; a++) {
+        g[a] = e->grav[a] / 256.0f;
+        norm += g[a] * g[a];
+    }
+    norm = sqrtf(norm);
+    if (norm < VIB_LSB_PER_G / 2) {
+        //Em queda ou sob aceleracao forte a direcao da gravidade nao vale
+        return 0;
+    }
+    if (!e->ref_ok) {
+        if (e->samples < EVT_SETTLE_SAMPLES) {
+            return 0;
+        }
+        for (int a = 0; a < VIB_AXES; a++) {
+            e->ref[a] = g[a] / norm;
+        }
+        e->ref_ok = true;
+    }
+    for (int a = 0; a < VIB_AXES; a++) {
+        c += g[a] * e->ref[a];
+    }
+    c /= norm;
+    c = c > 1 ? 1 : (c < -1 ? -1 : c);
+    deg = acosf(c) * EVT_RAD_TO_DEG;
+    e->tilt_now = (uint8_t)(deg + 0.5f);
+
+    if (deg > e->cfg.tilt_deg) {
+        if (e->tilt_bins++ == 0) {
+            e->tilt_onset_us = t_us;
+        }
+        if (e->tilt_bins * EVT_BIN_MS >= e->cfg.tilt_ms && (e->armed & TELEM_EVT_TILT)) {
+            e->armed &= ~TELEM_EVT_TILT;
+            return TELEM_EVT_TILT;
+        }
+    } else {
+        e->tilt_bins = 0;
+        if (deg < e->cfg.tilt_deg - EVT_TILT_HYST_DEG) {
+            e->armed |= TELEM_EVT_TILT;
+        }
+    }
+    return 0;
+}
+
+//Inicia a coleta ou soma as causas ao evento em andamento
+static void evt_fire(evt_t *e, uint8_t kind, uint32_t onset_us)
+{
+    if (e->post_left == 0) {
+        memset(&e->ev, 0, sizeof(e->ev));
+        e->ev.t_us = onset_us;
+        for (int i = 0; i < EVT_PRE_BINS; i++) {
+            e->ev.trace[i] = e->pre[(e->pre_pos + i) % EVT_PRE_BINS];
+        }
+        e->post_left = EVT_POST_BINS;
+    }
+    e->ev.kind |= kind;
+}
+
+bool evt_add(evt_t *e, const int16_t acc[VIB_AXES], uint32_t t_us, telem_evt_t *out)
+{
+    const bool active = e->samples >= EVT_SETTLE_SAMPLES;
+    uint32_t m2 = 0;
+    uint32_t dmax = 0;
+
+    for (int a = 0; a < VIB_AXES; a++) {
+        int32_t x = acc[a];
+        int32_t d;
+
+        if (e->samples == 0) {
+            e->grav[a] = x * 256;
+        }
+        e->grav[a] += (x * 256 - e->grav[a]) >> EVT_GRAV_SHIFT;
+        d = x - (e->grav[a] >> 8);
+        d = d < 0 ? -d : d;
+        dmax = (uint32_t)d > dmax ? (uint32_t)d : dmax;
+        m2 += (uint32_t)(x * x);
+    }
+    if (!active) {
+        e->samples++;
+    }
+
+    //Choque
+    if (dmax >= e->shock_lsb) {
+        if (active && (e->armed & TELEM_EVT_SHOCK)) {
+            e->armed &= ~TELEM_EVT_SHOCK;
+            evt_fire(e, TELEM_EVT_SHOCK, t_us);
+        }
+    } else if (dmax < e->shock_lsb / 2) {
+        e->armed |= TELEM_EVT_SHOCK;
+    }
+
+    //Queda livre
+    if (m2 < e->ff_lsb2) {
+        if (e->ff_count++ == 0) {
+            e->ff_onset_us = t_us;
+        }
+        if (active && (e->armed & TELEM_EVT_FREEFALL) &&
+                e->ff_count * 1000 >= (uint32_t)e->cfg.freefall_ms * VIB_RATE_HZ) {
+            e->armed &= ~TELEM_EVT_FREEFALL;
+            evt_fire(e, TELEM_EVT_FREEFALL, e->ff_onset_us);
+        }
+        if (e->post_left && (e->ev.kind & TELEM_EVT_FREEFALL)) {
+            e->ev.fall_ms = (uint16_t)(e->ff_count * 1000 / VIB_RATE_HZ);
+        }
+    } else {
+        e->ff_count = 0;
+        e->armed |= TELEM_EVT_FREEFALL;
+    }
+
+    if (e->post_left) {
+        uint16_t mg = evt_mg(dmax);
+        e->ev.peak_mg = mg > e->ev.peak_mg ? mg : e->ev.peak_mg;
+    }
+
+    //Fim do bloco: perfil, inclinacao e fim da coleta
+    e->bin_max2 = m2 > e->bin_max2 ? m2 : e->bin_max2;
+    if (++e->bin_fill == EVT_BIN_SAMPLES) {
+        uint32_t v = (evt_mg((uint32_t)sqrtf((float)e->bin_max2)) + EVT_TRACE_MG / 2) / EVT_TRACE_MG;
+        uint8_t tilt;
+
+        v = v > 255 ? 255 : v;
+        e->pre[e->pre_pos] = (uint8_t)v;
+        e->pre_pos = (e->pre_pos + 1) % EVT_PRE_BINS;
+        e->bin_max2 = 0;
+        e->bin_fill = 0;
+
+        tilt = evt_tilt(e, t_us);
+        if (e->post_left) {
+            e->ev.trace[TELEM_EVT_TRACE - e->post_left] = (uint8_t)v;
+            if (--e->post_left == 0) {
+                e->ev.tilt_deg = e->tilt_now;
+                *out = e->ev;
+                //Um tombamento confirmado no ultimo bloco abre o proximo evento
+                if (tilt) {
+                    evt_fire(e, tilt, e->tilt_onset_us);
+                }
+                return true;
+            }
+        }
+        if (tilt) {
+            evt_fire(e, tilt, e->tilt_onset_us);
+        }
+    }
+    return false;
+}
@@ -0,0 +1,80 @@
+/* Deteccao de eventos de movimento: choque, queda livre e tombamento
+
+   Roda sobre o mesmo fluxo de amostras da analise de vibracao, amostra a
+   amostra, para que o gatilho nao espere o fim de uma janela:
+     - choque: aceleracao dinamica (sem a gravidade estimada) de algum eixo
+       acima de shock_mg; rearma abaixo da metade;
+     - queda livre: |a| abaixo de freefall_mg por freefall_ms seguidos;
+     - tombamento: a gravidade estimada se afasta mais de tilt_deg da
+       posicao de repouso (aprendida nos primeiros segundos) por tilt_ms;
+       rearma ao voltar EVT_TILT_HYST_DEG para dentro.
+
+   O perfil de |a| e mantido em blocos de EVT_BIN_MS: EVT_PRE_BINS antes do
+   gatilho ficam num buffer circular e os seguintes sao coletados ate
+   completar TELEM_EVT_TRACE; so entao o evento e entregue. Gatilhos durante
+   a coleta sao somados ao mesmo evento (uma queda seguida do impacto vira
+   TELEM_EVT_FREEFALL | TELEM_EVT_SHOCK).
+
+   Nao depende do ESP-IDF.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "telem.h"
+#include "vib.h"
+
+#define EVT_BIN_MS          16
+#define EVT_BIN_SAMPLES     (EVT_BIN_MS * VIB_RATE_HZ / 1000)
+#define EVT_PRE_BINS        12      //~190 ms antes do gatilho
+#define EVT_POST_BINS       (TELEM_EVT_TRACE - EVT_PRE_BINS)
+#define EVT_SETTLE_MS       2000    //Tempo para aprender a posicao de repouso
+#define EVT_GRAV_SHIFT      9       //Filtro da gravidade: constante de ~0,5 s a 1 kHz
+#define EVT_TILT_HYST_DEG   10
+#define EVT_TRACE_MG        64      //Unidade do perfil
+
+#define EVT_CFG_DEFAULT     { .shock_mg = 2000, .freefall_mg = 300, .freefall_ms = 80, \
+                              .tilt_deg = 45, .tilt_ms = 2000 }
+
+typedef struct {
+    uint16_t shock_mg;
+    uint16_t freefall_mg;
+    uint16_t freefall_ms;
+    uint8_t tilt_deg;
+    uint16_t tilt_ms;
+} evt_cfg_t;
+
+typedef struct {
+    evt_cfg_t cfg;
+    uint32_t shock_lsb;
+    uint32_t ff_lsb2;                   //Limiar de queda livre ao quadrado
+    int32_t grav[VIB_AXES];             //Gravidade estimada, LSB << 8
+    float ref[VIB_AXES];                //Posicao de repouso (vetor unitario)
+    bool ref_ok;
+    uint32_t samples;
+    uint32_t ff_count;                  //Amostras seguidas em queda livre
+    uint32_t ff_onset_us;
+    uint32_t tilt_bins;                 //Blocos seguidos inclinado
+    uint32_t tilt_onset_us;
+    uint8_t armed;                      //TELEM_EVT_*: pronto para disparar
+    uint8_t tilt_now;                   //Angulo do ultimo bloco
+    uint32_t bin_max2;                  //Maior |a|^2 do bloco corrente
+    uint32_t bin_fill;
+    uint8_t pre[EVT_PRE_BINS];
+    uint8_t pre_pos;
+    uint8_t post_left;                  //0 = sem evento em coleta
+    telem_evt_t ev;
+} evt_t;
+
+/**
+ * @brief   Prepara o detector.
+ */
+void evt_init(evt_t *e, const evt_cfg_t *cfg);
+
+/**
+ * @brief   Processa uma amostra (x, y, z em LSB) com o instante t_us.
+ *
+ * @return  true quando um evento foi concluido e copiado para out (utc e
+ *          age_ms ficam por conta de quem publica)
+ */
+bool evt_add(evt_t *e, const int16_t acc[VIB_AXES], uint32_t t_us, telem_evt_t *out);
@@ -0,0 +1,286 @@
+/* Maquina de estados hierarquica dirigida por eventos
+
+   As tabelas sao percorridas linearmente: poucas dezenas de linhas e um
+   evento a cada resposta do modem. Acoes rodam na task dona e nao
+   despacham: pedem a transicao seguinte com fsm_post(), entregue no mesmo
+   fsm_poll().
+
+   Os prazos sao em ms de 32 bits comparados pela diferenca, entao a volta
+   do contador (49 dias) nao os afeta. No firmware o tempo e relido do
+   esp_timer a cada evento, porque uma acao pode bloquear (conexao MQTT) e
+   os prazos armados depois dela contam dali.
+*/
+
+#include "string.h"
+#include "fsm.h"
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
+#define FSM_CLOCK(t)        ((uint32_t)(esp_timer_get_time() / 1000))
+#else
+#define FSM_CLOCK(t)        (t)
+#endif
+
+void fsm_init(fsm_t *fsm, const char *name, const fsm_state_t *states, size_t nstates,
+              const fsm_trans_t *trans, size_t ntrans, void *ctx)
+{
+    memset(fsm, 0, sizeof(*fsm));
+    fsm->name = name;
+    fsm->states = states;
+    fsm->nstates = (uint8_t)nstates;
+    fsm->trans = trans;
+    fsm->ntrans = (uint16_t)ntrans;
+    fsm->ctx = ctx;
+    ring_mpsc_init(&fsm->queue, fsm->cells, FSM_QUEUE_LEN);
+}
+
+static inline bool fsm_expired(uint32_t deadline, uint32_t now)
+{
+    return (int32_t)(deadline - now) <= 0;
+}
+
+void fsm_arm(fsm_t *fsm, uint32_t ms)
+{
+    uint8_t lvl;
+
+    if (fsm->depth == 0) {
+        return;
+    }
+    lvl = fsm->depth - 1;
+    if (ms == 0) {
+        fsm->armed &= ~(1u << lvl);
+        return;
+    }
+    fsm->deadline[lvl] = fsm->now_ms + ms;
+    fsm->armed |= 1u << lvl;
+}
+
+//Caminho da raiz ate s; devolve a profundidade
+static uint8_t fsm_path_to(const fsm_t *fsm, uint8_t s, uint8_t *path)
+{
+    uint8_t rev[FSM_DEPTH];
+    uint8_t n = 0;
+
+    while (s != FSM_NONE && n < FSM_DEPTH) {
+        rev[n++] = s;
+        s = fsm->states[s].parent;
+    }
+    for (uint8_t i = 0; i < n; i++) {
+        path[i] = rev[n - 1 - i];
+    }
+    return n;
+}
+
+static void fsm_enter_path(fsm_t *fsm, const uint8_t *tpath, uint8_t from, uint8_t to)
+{
+    for (uint8_t lvl = from; lvl < to; lvl++) {
+        const fsm_state_t *st = &fsm->states[tpath[lvl]];
+
+        fsm->path[lvl] = tpath[lvl];
+        fsm->depth = lvl + 1;
+        fsm->armed &= ~(1u << lvl);
+        if (st->timeout_ms > 0) {
+            fsm_arm(fsm, st->timeout_ms);
+        }
+        if (st->entry != NULL) {
+            st->entry(fsm);
+        }
+    }
+}
+
+static void fsm_transition(fsm_t *fsm, uint8_t target)
+{
+    uint8_t tpath[FSM_DEPTH];
+    uint8_t tdepth;
+    uint8_t common = 0;
+    uint8_t leaf = fsm_state(fsm);
+
+    if (target == FSM_SELF) {
+        target = leaf;
+    } else if (target == FSM_BACK) {
+        target = fsm->prev;
+    }
+    if (target >= fsm->nstates) {
+        return;
+    }
+    if (target != leaf) {
+        fsm->prev = leaf;
+    }
+    if (fsm->trace != NULL) {
+        fsm->trace(fsm, leaf, target);
+    }
+    tdepth = fsm_path_to(fsm, target, tpath);
+
+    while (common < fsm->depth && common < tdepth && fsm->path[common] == tpath[common]) {
+        common++;
+    }
+    //Destino ativo (ele mesmo ou ancestral): sai e entra de novo nele
+    if (common == tdepth) {
+        common--;
+    }
+    while (fsm->depth > common) {
+        const fsm_state_t *st = &fsm->states[fsm->path[fsm->depth - 1]];
+
+        if (st->exit != NULL) {
+            st->exit(fsm);
+        }
+        fsm->depth--;
+        fsm->armed &= ~(1u << fsm->depth);
+    }
+    fsm->stats.transitions++;
+    fsm_enter_path(fsm, tpath, common, tdepth);
+}
+
+void fsm_start(fsm_t *fsm, uint8_t initial, uint32_t now_ms)
+{
+    uint8_t tpath[FSM_DEPTH];
+
+    fsm->now_ms = now_ms;
+    fsm->depth = 0;
+    fsm->armed = 0;
+    fsm->prev = initial;
+    fsm_enter_path(fsm, tpath, 0, fsm_path_to(fsm, initial, tpath));
+}
+
+//Procura a linha a partir do nivel lvl ate a raiz
+static bool fsm_handle(fsm_t *fsm, int lvl, uint8_t ev, uint32_t arg)
+{
+    int from = lvl;
+
+    fsm->ev = ev;
+    fsm->arg = arg;
+    fsm->stats.events++;
+    for (; lvl >= 0; lvl--) {
+        uint8_t s = fsm->path[lvl];
+
+        //Prazo de um filho passa direto pelos superestados com prazo proprio
+        if (ev == FSM_EV_TIMEOUT && lvl < from && fsm->states[s].timeout_ms > 0) {
+            continue;
+        }
+        for (uint16_t i = 0; i < fsm->ntrans; i++) {
+            const fsm_trans_t *t = &fsm->trans[i];
+
+            if (t->state != s || t->event != ev || (t->guard != NULL && !t->guard(fsm))) {
+                continue;
+            }
+            if (t->action != NULL) {
+                t->action(fsm);
+            }
+            if (t->next != FSM_SAME) {
+                fsm_transition(fsm, t->next);
+            }
+            return true;
+        }
+    }
+    fsm->stats.unhandled++;
+    return false;
+}
+
+bool fsm_dispatch(fsm_t *fsm, uint8_t ev, uint32_t arg, uint32_t now_ms)
+{
+    fsm->now_ms = now_ms;
+    return fsm_handle(fsm, (int)fsm->depth - 1, ev, arg);
+}
+
+//Primeiro prazo vencido, do nivel mais alto para o mais baixo
+static bool fsm_expire(fsm_t *fsm, uint32_t now_ms)
+{
+    for (uint8_t lvl = 0; lvl < fsm->depth; lvl++) {
+        if ((fsm->armed & (1u << lvl)) && fsm_expired(fsm->deadline[lvl], now_ms)) {
+            fsm->armed &= ~(1u << lvl);
+            fsm->now_ms = now_ms;
+            fsm->stats.timeouts++;
+            fsm_handle(fsm, lvl, FSM_EV_TIMEOUT, 0);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool fsm_post(fsm_t *fsm, uint8_t ev, uint32_t arg)
+{
+    if (!ring_mpsc_push(&fsm->queue, ev | ((arg & FSM_ARG_MAX) << 8))) {
+        return false;
+    }
+#ifdef ESP_PLATFORM
+    //Postado pela propria dona (acao): sai no mesmo fsm_poll()
+    if (fsm->task != NULL && fsm->task != xTaskGetCurrentTaskHandle()) {
+        xTaskNotifyGive(fsm->task);
+    }
+#endif
+    return true;
+}
+
+uint32_t fsm_poll(fsm_t *fsm, uint32_t now_ms)
+{
+    uint32_t n = 0;
+    uint32_t v;
+    bool more;
+
+    do {
+        more = false;
+        while (ring_mpsc_pop(&fsm->queue, &v)) {
+            now_ms = FSM_CLOCK(now_ms);
+            fsm_dispatch(fsm, (uint8_t)v, v >> 8, now_ms);
+            n++;
+        }
+        now_ms = FSM_CLOCK(now_ms);
+        if (fsm_expire(fsm, now_ms)) {
+            more = true;
+            n++;
+        }
+    } while (more);
+    return n;
+}
+
+uint32_t fsm_next_ms(const fsm_t *fsm, uint32_t now_ms)
+{
+    uint32_t best = FSM_FOREVER;
+
+    for (uint8_t lvl = 0; lvl < fsm->depth; lvl++) {
+        if (fsm->armed & (1u << lvl)) {
+            uint32_t left = fsm_expired(fsm->deadline[lvl], now_ms) ? 0 : fsm->deadline[lvl] - now_ms;
+
+            best = left < best ? left : best;
+        }
+    }
+    return best;
+}
+
+bool fsm_in(const fsm_t *fsm, uint8_t s)
+{
+    for (uint8_t lvl = 0; lvl < fsm->depth; lvl++) {
+        if (fsm->path[lvl] == s) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void fsm_get_stats(const fsm_t *fsm, fsm_stats_t *stats)
+{
+    *stats = fsm->stats;
+    stats->dropped = fsm->queue.dropped;
+}
+
+#ifdef ESP_PLATFORM
+void fsm_run(fsm_t *fsm)
+{
+    fsm->task = xTaskGetCurrentTaskHandle();
+    while (1) {
+        //Eventos postados antes da task existir saem na primeira volta
+        fsm_poll(fsm, FSM_CLOCK(0));
+
+        uint32_t wait = fsm_next_ms(fsm, FSM_CLOCK(0));
+        TickType_t ticks = portMAX_DELAY;
+
+        //Arredonda para cima: acordar antes do prazo so gastaria outro despertar
+        if (wait != FSM_FOREVER) {
+            ticks = (wait + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+        }
+        if (wait > 0) {
+            ulTaskNotifyTake(pdTRUE, ticks);
+            fsm->stats.wakeups++;
+        }
+    }
+}
+#endif
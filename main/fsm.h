@@ -0,0 +1,176 @@
+/* Maquina de estados hierarquica dirigida por eventos
+
+   Estados e transicoes sao tabelas constantes. Cada estado tem um pai
+   (superestado), acoes de entrada e de saida e um prazo opcional, armado
+   na entrada. O evento e procurado nas transicoes do estado ativo e, sem
+   linha ali, nas do pai, ate a raiz; a primeira linha cuja guarda aceitar
+   decide. Transicao para outro estado sai dos estados ate o ancestral
+   comum e entra nos do caminho ate o destino (pais antes dos filhos);
+   destino o proprio estado sai e entra de novo (rearma o prazo) e
+   FSM_SAME so executa a acao. Linhas de superestados podem usar FSM_SELF
+   (reentra na folha ativa, ex.: nova tentativa no prazo) e FSM_BACK
+   (volta a ultima folha diferente da ativa, ex.: fim de uma publicacao
+   que interrompeu outro estado).
+
+   Prazo vencido vira o evento FSM_EV_TIMEOUT, entregue a partir do estado
+   dono do prazo: o prazo de um superestado vale para todos os filhos e a
+   linha de recuperacao fica nele. O TIMEOUT de um filho sobe pulando os
+   superestados com prazo proprio (timeout_ms), cujas linhas de TIMEOUT
+   sao so para ele. Vencendo mais de um, o do nivel mais alto vai primeiro.
+
+   Eventos de outras tasks (callbacks do motor AT, alertas) entram por um
+   ring_mpsc_t e acordam a task dona por notificacao; fsm_run() so acorda
+   com evento ou no proximo prazo, nunca em periodo fixo. O nucleo
+   (tabelas, despacho e prazos) nao depende do FreeRTOS e compila no host,
+   com o tempo passado pelo chamador.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "ring.h"
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#endif
+
+#define FSM_DEPTH           4       //Niveis de hierarquia (raiz incluida)
+#define FSM_QUEUE_LEN       16      //Eventos pendentes (potencia de 2)
+#define FSM_NONE            0xFF    //Pai da raiz
+#define FSM_SAME            0xFE    //Destino: transicao interna, so a acao
+#define FSM_SELF            0xFD    //Destino: reentra na folha ativa
+#define FSM_BACK            0xFC    //Destino: ultima folha diferente da ativa
+#define FSM_FOREVER         UINT32_MAX
+#define FSM_ARG_MAX         0xFFFFFF    //Argumento do evento: 24 bits
+
+enum {
+    FSM_EV_TIMEOUT = 0,         //Prazo do estado vencido
+    FSM_EV_USER,                //Primeiro evento da aplicacao
+};
+
+typedef struct fsm fsm_t;
+typedef void (*fsm_action_t)(fsm_t *fsm);
+typedef bool (*fsm_guard_t)(fsm_t *fsm);
+typedef void (*fsm_trace_t)(const fsm_t *fsm, uint8_t from, uint8_t to);
+
+typedef struct {
+    const char *name;
+    uint8_t parent;             //FSM_NONE na raiz
+    uint32_t timeout_ms;        //0: sem prazo (a entrada pode armar com fsm_arm())
+    fsm_action_t entry;
+    fsm_action_t exit;
+} fsm_state_t;
+
+typedef struct {
+    uint8_t state;              //Estado ou superestado que trata o evento
+    uint8_t event;
+    fsm_guard_t guard;          //NULL: sempre
+    fsm_action_t action;        //Antes das saidas e entradas
+    uint8_t next;               //Destino, FSM_SAME, FSM_SELF ou FSM_BACK
+} fsm_trans_t;
+
+typedef struct {
+    uint32_t events;            //Eventos despachados (prazos incluidos)
+    uint32_t unhandled;         //Sem linha ate a raiz
+    uint32_t timeouts;
+    uint32_t transitions;
+    uint32_t wakeups;           //Retornos da espera em fsm_run()
+    uint32_t dropped;           //Fila de eventos cheia
+} fsm_stats_t;
+
+struct fsm {
+    const char *name;
+    const fsm_state_t *states;
+    uint8_t nstates;
+    const fsm_trans_t *trans;
+    uint16_t ntrans;
+    void *ctx;                  //Da aplicacao
+    uint8_t path[FSM_DEPTH];    //Estados ativos, da raiz a folha
+    uint8_t depth;
+    uint8_t prev;               //Ultima folha diferente da ativa (FSM_BACK)
+    uint32_t deadline[FSM_DEPTH];
+    uint8_t armed;              //Bit por nivel com prazo
+    uint8_t ev;                 //Evento em despacho, para as acoes
+    uint32_t arg;
+    uint32_t now_ms;
+    ring_mpsc_t queue;
+    ring_cell_t cells[FSM_QUEUE_LEN];
+    fsm_stats_t stats;
+    fsm_trace_t trace;          //Cada transicao, antes das saidas (pode ser NULL)
+#ifdef ESP_PLATFORM
+    TaskHandle_t task;
+#endif
+};
+
+_Static_assert((FSM_QUEUE_LEN & (FSM_QUEUE_LEN - 1)) == 0, "FSM_QUEUE_LEN deve ser potencia de 2");
+
+/**
+ * @brief   Prepara a maquina sobre as tabelas (constantes, devem permanecer
+ *          validas). Ainda sem estado ativo.
+ */
+void fsm_init(fsm_t *fsm, const char *name, const fsm_state_t *states, size_t nstates,
+              const fsm_trans_t *trans, size_t ntrans, void *ctx);
+
+/**
+ * @brief   Entra no estado inicial (e nos seus ancestrais).
+ */
+void fsm_start(fsm_t *fsm, uint8_t initial, uint32_t now_ms);
+
+/**
+ * @brief   Despacha um evento na task dona.
+ *
+ * @return  false se nenhuma linha tratou o evento
+ */
+bool fsm_dispatch(fsm_t *fsm, uint8_t ev, uint32_t arg, uint32_t now_ms);
+
+/**
+ * @brief   Qualquer task (nao ISR): enfileira um evento e acorda a dona.
+ *
+ * @return  false com a fila cheia (contado em dropped)
+ */
+bool fsm_post(fsm_t *fsm, uint8_t ev, uint32_t arg);
+
+/**
+ * @brief   Despacha os eventos enfileirados e os prazos vencidos.
+ *
+ * @return  Eventos despachados
+ */
+uint32_t fsm_poll(fsm_t *fsm, uint32_t now_ms);
+
+/**
+ * @brief   Milissegundos ate o prazo mais proximo (0 se ja venceu), ou
+ *          FSM_FOREVER sem prazo armado.
+ */
+uint32_t fsm_next_ms(const fsm_t *fsm, uint32_t now_ms);
+
+/**
+ * @brief   Em uma acao: arma (ms > 0) ou desarma (0) o prazo do estado
+ *          ativo mais profundo, contado do evento em despacho.
+ */
+void fsm_arm(fsm_t *fsm, uint32_t ms);
+
+/**
+ * @brief   O estado s esta ativo (e a folha ou um ancestral dela).
+ */
+bool fsm_in(const fsm_t *fsm, uint8_t s);
+
+static inline uint8_t fsm_state(const fsm_t *fsm)
+{
+    return fsm->depth ? fsm->path[fsm->depth - 1] : FSM_NONE;
+}
+
+static inline const char *fsm_state_name(const fsm_t *fsm, uint8_t s)
+{
+    return s < fsm->nstates ? fsm->states[s].name : "-";
+}
+
+void fsm_get_stats(const fsm_t *fsm, fsm_stats_t *stats);
+
+#ifdef ESP_PLATFORM
+/**
+ * @brief   Laco da task dona: dorme ate o proximo evento ou prazo e
+ *          despacha. Nao retorna.
+ */
+void fsm_run(fsm_t *fsm);
+#endif
@@ -0,0 +1,248 @@
+/* Decodificador da resposta +CGNSINF
+
+   Uma passada marca o inicio e o fim de cada campo (ponteiros para a propria
+   linha); em seguida cada campo e convertido direto do buffer para inteiro
+   ou ponto fixo, sem copias intermediarias.
+*/
+
+#include "string.h"
+#include "gnss.h"
+
+#define GNSS_PREFIX         "+CGNSINF:"
+#define GNSS_MAX_FIELDS     24
+#define GNSS_FIELDS_SIM7070 18
+#define GNSS_FIELDS_SIM7000 21
+
+typedef struct {
+    const char *p;
+    const char *end;
+} gnss_tok_t;
+
+//Indices dos campos comuns aos dois layouts
+enum {
+    F_RUN = 0, F_FIX, F_UTC, F_LAT, F_LON, F_ALT, F_SPEED, F_COURSE,
+    F_FIX_MODE, F_RES1, F_HDOP, F_PDOP, F_VDOP, F_RES2, F_SATS_VIEW,
+};
+
+/**
+ * Converte "[-]123.456" para inteiro escalado por 10^decimals. Digitos alem
+ * da escala sao truncados. Retorna -1 em campo invalido ou acima de INT32_MAX.
+ */
+static int gnss_fixed(const char *p, const char *end, int decimals, int32_t *out)
+{
+    int64_t v = 0;
+    int neg = 0;
+    int digits = 0;
+    int frac = -1;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = (*p == '-');
+        p++;
+    }
+    for (; p < end; p++) {
+        if (*p >= '0' && *p <= '9') {
+            if (frac >= 0) {
+                if (frac >= decimals) {
+                    continue;
+                }
+                frac++;
+            }
+            v = v * 10 + (*p - '0');
+            digits++;
+            if (v > INT32_MAX) {
+                return -1;
+            }
+        } else if (*p == '.' && frac < 0) {
+            frac = 0;
+        } else {
+            return -1;
+        }
+    }
+    if (digits == 0) {
+        return -1;
+    }
+    for (int f = (frac < 0) ? 0 : frac; f < decimals; f++) {
+        v *= 10;
+    }
+    if (v > INT32_MAX) {
+        return -1;
+    }
+    *out = neg ? (int32_t)-v : (int32_t)v;
+    return 0;
+}
+
+static int gnss_digits(const char *p, int n)
+{
+    int v = 0;
+
+    for (int i = 0; i < n; i++) {
+        if (p[i] < '0' || p[i] > '9') {
+            return -1;
+        }
+        v = v * 10 + (p[i] - '0');
+    }
+    return v;
+}
+
+//Dias desde 1970-01-01 para uma data do calendario gregoriano
+static int32_t gnss_days_from_civil(int y, int m, int d)
+{
+    y -= (m <= 2);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+//"yyyyMMddhhmmss.sss" -> segundos desde a epoca + milissegundos
+static int gnss_utc(const char *p, const char *end, uint32_t *utc, uint16_t *ms)
+{
+    int frac = 0;
+
+    if (end - p < 14) {
+        return GNSS_ERR_FIELD;
+    }
+    int y = gnss_digits(p, 4);
+    int mo = gnss_digits(p + 4, 2);
+    int d = gnss_digits(p + 6, 2);
+    int h = gnss_digits(p + 8, 2);
+    int mi = gnss_digits(p + 10, 2);
+    int s = gnss_digits(p + 12, 2);
+    if (y < 0 || mo < 0 || d < 0 || h < 0 || mi < 0 || s < 0) {
+        return GNSS_ERR_FIELD;
+    }
+    if (y < 1980 || mo < 1 || mo > 12 || d < 1 || d > 31 || h > 23 || mi > 59 || s > 60) {
+        return GNSS_ERR_RANGE;
+    }
+    if (end - p > 14) {
+        if (p[14] != '.') {
+            return GNSS_ERR_FIELD;
+        }
+        //Fracao de segundo: usa ate 3 digitos
+        int scale = 100;
+        for (const char *q = p + 15; q < end; q++) {
+            if (*q < '0' || *q > '9') {
+                return GNSS_ERR_FIELD;
+            }
+            frac += (*q - '0') * scale;
+            scale /= 10;
+        }
+    }
+    *utc = (uint32_t)gnss_days_from_civil(y, mo, d) * 86400u + h * 3600u + mi * 60u + s;
+    *ms = (uint16_t)frac;
+    return GNSS_OK;
+}
+
+/**
+ * Decodifica um campo numerico opcional. Campo vazio: retorna 0 sem marcar
+ * present. Caso contrario valida a faixa [min, max].
+ */
+static int gnss_field(const gnss_tok_t *t, int decimals, int32_t min, int32_t max,
+                      uint32_t bit, uint32_t *present, int32_t *out)
+{
+    if (t->p == t->end) {
+        *out = 0;
+        return GNSS_OK;
+    }
+    if (gnss_fixed(t->p, t->end, decimals, out) != 0) {
+        return GNSS_ERR_FIELD;
+    }
+    if (*out < min || *out > max) {
+        return GNSS_ERR_RANGE;
+    }
+    *present |= bit;
+    return GNSS_OK;
+}
+
+int gnss_parse_cgnsinf(const char *line, size_t len, gnss_fix_t *fix)
+{
+    gnss_tok_t tok[GNSS_MAX_FIELDS];
+    const char *p = line;
+    const char *end = line + len;
+    const size_t plen = sizeof(GNSS_PREFIX) - 1;
+    int n = 0;
+    int32_t v;
+    int ret;
+
+    memset(fix, 0, sizeof(*fix));
+
+    if (len < plen || memcmp(line, GNSS_PREFIX, plen) != 0) {
+        return GNSS_ERR_PREFIX;
+    }
+    p += plen;
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    while (end > p && (end[-1] == ' ' || end[-1] == '\r' || end[-1] == '\n')) {
+        end--;
+    }
+
+    //Passada unica marcando os campos
+    tok[0].p = p;
+    for (; p < end; p++) {
+        if (*p == ',') {
+            if (n + 1 >= GNSS_MAX_FIELDS) {
+                return GNSS_ERR_FIELD;
+            }
+            tok[n].end = p;
+            tok[++n].p = p + 1;
+        }
+    }
+    tok[n++].end = end;
+
+    //Com o GNSS desligado o modem responde apenas "+CGNSINF: 0"
+    if (n == 1) {
+        if (gnss_field(&tok[F_RUN], 0, 0, 1, GNSS_HAS_RUN, &fix->present, &v) != GNSS_OK ||
+                !(fix->present & GNSS_HAS_RUN)) {
+            return GNSS_ERR_TRUNC;
+        }
+        fix->run = (uint8_t)v;
+        return (v == 0) ? GNSS_OK : GNSS_ERR_TRUNC;
+    }
+    if (n < GNSS_FIELDS_SIM7070) {
+        return GNSS_ERR_TRUNC;
+    }
+
+#define GNSS_FIELD(idx, dec, min, max, bit, dst) \
+    do { \
+        if ((ret = gnss_field(&tok[idx], dec, min, max, bit, &fix->present, &v)) != GNSS_OK) { \
+            return ret; \
+        } \
+        dst = v; \
+    } while (0)
+
+    GNSS_FIELD(F_RUN,       0, 0, 1,            GNSS_HAS_RUN,       fix->run);
+    GNSS_FIELD(F_FIX,       0, 0, 1,            GNSS_HAS_FIX,       fix->fix);
+    GNSS_FIELD(F_LAT,       6, -90000000, 90000000,   GNSS_HAS_LAT, fix->lat_e6);
+    GNSS_FIELD(F_LON,       6, -180000000, 180000000, GNSS_HAS_LON, fix->lon_e6);
+    GNSS_FIELD(F_ALT,       2, -100000000, 100000000, GNSS_HAS_ALT, fix->alt_cm);
+    GNSS_FIELD(F_SPEED,     2, 0, UINT16_MAX,   GNSS_HAS_SPEED,     fix->speed_kmh_x100);
+    GNSS_FIELD(F_COURSE,    2, 0, 36000,        GNSS_HAS_COURSE,    fix->course_x100);
+    GNSS_FIELD(F_FIX_MODE,  0, 0, UINT8_MAX,    GNSS_HAS_FIX_MODE,  fix->fix_mode);
+    GNSS_FIELD(F_HDOP,      2, 0, UINT16_MAX,   GNSS_HAS_HDOP,      fix->hdop_x100);
+    GNSS_FIELD(F_PDOP,      2, 0, UINT16_MAX,   GNSS_HAS_PDOP,      fix->pdop_x100);
+    GNSS_FIELD(F_VDOP,      2, 0, UINT16_MAX,   GNSS_HAS_VDOP,      fix->vdop_x100);
+    GNSS_FIELD(F_SATS_VIEW, 0, 0, UINT8_MAX,    GNSS_HAS_SATS_VIEW, fix->sats_view);
+
+    if (n >= GNSS_FIELDS_SIM7000) {
+        GNSS_FIELD(15, 0, 0, UINT8_MAX,  GNSS_HAS_GPS_USED, fix->sats_gps_used);
+        GNSS_FIELD(16, 0, 0, UINT8_MAX,  GNSS_HAS_GLN_USED, fix->sats_gln_used);
+        GNSS_FIELD(18, 0, 0, UINT8_MAX,  GNSS_HAS_CN0,      fix->cn0_max);
+        GNSS_FIELD(19, 1, 0, UINT16_MAX, GNSS_HAS_HPA,      fix->hpa_dm);
+        GNSS_FIELD(20, 1, 0, UINT16_MAX, GNSS_HAS_VPA,      fix->vpa_dm);
+    } else {
+        GNSS_FIELD(16, 1, 0, UINT16_MAX, GNSS_HAS_HPA,      fix->hpa_dm);
+        GNSS_FIELD(17, 1, 0, UINT16_MAX, GNSS_HAS_VPA,      fix->vpa_dm);
+    }
+#undef GNSS_FIELD
+
+    if (tok[F_UTC].p != tok[F_UTC].end) {
+        ret = gnss_utc(tok[F_UTC].p, tok[F_UTC].end, &fix->utc, &fix->utc_ms);
+        if (ret != GNSS_OK) {
+            return ret;
+        }
+        fix->present |= GNSS_HAS_UTC;
+    }
+    return GNSS_OK;
+}
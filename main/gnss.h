@@ -0,0 +1,80 @@
+/* Decodificador da resposta +CGNSINF
+
+   Le a linha recebida do modem em uma unica passada, sem copiar, e preenche
+   uma estrutura binaria com todos os campos em inteiros/ponto fixo.
+   Aceita o layout de 18 campos do SIM7070 e o de 21 campos do SIM7000
+   (que traz satelites usados e C/N0).
+
+   Exemplo:
+   +CGNSINF: 1,1,20220212223745.000,-00.000000,-00.000000,591.395,0.00,,0,,1.0,1.4,0.9,,10,,3.6,4.0
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+//Bits de gnss_fix_t.present: campo veio preenchido na resposta
+#define GNSS_HAS_RUN        (1UL << 0)
+#define GNSS_HAS_FIX        (1UL << 1)
+#define GNSS_HAS_UTC        (1UL << 2)
+#define GNSS_HAS_LAT        (1UL << 3)
+#define GNSS_HAS_LON        (1UL << 4)
+#define GNSS_HAS_ALT        (1UL << 5)
+#define GNSS_HAS_SPEED      (1UL << 6)
+#define GNSS_HAS_COURSE     (1UL << 7)
+#define GNSS_HAS_FIX_MODE   (1UL << 8)
+#define GNSS_HAS_HDOP       (1UL << 9)
+#define GNSS_HAS_PDOP       (1UL << 10)
+#define GNSS_HAS_VDOP       (1UL << 11)
+#define GNSS_HAS_SATS_VIEW  (1UL << 12)
+#define GNSS_HAS_GPS_USED   (1UL << 13)
+#define GNSS_HAS_GLN_USED   (1UL << 14)
+#define GNSS_HAS_CN0        (1UL << 15)
+#define GNSS_HAS_HPA        (1UL << 16)
+#define GNSS_HAS_VPA        (1UL << 17)
+
+#define GNSS_HAS_POSITION   (GNSS_HAS_UTC | GNSS_HAS_LAT | GNSS_HAS_LON)
+
+//Codigos de retorno de gnss_parse_cgnsinf
+#define GNSS_OK             0
+#define GNSS_ERR_PREFIX     -1  //Linha nao comeca com "+CGNSINF:"
+#define GNSS_ERR_TRUNC      -2  //Menos campos que o layout minimo
+#define GNSS_ERR_FIELD      -3  //Campo com caracteres invalidos
+#define GNSS_ERR_RANGE      -4  //Valor fora da faixa valida
+
+typedef struct {
+    uint32_t utc;               //Segundos desde 1970-01-01 UTC
+    int32_t lat_e6;             //Latitude em micrograus
+    int32_t lon_e6;             //Longitude em micrograus
+    int32_t alt_cm;             //Altitude MSL em cm
+    uint32_t present;           //GNSS_HAS_*
+    uint16_t utc_ms;
+    uint16_t speed_kmh_x100;    //Velocidade sobre o solo, km/h * 100
+    uint16_t course_x100;       //Curso sobre o solo, graus * 100
+    uint16_t hdop_x100;
+    uint16_t pdop_x100;
+    uint16_t vdop_x100;
+    uint16_t hpa_dm;            //Precisao horizontal estimada, decimetros
+    uint16_t vpa_dm;            //Precisao vertical estimada, decimetros
+    uint8_t run;                //GNSS ligado
+    uint8_t fix;                //Posicao valida
+    uint8_t fix_mode;
+    uint8_t sats_view;
+    uint8_t sats_gps_used;
+    uint8_t sats_gln_used;
+    uint8_t cn0_max;            //dB-Hz
+} gnss_fix_t;
+
+/**
+ * @brief   Decodifica uma linha +CGNSINF.
+ *
+ * Campos vazios apenas nao marcam seu bit em present. A linha nao e alterada
+ * e nada e lido fora de [line, line + len).
+ *
+ * @param   line    Inicio da linha (sem precisar de '\0')
+ * @param   len     Tamanho da linha
+ * @param   fix     Saida; zerada antes da decodificacao
+ *
+ * @return  GNSS_OK ou GNSS_ERR_*
+ */
+int gnss_parse_cgnsinf(const char *line, size_t len, gnss_fix_t *fix);
@@ -0,0 +1,212 @@
+/* Sessao de GNSS: partida hot/warm/cold, criterio de parada e TTFF
+
+   O cache vai para a NVS so quando o fix ou o XTRA mudam; a copia na RTC
+   (com o histograma) e refeita a cada gnss_cache_save().
+*/
+
+#include <stdio.h>
+#include "string.h"
+#include "esp_attr.h"
+#include "nvs.h"
+#include "gnss_sess.h"
+
+#define GNSS_NVS_NS         "gnss"
+#define GNSS_NVS_KEY        "cache"
+#define GNSS_RTC_MAGIC      0x53534E47  //"GNSS"
+
+typedef struct {
+    uint32_t magic;
+    gnss_cache_t cache;
+    gnss_ttff_t stats;
+} gnss_rtc_t;
+
+static RTC_DATA_ATTR gnss_rtc_t gnss_rtc;
+static gnss_cache_t gnss_nvs;           //Ultimo conteudo gravado na NVS
+
+static const uint16_t gnss_ttff_edges[GNSS_TTFF_BINS - 1] = GNSS_TTFF_EDGES_S;
+
+gnss_start_t gnss_sess_begin(gnss_sess_t *s, const gnss_sess_cfg_t *cfg, const gnss_cache_t *cache,
+                             uint32_t now_utc, uint32_t now_ms)
+{
+    bool clock_ok = now_utc >= GNSS_SESS_TIME_MIN;
+    bool recent = clock_ok && cache->fix_utc != 0 && now_utc - cache->fix_utc < GNSS_SESS_HOT_S;
+    bool xtra = clock_ok && cache->xtra_utc != 0 && now_utc - cache->xtra_utc < GNSS_SESS_XTRA_S;
+
+    memset(s, 0, sizeof(*s));
+    s->cfg = *cfg;
+    s->t0_ms = now_ms;
+    if (cache->modem_data && recent) {
+        s->mode = GNSS_START_HOT;
+    } else if (cache->modem_data || xtra) {
+        s->mode = GNSS_START_WARM;
+    } else {
+        s->mode = GNSS_START_COLD;
+    }
+    return s->mode;
+}
+
+const char *gnss_sess_start_cmd(gnss_start_t mode)
+{
+    static const char *const cmd[GNSS_START_MODES] = {"AT+CGNSCOLD\r", "AT+CGNSWARM\r", "AT+CGNSHOT\r"};
+
+    return cmd[mode < GNSS_START_MODES ? mode : GNSS_START_COLD];
+}
+
+const char *gnss_sess_mode_name(gnss_start_t mode)
+{
+    static const char *const name[GNSS_START_MODES] = {"cold", "warm", "hot"};
+
+    return name[mode < GNSS_START_MODES ? mode : GNSS_START_COLD];
+}
+
+static int gnss_ttff_bin(uint32_t ms)
+{
+    int b = 0;
+
+    while (b < GNSS_TTFF_BINS - 1 && ms >= gnss_ttff_edges[b] * 1000u) {
+        b++;
+    }
+    return b;
+}
+
+//Satelites usados quando o modem informa; no SIM7070 so ha os em vista
+static uint8_t gnss_sats(const gnss_fix_t *f)
+{
+    if (f->present & (GNSS_HAS_GPS_USED | GNSS_HAS_GLN_USED)) {
+        return f->sats_gps_used + f->sats_gln_used;
+    }
+    return f->sats_view;
+}
+
+static bool gnss_better(const gnss_fix_t *a, const gnss_fix_t *b)
+{
+    uint16_t ha = (a->present & GNSS_HAS_HDOP) ? a->hdop_x100 : UINT16_MAX;
+    uint16_t hb = (b->present & GNSS_HAS_HDOP) ? b->hdop_x100 : UINT16_MAX;
+
+    return ha < hb || (ha == hb && gnss_sats(a) > gnss_sats(b));
+}
+
+gnss_sess_res_t gnss_sess_update(gnss_sess_t *s, const gnss_fix_t *fix, uint32_t now_ms, gnss_ttff_t *stats)
+{
+    uint32_t dt = now_ms - s->t0_ms;
+    bool done = false;
+
+    s->polls++;
+    if (fix != NULL && fix->fix && (fix->present & GNSS_HAS_POSITION) == GNSS_HAS_POSITION) {
+        if (s->ttff_ms == 0) {
+            s->ttff_ms = dt ? dt : 1;
+            stats->hist[s->mode][gnss_ttff_bin(s->ttff_ms)]++;
+            stats->ttff_ms_sum[s->mode] += s->ttff_ms;
+        }
+        if (!s->best_ok || gnss_better(fix, &s->best)) {
+            s->best = *fix;
+            s->best_ok = true;
+        }
+        done = (fix->present & GNSS_HAS_HDOP) && fix->hdop_x100 <= s->cfg.hdop_max_x100 &&
+               gnss_sats(fix) >= s->cfg.sats_min;
+    }
+    if (done) {
+        s->best = *fix;
+        stats->sessions[s->mode]++;
+        return GNSS_SESS_DONE;
+    }
+    if (dt >= s->cfg.timeout_s * 1000u) {
+        stats->sessions[s->mode]++;
+        stats->timeouts[s->mode]++;
+        return GNSS_SESS_TIMEOUT;
+    }
+    return GNSS_SESS_WAIT;
+}
+
+void gnss_cache_store(gnss_cache_t *cache, const gnss_fix_t *fix)
+{
+    cache->fix_utc = fix->utc;
+    cache->lat_e6 = fix->lat_e6;
+    cache->lon_e6 = fix->lon_e6;
+    cache->alt_cm = fix->alt_cm;
+    cache->modem_data = true;
+}
+
+bool gnss_cache_xtra_due(const gnss_cache_t *cache, uint32_t now_utc)
+{
+    return now_utc >= GNSS_SESS_TIME_MIN && (cache->xtra_utc == 0 || now_utc - cache->xtra_utc >= GNSS_SESS_XTRA_S);
+}
+
+esp_err_t gnss_cache_load(gnss_cache_t *cache, gnss_ttff_t *stats)
+{
+    nvs_handle_t h;
+    size_t len = sizeof(*cache);
+    esp_err_t ret;
+
+    if (gnss_rtc.magic == GNSS_RTC_MAGIC) {
+        *cache = gnss_rtc.cache;
+        *stats = gnss_rtc.stats;
+        gnss_nvs = *cache;
+        return ESP_OK;
+    }
+    memset(cache, 0, sizeof(*cache));
+    memset(stats, 0, sizeof(*stats));
+    ret = nvs_open(GNSS_NVS_NS, NVS_READONLY, &h);
+    if (ret == ESP_OK) {
+        ret = nvs_get_blob(h, GNSS_NVS_KEY, cache, &len);
+        nvs_close(h);
+    }
+    if (ret != ESP_OK || len != sizeof(*cache)) {
+        memset(cache, 0, sizeof(*cache));
+        return (ret == ESP_ERR_NVS_NOT_FOUND || ret == ESP_OK) ? ESP_ERR_NOT_FOUND : ret;
+    }
+    //Sem RTC valida o modem tambem foi desligado
+    cache->modem_data = false;
+    gnss_nvs = *cache;
+    return ESP_OK;
+}
+
+esp_err_t gnss_cache_save(const gnss_cache_t *cache, const gnss_ttff_t *stats)
+{
+    nvs_handle_t h;
+    esp_err_t ret;
+
+    gnss_rtc.cache = *cache;
+    gnss_rtc.stats = *stats;
+    gnss_rtc.magic = GNSS_RTC_MAGIC;
+    if (cache->fix_utc == gnss_nvs.fix_utc && cache->xtra_utc == gnss_nvs.xtra_utc) {
+        return ESP_OK;
+    }
+    ret = nvs_open(GNSS_NVS_NS, NVS_READWRITE, &h);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = nvs_set_blob(h, GNSS_NVS_KEY, cache, sizeof(*cache));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(h);
+    }
+    nvs_close(h);
+    if (ret == ESP_OK) {
+        gnss_nvs = *cache;
+    }
+    return ret;
+}
+
+void gnss_ttff_print(const gnss_ttff_t *stats)
+{
+    for (int m = GNSS_START_MODES - 1; m >= 0; m--) {
+        uint32_t fixes = 0;
+
+        if (stats->sessions[m] == 0) {
+            continue;
+        }
+        for (int b = 0; b < GNSS_TTFF_BINS; b++) {
+            fixes += stats->hist[m][b];
+        }
+        printf("| TTFF | %-4s | Sessoes %u | Sem criterio %u | Media %u ms |", gnss_sess_mode_name(m),
+               stats->sessions[m], stats->timeouts[m], fixes ? stats->ttff_ms_sum[m] / fixes : 0);
+        for (int b = 0; b < GNSS_TTFF_BINS; b++) {
+            if (b < GNSS_TTFF_BINS - 1) {
+                printf(" <%us %u", gnss_ttff_edges[b], stats->hist[m][b]);
+            } else {
+                printf(" >=%us %u", gnss_ttff_edges[b - 1], stats->hist[m][b]);
+            }
+        }
+        printf("\n");
+    }
+}
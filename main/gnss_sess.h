@@ -0,0 +1,136 @@
+/* Sessao de GNSS: partida hot/warm/cold, criterio de parada e TTFF
+
+   O ultimo fix aceito, o horario dele e o instante do ultimo download do
+   arquivo de assistencia XTRA ficam em gnss_cache_t, guardado na memoria
+   RTC (sobrevive ao deep sleep) e na NVS (sobrevive a falta de energia).
+   Na partida o cache decide o modo:
+     - hot:  o modem nao foi reiniciado desde o fix e ele tem menos de
+             GNSS_SESS_HOT_S (efemerides ainda validas na RAM do modem);
+     - warm: modem sem reinicio (almanaque e horario no modem) ou XTRA com
+             menos de GNSS_SESS_XTRA_S;
+     - cold: nada aproveitavel.
+   O SIM7070 nao aceita injecao de posicao por AT; a assistencia possivel e
+   manter o modem ligado entre as janelas e o XTRA.
+
+   A sessao termina no primeiro fix com HDOP e satelites dentro do criterio
+   (gnss_sess_cfg_t) ou no timeout, com o melhor fix visto ate ali. O tempo
+   ate o primeiro fix de cada sessao vai para um histograma por modo.
+
+   gnss_sess_begin/update nao dependem do ESP-IDF; o cache usa NVS e RTC.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "gnss.h"
+
+#define GNSS_SESS_HOT_S     (2 * 3600)          //Efemerides valem ~4 h
+#define GNSS_SESS_XTRA_S    (3 * 24 * 3600)     //Renovacao do XTRA (o arquivo vale 7 dias)
+#define GNSS_SESS_TIME_MIN  1577836800u         //2020-01-01: relogio antes disso nao foi acertado
+#define GNSS_TTFF_BINS      8                   //Limites em GNSS_TTFF_EDGES_S, o ultimo aberto
+#define GNSS_TTFF_EDGES_S   {2, 5, 10, 20, 40, 80, 160}
+
+#define GNSS_XTRA_URL       "http://iot1.xtracloud.net/xtra3grc.bin"
+#define GNSS_XTRA_FILE      "/customer/Xtra3.bin"
+
+typedef enum {
+    GNSS_START_COLD = 0,
+    GNSS_START_WARM,
+    GNSS_START_HOT,
+    GNSS_START_MODES,
+} gnss_start_t;
+
+typedef enum {
+    GNSS_SESS_WAIT = 0,         //Continua consultando
+    GNSS_SESS_DONE,             //Fix dentro do criterio em best
+    GNSS_SESS_TIMEOUT,          //Prazo esgotado; best so vale com best_ok
+} gnss_sess_res_t;
+
+typedef struct {
+    uint16_t hdop_max_x100;
+    uint8_t sats_min;           //Satelites usados; em vista se o modem nao informa (SIM7070)
+    uint16_t timeout_s;
+} gnss_sess_cfg_t;
+
+typedef struct {
+    uint32_t fix_utc;           //Ultimo fix aceito; 0 = nenhum
+    int32_t lat_e6;
+    int32_t lon_e6;
+    int32_t alt_cm;
+    uint32_t xtra_utc;          //Ultimo download do XTRA; 0 = nenhum
+    bool modem_data;            //Modem ligado desde o fix (dados do GNSS na RAM dele)
+} gnss_cache_t;
+
+typedef struct {
+    uint32_t sessions[GNSS_START_MODES];
+    uint32_t timeouts[GNSS_START_MODES];    //Sem fix dentro do criterio
+    uint32_t ttff_ms_sum[GNSS_START_MODES];
+    uint16_t hist[GNSS_START_MODES][GNSS_TTFF_BINS];
+} gnss_ttff_t;
+
+typedef struct {
+    gnss_sess_cfg_t cfg;
+    gnss_start_t mode;
+    uint32_t t0_ms;
+    uint32_t ttff_ms;           //0 = ainda sem fix
+    uint32_t polls;
+    bool best_ok;
+    gnss_fix_t best;            //Menor HDOP da sessao
+} gnss_sess_t;
+
+/**
+ * @brief   Inicia uma sessao e escolhe o modo de partida pelo cache.
+ *
+ * @param   now_utc     Relogio do sistema (abaixo de GNSS_SESS_TIME_MIN = desconhecido)
+ * @param   now_ms      Relogio monotonico da sessao
+ */
+gnss_start_t gnss_sess_begin(gnss_sess_t *s, const gnss_sess_cfg_t *cfg, const gnss_cache_t *cache,
+                             uint32_t now_utc, uint32_t now_ms);
+
+/**
+ * @brief   Comando AT que reinicia o GNSS no modo (com '\r').
+ */
+const char *gnss_sess_start_cmd(gnss_start_t mode);
+
+const char *gnss_sess_mode_name(gnss_start_t mode);
+
+/**
+ * @brief   Trata uma consulta ao +CGNSINF.
+ *
+ * O primeiro fix com posicao marca o TTFF no histograma; ao terminar
+ * (DONE ou TIMEOUT) a sessao e contada em stats.
+ *
+ * @param   fix     Resposta decodificada, ou NULL se a consulta falhou
+ */
+gnss_sess_res_t gnss_sess_update(gnss_sess_t *s, const gnss_fix_t *fix, uint32_t now_ms, gnss_ttff_t *stats);
+
+/**
+ * @brief   Guarda o fix no cache (nao grava; ver gnss_cache_save()).
+ */
+void gnss_cache_store(gnss_cache_t *cache, const gnss_fix_t *fix);
+
+/**
+ * @brief   O XTRA deve ser baixado de novo (relogio acertado e arquivo velho ou ausente).
+ */
+bool gnss_cache_xtra_due(const gnss_cache_t *cache, uint32_t now_utc);
+
+/**
+ * @brief   Le o cache e o histograma: da memoria RTC depois de um deep sleep,
+ *          senao o cache da NVS (sem modem_data) e o histograma zerado.
+ *
+ * Requer nvs_flash_init().
+ *
+ * @return  ESP_OK, ESP_ERR_NOT_FOUND se nunca foi gravado (cache zerado) ou erro da NVS
+ */
+esp_err_t gnss_cache_load(gnss_cache_t *cache, gnss_ttff_t *stats);
+
+/**
+ * @brief   Grava o cache e o histograma na memoria RTC e o cache na NVS.
+ */
+esp_err_t gnss_cache_save(const gnss_cache_t *cache, const gnss_ttff_t *stats);
+
+/**
+ * @brief   Imprime o histograma de TTFF por modo.
+ */
+void gnss_ttff_print(const gnss_ttff_t *stats);
@@ -0,0 +1,1244 @@
+/* Maquina de estados do GSM_C (fsm.h)
+
+   ROOT
+    +- BOOT:  PWR_PULSE <-> PWR_SETTLE -> LINK -> ECHO -> CSCLK
+    +- WAKE   (inicio de cada janela)
+    +- GNSS:  GNSS_PWR (-> GNSS_ON) -> GNSS_START -> GNSS_FIX      prazo da sessao
+    +- LTE:   GNSS_OFF (-> GNSS_OFF_CHK) -> LTE_KEPT | NET (-> BANDS) -> PDP -> REG
+    |         GNSS_OFF -> END quando a politica nao publica
+    |         NET_CHK, PDP_CHK (consultas de reserva)             prazo GSM_LTE_MS
+    +- DATA:  PUBLISH -> CELL -> XTRA
+    +- END -> IDLE -> WAKE
+
+   Cada consulta ao modem vai pelo motor AT; a resposta volta como
+   GSM_EV_AT e vira OK, NO (ainda nao: fix) ou FAIL pelo parser da
+   consulta. NO e FAIL esperam RADIO_POLL_MS no proprio estado e o prazo
+   reentra nele, repetindo a consulta. Entre janelas o unico prazo armado
+   e o da proxima janela: a task so acorda com resposta, alerta ou prazo.
+
+   Registro e PDP nao sao consultados em laco: as URCs do modem mudam o
+   modelo do netreg, que posta GSM_EV_NET. NET e REG conferem o modelo na
+   entrada e a cada GSM_EV_NET; so com o estado desconhecido (boot, reset
+   do modem) ou sem URC em GSM_URC_CHECK_MS consultam uma vez (NET_CHK,
+   PDP_CHK) e voltam.
+
+   A politica de relatorio (report.h) decide no fim do GNSS se a janela
+   publica e, no END, quando comeca a proxima. O movimento e os eventos da
+   IMU chegam como GSM_EV_MOTION; no IDLE, saindo de parado, antecipam a
+   janela.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+#include "string.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "sdkconfig.h"
+#include "at_cmd.h"
+#include "at_link.h"
+#include "at_decode.h"
+#include "gnss.h"
+#include "gnss_sess.h"
+#include "tlog.h"
+#include "telem.h"
+#include "mqtt_pub.h"
+#include "power.h"
+#include "radio.h"
+#include "modem_cfg.h"
+#include "dlog.h"
+#include "at_health.h"
+#include "ring.h"
+#include "fsm.h"
+#include "netreg.h"
+#include "report.h"
+#include "gsm.h"
+
+#define GSM_PWRKEY_PULSE_MS 1500    //PWRKEY em nivel alto
+#define GSM_PWRKEY_OFF_MS   5000    //Entre os pulsos do reset (desliga e liga)
+#define GSM_PWRKEY_BOOT_MS  1000    //Depois do ultimo pulso, antes do primeiro AT
+#define GSM_LINK_RETRY_MS   2500
+#define GSM_ECHO_RESET      15      //ATE0 sem resposta ate religar o modem
+#define AT_LINK_RESET_TRIES 5       //Negociacoes sem resposta ate religar o modem
+#define GSM_AT_MS           2000    //Consultas de estado
+#define GSM_GNSS_MARGIN_S   30      //Alem do prazo da sessao: modem que parou de responder
+#define GSM_GNSS_MS         ((CONFIG_LOGQ_GNSS_TIMEOUT_S + GSM_GNSS_MARGIN_S) * 1000)
+#define GSM_LTE_MS          (5 * 60 * 1000)     //Rede e PDP: desiste e fecha a janela
+#define GSM_URC_CHECK_MS    30000   //Rede ou PDP sem URC: consulta de reserva
+#define GSM_TAG_MAX         0xFFFFF //Etiqueta do comando no argumento do evento (20 bits)
+#if CONFIG_LOGQ_REPORT_ADAPTIVE
+#define GSM_REPORT_ADAPTIVE 1
+#else
+#define GSM_REPORT_ADAPTIVE 0       //Janelas fixas de POWER_WINDOW_S, todas publicam
+#endif
+
+enum {
+    GSM_ROOT = 0,
+    GSM_BOOT,
+    GSM_PWR_PULSE,
+    GSM_PWR_SETTLE,
+    GSM_LINK,
+    GSM_ECHO,
+    GSM_CSCLK,
+    GSM_WAKE,
+    GSM_GNSS,
+    GSM_GNSS_PWR,
+    GSM_GNSS_ON,
+    GSM_GNSS_START,
+    GSM_GNSS_FIX,
+    GSM_LTE,
+    GSM_GNSS_OFF,
+    GSM_GNSS_OFF_CHK,
+    GSM_LTE_KEPT,
+    GSM_NET,
+    GSM_BANDS,
+    GSM_PDP,
+    GSM_REG,
+    GSM_NET_CHK,
+    GSM_PDP_CHK,
+    GSM_DATA,
+    GSM_PUBLISH,
+    GSM_CELL,
+    GSM_XTRA,
+    GSM_END,
+    GSM_IDLE,
+    GSM_STATES
+};
+
+enum {
+    GSM_EV_AT = FSM_EV_USER,    //Comando concluido: etiqueta << 4 | at_result_t
+    GSM_EV_OK,
+    GSM_EV_NO,                  //Resposta valida, condicao ainda nao atingida
+    GSM_EV_FAIL,
+    GSM_EV_URGENT,              //Alerta na fila do mqtt_pub
+    GSM_EV_NET,                 //Mudanca no registro, PDP ou MQTT (netreg)
+    GSM_EV_MOTION,              //Movimento (0) ou evento (1) da IMU
+};
+
+_Static_assert(GSM_STATES < FSM_BACK, "Estados do GSM_C colidem com os destinos especiais");
+_Static_assert(((GSM_TAG_MAX << 4) | 0xF) <= FSM_ARG_MAX, "Etiqueta do GSM_C nao cabe no argumento");
+
+typedef struct {
+    volatile uint32_t at_tag;   //Comando esperado; respostas de outra etiqueta sao de estados que ja sairam
+    at_line_t *resp;            //Ultima linha de informacao
+    gnss_fix_t fix;
+    gnss_sess_t sess;
+    gnss_sess_res_t gres;
+    const char *gnss_cmd;       //Partida escolhida pelo cache
+    at_cpsi_t cpsi;
+    at_cbandcfg_t bandcfg;
+    at_cnact_t cnact;
+    radio_plan_t plano;
+    telem_at_t saude;
+    bool rede_ok;
+    bool bandas_ok;             //Bandas conferidas antes do deep sleep continuam no modem mantido
+    bool urc_ok;                //URCs de registro ligadas neste boot do modem
+    bool boot;
+    bool alerta;                //Publicacao de alerta: volta ao estado interrompido
+    bool pub_ok;
+    bool enviar;                //Politica de relatorio: a janela publica
+    uint8_t pulsos;             //PWRKEY: pulsos que faltam
+    uint32_t tentativas;
+    uint8_t at_estado;          //Estado que enviou o ultimo comando (GSM_STATES: nenhum)
+    uint32_t repeticoes;        //Reentradas dele enviando de novo
+    uint32_t despertares;       //fsm_stats_t.wakeups no inicio da janela
+} gsm_ctx_t;
+
+typedef struct {
+    const char *cmd;            //NULL: a entrada do estado envia
+    at_final_t final;
+    const char *prefix;         //Linha de informacao entregue ao parser
+    uint32_t timeout_ms;
+    uint8_t (*parse)(at_result_t res, const char *txt);    //NULL: OK ou FAIL
+} gsm_query_t;
+
+static gsm_ctx_t gsm;
+static fsm_t gsm_fsm;
+static gsm_cfg_t gsm_conf;
+static volatile bool gsm_pronto;            //gsm_fsm montada: a IMU ja pode postar
+static RTC_DATA_ATTR report_t relatorio;    //Politica de relatorio, mantida no deep sleep
+static gnss_cache_t gnss_cache;             //Ultimo fix e XTRA (RTC e NVS)
+static gnss_ttff_t gnss_ttff;
+static int64_t pdp_t0;
+
+//Respostas do motor AT para o GSM_C: vai o indice do slot, nao a linha
+static at_line_t gsm_msg_pool[GSM_MSG_SLOTS];
+static ring_mpsc_t gsm_msg_free;              //Slots livres: quem le devolve, o motor AT pega
+static ring_cell_t gsm_msg_free_cells[RING_CAP(GSM_MSG_SLOTS)];
+static ring_t gsm_msg_ready;                  //Linhas da ultima resposta, em ordem de chegada
+static uint8_t gsm_msg_ready_buf[RING_CAP(GSM_MSG_SLOTS)];
+static at_line_t gsm_msg_vazia;               //Resposta "lida" antes da primeira
+static uint32_t gsm_msg_drop;                 //Linhas sem slot livre
+
+static void gsm_msg_init(void)
+{
+    ring_mpsc_init(&gsm_msg_free, gsm_msg_free_cells, RING_CAP(GSM_MSG_SLOTS));
+    ring_init(&gsm_msg_ready, gsm_msg_ready_buf, 1, RING_CAP(GSM_MSG_SLOTS));
+    for (uint32_t i = 0; i < GSM_MSG_SLOTS; i++) {
+        ring_mpsc_push(&gsm_msg_free, i);
+    }
+}
+
+static void gsm_msg_release(at_line_t *msg)
+{
+    if (msg >= gsm_msg_pool && msg < gsm_msg_pool + GSM_MSG_SLOTS) {
+        ring_mpsc_push(&gsm_msg_free, (uint32_t)(msg - gsm_msg_pool));
+    }
+}
+
+//Descarta respostas nao lidas de um comando anterior
+static void gsm_msg_reset(void)
+{
+    uint8_t idx;
+
+    while (ring_pop(&gsm_msg_ready, &idx, 1) == 1) {
+        ring_mpsc_push(&gsm_msg_free, idx);
+    }
+}
+
+//Chamada pela task do motor AT, na conclusao do comando
+static void gsm_msg_put(const char *txt)
+{
+    uint32_t idx;
+    uint8_t i8;
+    size_t len = strlen(txt);
+
+    if (!ring_mpsc_pop(&gsm_msg_free, &idx)) {
+        gsm_msg_drop++;
+        return;
+    }
+    if (len >= AT_LINE_MAX) {
+        len = AT_LINE_MAX - 1;
+    }
+    i8 = (uint8_t)idx;
+    gsm_msg_pool[idx].len = (uint16_t)len;
+    memcpy(gsm_msg_pool[idx].txt, txt, len);
+    gsm_msg_pool[idx].txt[len] = '\0';
+    ring_push(&gsm_msg_ready, &i8, 1);
+}
+
+/**
+ * Proxima resposta do ultimo comando. A anterior volta ao pool; sem
+ * resposta nova fica a anterior, como a fila antiga deixava o buffer.
+ */
+static at_line_t *gsm_msg_take(at_line_t *atual)
+{
+    uint8_t idx;
+
+    if (ring_pop(&gsm_msg_ready, &idx, 1) == 0) {
+        return atual;
+    }
+    gsm_msg_release(atual);
+    return &gsm_msg_pool[idx];
+}
+
+//Parametros do PDP que ficam no modem: so o que difere e enviado (modem_cfg)
+static const modem_cfg_item_t pdp_cfg_items[] = {
+    {"AT+CFUN?\r",    "+CFUN:",       "1",                    "AT+CFUN=1,0\r"},
+    {"AT+CGDCONT?\r", "+CGDCONT: 1,", "IP,java.claro.com.br", "AT+CGDCONT=1,\"IP\",\"java.claro.com.br\",\"0.0.0.0\"\r"},
+    {"AT+CNCFG?\r",   "+CNCFG: 0,",   "1,IoTLog",             "AT+CNCFG=0,1,\"IoTLog\"\r"},
+};
+static modem_cfg_t pdp_cfg = {
+    .name = "pdp",
+    .items = pdp_cfg_items,
+    .n = sizeof(pdp_cfg_items) / sizeof(pdp_cfg_items[0]),
+};
+
+//Sequencia de subida do PDP (estado GSM_PDP), depois do perfil pdp_cfg
+static const struct {
+    const char *cmd;
+    at_final_t final;
+    const char *prefix;
+    uint32_t timeout_ms;
+} pdp_seq[] = {
+    {"AT+CGACT=1,1\r",                                         AT_FINAL_OK,     NULL,           30000},
+    {"AT+CGACT?\r",                                            AT_FINAL_OK,     NULL,           5000},
+    {"AT+CPSI?\r",                                             AT_FINAL_OK,     NULL,           5000},
+    {"AT+CGPADDR\r",                                           AT_FINAL_OK,     NULL,           5000},
+    {"AT+CNACT=0,1\r",                                         AT_FINAL_PREFIX, "+APP PDP: 0,", 30000},
+    {"AT+SNPDPID=0\r",                                         AT_FINAL_OK,     NULL,           5000},
+    {"AT+SNPING4=\"8.8.8.8\",5,1,20000\r",                      AT_FINAL_OK,     NULL,           25000},
+    {"AT+SNPING4=\"8.8.8.8\",5,1,20000\r",                      AT_FINAL_OK,     NULL,           25000},
+};
+#define PDP_SEQ_LEN (sizeof(pdp_seq) / sizeof(pdp_seq[0]))
+
+//Download e carga do arquivo de assistencia XTRA (com a rede ativa)
+static const struct {
+    const char *cmd;
+    at_final_t final;
+    const char *prefix;
+    uint32_t timeout_ms;
+} xtra_seq[] = {
+    {"AT+HTTPTOFS=\"" GNSS_XTRA_URL "\",\"" GNSS_XTRA_FILE "\"\r", AT_FINAL_PREFIX, "+HTTPTOFS:", 60000},
+    {"AT+CGNSCPY\r",                                                AT_FINAL_OK,     NULL,          10000},
+    {"AT+CGNSXTRA=1\r",                                             AT_FINAL_OK,     NULL,          5000},
+};
+#define XTRA_SEQ_LEN (sizeof(xtra_seq) / sizeof(xtra_seq[0]))
+
+//Algum passo da sequencia em andamento falhou ou nao foi enfileirado
+static bool xtra_falhou;
+
+static void gsm_tag_next(void)
+{
+    gsm.at_tag = gsm.at_tag % GSM_TAG_MAX + 1;
+}
+
+//Conclusao de um comando do GSM_C, chamada pela task do motor AT
+static void gsm_at_done(const at_cmd_t *cmd, at_result_t res, const char *info, void *arg)
+{
+    uint32_t tag = (uint32_t)(uintptr_t)arg;
+
+    if (tag != gsm.at_tag) {
+        return;
+    }
+    if (info[0] != '\0') {
+        gsm_msg_put(info);
+    }
+    fsm_post(&gsm_fsm, GSM_EV_AT, (tag << 4) | res);
+}
+
+//Novo comando: respostas antigas nao pertencem a ele; devolve o argumento da callback
+static void *gsm_at_begin(void)
+{
+    gsm_msg_reset();
+    gsm_msg_release(gsm.resp);
+    gsm.resp = &gsm_msg_vazia;
+    gsm_tag_next();
+    return (void *)(uintptr_t)gsm.at_tag;
+}
+
+//Mesmo estado enviando de novo (prazo, "ainda nao" ou consulta de reserva) conta como tentativa
+static void gsm_at(const char *cmd, at_final_t final, const char *prefix, uint32_t timeout_ms)
+{
+    uint8_t estado = fsm_state(&gsm_fsm);
+
+    if (estado == gsm.at_estado) {
+        gsm.repeticoes++;
+        DLOG(AT_RETRY, gsm.repeticoes + 1);
+    } else {
+        gsm.at_estado = estado;
+        gsm.repeticoes = 0;
+    }
+    if (at_cmd_submit_retry(cmd, final, prefix, timeout_ms, gsm.repeticoes > 0, gsm_at_done, gsm_at_begin()) != ESP_OK) {
+        fsm_post(&gsm_fsm, GSM_EV_FAIL, 0);
+    }
+}
+
+//Conclusao de cada passo do PDP, chamada pela task do motor AT
+static void gsm_pdp_step(const at_cmd_t *cmd, at_result_t res, const char *info, void *arg)
+{
+    if (res != AT_RES_OK) {
+        printf("\tFalha %d: %s\n", res, cmd->cmd);
+        // PDP que nao sobe: confere o perfil no modem na proxima tentativa
+        if (strncmp(cmd->cmd, "AT+CNACT", 8) == 0)
+            modem_cfg_invalidate(&pdp_cfg);
+    }
+    if (strncmp(info, "+APP PDP: 0,ACTIVE", 18) == 0) {
+        printf("PDP ativo em %d ms\n", (int)((esp_timer_get_time() - pdp_t0) / 1000));
+    }
+    if (arg != NULL) {
+        gsm_at_done(cmd, res, "", arg);
+    }
+}
+
+//Passo do XTRA: qualquer falha descarta o resto da sequencia (so ela; o resto da fila segue)
+static void gsm_xtra_step(const at_cmd_t *cmd, at_result_t res, const char *info, void *arg)
+{
+    if (res == AT_RES_CANCELLED) {
+        xtra_falhou = true;
+    } else if (res != AT_RES_OK || (strncmp(cmd->cmd, "AT+HTTPTOFS", 11) == 0 && strncmp(info, "+HTTPTOFS: 200,", 15) != 0)) {
+        printf("\tFalha %d: %s %s\n", res, cmd->cmd, info);
+        xtra_falhou = true;
+        at_cmd_cancel(gsm_xtra_step);
+    }
+    if (arg != NULL) {
+        if (!xtra_falhou) {
+            gnss_cache.xtra_utc = (uint32_t)time(NULL);
+            printf("XTRA atualizado\n");
+        }
+        gsm_at_done(cmd, res, "", arg);
+    }
+}
+
+//---------------------------------------------------------------- Parsers das consultas
+
+static uint8_t gsm_sempre(at_result_t res, const char *txt)
+{
+    return GSM_EV_OK;
+}
+
+static uint8_t gsm_parse_gnss_pwr(at_result_t res, const char *txt)
+{
+    if (res != AT_RES_OK) {
+        return GSM_EV_FAIL;
+    }
+    DLOGS(GSM_STATUS, txt);
+    return strstr(txt, "0") != NULL ? GSM_EV_NO : GSM_EV_OK;
+}
+
+static uint8_t gsm_parse_cgnsinf(at_result_t res, const char *txt)
+{
+    // Decodifica o +CGNSINF direto do buffer recebido, todos os campos
+    int ret = gnss_parse_cgnsinf(txt, strlen(txt), &gsm.fix);
+    if(ret != GNSS_OK)
+    {
+        printf("FAIL (%d)\n", ret);
+    }
+    // Para no primeiro fix dentro do criterio de HDOP/satelites ou no timeout
+    gsm.gres = gnss_sess_update(&gsm.sess, ret == GNSS_OK ? &gsm.fix : NULL,
+                                (uint32_t)(esp_timer_get_time() / 1000), &gnss_ttff);
+    if(gsm.gres == GNSS_SESS_WAIT)
+    {
+        DLOG(GNSS_SYNC, gsm.fix.fix, gsm.fix.hdop_x100, gsm.fix.sats_view);
+        return GSM_EV_NO;
+    }
+    return GSM_EV_OK;
+}
+
+//Desligamento do GPS conferido: o OK do AT+CGNSPWR=0 pode ter se perdido
+static uint8_t gsm_parse_gnss_off(at_result_t res, const char *txt)
+{
+    if (res != AT_RES_OK) {
+        return GSM_EV_FAIL;
+    }
+    return strncmp(txt, "+CGNSPWR: 0", 11) == 0 ? GSM_EV_OK : GSM_EV_NO;
+}
+
+//GNSS curto com o PDP ativo antes: confere o PDP em vez de refazer o registro
+static uint8_t gsm_parse_kept(at_result_t res, const char *txt)
+{
+    if (res != AT_RES_OK) {
+        return GSM_EV_FAIL;
+    }
+    int ret = at_decode_cnact(txt, strlen(txt), &gsm.cnact);
+    return (ret >= 3 && gsm.cnact.status == 1) ? GSM_EV_OK : GSM_EV_NO;
+}
+
+static uint8_t gsm_parse_pdp(at_result_t res, const char *txt)
+{
+    int ret = at_decode_cnact(txt, strlen(txt), &gsm.cnact);
+
+    if(ret >= 3 && gsm.cnact.status == 1)
+        DLOG(GSM_PDP_UP, gsm.cnact.pdp_idx, (gsm.cnact.ip >> 24) & 0xff, (gsm.cnact.ip >> 16) & 0xff,
+             (gsm.cnact.ip >> 8) & 0xff, gsm.cnact.ip & 0xff);
+    else
+        DLOG(GSM_PDP_DOWN);
+    return GSM_EV_OK;
+}
+
+//Celula e sinal uma vez por janela, para o diagnostico; o registro vem das URCs
+static uint8_t gsm_parse_cell(at_result_t res, const char *txt)
+{
+    DLOGS(GSM_STATUS, txt);
+    int ret = at_decode_cpsi(txt, strlen(txt), &gsm.cpsi);
+    if(ret >= 1 && gsm.cpsi.sys_mode != AT_SYS_NO_SERVICE)
+        DLOG(GSM_CELL, gsm.cpsi.sys_mode, gsm.cpsi.mcc, gsm.cpsi.mnc,
+             gsm.cpsi.band, gsm.cpsi.rsrp, gsm.cpsi.rsrq, gsm.cpsi.sinr);
+    if(ret >= 12)
+    {
+        DLOG(GSM_CELL_ID, gsm.cpsi.cell_id, gsm.cpsi.tac, gsm.cpsi.rsrp);
+        // Enlace da janela para a politica de relatorio
+        report_link(&relatorio, gsm.cpsi.sys_mode != AT_SYS_NO_SERVICE, gsm.cpsi.rsrp);
+    }
+    return GSM_EV_OK;
+}
+
+static uint8_t gsm_parse_bands(at_result_t res, const char *txt)
+{
+    DLOGS(GSM_STATUS, txt);
+    int ret = at_decode_cbandcfg(txt, strlen(txt), &gsm.bandcfg);
+    if(ret >= 1 && gsm.bandcfg.rat == AT_RAT_CATM)
+    {
+        // Bandas CAT-M configuradas, segue para a subida do PDP
+        gsm.bandas_ok = true;
+        DLOG(GSM_CATM, gsm.bandcfg.nbands);
+        return GSM_EV_OK;
+    }
+    DLOGS(GSM_NOCMP, txt);
+    return GSM_EV_NO;
+}
+
+//Consulta de cada estado; cmd NULL: enviada pela entrada do proprio estado
+static const gsm_query_t gsm_queries[GSM_STATES] = {
+    [GSM_ECHO]         = {"ATE0\r",         AT_FINAL_OK, NULL,         GSM_AT_MS, NULL},
+    [GSM_CSCLK]        = {"AT+CSCLK=1\r",   AT_FINAL_OK, NULL,         GSM_AT_MS, gsm_sempre},
+    [GSM_GNSS_PWR]     = {"AT+CGNSPWR?\r",  AT_FINAL_OK, "+CGNSPWR:",  GSM_AT_MS, gsm_parse_gnss_pwr},
+    [GSM_GNSS_ON]      = {"AT+CGNSPWR=1\r", AT_FINAL_OK, NULL,         GSM_AT_MS, gsm_sempre},
+    [GSM_GNSS_START]   = {NULL,             AT_FINAL_OK, NULL,         GSM_AT_MS, gsm_sempre},
+    [GSM_GNSS_FIX]     = {"AT+CGNSINF\r",   AT_FINAL_OK, "+CGNSINF:",  GSM_AT_MS, gsm_parse_cgnsinf},
+    [GSM_GNSS_OFF]     = {"AT+CGNSPWR=0\r", AT_FINAL_OK, NULL,         GSM_AT_MS, NULL},
+    [GSM_GNSS_OFF_CHK] = {"AT+CGNSPWR?\r",  AT_FINAL_OK, "+CGNSPWR:",  GSM_AT_MS, gsm_parse_gnss_off},
+    [GSM_LTE_KEPT]     = {NULL,             AT_FINAL_OK, NULL,         GSM_AT_MS, gsm_parse_kept},
+    [GSM_BANDS]        = {"AT+CBANDCFG?\r", AT_FINAL_OK, "+CBANDCFG:", GSM_AT_MS, gsm_parse_bands},
+    [GSM_PDP]          = {NULL,             AT_FINAL_OK, NULL,         GSM_AT_MS, gsm_sempre},
+    [GSM_NET_CHK]      = {"AT+CEREG?\r",    AT_FINAL_OK, "+CEREG:",    GSM_AT_MS, gsm_sempre},
+    [GSM_PDP_CHK]      = {"AT+CNACT?\r",    AT_FINAL_OK, "+CNACT:",    GSM_AT_MS, gsm_parse_pdp},
+    [GSM_CELL]         = {"AT+CPSI?\r",     AT_FINAL_OK, "+CPSI:",     GSM_AT_MS, gsm_parse_cell},
+    [GSM_XTRA]         = {NULL,             AT_FINAL_OK, NULL,         GSM_AT_MS, gsm_sempre},
+};
+
+//---------------------------------------------------------------- Entradas e saidas
+
+//DTR recem baixado: arma o resto da espera da UART; o prazo reentra no estado (linha da raiz)
+static bool gsm_modem_waking(fsm_t *fsm)
+{
+    uint32_t ms = power_modem_ready_ms();
+
+    if (ms == 0) {
+        return false;
+    }
+    fsm_arm(fsm, ms);
+    return true;
+}
+
+static void gsm_query(fsm_t *fsm)
+{
+    const gsm_query_t *q = &gsm_queries[fsm_state(fsm)];
+
+    if (gsm_modem_waking(fsm)) {
+        return;
+    }
+    gsm_at(q->cmd, q->final, q->prefix, q->timeout_ms);
+}
+
+//Resposta que chegar depois da saida e descartada pela etiqueta
+static void gsm_query_end(fsm_t *fsm)
+{
+    gsm_tag_next();
+}
+
+//Pulsos no PWRKEY: 2 reinicia (desliga e liga), 1 liga ou desliga
+static void gsm_pwrkey(uint8_t pulsos)
+{
+    //Modem reiniciado perde efemerides e almanaque
+    gnss_cache.modem_data = false;
+    //e a configuracao que nao fica na flash dele
+    modem_cfg_modem_reset();
+    at_health_modem_reset();
+    //Registro desconhecido e URCs desligadas ate o proximo CSCLK
+    netreg_modem_reset();
+    gsm.urc_ok = false;
+    gsm.at_estado = GSM_STATES;
+    gsm.pulsos = pulsos;
+    gsm.tentativas = 0;
+    printf(pulsos == 2 ? "\rReset Modem GSM\n" : "\rTurn ON/OFF Modem GSM\n");
+}
+
+static void gsm_pwr_pulse(fsm_t *fsm)
+{
+    power_pwrkey(true);
+    gsm.pulsos--;
+}
+
+static void gsm_pwr_settle(fsm_t *fsm)
+{
+    power_pwrkey(false);
+    fsm_arm(fsm, gsm.pulsos > 0 ? GSM_PWRKEY_OFF_MS : GSM_PWRKEY_BOOT_MS);
+}
+
+// Enlace com o modem: baud rate da NVS ou autobaud e subida com RTS/CTS.
+// Bloqueia a task: a negociacao troca o baud da UART e precisa dela so para si
+// (at_uart_lock), entao nao passa pelo motor AT. Roda so na partida do modem,
+// antes de qualquer outro comando; dura um AT (NVS) ou poucos segundos
+// (AT_LINK_SCAN x AT_LINK_PROBE_TRIES x AT_LINK_PROBE_MS e a verificacao).
+// Eventos que chegarem esperam na fila da fsm.
+static void gsm_link(fsm_t *fsm)
+{
+    int64_t t0;
+    esp_err_t ret;
+
+    if (gsm_modem_waking(fsm)) {
+        return;
+    }
+    printf("Set auto-baud rate\n");
+    if (gsm.tentativas > 0)
+        DLOG(AT_RETRY, gsm.tentativas + 1);
+    t0 = esp_timer_get_time();
+    ret = at_link_start(CONFIG_LOGQ_MODEM_BAUD_MAX, CONFIG_LOGQ_MODEM_RTS_GPIO, CONFIG_LOGQ_MODEM_CTS_GPIO);
+    // Fora do motor AT: o enlace conta na saude como um AT, com a reentrada pelo prazo como tentativa
+    at_health_record("AT\r", ret == ESP_OK ? AT_RES_OK : AT_RES_TIMEOUT,
+                     (uint32_t)((esp_timer_get_time() - t0) / 1000), gsm.tentativas > 0);
+    if (ret == ESP_OK) {
+        fsm_post(fsm, GSM_EV_OK, 0);
+        return;
+    }
+    printf("Modem sem resposta (%u)\n", gsm.tentativas);
+    gsm.tentativas++;
+    fsm_post(fsm, GSM_EV_FAIL, 0);
+}
+
+// Desativar ECHO (eco)
+static void gsm_echo(fsm_t *fsm)
+{
+    gsm.tentativas++;
+    gsm_query(fsm);
+}
+
+// Energizacao publica antes do fix; despertar do deep sleep comeca pelo GNSS.
+// A primeira consulta (GNSS_PWR ou GNSS_OFF) espera a UART do modem pelo prazo
+static void gsm_wake(fsm_t *fsm)
+{
+    fsm_stats_t st;
+
+    power_modem_wake();
+    power_window_begin();
+    if (gsm_conf.window != NULL) {
+        gsm_conf.window(false, gsm_conf.window_arg);
+    }
+    radio_cycle_begin(&gsm.plano, gsm.boot && power_wake_cause() == POWER_WAKE_BOOT, gsm.rede_ok);
+    gsm.boot = false;
+    gsm.enviar = true;
+    fsm_get_stats(fsm, &st);
+    gsm.despertares = st.wakeups;
+    gsm.at_estado = GSM_STATES;
+    fsm_post(fsm, GSM_EV_OK, 0);
+}
+
+static void gsm_gnss_start(fsm_t *fsm)
+{
+    gsm_at(gsm.gnss_cmd, AT_FINAL_OK, NULL, GSM_AT_MS);
+}
+
+//PDP que as URCs dao como perdido dispensa a consulta; ativo e conferido,
+//porque o modem pode nao avisar a queda durante o GNSS
+static void gsm_lte_kept(fsm_t *fsm)
+{
+    if (!radio_lte_keep()) {
+        fsm_post(fsm, GSM_EV_NO, 1);
+        return;
+    }
+    if (netreg_pdp() == 0 || netreg_registered() == 0) {
+        fsm_post(fsm, GSM_EV_NO, 0);
+        return;
+    }
+    gsm_at("AT+CNACT?\r", AT_FINAL_OK, "+CNACT:", GSM_AT_MS);
+}
+
+//Prazo ate a consulta de reserva: longo com as URCs ligadas
+static uint32_t gsm_check_ms(void)
+{
+    return gsm.urc_ok ? GSM_URC_CHECK_MS : RADIO_POLL_MS;
+}
+
+// Espera do registro pelas URCs; consulta ja so sem estado conhecido
+static void gsm_net(fsm_t *fsm)
+{
+    uint8_t reg = netreg_registered();
+
+    if (reg == 1) {
+        fsm_post(fsm, GSM_EV_NET, 0);
+        return;
+    }
+    // Consulta que acabou de voltar sem informar: espera o prazo
+    if (reg == NETREG_UNKNOWN && fsm->prev != GSM_NET_CHK) {
+        fsm_post(fsm, GSM_EV_NO, 0);
+        return;
+    }
+    gsm.rede_ok = false;
+    DLOG(GSM_NOSERV);
+    fsm_arm(fsm, gsm_check_ms());
+}
+
+// Subida do contexto PDP: o motor AT envia cada comando assim
+// que o anterior responde, sem esperas fixas entre eles.
+// O modem_cfg_apply() bloqueia so quando vai ao modem (uma vez por reset
+// dele; nas outras janelas o perfil vale pela geracao ou pelo hash na NVS):
+// as consultas tem respostas de varias linhas que a callback do motor AT nao
+// entrega, e os comandos de escrita tem de terminar antes do AT+CNACT.
+static void gsm_pdp(fsm_t *fsm)
+{
+    void *tag;
+
+    pdp_t0 = esp_timer_get_time();
+    if(modem_cfg_apply(&pdp_cfg) != ESP_OK)
+        printf("Perfil do PDP incompleto\n");
+    tag = gsm_at_begin();
+    for (int i = 0; i < PDP_SEQ_LEN; i++) {
+        if (at_cmd_submit(pdp_seq[i].cmd, pdp_seq[i].final, pdp_seq[i].prefix, pdp_seq[i].timeout_ms,
+                          gsm_pdp_step, (i == PDP_SEQ_LEN - 1) ? tag : NULL) != ESP_OK && i == PDP_SEQ_LEN - 1) {
+            fsm_post(fsm, GSM_EV_FAIL, 0);
+        }
+    }
+}
+
+// PDP ativo e registro: o "+APP PDP" da subida ja passou pelo netreg
+static void gsm_reg(fsm_t *fsm)
+{
+    netreg_t nr;
+
+    if (netreg_pdp() == 1 && netreg_registered() != 0) {
+        fsm_post(fsm, GSM_EV_NET, 0);
+        return;
+    }
+    netreg_get(&nr);
+    DLOG(GSM_REG_WAIT, nr.eps);
+    fsm_arm(fsm, gsm_check_ms());
+}
+
+// Sessao MQTT configurada uma vez e mantida; esvazia o log em lotes.
+// Bloqueia a task ate o fim do esvaziamento: cada lote so e confirmado no
+// tlog depois do OK do AT+SMPUB, com os payloads do lote seguinte montados
+// nas mesmas areas, e nada mais usa o modem nesse trecho. Alerta que chegar
+// fica na fila da fsm e volta ao PUBLISH (gsm_pub_again); o resto da janela
+// (CELL, XTRA) nao depende do tempo da publicacao.
+static void gsm_publish(fsm_t *fsm)
+{
+    if (gsm_modem_waking(fsm)) {
+        return;
+    }
+    gsm.pub_ok = (mqtt_pub_connect() == ESP_OK);
+    if(gsm.pub_ok)
+    {
+        size_t enviados = 0;
+        mqtt_pub_stats_t mst;
+        esp_err_t dret = mqtt_pub_drain(gsm_conf.log, &enviados);
+        mqtt_pub_get_stats(&mst);
+        printf("MQTT: %u registros enviados (%s), %u publicacoes no total\n", enviados,
+               dret == ESP_OK ? "log vazio" : "interrompido", mst.publishes);
+        if(mst.records > 0 && mst.publish_ms > 0)
+        {
+            printf("MQTT: %u reg/s, conexao %u ms (%u ms/registro)\n", mst.records * 1000 / mst.publish_ms,
+                   mst.connect_ms, mst.connect_ms / mst.records);
+        }
+    }
+    else
+        printf("Falha ao conectar ao broker\n");
+    fsm_post(fsm, GSM_EV_OK, 0);
+}
+
+// Assistencia do GNSS vencida: baixa com a rede ja ativa
+static void gsm_xtra(fsm_t *fsm)
+{
+    void *tag;
+
+    if(!gsm.rede_ok || !gnss_cache_xtra_due(&gnss_cache, (uint32_t)time(NULL)))
+    {
+        fsm_post(fsm, GSM_EV_OK, 0);
+        return;
+    }
+    tag = gsm_at_begin();
+    xtra_falhou = false;
+    for (int i = 0; i < XTRA_SEQ_LEN; i++) {
+        if (at_cmd_submit(xtra_seq[i].cmd, xtra_seq[i].final, xtra_seq[i].prefix, xtra_seq[i].timeout_ms,
+                          gsm_xtra_step, (i == XTRA_SEQ_LEN - 1) ? tag : NULL) != ESP_OK) {
+            xtra_falhou = true;
+            if (i == XTRA_SEQ_LEN - 1)
+                fsm_post(fsm, GSM_EV_FAIL, 0);
+        }
+    }
+}
+
+// Fim da janela: mede o ciclo e o modem dorme ate a proxima
+static void gsm_end(fsm_t *fsm)
+{
+    fsm_stats_t st;
+    uint64_t up_ms = (uint64_t)(esp_timer_get_time() / 1000);
+
+    gnss_cache_save(&gnss_cache, &gnss_ttff);
+    radio_cycle_end(NULL);
+    // Saude do modem na janela: console e registro para o proximo lote
+    at_health_print();
+    if(at_health_to_telem(&gsm.saude, (uint32_t)time(NULL)) == ESP_OK && gsm_conf.log != NULL &&
+       tlog_append(gsm_conf.log, TELEM_TYPE_AT, &gsm.saude, sizeof(gsm.saude)) != ESP_OK)
+        printf("Falha ao gravar saude do modem\n");
+    // Despertares da task: so resposta do modem, alerta ou prazo
+    fsm_get_stats(fsm, &st);
+    printf("| GSM FSM | Despertares %u na janela | %u/h desde o boot | Eventos %u | Sem linha %u | Prazos %u | Descartados %u\n",
+           st.wakeups - gsm.despertares, (uint32_t)(st.wakeups * 3600000ULL / (up_ms ? up_ms : 1)),
+           st.events, st.unhandled, st.timeouts, st.dropped);
+    printf("| Relatorio | Modo %s | Fixes %u | Publicados %u | Adiados %u | Rajadas %u | Cerca %u\n",
+           report_mode_name(relatorio.mode), relatorio.stats.fixes, relatorio.stats.sent,
+           relatorio.stats.deferred, relatorio.stats.bursts, relatorio.stats.fences);
+    // Erros na UART desde a ultima janela derrubam um degrau do baud rate
+    // (bloqueia como o gsm_link, so quando ha erros; o motor AT esta parado aqui)
+    if(at_link_check() != ESP_OK)
+        printf("Link: modem perdido\n");
+    // Proxima janela pela politica: parado, em movimento ou rajada
+    if(GSM_REPORT_ADAPTIVE)
+        power_set_next_window(report_next_s(&relatorio, (uint32_t)time(NULL)));
+    power_window_end(NULL);
+    // Log diferido e estatisticas de execucao da janela (power_window_end fecha o periodo do rtstats)
+    if(gsm_conf.window != NULL)
+        gsm_conf.window(true, gsm_conf.window_arg);
+    if(power_deep_sleep_ok())
+        power_deep_sleep(gsm_conf.log);
+    power_modem_sleep();
+    fsm_post(fsm, GSM_EV_OK, 0);
+}
+
+// Entre janelas o sistema fica em light sleep; so o prazo da janela fica armado
+static void gsm_idle(fsm_t *fsm)
+{
+    uint32_t ms;
+
+    power_modem_sleep();
+    ms = power_next_window_ms();
+    fsm_arm(fsm, ms > 0 ? ms : 1);
+    // Alerta que chegou enquanto a janela fechava
+    if(mqtt_pub_urgent_pending())
+        fsm_post(fsm, GSM_EV_URGENT, 0);
+}
+
+//---------------------------------------------------------------- Acoes e guardas
+
+//Resposta do motor AT vira o evento do parser da consulta do estado
+static void gsm_on_at(fsm_t *fsm)
+{
+    const gsm_query_t *q = &gsm_queries[fsm_state(fsm)];
+    at_result_t res = (at_result_t)(fsm->arg & 0xF);
+    at_line_t *m;
+
+    if ((fsm->arg >> 4) != gsm.at_tag) {
+        return;
+    }
+    // Fica a ultima linha entregue (a da consulta, pelo prefixo)
+    while ((m = gsm_msg_take(gsm.resp)) != gsm.resp) {
+        gsm.resp = m;
+    }
+    if (q->parse != NULL) {
+        fsm_post(fsm, q->parse(res, gsm.resp->txt), 0);
+    } else {
+        fsm_post(fsm, res == AT_RES_OK ? GSM_EV_OK : GSM_EV_FAIL, 0);
+    }
+}
+
+//Consulta que ainda nao deu o resultado: o prazo reentra no estado
+static void gsm_poll_later(fsm_t *fsm)
+{
+    fsm_arm(fsm, RADIO_POLL_MS);
+}
+
+static bool gsm_more_pulses(fsm_t *fsm)
+{
+    return gsm.pulsos > 0;
+}
+
+static void gsm_toggle(fsm_t *fsm)
+{
+    gsm_pwrkey(1);
+}
+
+static bool gsm_link_reset(fsm_t *fsm)
+{
+    return gsm.tentativas % AT_LINK_RESET_TRIES == 0;
+}
+
+static void gsm_link_retry(fsm_t *fsm)
+{
+    fsm_arm(fsm, GSM_LINK_RETRY_MS);
+}
+
+static void gsm_link_ok(fsm_t *fsm)
+{
+    printf("Baud rate configurado.\n");
+    printf("Escrita ECHO\n");
+    gsm.tentativas = 0;
+}
+
+static bool gsm_echo_reset(fsm_t *fsm)
+{
+    return gsm.tentativas >= GSM_ECHO_RESET;
+}
+
+static bool gsm_gnss_first(fsm_t *fsm)
+{
+    return gsm.plano.gnss_first;
+}
+
+// Partida pelo cache: hot/warm aproveitam o que o modem ainda tem
+static void gsm_gnss_begin(fsm_t *fsm)
+{
+    gnss_start_t modo = gnss_sess_begin(&gsm.sess, &gsm_conf.gnss, &gnss_cache, (uint32_t)time(NULL),
+                                        (uint32_t)(esp_timer_get_time() / 1000));
+    gsm.sess.cfg.timeout_s = radio_gnss_budget(modo == GNSS_START_HOT, gsm_conf.gnss.timeout_s);
+    printf("GNSS: partida %s, prazo %u s\n", gnss_sess_mode_name(modo), gsm.sess.cfg.timeout_s);
+    gsm.gnss_cmd = gnss_sess_start_cmd(modo);
+}
+
+static void gsm_gnss_on(fsm_t *fsm)
+{
+    power_gnss(true);
+    radio_set(RADIO_GNSS);
+}
+
+// Melhor fix da sessao (no timeout, o de menor HDOP)
+static void gsm_gnss_done(fsm_t *fsm)
+{
+    gnss_fix_t *fixGPS = &gsm.fix;
+
+    if(!gsm.sess.best_ok)
+    {
+        printf("GNSS: sem fix em %u s\n", gsm.sess.cfg.timeout_s);
+    }
+    else
+    {
+        telem_fix_t regGPS;
+        *fixGPS = gsm.sess.best;
+        printf("GNSS: %s, TTFF %u ms, %u consultas%s\n", gnss_sess_mode_name(gsm.sess.mode), gsm.sess.ttff_ms,
+               gsm.sess.polls, gsm.gres == GNSS_SESS_TIMEOUT ? ", fora do criterio" : "");
+        time_t utc = (time_t)fixGPS->utc;
+        struct tm tmGPS;
+        gmtime_r(&utc, &tmGPS);
+        // Linhas de Teste
+        printf("Dados: \n");
+        printf("Hora, Dia, Mes, Ano \n %02d%02d%02d %02d/%02d/%04d \n", tmGPS.tm_hour, tmGPS.tm_min, tmGPS.tm_sec,
+               tmGPS.tm_mday, tmGPS.tm_mon + 1, tmGPS.tm_year + 1900);
+        printf("Latitude: %s%d.%06d \n", fixGPS->lat_e6 < 0 ? "-" : "", abs(fixGPS->lat_e6) / 1000000, abs(fixGPS->lat_e6) % 1000000);
+        printf("Longitude: %s%d.%06d \n", fixGPS->lon_e6 < 0 ? "-" : "", abs(fixGPS->lon_e6) / 1000000, abs(fixGPS->lon_e6) % 1000000);
+        printf("Alt %d cm, Vel %u, Curso %u, HDOP %u, Sats %u\n", fixGPS->alt_cm, fixGPS->speed_kmh_x100,
+               fixGPS->course_x100, fixGPS->hdop_x100, fixGPS->sats_view);
+        // Guarda na flash ate o broker confirmar o envio
+        telem_fix_from_gnss(&regGPS, fixGPS);
+#ifdef ESP_PLATFORM
+        // No host o relogio e o do sistema
+        struct timeval tvGPS = { .tv_sec = utc };
+        settimeofday(&tvGPS, NULL);
+#endif
+        if(gsm_conf.log != NULL && tlog_append(gsm_conf.log, TELEM_TYPE_FIX, &regGPS, sizeof(regGPS)) != ESP_OK)
+        {
+            printf("Falha ao gravar registro\n");
+        }
+        gnss_cache_store(&gnss_cache, fixGPS);
+    }
+    if(gnss_cache_save(&gnss_cache, &gnss_ttff) != ESP_OK)
+        printf("Falha ao gravar o cache do GNSS\n");
+    gnss_ttff_print(&gnss_ttff);
+    // Politica de relatorio: o fix fica no tlog de qualquer forma, a janela so publica se pedido
+    uint32_t agora = (uint32_t)time(NULL);
+    gsm.enviar = report_fix(&relatorio, gsm.sess.best_ok ? fixGPS : NULL, agora) || !GSM_REPORT_ADAPTIVE;
+    DLOG(REPORT_PLAN, relatorio.mode, gsm.enviar, report_next_s(&relatorio, agora), relatorio.dist_m);
+}
+
+static void gsm_gnss_lost(fsm_t *fsm)
+{
+    printf("GNSS: modem sem resposta, sessao encerrada\n");
+}
+
+// Desligamento do GPS para trabalhar com LTE
+static void gsm_lte_switch(fsm_t *fsm)
+{
+    size_t preparados;
+
+    power_gnss(false);
+    radio_set(RADIO_SWITCH);
+    // Enquanto o radio troca para o LTE, le e codifica o lote do tlog
+    preparados = mqtt_pub_prepare(gsm_conf.log);
+    radio_note_prepared(preparados);
+}
+
+static void gsm_kept(fsm_t *fsm)
+{
+    radio_note_kept(true);
+    printf("LTE mantido durante o GNSS\n");
+    radio_set(RADIO_DATA);
+}
+
+//PDP perdido (consultado) ou GNSS longo (argumento 1): refaz o registro
+static void gsm_lost(fsm_t *fsm)
+{
+    if (fsm->arg == 0) {
+        radio_note_kept(false);
+        gsm.rede_ok = false;
+    }
+}
+
+static void gsm_attach(fsm_t *fsm)
+{
+    radio_set(RADIO_ATTACH);
+}
+
+// URCs de registro no modem recem-ligado (perfil; no modem mantido, so o hash)
+static void gsm_urc_on(fsm_t *fsm)
+{
+    gsm.urc_ok = (netreg_enable() == ESP_OK);
+    if(!gsm.urc_ok)
+        printf("GSM: URCs de registro indisponiveis, consultando a cada %u ms\n", RADIO_POLL_MS);
+}
+
+static bool gsm_net_up(fsm_t *fsm)
+{
+    return netreg_registered() == 1;
+}
+
+// Bandas so mudam pelo proprio firmware: conferidas uma vez
+static bool gsm_net_up_bands(fsm_t *fsm)
+{
+    return gsm.bandas_ok && netreg_registered() == 1;
+}
+
+static bool gsm_net_down(fsm_t *fsm)
+{
+    return netreg_registered() == 0;
+}
+
+static bool gsm_data_up(fsm_t *fsm)
+{
+    return netreg_pdp() == 1 && netreg_registered() != 0;
+}
+
+static bool gsm_pdp_down(fsm_t *fsm)
+{
+    return netreg_pdp() == 0;
+}
+
+static void gsm_registered(fsm_t *fsm)
+{
+    netreg_t nr;
+
+    netreg_get(&nr);
+    DLOG(GSM_REG, nr.eps);
+    gsm.rede_ok = true;
+    radio_set(RADIO_DATA);
+}
+
+static void gsm_no_net(fsm_t *fsm)
+{
+    printf("GSM: sem rede em %u s, janela encerrada\n", GSM_LTE_MS / 1000);
+    report_link(&relatorio, false, REPORT_RSRP_NONE);
+}
+
+//Fix so no tlog: sem alerta pendente o radio nem troca para o LTE
+static bool gsm_no_pub(fsm_t *fsm)
+{
+    return !gsm.enviar && !mqtt_pub_urgent_pending();
+}
+
+static void gsm_skip_pub(fsm_t *fsm)
+{
+    power_gnss(false);
+    radio_set(RADIO_IDLE);
+    printf("Relatorio: %s, fix guardado para o proximo lote\n", report_mode_name(relatorio.mode));
+}
+
+// Movimento ou evento da IMU (argumento 1); saindo de parado a proxima janela vem antes
+static void gsm_moved(fsm_t *fsm)
+{
+    uint32_t agora = (uint32_t)time(NULL);
+    bool antecipa = fsm->arg ? report_event(&relatorio, agora) : report_motion(&relatorio, agora);
+    uint32_t prox = report_next_s(&relatorio, agora);
+
+    if(GSM_REPORT_ADAPTIVE && antecipa && (uint64_t)prox * 1000 < power_next_window_ms())
+        power_set_next_window(prox);
+}
+
+static bool gsm_urgent_pending(fsm_t *fsm)
+{
+    return mqtt_pub_urgent_pending();
+}
+
+//Alerta de evento passa na frente do ciclo; a publicacao volta ao estado interrompido.
+//Modem vindo do IDLE: o PUBLISH espera a UART pelo prazo
+static void gsm_alert_begin(fsm_t *fsm)
+{
+    power_modem_wake();
+    gsm.alerta = true;
+}
+
+//Alerta que chegou durante a publicacao: publica de novo
+static bool gsm_pub_again(fsm_t *fsm)
+{
+    return gsm.pub_ok && mqtt_pub_urgent_pending();
+}
+
+static bool gsm_alert_back(fsm_t *fsm)
+{
+    return gsm.alerta;
+}
+
+static void gsm_alert_end(fsm_t *fsm)
+{
+    gsm.alerta = false;
+}
+
+static bool gsm_window_due(fsm_t *fsm)
+{
+    return power_next_window_ms() == 0;
+}
+
+//---------------------------------------------------------------- Tabelas
+
+static const fsm_state_t gsm_states[GSM_STATES] = {
+    [GSM_ROOT]         = {"ROOT",         FSM_NONE,  0,                   NULL,            NULL},
+    [GSM_BOOT]         = {"BOOT",         GSM_ROOT,  0,                   NULL,            NULL},
+    [GSM_PWR_PULSE]    = {"PWR_PULSE",    GSM_BOOT,  GSM_PWRKEY_PULSE_MS, gsm_pwr_pulse,   NULL},
+    [GSM_PWR_SETTLE]   = {"PWR_SETTLE",   GSM_BOOT,  0,                   gsm_pwr_settle,  NULL},
+    [GSM_LINK]         = {"LINK",         GSM_BOOT,  0,                   gsm_link,        NULL},
+    [GSM_ECHO]         = {"ECHO",         GSM_BOOT,  0,                   gsm_echo,        gsm_query_end},
+    [GSM_CSCLK]        = {"CSCLK",        GSM_BOOT,  0,                   gsm_query,       gsm_query_end},
+    [GSM_WAKE]         = {"WAKE",         GSM_ROOT,  0,                   gsm_wake,        NULL},
+    [GSM_GNSS]         = {"GNSS",         GSM_ROOT,  GSM_GNSS_MS,         NULL,            NULL},
+    [GSM_GNSS_PWR]     = {"GNSS_PWR",     GSM_GNSS,  0,                   gsm_query,       gsm_query_end},
+    [GSM_GNSS_ON]      = {"GNSS_ON",      GSM_GNSS,  0,                   gsm_query,       gsm_query_end},
+    [GSM_GNSS_START]   = {"GNSS_START",   GSM_GNSS,  0,                   gsm_gnss_start,  gsm_query_end},
+    [GSM_GNSS_FIX]     = {"GNSS_FIX",     GSM_GNSS,  0,                   gsm_query,       gsm_query_end},
+    [GSM_LTE]          = {"LTE",          GSM_ROOT,  GSM_LTE_MS,          NULL,            NULL},
+    [GSM_GNSS_OFF]     = {"GNSS_OFF",     GSM_LTE,   0,                   gsm_query,       gsm_query_end},
+    [GSM_GNSS_OFF_CHK] = {"GNSS_OFF_CHK", GSM_LTE,   0,                   gsm_query,       gsm_query_end},
+    [GSM_LTE_KEPT]     = {"LTE_KEPT",     GSM_LTE,   0,                   gsm_lte_kept,    gsm_query_end},
+    [GSM_NET]          = {"NET",          GSM_LTE,   0,                   gsm_net,         NULL},
+    [GSM_BANDS]        = {"BANDS",        GSM_LTE,   0,                   gsm_query,       gsm_query_end},
+    [GSM_PDP]          = {"PDP",          GSM_LTE,   0,                   gsm_pdp,         gsm_query_end},
+    [GSM_REG]          = {"REG",          GSM_LTE,   0,                   gsm_reg,         NULL},
+    [GSM_NET_CHK]      = {"NET_CHK",      GSM_LTE,   0,                   gsm_query,       gsm_query_end},
+    [GSM_PDP_CHK]      = {"PDP_CHK",      GSM_LTE,   0,                   gsm_query,       gsm_query_end},
+    [GSM_DATA]         = {"DATA",         GSM_ROOT,  0,                   NULL,            NULL},
+    [GSM_PUBLISH]      = {"PUBLISH",      GSM_DATA,  0,                   gsm_publish,     NULL},
+    [GSM_CELL]         = {"CELL",         GSM_DATA,  0,                   gsm_query,       gsm_query_end},
+    [GSM_XTRA]         = {"XTRA",         GSM_DATA,  0,                   gsm_xtra,        gsm_query_end},
+    [GSM_END]          = {"END",          GSM_ROOT,  0,                   gsm_end,         NULL},
+    [GSM_IDLE]         = {"IDLE",         GSM_ROOT,  0,                   gsm_idle,        NULL},
+};
+
+//Procuradas da folha para a raiz; no mesmo estado, a primeira guarda aceita
+static const fsm_trans_t gsm_trans[] = {
+    //Partida: PWRKEY, enlace, eco, sleep por DTR e URCs de registro
+    {GSM_PWR_PULSE,    FSM_EV_TIMEOUT, NULL,               NULL,            GSM_PWR_SETTLE},
+    {GSM_PWR_SETTLE,   FSM_EV_TIMEOUT, gsm_more_pulses,    NULL,            GSM_PWR_PULSE},
+    {GSM_PWR_SETTLE,   FSM_EV_TIMEOUT, NULL,               NULL,            GSM_LINK},
+    {GSM_LINK,         GSM_EV_OK,      NULL,               gsm_link_ok,     GSM_ECHO},
+    {GSM_LINK,         GSM_EV_FAIL,    gsm_link_reset,     gsm_toggle,      GSM_PWR_PULSE},
+    {GSM_LINK,         GSM_EV_FAIL,    NULL,               gsm_link_retry,  FSM_SAME},
+    {GSM_ECHO,         GSM_EV_OK,      NULL,               NULL,            GSM_CSCLK},
+    {GSM_ECHO,         GSM_EV_FAIL,    gsm_echo_reset,     gsm_toggle,      GSM_PWR_PULSE},
+    {GSM_CSCLK,        GSM_EV_OK,      NULL,               gsm_urc_on,      GSM_WAKE},
+
+    //Inicio da janela
+    {GSM_WAKE,         GSM_EV_OK,      gsm_gnss_first,     NULL,            GSM_GNSS_PWR},
+    {GSM_WAKE,         GSM_EV_OK,      NULL,               NULL,            GSM_GNSS_OFF},
+
+    //GNSS
+    {GSM_GNSS_PWR,     GSM_EV_NO,      NULL,               NULL,            GSM_GNSS_ON},
+    {GSM_GNSS_PWR,     GSM_EV_OK,      NULL,               gsm_gnss_begin,  GSM_GNSS_START},
+    {GSM_GNSS_ON,      GSM_EV_OK,      NULL,               NULL,            GSM_GNSS_PWR},
+    {GSM_GNSS_START,   GSM_EV_OK,      NULL,               gsm_gnss_on,     GSM_GNSS_FIX},
+    {GSM_GNSS_FIX,     GSM_EV_OK,      NULL,               gsm_gnss_done,   GSM_GNSS_OFF},
+    {GSM_GNSS,         FSM_EV_TIMEOUT, NULL,               gsm_gnss_lost,   GSM_GNSS_OFF},
+    // GNSS e LTE nao operam juntos: alerta desliga o GPS e busca a rede
+    {GSM_GNSS,         GSM_EV_URGENT,  gsm_urgent_pending, NULL,            GSM_GNSS_OFF},
+
+    //LTE: troca do radio, registro e PDP
+    {GSM_GNSS_OFF,     GSM_EV_OK,      gsm_no_pub,         gsm_skip_pub,    GSM_END},
+    {GSM_GNSS_OFF,     GSM_EV_OK,      NULL,               gsm_lte_switch,  GSM_LTE_KEPT},
+    {GSM_GNSS_OFF,     GSM_EV_FAIL,    NULL,               NULL,            GSM_GNSS_OFF_CHK},
+    {GSM_GNSS_OFF_CHK, GSM_EV_OK,      gsm_no_pub,         gsm_skip_pub,    GSM_END},
+    {GSM_GNSS_OFF_CHK, GSM_EV_OK,      NULL,               gsm_lte_switch,  GSM_LTE_KEPT},
+    {GSM_GNSS_OFF_CHK, FSM_EV_TIMEOUT, NULL,               NULL,            GSM_GNSS_OFF},
+    {GSM_LTE_KEPT,     GSM_EV_OK,      NULL,               gsm_kept,        GSM_PUBLISH},
+    {GSM_LTE_KEPT,     GSM_EV_NO,      NULL,               gsm_lost,        GSM_NET},
+    {GSM_LTE_KEPT,     GSM_EV_FAIL,    NULL,               gsm_lost,        GSM_NET},
+    {GSM_NET,          GSM_EV_NET,     gsm_net_up_bands,   gsm_attach,      GSM_PDP},
+    {GSM_NET,          GSM_EV_NET,     gsm_net_up,         gsm_attach,      GSM_BANDS},
+    {GSM_NET,          GSM_EV_NO,      NULL,               NULL,            GSM_NET_CHK},
+    {GSM_NET,          FSM_EV_TIMEOUT, NULL,               NULL,            GSM_NET_CHK},
+    {GSM_BANDS,        GSM_EV_OK,      NULL,               NULL,            GSM_PDP},
+    {GSM_BANDS,        FSM_EV_TIMEOUT, NULL,               NULL,            GSM_NET},
+    {GSM_PDP,          GSM_EV_OK,      NULL,               NULL,            GSM_REG},
+    {GSM_REG,          GSM_EV_NET,     gsm_data_up,        gsm_registered,  GSM_PUBLISH},
+    {GSM_REG,          GSM_EV_NET,     gsm_net_down,       NULL,            GSM_NET},
+    {GSM_REG,          FSM_EV_TIMEOUT, gsm_pdp_down,       NULL,            GSM_PDP},
+    {GSM_REG,          FSM_EV_TIMEOUT, NULL,               NULL,            GSM_PDP_CHK},
+    // Consultas de reserva: o modelo e alimentado pela resposta, o estado confere de novo
+    {GSM_NET_CHK,      GSM_EV_OK,      NULL,               NULL,            FSM_BACK},
+    {GSM_PDP_CHK,      GSM_EV_OK,      NULL,               NULL,            FSM_BACK},
+    {GSM_LTE,          FSM_EV_TIMEOUT, NULL,               gsm_no_net,      GSM_END},
+
+    //Dados: publicacao, celula, XTRA
+    {GSM_PUBLISH,      GSM_EV_OK,      gsm_pub_again,      NULL,            GSM_PUBLISH},
+    {GSM_PUBLISH,      GSM_EV_OK,      gsm_alert_back,     gsm_alert_end,   FSM_BACK},
+    {GSM_PUBLISH,      GSM_EV_OK,      NULL,               NULL,            GSM_CELL},
+    {GSM_PUBLISH,      GSM_EV_URGENT,  NULL,               NULL,            FSM_SAME},
+    {GSM_CELL,         GSM_EV_OK,      NULL,               NULL,            GSM_XTRA},
+    {GSM_XTRA,         GSM_EV_OK,      NULL,               NULL,            GSM_END},
+    {GSM_XTRA,         GSM_EV_FAIL,    NULL,               NULL,            GSM_END},
+    // Download do XTRA em andamento: o alerta sai no IDLE, logo depois
+    {GSM_XTRA,         GSM_EV_URGENT,  NULL,               NULL,            FSM_SAME},
+    {GSM_DATA,         GSM_EV_URGENT,  gsm_urgent_pending, gsm_alert_begin, GSM_PUBLISH},
+
+    //Entre janelas
+    {GSM_END,          GSM_EV_OK,      NULL,               NULL,            GSM_IDLE},
+    {GSM_IDLE,         FSM_EV_TIMEOUT, gsm_window_due,     NULL,            GSM_WAKE},
+    {GSM_IDLE,         FSM_EV_TIMEOUT, NULL,               NULL,            FSM_SELF},
+    {GSM_IDLE,         GSM_EV_URGENT,  gsm_urgent_pending, gsm_alert_begin, GSM_PUBLISH},
+    {GSM_IDLE,         GSM_EV_MOTION,  NULL,               gsm_moved,       FSM_SELF},
+
+    //Raiz: respostas do motor AT, nova tentativa no prazo, URCs fora da espera
+    {GSM_ROOT,         GSM_EV_AT,      NULL,               gsm_on_at,       FSM_SAME},
+    {GSM_ROOT,         GSM_EV_NO,      NULL,               gsm_poll_later,  FSM_SAME},
+    {GSM_ROOT,         GSM_EV_FAIL,    NULL,               gsm_poll_later,  FSM_SAME},
+    {GSM_ROOT,         FSM_EV_TIMEOUT, NULL,               NULL,            FSM_SELF},
+    {GSM_ROOT,         GSM_EV_URGENT,  NULL,               NULL,            FSM_SAME},
+    {GSM_ROOT,         GSM_EV_NET,     NULL,               NULL,            FSM_SAME},
+    {GSM_ROOT,         GSM_EV_MOTION,  NULL,               gsm_moved,       FSM_SAME},
+};
+
+static void gsm_trace(const fsm_t *fsm, uint8_t from, uint8_t to)
+{
+    DLOG(GSM_STATE, from, to, fsm->ev);
+}
+
+static void gsm_urgent(void *arg)
+{
+    fsm_post(&gsm_fsm, GSM_EV_URGENT, 0);
+}
+
+//Chamada pela task leitora da UART
+static void gsm_net_changed(void *arg)
+{
+    fsm_post(&gsm_fsm, GSM_EV_NET, 0);
+}
+
+//Chamada pela task da IMU, que parte antes do GSM_C: antes disso vale o despertar
+void gsm_motion(bool evento)
+{
+    if (gsm_pronto) {
+        fsm_post(&gsm_fsm, GSM_EV_MOTION, evento);
+    }
+}
+
+esp_err_t gsm_init(const gsm_cfg_t *cfg)
+{
+    gsm_conf = *cfg;
+    gsm_msg_init();
+    if(gnss_cache_load(&gnss_cache, &gnss_ttff) == ESP_OK && gnss_cache.fix_utc != 0)
+        printf("Ultimo fix: %d, %d (utc %u)\n", gnss_cache.lat_e6, gnss_cache.lon_e6, gnss_cache.fix_utc);
+
+    DLOG(GSM_BOOT, power_wake_cause(), power_modem_kept());
+    gsm.bandas_ok = power_modem_kept();
+    gsm.boot = true;
+    gsm.resp = &gsm_msg_vazia;
+    // Politica de relatorio: a do deep sleep continua; o despertar pela IMU e movimento
+    if(power_wake_cause() == POWER_WAKE_BOOT)
+        report_init(&relatorio, &gsm_conf.report, (uint32_t)time(NULL));
+    else if(power_wake_cause() == POWER_WAKE_MOTION)
+        report_motion(&relatorio, (uint32_t)time(NULL));
+    fsm_init(&gsm_fsm, "GSM", gsm_states, GSM_STATES, gsm_trans, sizeof(gsm_trans) / sizeof(gsm_trans[0]), &gsm);
+    gsm_fsm.trace = gsm_trace;
+    gsm_pronto = true;
+    mqtt_pub_on_urgent(gsm_urgent, NULL);
+    netreg_on_change(gsm_net_changed, NULL);
+
+    // Modem que dormiu durante o deep sleep segue ligado e configurado
+    if(power_modem_kept())
+    {
+        power_modem_wake();
+        fsm_start(&gsm_fsm, GSM_LINK, (uint32_t)(esp_timer_get_time() / 1000));
+    }
+    else
+    {
+        gsm_pwrkey(2);
+        fsm_start(&gsm_fsm, GSM_PWR_PULSE, (uint32_t)(esp_timer_get_time() / 1000));
+    }
+    return ESP_OK;
+}
+
+fsm_t *gsm_machine(void)
+{
+    return &gsm_fsm;
+}
+
+uint32_t gsm_msg_dropped(void)
+{
+    return gsm_msg_drop;
+}
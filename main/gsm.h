@@ -0,0 +1,63 @@
+/* GSM_C: ciclo do modem em cada janela de relatorio
+
+   Partida do modem, sessao de GNSS, troca para o LTE, publicacao do log de
+   telemetria, celula e XTRA, dirigidos pela maquina de estados de gsm.c
+   (tabelas do fsm.h). O modulo nao chama o ESP-IDF diretamente: o modem
+   vai pelo at_cmd, at_link, modem_cfg, netreg e mqtt_pub, a energia e o
+   PWRKEY pelo power e o armazenamento pelo tlog e pelo cache do gnss_sess.
+   Assim o tools/modem_host.c monta as mesmas tabelas no host, com corpos
+   proprios para esses modulos, contra o simulador do SIM7070.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "fsm.h"
+#include "tlog.h"
+#include "gnss_sess.h"
+#include "report.h"
+
+#ifdef CONFIG_LOGQ_GSM_MSG_SLOTS
+#define GSM_MSG_SLOTS       CONFIG_LOGQ_GSM_MSG_SLOTS
+#else
+#define GSM_MSG_SLOTS       4       //Respostas do motor AT para o GSM_C (uma fica com o GSM_C)
+#endif
+
+typedef struct {
+    tlog_t *log;                //Log de telemetria aberto (NULL: sem log)
+    gnss_sess_cfg_t gnss;       //Criterio de parada da sessao de GNSS
+    report_cfg_t report;        //Politica de relatorio (so na energizacao; o deep sleep mantem a anterior)
+    void (*window)(bool end, void *arg);    //Inicio e fim de cada janela, na task do GSM_C
+    void *window_arg;
+} gsm_cfg_t;
+
+/**
+ * @brief   Monta a maquina do GSM_C e a inicia: modem mantido no deep sleep
+ *          segue pelo enlace, senao e reiniciado pelo PWRKEY.
+ *
+ * Requer at_cmd_init(), netreg_init(), modem_cfg_init(), mqtt_pub_init() e
+ * power_init() ja executados. Carrega o cache do GNSS e registra os avisos
+ * do mqtt_pub (alertas) e do netreg (rede).
+ *
+ * @return  ESP_OK
+ */
+esp_err_t gsm_init(const gsm_cfg_t *cfg);
+
+/**
+ * @brief   Maquina do GSM_C, para fsm_run() na task do modem (ou
+ *          fsm_poll() no host).
+ */
+fsm_t *gsm_machine(void);
+
+/**
+ * @brief   Movimento (false) ou evento (true) da IMU, para a politica de
+ *          relatorio. Sem efeito antes do gsm_init().
+ */
+void gsm_motion(bool evento);
+
+/**
+ * @brief   Respostas do motor AT descartadas por falta de slot livre.
+ */
+uint32_t gsm_msg_dropped(void);
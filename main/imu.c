@@ -0,0 +1,390 @@
+/* Aquisicao do acelerometro/giroscopio (MPU6050 / ICM-20602) por FIFO
+
+   A task espera a notificacao da ISR do pino INT (watermark ou movimento)
+   com timeout de IMU_BURST_MS; no MPU6050 o proprio timeout faz a leitura
+   periodica. A
+   cada despertar le FIFO_COUNT e esvazia a FIFO em blocos de ate
+   IMU_CHUNK_FRAMES quadros por transacao I2C.
+*/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "string.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "ring.h"
+#include "imu.h"
+
+//Registros comuns ao MPU6050 e ao ICM-20602
+#define REG_SMPLRT_DIV      0x19
+#define REG_CONFIG          0x1A
+#define REG_GYRO_CONFIG     0x1B
+#define REG_ACCEL_CONFIG    0x1C
+#define REG_ACCEL_CONFIG2   0x1D    //So ICM-20602
+#define REG_FIFO_WM_TH1     0x60    //So ICM-20602
+#define REG_FIFO_WM_TH2     0x61
+#define REG_MOT_THR         0x1F    //So MPU6050
+#define REG_MOT_DUR         0x20
+#define REG_WOM_X_THR       0x20    //So ICM-20602 (Y e Z nos dois seguintes)
+#define REG_FIFO_EN         0x23
+#define REG_INT_PIN_CFG     0x37
+#define REG_INT_ENABLE      0x38
+#define REG_INT_STATUS      0x3A
+#define REG_ACCEL_INTEL     0x69    //So ICM-20602
+#define REG_USER_CTRL       0x6A
+#define REG_PWR_MGMT_1      0x6B
+#define REG_PWR_MGMT_2      0x6C
+#define REG_FIFO_COUNTH     0x72
+#define REG_FIFO_R_W        0x74
+#define REG_WHO_AM_I        0x75
+
+#define WHO_MPU6050         0x68
+#define WHO_ICM20602        0x12
+
+#define INT_FIFO_OFLOW      0x10
+#define INT_MOT_MPU         0x40
+#define INT_WOM_ICM         0xE0
+#define USER_FIFO_EN        0x40
+#define USER_FIFO_RESET     0x04
+#define INT_LATCH           0x20    //INT_PIN_CFG: nivel mantido ate ler INT_STATUS
+#define PWR_CYCLE           0x20
+#define PWR_TEMP_DIS        0x08
+#define PWR2_GYRO_STBY      0x07
+
+#define IMU_CHUNK_FRAMES    16
+#define IMU_FRAME_MAX       14      //ICM-20602 grava a temperatura junto
+#define IMU_I2C_TIMEOUT     pdMS_TO_TICKS(20)
+#define IMU_PERIOD_US       (1000000 / IMU_RATE_HZ)
+
+static ring_t imu_ring;
+static imu_sample_t imu_ring_buf[IMU_RING_LEN];
+static TaskHandle_t imu_task_handle;
+static imu_stats_t imu_stats;
+static TaskHandle_t imu_consumer;
+static uint8_t imu_frame;           //Bytes por amostra na FIFO
+static uint8_t imu_motion_mask;     //Bits de movimento no INT_STATUS
+static bool imu_has_watermark;
+static volatile bool imu_parked;    //imu_sleep(): a task para de ler o sensor
+
+static esp_err_t imu_write(uint8_t reg, uint8_t val)
+{
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    esp_err_t ret;
+
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (IMU_ADDR << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_write_byte(cmd, reg, true);
+    i2c_master_write_byte(cmd, val, true);
+    i2c_master_stop(cmd);
+    ret = i2c_master_cmd_begin(IMU_I2C_PORT, cmd, IMU_I2C_TIMEOUT);
+    i2c_cmd_link_delete(cmd);
+    return ret;
+}
+
+static esp_err_t imu_read_regs(uint8_t reg, uint8_t *buf, size_t len)
+{
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    esp_err_t ret;
+
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (IMU_ADDR << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_write_byte(cmd, reg, true);
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (IMU_ADDR << 1) | I2C_MASTER_READ, true);
+    i2c_master_read(cmd, buf, len, I2C_MASTER_LAST_NACK);
+    i2c_master_stop(cmd);
+    ret = i2c_master_cmd_begin(IMU_I2C_PORT, cmd, IMU_I2C_TIMEOUT);
+    i2c_cmd_link_delete(cmd);
+    return ret;
+}
+
+static void IRAM_ATTR imu_isr(void *arg)
+{
+    BaseType_t woken = pdFALSE;
+
+    vTaskNotifyGiveFromISR(imu_task_handle, &woken);
+    if (woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+static esp_err_t imu_fifo_reset(void)
+{
+    esp_err_t ret = imu_write(REG_USER_CTRL, USER_FIFO_RESET);
+
+    if (ret == ESP_OK) {
+        ret = imu_write(REG_USER_CTRL, USER_FIFO_EN);
+    }
+    return ret;
+}
+
+static esp_err_t imu_configure(void)
+{
+    const uint16_t wm = IMU_WATERMARK * IMU_FRAME_MAX;
+    const uint8_t regs[][2] = {
+        {REG_PWR_MGMT_1,    0x01},      //Acorda, clock do PLL do giroscopio
+        {REG_PWR_MGMT_2,    0x00},      //Todos os eixos (imu_sleep() desliga o giroscopio)
+        {REG_SMPLRT_DIV,    0x00},      //1 kHz / (1 + 0)
+        {REG_CONFIG,        0x01},      //DLPF ~184 Hz, taxa interna de 1 kHz
+        {REG_GYRO_CONFIG,   0x08},      //+-500 graus/s
+        {REG_ACCEL_CONFIG,  0x10},      //+-8 g
+        {REG_INT_PIN_CFG,   0x00},      //Pulso ativo em nivel alto, limpo ao ler INT_STATUS
+        {REG_INT_ENABLE,    INT_FIFO_OFLOW | imu_motion_mask},
+    };
+    const uint8_t mpu_regs[][2] = {
+        {REG_ACCEL_CONFIG,  0x11},                  //Passa-alta de 5 Hz so no caminho da deteccao de movimento
+        {REG_MOT_THR,       IMU_MOTION_MG / 2},     //2 mg/LSB
+        {REG_MOT_DUR,       1},                     //1 ms acima do limiar
+    };
+    const uint8_t icm_regs[][2] = {
+        {REG_ACCEL_CONFIG2, 0x01},                  //DLPF do acelerometro ~218 Hz
+        {REG_FIFO_WM_TH1,   (wm >> 8) & 0x03},
+        {REG_FIFO_WM_TH2,   wm & 0xFF},
+        {REG_WOM_X_THR,     IMU_MOTION_MG / 4},     //4 mg/LSB
+        {REG_WOM_X_THR + 1, IMU_MOTION_MG / 4},
+        {REG_WOM_X_THR + 2, IMU_MOTION_MG / 4},
+        {REG_ACCEL_INTEL,   0xC0},                  //Wake-on-motion contra a amostra anterior
+    };
+    esp_err_t ret = ESP_OK;
+
+    for (size_t i = 0; i < sizeof(regs) / sizeof(regs[0]) && ret == ESP_OK; i++) {
+        ret = imu_write(regs[i][0], regs[i][1]);
+    }
+    if (imu_has_watermark) {
+        for (size_t i = 0; i < sizeof(icm_regs) / sizeof(icm_regs[0]) && ret == ESP_OK; i++) {
+            ret = imu_write(icm_regs[i][0], icm_regs[i][1]);
+        }
+    } else {
+        for (size_t i = 0; i < sizeof(mpu_regs) / sizeof(mpu_regs[0]) && ret == ESP_OK; i++) {
+            ret = imu_write(mpu_regs[i][0], mpu_regs[i][1]);
+        }
+    }
+    if (ret == ESP_OK) {
+        //Acelerometro e giroscopio na FIFO (o ICM-20602 inclui a temperatura)
+        ret = imu_write(REG_FIFO_EN, imu_has_watermark ? 0x18 : 0x78);
+    }
+    if (ret == ESP_OK) {
+        ret = imu_fifo_reset();
+    }
+    return ret;
+}
+
+static inline int16_t imu_be16(const uint8_t *p)
+{
+    return (int16_t)((p[0] << 8) | p[1]);
+}
+
+//Esvazia a FIFO do sensor para o ring
+static void imu_drain(void)
+{
+    uint8_t raw[IMU_CHUNK_FRAMES * IMU_FRAME_MAX];
+    imu_sample_t batch[IMU_CHUNK_FRAMES];
+    uint8_t st;
+    uint8_t cnt[2];
+    uint32_t frames;
+    uint32_t t_last;
+    uint32_t bits;
+
+    if (imu_read_regs(REG_INT_STATUS, &st, 1) != ESP_OK ||
+            imu_read_regs(REG_FIFO_COUNTH, cnt, 2) != ESP_OK) {
+        imu_stats.i2c_errors++;
+        return;
+    }
+    if (st & imu_motion_mask) {
+        imu_stats.motion_irqs++;
+    }
+    if (st & INT_FIFO_OFLOW) {
+        //Amostras ja perdidas no sensor; recomeca alinhado ao quadro
+        imu_stats.fifo_overflows++;
+        imu_fifo_reset();
+        return;
+    }
+    //A amostra mais nova e a do instante da leitura do contador
+    t_last = (uint32_t)esp_timer_get_time();
+    frames = ((cnt[0] << 8) | cnt[1]) / imu_frame;
+    if (frames == 0) {
+        return;
+    }
+    imu_stats.bursts++;
+    if (frames > imu_stats.max_burst) {
+        imu_stats.max_burst = frames;
+    }
+
+    for (uint32_t done = 0; done < frames;) {
+        uint32_t n = frames - done;
+        if (n > IMU_CHUNK_FRAMES) {
+            n = IMU_CHUNK_FRAMES;
+        }
+        if (imu_read_regs(REG_FIFO_R_W, raw, n * imu_frame) != ESP_OK) {
+            //Leitura parcial desalinha os quadros: descarta a FIFO
+            imu_stats.i2c_errors++;
+            imu_fifo_reset();
+            return;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            const uint8_t *f = &raw[i * imu_frame];
+            const uint8_t *g = f + imu_frame - 6;
+            imu_sample_t *s = &batch[i];
+
+            s->t_us = t_last - (frames - 1 - (done + i)) * IMU_PERIOD_US;
+            for (int k = 0; k < 3; k++) {
+                s->acc[k] = imu_be16(f + 2 * k);
+                s->gyr[k] = imu_be16(g + 2 * k);
+            }
+        }
+        imu_stats.samples += ring_push(&imu_ring, batch, n);
+        done += n;
+    }
+    imu_stats.ring_dropped = imu_ring.dropped;
+    imu_stats.ring_high_water = imu_ring.high_water;
+    //Consumidor sem periodo: so o movimento ou o ring pela metade o acordam
+    bits = (st & imu_motion_mask) ? IMU_NOTIFY_MOTION : 0;
+    if (ring_count(&imu_ring) >= IMU_NOTIFY_FILL) {
+        bits |= IMU_NOTIFY_DATA;
+    }
+    if (bits != 0 && imu_consumer != NULL) {
+        xTaskNotify(imu_consumer, bits, eSetBits);
+    }
+}
+
+static void imu_task(void *arg)
+{
+    while (1) {
+        //INT (watermark ou movimento) ou leitura periodica
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(IMU_BURST_MS));
+        if (!imu_parked) {
+            imu_drain();
+        }
+    }
+}
+
+esp_err_t imu_init(void)
+{
+    i2c_config_t conf = {
+        .mode = I2C_MODE_MASTER,
+        .sda_io_num = IMU_SDA_GPIO,
+        .scl_io_num = IMU_SCL_GPIO,
+        .sda_pullup_en = GPIO_PULLUP_ENABLE,
+        .scl_pullup_en = GPIO_PULLUP_ENABLE,
+        .master.clk_speed = IMU_I2C_HZ,
+    };
+    gpio_config_t io = {
+        .pin_bit_mask = 1ULL << IMU_INT_GPIO,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_ENABLE,
+        .intr_type = GPIO_INTR_POSEDGE,
+    };
+    esp_err_t ret;
+
+    ring_init(&imu_ring, imu_ring_buf, sizeof(imu_sample_t), IMU_RING_LEN);
+
+    ret = i2c_param_config(IMU_I2C_PORT, &conf);
+    if (ret == ESP_OK) {
+        ret = i2c_driver_install(IMU_I2C_PORT, I2C_MODE_MASTER, 0, 0, 0);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    if (imu_read_regs(REG_WHO_AM_I, &imu_stats.who_am_i, 1) != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    switch (imu_stats.who_am_i) {
+    case WHO_MPU6050:
+        imu_frame = 12;
+        imu_motion_mask = INT_MOT_MPU;
+        imu_has_watermark = false;
+        break;
+    case WHO_ICM20602:
+        imu_frame = 14;
+        imu_motion_mask = INT_WOM_ICM;
+        imu_has_watermark = true;
+        break;
+    default:
+        printf("IMU: WHO_AM_I 0x%02x desconhecido\n", imu_stats.who_am_i);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    ret = imu_configure();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (xTaskCreatePinnedToCore(imu_task, "imu", 3072, NULL, IMU_TASK_PRIO, &imu_task_handle, IMU_TASK_CORE) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ret = gpio_config(&io);
+    if (ret == ESP_OK) {
+        //Ja pode estar instalado por outro modulo
+        ret = gpio_install_isr_service(0);
+        ret = (ret == ESP_ERR_INVALID_STATE) ? ESP_OK : ret;
+    }
+    if (ret == ESP_OK) {
+        ret = gpio_isr_handler_add(IMU_INT_GPIO, imu_isr, NULL);
+    }
+    printf("IMU: WHO_AM_I 0x%02x, %d Hz, %s\n", imu_stats.who_am_i, IMU_RATE_HZ,
+           imu_has_watermark ? "watermark" : "leitura periodica");
+    return ret;
+}
+
+size_t imu_read(imu_sample_t *out, size_t max)
+{
+    return ring_pop(&imu_ring, out, max);
+}
+
+size_t imu_available(void)
+{
+    return ring_count(&imu_ring);
+}
+
+esp_err_t imu_sleep(void)
+{
+    const uint8_t mpu_regs[][2] = {
+        {REG_PWR_MGMT_2,    0x40 | PWR2_GYRO_STBY},        //Ciclos a 5 Hz, so o acelerometro
+        {REG_PWR_MGMT_1,    PWR_CYCLE | PWR_TEMP_DIS},
+    };
+    const uint8_t icm_regs[][2] = {
+        {REG_SMPLRT_DIV,    199},                           //5 Hz no modo de baixo consumo
+        {REG_ACCEL_CONFIG2, 0x08},                          //Media de 4 amostras
+        {REG_PWR_MGMT_2,    PWR2_GYRO_STBY},
+        {REG_PWR_MGMT_1,    PWR_CYCLE | 0x01},
+    };
+    const uint8_t (*regs)[2] = imu_has_watermark ? icm_regs : mpu_regs;
+    size_t n = imu_has_watermark ? sizeof(icm_regs) / sizeof(icm_regs[0]) : sizeof(mpu_regs) / sizeof(mpu_regs[0]);
+    uint8_t st;
+    esp_err_t ret;
+
+    if (imu_task_handle == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    imu_parked = true;
+    gpio_intr_disable(IMU_INT_GPIO);
+    //Limiares de movimento ja configurados; so a interrupcao de movimento, em nivel
+    ret = imu_write(REG_INT_ENABLE, imu_motion_mask);
+    if (ret == ESP_OK) {
+        ret = imu_write(REG_INT_PIN_CFG, INT_LATCH);
+    }
+    if (ret == ESP_OK) {
+        ret = imu_write(REG_USER_CTRL, 0x00);
+    }
+    for (size_t i = 0; i < n && ret == ESP_OK; i++) {
+        ret = imu_write(regs[i][0], regs[i][1]);
+    }
+    if (ret == ESP_OK) {
+        //Solta o pino INT antes de dormir
+        ret = imu_read_regs(REG_INT_STATUS, &st, 1);
+    }
+    return ret;
+}
+
+void imu_set_consumer(TaskHandle_t task)
+{
+    imu_consumer = task;
+}
+
+void imu_get_stats(imu_stats_t *stats)
+{
+    *stats = imu_stats;
+}
@@ -0,0 +1,104 @@
+/* Aquisicao do acelerometro/giroscopio (MPU6050 / ICM-20602) por FIFO
+
+   O sensor amostra a IMU_RATE_HZ e guarda as amostras na propria FIFO. Uma
+   task de prioridade alta acorda pela interrupcao de watermark da FIFO
+   (ICM-20602) ou, no MPU6050, que nao tem watermark, por um timer a cada
+   IMU_BURST_MS; le a FIFO inteira em rajadas pelo I2C, marca o instante de
+   cada amostra e empurra tudo para um ring sem trava.
+
+   O consumidor (analise de vibracao), registrado em imu_set_consumer(),
+   dorme ate ser avisado: com o ring passando de IMU_NOTIFY_FILL
+   amostras (IMU_NOTIFY_DATA) ou na interrupcao de movimento do sensor
+   (motion no MPU6050, wake-on-motion no ICM-20602, IMU_NOTIFY_MOTION), que
+   chega pelo pino INT e e lida na hora, sem esperar a rajada seguinte. Com
+   IMU_RING_LEN amostras ele ainda tem ~0,5 s de folga depois do aviso.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/i2c.h"
+
+#define IMU_I2C_PORT        I2C_NUM_0
+#define IMU_I2C_HZ          400000
+#define IMU_SDA_GPIO        21
+#define IMU_SCL_GPIO        22
+#define IMU_INT_GPIO        32
+#define IMU_ADDR            0x68
+
+#define IMU_RATE_HZ         1000
+#define IMU_BURST_MS        20      //Periodo de leitura do MPU6050 (FIFO de 1024 B = ~85 ms a 1 kHz)
+#define IMU_WATERMARK       20      //Amostras na FIFO que disparam a interrupcao (ICM-20602)
+#define IMU_MOTION_MG       256     //Variacao que dispara a interrupcao de movimento
+#define IMU_RING_LEN        1024    //Amostras; potencia de 2
+#define IMU_NOTIFY_FILL     (IMU_RING_LEN / 2)  //Ocupacao que acorda o consumidor
+#define IMU_NOTIFY_DATA     (1u << 0)   //Bits da notificacao do consumidor
+#define IMU_NOTIFY_MOTION   (1u << 1)
+#define IMU_TASK_PRIO       6       //Acima das tasks do modem
+#define IMU_TASK_CORE       1
+
+//Escalas: +-8 g e +-500 graus/s
+#define IMU_ACCEL_LSB_PER_G 4096
+#define IMU_GYRO_LSB_PER_DPS_X10    655
+
+typedef struct {
+    uint32_t t_us;              //esp_timer_get_time() da amostra (32 bits baixos)
+    int16_t acc[3];             //x, y, z em LSB (IMU_ACCEL_LSB_PER_G)
+    int16_t gyr[3];
+} imu_sample_t;
+
+typedef struct {
+    uint32_t samples;           //Amostras entregues ao ring
+    uint32_t bursts;
+    uint32_t max_burst;         //Maior rajada lida de uma vez
+    uint32_t fifo_overflows;    //FIFO do sensor transbordou (amostras perdidas no sensor)
+    uint32_t ring_dropped;      //Amostras recusadas por ring cheio
+    uint32_t ring_high_water;
+    uint32_t i2c_errors;
+    uint32_t motion_irqs;       //Interrupcoes de movimento atendidas
+    uint8_t who_am_i;
+} imu_stats_t;
+
+/**
+ * @brief   Configura o I2C e o sensor, e inicia a task de aquisicao.
+ *
+ * @return
+ *  - ESP_OK                Sucesso
+ *  - ESP_ERR_NOT_FOUND     Sensor nao respondeu ou WHO_AM_I desconhecido
+ *  - ESP_ERR_NO_MEM        Falha ao criar a task
+ *  - Outros                Erros do driver I2C/GPIO
+ */
+esp_err_t imu_init(void);
+
+/**
+ * @brief   Retira ate max amostras do ring (um unico consumidor).
+ *
+ * @return  Amostras copiadas
+ */
+size_t imu_read(imu_sample_t *out, size_t max);
+
+/**
+ * @brief   Amostras aguardando no ring.
+ */
+size_t imu_available(void);
+
+/**
+ * @brief   Task avisada por xTaskNotify() com os bits IMU_NOTIFY_* (NULL
+ *          desliga); le com xTaskNotifyWait().
+ */
+void imu_set_consumer(TaskHandle_t task);
+
+/**
+ * @brief   Para a aquisicao e deixa o sensor em wake-on-motion de baixo
+ *          consumo (so o acelerometro, 5 Hz), com o pino INT em nivel alto
+ *          ate o proximo imu_init(). Usado antes do deep sleep, com o INT
+ *          como fonte de despertar.
+ *
+ * @return  ESP_OK, ESP_ERR_INVALID_STATE sem imu_init() ou erro do I2C
+ */
+esp_err_t imu_sleep(void);
+
+void imu_get_stats(imu_stats_t *stats);
@@ -0,0 +1,309 @@
+/* Configuracao persistente do SIM7070 sem comandos redundantes
+
+   As consultas sao lidas direto do at_uart porque respostas como a do
+   AT+SMCONF? tem varias linhas de valor, e a callback do motor AT so ve a
+   ultima. Os comandos de escrita vao todos de uma vez para o motor AT e as
+   respostas sao conferidas depois, na ordem de envio. Cada comando leva um
+   numero de sequencia: resposta de uma aplicacao anterior que desistiu
+   pelo prazo e descartada, nao conta para a atual.
+*/
+
+#include <stdio.h>
+#include "string.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "at_uart.h"
+#include "at_cmd.h"
+#include "at_health.h"
+#include "modem_cfg.h"
+
+#define MODEM_CFG_NVS_NS    "mcfg"
+
+typedef struct {
+    uint32_t seq;
+    at_result_t res;
+} mc_res_t;
+
+static QueueHandle_t mc_res_queue;
+static uint32_t mc_seq;                 //Ultimo comando de escrita enviado
+static modem_cfg_stats_t mc_stats;
+static bool mc_kept;                    //Modem sem reset desde o boot anterior
+static uint32_t mc_gen = 1;             //Incrementada a cada reset do modem
+static bool mc_stored;                  //Algum hash gravado desde o ultimo reset
+static const modem_cfg_t *mc_failed;    //Perfil cuja ultima aplicacao falhou: a proxima repete os comandos
+static at_line_t mc_line;
+static char mc_value[MODEM_CFG_VALUE_MAX];
+
+//FNV-1a dos valores e comandos do perfil
+static uint32_t mc_hash(const modem_cfg_t *cfg)
+{
+    uint32_t h = 2166136261u;
+
+    for (int i = 0; i < cfg->n; i++) {
+        const char *s[2] = {cfg->items[i].want, cfg->items[i].set};
+
+        for (int k = 0; k < 2; k++) {
+            for (const char *p = s[k]; *p != '\0'; p++) {
+                h = (h ^ (uint8_t)*p) * 16777619u;
+            }
+            h = (h ^ 0xff) * 16777619u;
+        }
+    }
+    return h;
+}
+
+static esp_err_t mc_nvs_get(const char *key, uint32_t *hash)
+{
+    nvs_handle_t h;
+    esp_err_t ret = nvs_open(MODEM_CFG_NVS_NS, NVS_READONLY, &h);
+
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = nvs_get_u32(h, key, hash);
+    nvs_close(h);
+    return ret;
+}
+
+//key NULL apaga todos os perfis
+static esp_err_t mc_nvs_set(const char *key, const uint32_t *hash)
+{
+    nvs_handle_t h;
+    esp_err_t ret = nvs_open(MODEM_CFG_NVS_NS, NVS_READWRITE, &h);
+
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (key == NULL) {
+        ret = nvs_erase_all(h);
+    } else if (hash == NULL) {
+        ret = nvs_erase_key(h, key);
+    } else {
+        ret = nvs_set_u32(h, key, *hash);
+    }
+    if (ret == ESP_OK || ret == ESP_ERR_NVS_NOT_FOUND) {
+        ret = nvs_commit(h);
+    }
+    nvs_close(h);
+    return ret;
+}
+
+//Copia sem aspas e espacos
+static void mc_normalize(const char *src, char *dst, size_t size)
+{
+    size_t n = 0;
+
+    for (; *src != '\0' && n + 1 < size; src++) {
+        if (*src != '"' && *src != ' ') {
+            dst[n++] = *src;
+        }
+    }
+    dst[n] = '\0';
+}
+
+//Igual ao esperado ou com campos a mais depois dele
+static bool mc_match(const char *value, const char *want)
+{
+    size_t n = strlen(want);
+
+    return strncmp(value, want, n) == 0 && (value[n] == '\0' || value[n] == ',');
+}
+
+/**
+ * Envia a consulta do item q e marca em same[] os itens do perfil com a
+ * mesma consulta cujo valor ja e o esperado. O prefixo e comparado antes
+ * de normalizar, como o modem o imprime.
+ */
+static esp_err_t mc_query(const modem_cfg_t *cfg, int q, bool *same)
+{
+    const char *query = cfg->items[q].query;
+    int64_t t0 = esp_timer_get_time();
+    int64_t end = t0 + (int64_t)MODEM_CFG_QUERY_MS * 1000;
+    int64_t left;
+    at_result_t res = AT_RES_TIMEOUT;
+    esp_err_t ret = ESP_ERR_TIMEOUT;
+
+    mc_stats.queries++;
+    at_uart_lock(portMAX_DELAY);
+    at_uart_flush();
+    at_uart_write(query, strlen(query));
+    while ((left = end - esp_timer_get_time()) > 0) {
+        if (at_uart_read_line(&mc_line, pdMS_TO_TICKS(left / 1000) + 1) < 0) {
+            break;
+        }
+        if (strcmp(mc_line.txt, "OK") == 0) {
+            res = AT_RES_OK;
+            ret = ESP_OK;
+            break;
+        }
+        if (strstr(mc_line.txt, "ERROR") != NULL) {
+            //Consulta nao suportada: todos os itens dela sao enviados
+            res = AT_RES_ERROR;
+            ret = ESP_OK;
+            break;
+        }
+        for (int i = q; i < cfg->n; i++) {
+            const modem_cfg_item_t *it = &cfg->items[i];
+            size_t plen = strlen(it->prefix);
+
+            if (strcmp(it->query, query) == 0 && strncmp(mc_line.txt, it->prefix, plen) == 0) {
+                mc_normalize(mc_line.txt + plen, mc_value, sizeof(mc_value));
+                same[i] = mc_match(mc_value, it->want);
+            }
+        }
+    }
+    at_uart_unlock();
+    at_health_record(query, res, (uint32_t)((esp_timer_get_time() - t0) / 1000), mc_failed == cfg);
+    return ret;
+}
+
+//Roda na task do motor AT: fila cheia so acontece com quem esperava ja fora
+static void mc_cmd_done(const at_cmd_t *cmd, at_result_t res, const char *info, void *arg)
+{
+    mc_res_t r = {(uint32_t)(uintptr_t)arg, res};
+
+    if (res != AT_RES_OK) {
+        printf("\tFalha %d: %s %s\n", res, cmd->cmd, info);
+    }
+    xQueueSend(mc_res_queue, &r, 0);
+}
+
+//Le o modem e envia so o que difere
+static esp_err_t mc_sync(const modem_cfg_t *cfg)
+{
+    bool same[MODEM_CFG_ITEMS_MAX] = {false};
+    bool asked;
+    int sent = 0;
+    int ok = 0;
+    uint32_t first = mc_seq + 1;
+    int64_t end;
+    int64_t left;
+    mc_res_t r;
+    esp_err_t ret = ESP_OK;
+
+    for (int i = 0; i < cfg->n && ret == ESP_OK; i++) {
+        asked = false;
+        for (int k = 0; k < i && !asked; k++) {
+            asked = (strcmp(cfg->items[k].query, cfg->items[i].query) == 0);
+        }
+        if (!asked) {
+            ret = mc_query(cfg, i, same);
+        }
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    for (int i = 0; i < cfg->n; i++) {
+        if (same[i]) {
+            mc_stats.skipped++;
+            continue;
+        }
+        if (at_cmd_submit_retry(cfg->items[i].set, AT_FINAL_OK, NULL, MODEM_CFG_SET_MS, mc_failed == cfg,
+                                mc_cmd_done, (void *)(uintptr_t)(first + sent)) != ESP_OK) {
+            ret = ESP_FAIL;
+            break;
+        }
+        sent++;
+    }
+    mc_seq = first + sent - 1;
+    mc_stats.sets += sent;
+    //Um prazo por comando, como o motor os executa em fila
+    end = esp_timer_get_time() + (int64_t)sent * (MODEM_CFG_SET_MS + MODEM_CFG_QUERY_MS) * 1000;
+    for (int got = 0; got < sent && (left = end - esp_timer_get_time()) > 0;) {
+        if (xQueueReceive(mc_res_queue, &r, pdMS_TO_TICKS(left / 1000) + 1) != pdTRUE) {
+            break;
+        }
+        //Resposta atrasada de uma aplicacao anterior
+        if (r.seq - first >= (uint32_t)sent) {
+            mc_stats.stale++;
+            continue;
+        }
+        got++;
+        ok += (r.res == AT_RES_OK);
+    }
+    return (ret == ESP_OK && ok == sent) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t modem_cfg_init(bool modem_kept)
+{
+    mc_kept = modem_kept;
+    mc_stored = false;
+    if (mc_res_queue == NULL) {
+        mc_res_queue = xQueueCreate(AT_CMD_QUEUE_LEN, sizeof(mc_res_t));
+    }
+    return mc_res_queue != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void modem_cfg_modem_reset(void)
+{
+    mc_kept = false;
+    mc_gen++;
+    mc_failed = NULL;
+    //Um deep sleep antes de reaplicar nao pode confiar nos hashes
+    if (mc_stored && mc_nvs_set(NULL, NULL) == ESP_OK) {
+        mc_stored = false;
+    }
+}
+
+esp_err_t modem_cfg_apply(modem_cfg_t *cfg)
+{
+    modem_cfg_stats_t st0 = mc_stats;
+    int64_t t0;
+    uint32_t hash;
+    uint32_t saved = 0;
+    bool have;
+    esp_err_t ret;
+
+    if (cfg->n > MODEM_CFG_ITEMS_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (cfg->gen == mc_gen) {
+        return ESP_OK;
+    }
+    t0 = esp_timer_get_time();
+    mc_stats.applies++;
+    hash = mc_hash(cfg);
+    have = (mc_nvs_get(cfg->name, &saved) == ESP_OK);
+    if (mc_kept && have && saved == hash) {
+        mc_stats.warm++;
+        mc_stats.skipped += cfg->n;
+        mc_stored = true;
+        cfg->gen = mc_gen;
+        printf("Perfil %s: modem ja configurado (hash %08x)\n", cfg->name, hash);
+        return ESP_OK;
+    }
+
+    ret = mc_sync(cfg);
+    if (ret != ESP_OK) {
+        mc_failed = cfg;
+        mc_stats.failures++;
+        printf("Perfil %s: falha %d\n", cfg->name, ret);
+        return ret;
+    }
+    if (!have || saved != hash) {
+        mc_nvs_set(cfg->name, &hash);
+    }
+    if (mc_failed == cfg) {
+        mc_failed = NULL;
+    }
+    mc_stored = true;
+    cfg->gen = mc_gen;
+    printf("Perfil %s aplicado em %u ms | Consultas %u | Comandos %u | Evitados %u\n", cfg->name,
+           (unsigned)((esp_timer_get_time() - t0) / 1000), mc_stats.queries - st0.queries,
+           mc_stats.sets - st0.sets, mc_stats.skipped - st0.skipped);
+    return ESP_OK;
+}
+
+void modem_cfg_invalidate(modem_cfg_t *cfg)
+{
+    cfg->gen = 0;
+    mc_nvs_set(cfg->name, NULL);
+}
+
+void modem_cfg_get_stats(modem_cfg_stats_t *stats)
+{
+    *stats = mc_stats;
+}
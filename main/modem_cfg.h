@@ -0,0 +1,89 @@
+/* Configuracao persistente do SIM7070 sem comandos redundantes
+
+   Um perfil e a lista de parametros que o firmware quer no modem (CFUN,
+   contexto PDP, SMCONF...). Cada item tem a consulta que le o valor
+   atual, o prefixo da linha da resposta, o valor esperado e o comando que
+   o grava. modem_cfg_apply():
+     - perfil ja aplicado neste boot (reconexoes): nada e enviado;
+     - modem mantido dormindo durante o deep sleep e hash do perfil igual ao
+       gravado na NVS: o modem ja tem o perfil, nada e enviado;
+     - senao le cada consulta uma vez e envia so os comandos cujo valor
+       difere; com todos aceitos grava o hash na NVS.
+
+   O hash na NVS vale enquanto o modem nao for reiniciado: um reset depois
+   de algum perfil aplicado apaga os hashes (modem_cfg_modem_reset()). Quem
+   detectar que o modem perdeu a configuracao (SMCONN recusado, PDP que nao
+   sobe) chama modem_cfg_invalidate() e a proxima aplicacao volta a ler o
+   modem.
+
+   Valores sao comparados sem aspas e espacos; o valor lido pode ter campos
+   a mais depois do esperado (ex.: +CGDCONT: 1,"IP","apn","0.0.0.0",0,0).
+   As consultas usam a UART direto (segurando at_uart_lock()); os comandos
+   vao pelo motor AT. Requer nvs_flash_init() e at_cmd_init().
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define MODEM_CFG_ITEMS_MAX     8       //Itens por perfil
+#define MODEM_CFG_VALUE_MAX     96      //Valor normalizado lido do modem
+#define MODEM_CFG_QUERY_MS      3000    //Resposta completa de uma consulta
+#define MODEM_CFG_SET_MS        10000   //Timeout de cada comando de escrita
+
+typedef struct {
+    const char *query;          //Ex.: "AT+CGDCONT?\r"
+    const char *prefix;         //Linha da resposta com o valor, ex.: "+CGDCONT: 1,"
+    const char *want;           //Valor esperado depois do prefixo, sem aspas nem espacos
+    const char *set;            //Comando que grava o valor
+} modem_cfg_item_t;
+
+typedef struct {
+    const char *name;           //Chave na NVS (ate 15 caracteres)
+    const modem_cfg_item_t *items;
+    uint8_t n;
+    uint32_t gen;               //Geracao do modem em que foi aplicado (0: nunca)
+} modem_cfg_t;
+
+typedef struct {
+    uint32_t applies;           //Chamadas de modem_cfg_apply() que foram ao modem ou a NVS
+    uint32_t warm;              //Perfis confirmados pelo hash, sem consulta
+    uint32_t queries;           //Consultas enviadas
+    uint32_t sets;              //Comandos de escrita enviados
+    uint32_t skipped;           //Comandos de escrita evitados (valor ja certo)
+    uint32_t failures;
+    uint32_t stale;             //Respostas de escrita que chegaram depois do prazo
+} modem_cfg_stats_t;
+
+/**
+ * @brief   Cria a fila de resultados e registra se o modem segue ligado
+ *          desde o boot anterior.
+ *
+ * @param   modem_kept  Modem dormiu pelo DTR durante o deep sleep (power_modem_kept())
+ */
+esp_err_t modem_cfg_init(bool modem_kept);
+
+/**
+ * @brief   Modem reiniciado (PWRKEY): perfis deixam de valer.
+ */
+void modem_cfg_modem_reset(void);
+
+/**
+ * @brief   Garante o perfil no modem com o minimo de comandos.
+ *
+ * @return
+ *  - ESP_OK                Perfil no modem
+ *  - ESP_ERR_INVALID_ARG   Perfil maior que MODEM_CFG_ITEMS_MAX
+ *  - ESP_ERR_TIMEOUT       Consulta sem resposta
+ *  - ESP_FAIL              Algum comando de escrita recusado
+ */
+esp_err_t modem_cfg_apply(modem_cfg_t *cfg);
+
+/**
+ * @brief   Obriga a proxima modem_cfg_apply() a ler o modem e esquece o
+ *          hash do perfil na NVS.
+ */
+void modem_cfg_invalidate(modem_cfg_t *cfg);
+
+void modem_cfg_get_stats(modem_cfg_stats_t *stats);
@@ -0,0 +1,440 @@
+/* Publicacao MQTT em lote pelo cliente MQTT do SIM7070 (AT+SM*)
+
+   Todos os comandos passam pelo motor AT; as callbacks so repassam o
+   resultado para uma fila, que e lida na mesma ordem de envio. Cada envio
+   leva um numero de sequencia no argumento da callback: o resultado que
+   chega depois do prazo de quem esperava (ainda na fila na proxima
+   espera) e descartado pelo numero, nunca tomado pelo comando seguinte.
+
+   A fila urgente guarda registros no mesmo formato do tlog, para que o
+   envio e o retorno ao tlog em caso de falha usem o mesmo caminho.
+*/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "string.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "at_cmd.h"
+#include "modem_cfg.h"
+#include "netreg.h"
+#include "telem.h"
+#include "mqtt_pub.h"
+
+#define MQTT_WAIT_MARGIN_MS 1000    //Alem do timeout do proprio comando
+
+typedef struct {
+    uint32_t seq;               //Envio a que pertence
+    at_result_t res;
+    int value;                  //Valor da resposta (+SMSTATE: <n>), 0 sem
+} mqtt_res_t;
+
+static mqtt_pub_cfg_t mqtt_cfg;
+static QueueHandle_t mqtt_res_queue;
+static uint32_t mqtt_seq;               //Ultimo envio (so a task do modem)
+static QueueHandle_t mqtt_urgent_queue;
+static void (*mqtt_urgent_cb)(void *arg);
+static void *mqtt_urgent_arg;
+
+//Configuracao do cliente no modem (AT+SMCONF)
+#define MQTT_CONF_ITEMS 7
+static const char *const mqtt_conf_prefix[MQTT_CONF_ITEMS] = {
+    "URL:", "KEEPTIME:", "CLEANSS:", "CLIENTID:", "QOS:", "USERNAME:", "PASSWORD:",
+};
+static char mqtt_conf_set[MQTT_CONF_ITEMS][AT_CMD_MAX];
+static char mqtt_conf_want[MQTT_CONF_ITEMS][MODEM_CFG_VALUE_MAX];
+static modem_cfg_item_t mqtt_conf_items[MQTT_CONF_ITEMS];
+static modem_cfg_t mqtt_profile;
+_Static_assert(MQTT_CONF_ITEMS <= MODEM_CFG_ITEMS_MAX, "perfil MQTT maior que o modem_cfg aceita");
+
+static mqtt_pub_stats_t mqtt_stats;
+
+//Areas de trabalho do esvaziamento (uma task por vez)
+static tlog_rec_t mqtt_recs[MQTT_BATCH_RECS];
+static uint8_t mqtt_payload[MQTT_PIPELINE][MQTT_PAYLOAD_MAX];
+
+//Primeiro lote do tlog ja codificado em mqtt_payload (npl = 0: nenhum)
+typedef struct {
+    uint32_t seq;               //Primeiro registro
+    size_t n;                   //Registros cobertos
+    int npl;
+    telem_enc_t enc[MQTT_PIPELINE];
+    size_t consumed[MQTT_PIPELINE];
+} mqtt_prep_t;
+
+static mqtt_prep_t mqtt_prep;
+
+//Roda na task do motor AT: nunca espera pela fila (cheia, quem esperava ja desistiu)
+static void mqtt_cmd_done(const at_cmd_t *cmd, at_result_t res, const char *info, void *arg)
+{
+    mqtt_res_t r = {(uint32_t)(uintptr_t)arg, res, 0};
+    const char *v = strchr(info, ':');
+
+    if (res == AT_RES_OK && v != NULL) {
+        r.value = atoi(v + 1);
+    }
+    xQueueSend(mqtt_res_queue, &r, 0);
+}
+
+//Argumento da callback do proximo envio (nunca 0)
+static void *mqtt_next_seq(void)
+{
+    if (++mqtt_seq == 0) {
+        mqtt_seq = 1;
+    }
+    return (void *)(uintptr_t)mqtt_seq;
+}
+
+//Resultado do envio seq; os de envios anteriores que ainda chegarem sao descartados
+static at_result_t mqtt_wait(uint32_t seq, uint32_t timeout_ms, int *value)
+{
+    int64_t end = esp_timer_get_time() + (int64_t)(timeout_ms + MQTT_WAIT_MARGIN_MS) * 1000;
+    int64_t left;
+    mqtt_res_t r;
+
+    while ((left = end - esp_timer_get_time()) > 0) {
+        if (xQueueReceive(mqtt_res_queue, &r, pdMS_TO_TICKS(left / 1000) + 1) != pdTRUE) {
+            break;
+        }
+        if (r.seq != seq) {
+            mqtt_stats.stale++;
+            continue;
+        }
+        if (value != NULL) {
+            *value = r.value;
+        }
+        return r.res;
+    }
+    return AT_RES_TIMEOUT;
+}
+
+static at_result_t mqtt_exec(const char *cmd, at_final_t final, const char *prefix, uint32_t timeout_ms, int *value)
+{
+    void *seq = mqtt_next_seq();
+
+    if (at_cmd_submit(cmd, final, prefix, timeout_ms, mqtt_cmd_done, seq) != ESP_OK) {
+        return AT_RES_ERROR;
+    }
+    return mqtt_wait((uint32_t)(uintptr_t)seq, timeout_ms, value);
+}
+
+//Comando e valor esperado na resposta do AT+SMCONF? (sem aspas) de cada parametro
+static int mqtt_conf_cmd(int i, char *cmd, size_t size, char *want, size_t wsize)
+{
+    switch (i) {
+    case 0:
+        snprintf(want, wsize, "%s,%u", mqtt_cfg.url, mqtt_cfg.port);
+        return snprintf(cmd, size, "AT+SMCONF=\"URL\",\"%s\",\"%u\"\r", mqtt_cfg.url, mqtt_cfg.port);
+    case 1:
+        snprintf(want, wsize, "%u", mqtt_cfg.keepalive_s);
+        return snprintf(cmd, size, "AT+SMCONF=\"KEEPTIME\",%u\r", mqtt_cfg.keepalive_s);
+    case 2:
+        snprintf(want, wsize, "1");
+        return snprintf(cmd, size, "AT+SMCONF=\"CLEANSS\",1\r");
+    case 3:
+        snprintf(want, wsize, "%s", mqtt_cfg.client_id);
+        return snprintf(cmd, size, "AT+SMCONF=\"CLIENTID\",\"%s\"\r", mqtt_cfg.client_id);
+    case 4:
+        snprintf(want, wsize, "%u", mqtt_cfg.qos);
+        return snprintf(cmd, size, "AT+SMCONF=\"QOS\",%u\r", mqtt_cfg.qos);
+    case 5:
+        snprintf(want, wsize, "%s", mqtt_cfg.username);
+        return snprintf(cmd, size, "AT+SMCONF=\"USERNAME\",\"%s\"\r", mqtt_cfg.username);
+    case 6:
+        snprintf(want, wsize, "%s", mqtt_cfg.password);
+        return snprintf(cmd, size, "AT+SMCONF=\"PASSWORD\",\"%s\"\r", mqtt_cfg.password);
+    default:
+        return -1;
+    }
+}
+
+//Perfil do modem_cfg com os AT+SMCONF; so o que difere do modem e enviado
+static esp_err_t mqtt_build_profile(void)
+{
+    for (int i = 0; i < MQTT_CONF_ITEMS; i++) {
+        int len = mqtt_conf_cmd(i, mqtt_conf_set[i], AT_CMD_MAX, mqtt_conf_want[i], MODEM_CFG_VALUE_MAX);
+
+        if (len < 0 || len >= AT_CMD_MAX || strlen(mqtt_conf_want[i]) + 1 >= MODEM_CFG_VALUE_MAX) {
+            printf("MQTT: parametro %d longo demais\n", i);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        mqtt_conf_items[i].query = "AT+SMCONF?\r";
+        mqtt_conf_items[i].prefix = mqtt_conf_prefix[i];
+        mqtt_conf_items[i].want = mqtt_conf_want[i];
+        mqtt_conf_items[i].set = mqtt_conf_set[i];
+    }
+    mqtt_profile.name = "mqtt";
+    mqtt_profile.items = mqtt_conf_items;
+    mqtt_profile.n = MQTT_CONF_ITEMS;
+    mqtt_profile.gen = 0;
+    return ESP_OK;
+}
+
+esp_err_t mqtt_pub_init(const mqtt_pub_cfg_t *cfg)
+{
+    mqtt_cfg = *cfg;
+    if (mqtt_build_profile() != ESP_OK) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    mqtt_res_queue = xQueueCreate(AT_CMD_QUEUE_LEN, sizeof(mqtt_res_t));
+    mqtt_urgent_queue = xQueueCreate(MQTT_URGENT_LEN, sizeof(tlog_rec_t));
+    if (mqtt_res_queue == NULL || mqtt_urgent_queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t mqtt_pub_urgent(uint8_t type, const void *data, size_t len)
+{
+    tlog_rec_t rec;
+
+    if (len > TLOG_PAYLOAD_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (mqtt_urgent_queue == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    rec.seq = 0;
+    rec.type = type;
+    rec.len = (uint8_t)len;
+    memcpy(rec.data, data, len);
+    if (xQueueSend(mqtt_urgent_queue, &rec, 0) != pdTRUE) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (mqtt_urgent_cb != NULL) {
+        mqtt_urgent_cb(mqtt_urgent_arg);
+    }
+    return ESP_OK;
+}
+
+void mqtt_pub_on_urgent(void (*cb)(void *arg), void *arg)
+{
+    mqtt_urgent_arg = arg;
+    mqtt_urgent_cb = cb;
+}
+
+bool mqtt_pub_urgent_pending(void)
+{
+    return mqtt_urgent_queue != NULL && uxQueueMessagesWaiting(mqtt_urgent_queue) > 0;
+}
+
+esp_err_t mqtt_pub_connect(void)
+{
+    int64_t t0 = esp_timer_get_time();
+    int state = 0;
+    uint8_t known = netreg_mqtt();
+    esp_err_t ret;
+
+    //Sessao acompanhada pelo +SMSTATE (netreg): consulta so sem estado conhecido
+    if (known == 1 || (known == NETREG_UNKNOWN &&
+                       mqtt_exec("AT+SMSTATE?\r", AT_FINAL_PREFIX, "+SMSTATE:", MQTT_CONF_TIMEOUT_MS, &state) == AT_RES_OK &&
+                       state != 0)) {
+        mqtt_stats.reused++;
+        return ESP_OK;
+    }
+    ret = modem_cfg_apply(&mqtt_profile);
+    if (ret != ESP_OK) {
+        mqtt_stats.errors++;
+        return ret;
+    }
+    if (mqtt_exec("AT+SMCONN\r", AT_FINAL_OK, NULL, MQTT_CONNECT_TIMEOUT_MS, NULL) != AT_RES_OK) {
+        //Sem saber se foi a rede ou o modem sem os parametros: proxima conexao confere o SMCONF
+        modem_cfg_invalidate(&mqtt_profile);
+        netreg_set_mqtt(NETREG_UNKNOWN);
+        mqtt_stats.errors++;
+        return ESP_FAIL;
+    }
+    netreg_set_mqtt(1);
+    mqtt_stats.connects++;
+    mqtt_stats.connect_ms += (uint32_t)((esp_timer_get_time() - t0) / 1000);
+    return ESP_OK;
+}
+
+//Divide os registros em ate MQTT_PIPELINE payloads; devolve quantos montou
+static int mqtt_encode(const tlog_rec_t *recs, size_t n, telem_enc_t *enc, size_t *consumed)
+{
+    size_t idx = 0;
+    int npl = 0;
+
+    while (npl < MQTT_PIPELINE && idx < n) {
+        size_t start = idx;
+
+        telem_enc_init(&enc[npl], mqtt_payload[npl], MQTT_PAYLOAD_MAX);
+        for (; idx < n; idx++) {
+            int r = telem_enc_record(&enc[npl], recs[idx].type, recs[idx].data, recs[idx].len);
+            if (r == TELEM_ERR_FULL) {
+                break;
+            }
+            if (r == TELEM_ERR_TYPE) {
+                //Registro de formato antigo/desconhecido: consumido sem envio
+                printf("MQTT: registro %u tipo %u ignorado\n", recs[idx].seq, recs[idx].type);
+            }
+        }
+        consumed[npl] = idx - start;
+        npl++;
+        if (idx == start) {
+            break;
+        }
+    }
+    return npl;
+}
+
+/**
+ * Callback do tlog_drain: usa os payloads preparados se o lote comeca nos
+ * mesmos registros, senao codifica; enfileira todos os AT+SMPUB e
+ * confirma, em ordem, os registros de cada payload aceito.
+ */
+static esp_err_t mqtt_send_batch(const tlog_rec_t *recs, size_t n, size_t *used, void *arg)
+{
+    mqtt_prep_t *prep = arg;
+    telem_enc_t enc[MQTT_PIPELINE];
+    size_t consumed[MQTT_PIPELINE];
+    uint32_t seq[MQTT_PIPELINE] = {0};
+    char cmd[AT_CMD_MAX];
+    int npl;
+    bool failed = false;
+
+    if (prep != NULL && prep->npl > 0 && n >= prep->n && recs[0].seq == prep->seq) {
+        npl = prep->npl;
+        memcpy(enc, prep->enc, sizeof(enc));
+        memcpy(consumed, prep->consumed, sizeof(consumed));
+        mqtt_stats.prepared += prep->n;
+    } else {
+        npl = mqtt_encode(recs, n, enc, consumed);
+    }
+    if (prep != NULL) {
+        prep->npl = 0;
+    }
+    for (int p = 0; p < npl; p++) {
+        if (enc[p].count > 0) {
+            snprintf(cmd, sizeof(cmd), "AT+SMPUB=\"%s\",%u,%u,0\r", mqtt_cfg.topic,
+                     (unsigned)enc[p].len, mqtt_cfg.qos);
+            void *arg = mqtt_next_seq();
+
+            if (at_cmd_submit_data(cmd, mqtt_payload[p], enc[p].len, MQTT_PUB_TIMEOUT_MS,
+                                   mqtt_cmd_done, arg) != ESP_OK) {
+                npl = p;
+                break;
+            }
+            seq[p] = (uint32_t)(uintptr_t)arg;
+        }
+    }
+
+    //Resultados chegam na ordem de envio; so a parte inicial aceita e confirmada
+    for (int p = 0; p < npl; p++) {
+        if (seq[p] != 0) {
+            if (mqtt_wait(seq[p], MQTT_PUB_TIMEOUT_MS, NULL) != AT_RES_OK) {
+                //Sessao pode ter caido sem o +SMSTATE: a proxima conexao consulta
+                netreg_set_mqtt(NETREG_UNKNOWN);
+                failed = true;
+                mqtt_stats.errors++;
+                continue;
+            }
+            mqtt_stats.publishes++;
+            mqtt_stats.records += enc[p].count;
+            mqtt_stats.bytes += enc[p].len;
+        }
+        if (!failed) {
+            *used += consumed[p];
+        }
+    }
+    return failed ? ESP_FAIL : ESP_OK;
+}
+
+//Publica a fila urgente; o que o broker nao aceitar vai para o tlog
+static size_t mqtt_send_urgent(tlog_t *log)
+{
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    uint32_t oldest_us = 0;
+    size_t n = 0;
+    size_t used = 0;
+
+    while (n < MQTT_URGENT_LEN && xQueueReceive(mqtt_urgent_queue, &mqtt_recs[n], 0) == pdTRUE) {
+        if (mqtt_recs[n].type == TELEM_TYPE_EVT && mqtt_recs[n].len == sizeof(telem_evt_t)) {
+            //data nao e alinhado: copia, preenche e devolve
+            telem_evt_t ev;
+            uint32_t age;
+
+            memcpy(&ev, mqtt_recs[n].data, sizeof(ev));
+            age = (now - ev.t_us) / 1000;
+            ev.age_ms = age > 65535 ? 65535 : (uint16_t)age;
+            memcpy(mqtt_recs[n].data, &ev, sizeof(ev));
+            if (now - ev.t_us > oldest_us) {
+                oldest_us = now - ev.t_us;
+            }
+        }
+        n++;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    //Os alertas usam as mesmas areas de payload
+    mqtt_prep.npl = 0;
+    mqtt_send_batch(mqtt_recs, n, &used, NULL);
+    if (used > 0) {
+        mqtt_stats.alerts += used;
+        mqtt_stats.alert_ms = (uint32_t)(oldest_us + (esp_timer_get_time() - now)) / 1000;
+        printf("MQTT: %u alerta(s) publicado(s) %u ms apos o evento\n", (unsigned)used, mqtt_stats.alert_ms);
+    }
+    for (size_t i = used; i < n && log != NULL; i++) {
+        tlog_append(log, mqtt_recs[i].type, mqtt_recs[i].data, mqtt_recs[i].len);
+    }
+    return used;
+}
+
+esp_err_t mqtt_pub_drain(tlog_t *log, size_t *sent)
+{
+    int64_t t0 = esp_timer_get_time();
+    size_t urgent;
+    size_t n = 0;
+    esp_err_t ret;
+
+    urgent = mqtt_send_urgent(log);
+    ret = (log != NULL) ? tlog_drain(log, mqtt_recs, MQTT_BATCH_RECS, mqtt_send_batch, &mqtt_prep, &n) : ESP_OK;
+    n += urgent;
+    mqtt_stats.publish_ms += (uint32_t)((esp_timer_get_time() - t0) / 1000);
+    if (sent != NULL) {
+        *sent = n;
+    }
+    return ret;
+}
+
+size_t mqtt_pub_prepare(tlog_t *log)
+{
+    size_t n = 0;
+
+    mqtt_prep.npl = 0;
+    if (log == NULL || tlog_peek(log, mqtt_recs, MQTT_BATCH_RECS, &n) != ESP_OK || n == 0) {
+        return 0;
+    }
+    mqtt_prep.npl = mqtt_encode(mqtt_recs, n, mqtt_prep.enc, mqtt_prep.consumed);
+    mqtt_prep.seq = mqtt_recs[0].seq;
+    mqtt_prep.n = 0;
+    for (int p = 0; p < mqtt_prep.npl; p++) {
+        mqtt_prep.n += mqtt_prep.consumed[p];
+    }
+    return mqtt_prep.n;
+}
+
+esp_err_t mqtt_pub_disconnect(void)
+{
+    if (mqtt_exec("AT+SMDISC\r", AT_FINAL_OK, NULL, MQTT_CONF_TIMEOUT_MS, NULL) != AT_RES_OK) {
+        netreg_set_mqtt(NETREG_UNKNOWN);
+        return ESP_FAIL;
+    }
+    netreg_set_mqtt(0);
+    return ESP_OK;
+}
+
+void mqtt_pub_invalidate(void)
+{
+    modem_cfg_invalidate(&mqtt_profile);
+}
+
+void mqtt_pub_get_stats(mqtt_pub_stats_t *stats)
+{
+    *stats = mqtt_stats;
+}
@@ -0,0 +1,145 @@
+/* Publicacao MQTT em lote pelo cliente MQTT do SIM7070 (AT+SM*)
+
+   A configuracao (AT+SMCONF) e um perfil do modem_cfg: lida do modem uma
+   vez por reset dele e enviada so no que difere. A sessao aberta com
+   AT+SMCONN e mantida entre os ciclos de envio: antes de conectar o estado
+   e consultado com AT+SMSTATE?.
+
+   O broker tem que aceitar payload binario. Com QoS 1 o OK do AT+SMPUB
+   vem depois do PUBACK; com QoS 0 ele so confirma o envio pelo modem, e
+   os registros confirmados no tlog podem nao ter chegado.
+
+   O esvaziamento do tlog empacota varios registros por payload (formato
+   telem) ate MQTT_PAYLOAD_MAX e enfileira ate MQTT_PIPELINE AT+SMPUB
+   seguidos; o motor envia cada um assim que o anterior responde. Os
+   registros de um payload so sao confirmados no tlog depois do OK do
+   AT+SMPUB correspondente.
+
+   O primeiro lote pode ser lido e codificado antes da sessao existir
+   (mqtt_pub_prepare(), enquanto o radio troca do GNSS para o LTE); o
+   esvaziamento usa esses payloads se o tlog ainda comecar nos mesmos
+   registros.
+
+   Alertas (eventos de movimento) entram por mqtt_pub_urgent() numa fila em
+   RAM que avisa a task do modem e sao publicados antes do tlog no proximo
+   esvaziamento; o que nao for aceito pelo broker volta para o tlog.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "tlog.h"
+
+#define MQTT_PAYLOAD_MAX        1024    //Limite de dados do AT+SMPUB
+#define MQTT_PIPELINE           2       //Publicacoes em voo por lote
+#define MQTT_BATCH_RECS         64      //Registros lidos do tlog por lote
+#define MQTT_CONNECT_TIMEOUT_MS 30000
+#define MQTT_PUB_TIMEOUT_MS     10000
+#define MQTT_CONF_TIMEOUT_MS    2000
+#define MQTT_URGENT_LEN         8       //Alertas aguardando publicacao
+
+typedef struct {
+    const char *url;
+    uint16_t port;
+    const char *client_id;
+    const char *username;
+    const char *password;
+    const char *topic;
+    uint16_t keepalive_s;
+    uint8_t qos;                //1: OK do AT+SMPUB so depois do PUBACK; 0: OK so diz que saiu do modem
+} mqtt_pub_cfg_t;
+
+typedef struct {
+    uint32_t connects;          //AT+SMCONN executados
+    uint32_t reused;            //Sessoes ja abertas reaproveitadas
+    uint32_t connect_ms;        //Tempo total de configuracao + conexao
+    uint32_t publishes;
+    uint32_t records;           //Registros confirmados pelo broker
+    uint32_t bytes;             //Bytes de payload publicados
+    uint32_t publish_ms;        //Tempo total dentro dos esvaziamentos
+    uint32_t errors;
+    uint32_t alerts;            //Alertas publicados pela fila urgente
+    uint32_t alert_ms;          //Do inicio do ultimo alerta ao OK do broker
+    uint32_t prepared;          //Registros enviados com payload ja preparado
+    uint32_t stale;             //Resultados que chegaram depois do prazo, descartados
+} mqtt_pub_stats_t;
+
+/**
+ * @brief   Cria a fila de resultados e monta o perfil do AT+SMCONF. As
+ *          strings de cfg devem permanecer validas.
+ *
+ * Requer at_cmd_init() e modem_cfg_init() ja executados.
+ *
+ * @return  ESP_OK, ESP_ERR_INVALID_SIZE (parametro longo demais para um
+ *          comando) ou ESP_ERR_NO_MEM
+ */
+esp_err_t mqtt_pub_init(const mqtt_pub_cfg_t *cfg);
+
+/**
+ * @brief   Garante uma sessao MQTT aberta.
+ *
+ * Reaproveita a sessao se o modem informar que ja esta conectado (pelo
+ * +SMSTATE acompanhado no netreg, ou AT+SMSTATE? sem estado conhecido);
+ * senao configura (apenas na primeira vez) e conecta.
+ *
+ * @return  ESP_OK, ESP_ERR_INVALID_SIZE (parametro longo demais) ou ESP_FAIL
+ */
+esp_err_t mqtt_pub_connect(void);
+
+/**
+ * @brief   Publica os alertas da fila urgente e depois todos os registros
+ *          pendentes do tlog na sessao aberta.
+ *
+ * @param   log     tlog a esvaziar; NULL publica so a fila urgente
+ * @param   sent    Registros confirmados (pode ser NULL)
+ *
+ * @return  ESP_OK se o log foi esvaziado
+ */
+esp_err_t mqtt_pub_drain(tlog_t *log, size_t *sent);
+
+/**
+ * @brief   Le e codifica o primeiro lote pendente do tlog sem publicar.
+ *
+ * Nao usa o modem. Alertas publicados depois descartam a preparacao (as
+ * areas de payload sao as mesmas), assim como um lote que nao comece no
+ * mesmo registro.
+ *
+ * @return  Registros cobertos pelos payloads preparados
+ */
+size_t mqtt_pub_prepare(tlog_t *log);
+
+/**
+ * @brief   Enfileira um registro para publicacao imediata e avisa pela
+ *          callback de mqtt_pub_on_urgent().
+ *
+ * Registros TELEM_TYPE_EVT tem o age_ms preenchido na hora do envio.
+ *
+ * @return  ESP_OK, ESP_ERR_INVALID_SIZE ou ESP_ERR_NO_MEM (fila cheia)
+ */
+esp_err_t mqtt_pub_urgent(uint8_t type, const void *data, size_t len);
+
+/**
+ * @brief   Registra quem e avisado a cada alerta enfileirado. A callback
+ *          roda na task que chamou mqtt_pub_urgent() e nao deve bloquear.
+ */
+void mqtt_pub_on_urgent(void (*cb)(void *arg), void *arg);
+
+/**
+ * @brief   Ha alerta aguardando publicacao.
+ */
+bool mqtt_pub_urgent_pending(void);
+
+/**
+ * @brief   Encerra a sessao (AT+SMDISC).
+ */
+esp_err_t mqtt_pub_disconnect(void);
+
+/**
+ * @brief   Obriga a proxima conexao a conferir o AT+SMCONF no modem.
+ */
+void mqtt_pub_invalidate(void);
+
+void mqtt_pub_get_stats(mqtt_pub_stats_t *stats);
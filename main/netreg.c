@@ -0,0 +1,304 @@
+/* Registro na rede, PDP e sessao MQTT acompanhados pelas URCs do modem
+
+   netreg_feed() roda na task leitora da UART, uma linha por vez; os
+   leitores sao outras tasks. A linha e separada e convertida fora do
+   lock; o spinlock so cobre a gravacao no modelo e a copia, e o aviso e
+   chamado fora dele, so quando algum campo mudou.
+
+   +CEREG e +CGREG chegam em duas formas: a resposta da consulta comeca
+   pelo modo (+CEREG: <n>,<stat>[,<tac>,<ci>,<AcT>]) e a URC pelo estado
+   (+CEREG: <stat>[,<tac>,<ci>,<AcT>]). TAC e celula vem entre aspas, em
+   hexadecimal; o segundo campo sem aspas identifica a resposta.
+*/
+
+#include <stdlib.h>
+#include "string.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "at_uart.h"
+#include "modem_cfg.h"
+#include "dlog.h"
+#include "netreg.h"
+
+#define NETREG_FIELDS       6       //Campos lidos por linha (os demais sao ignorados)
+#define NETREG_FIELD_MAX    16
+
+typedef enum {
+    NR_REG,
+    NR_PDP,
+    NR_MQTT,
+} nr_kind_t;
+
+typedef struct {
+    char txt[NETREG_FIELD_MAX];
+    bool quoted;
+} nr_field_t;
+
+//URCs de registro com localizacao; AT+CGREG vale para o GPRS de fallback
+static const modem_cfg_item_t nr_cfg_items[] = {
+    {"AT+CEREG?\r", "+CEREG:", "2", "AT+CEREG=2\r"},
+    {"AT+CGREG?\r", "+CGREG:", "2", "AT+CGREG=2\r"},
+};
+static modem_cfg_t nr_cfg = {
+    .name = "urc",
+    .items = nr_cfg_items,
+    .n = sizeof(nr_cfg_items) / sizeof(nr_cfg_items[0]),
+};
+
+static portMUX_TYPE nr_lock = portMUX_INITIALIZER_UNLOCKED;
+static netreg_t nr = {
+    .eps = NETREG_UNKNOWN,
+    .gprs = NETREG_UNKNOWN,
+    .act = NETREG_UNKNOWN,
+    .pdp = NETREG_UNKNOWN,
+    .mqtt = NETREG_UNKNOWN,
+};
+static void (*nr_cb)(void *arg);
+static void *nr_cb_arg;
+
+//Separa ate max campos por virgula, sem espacos e aspas; devolve quantos
+static int nr_split(const char *p, const char *end, nr_field_t *f, int max)
+{
+    int n = 0;
+
+    while (p < end && n < max) {
+        size_t len = 0;
+
+        f[n].quoted = false;
+        while (p < end && *p == ' ') {
+            p++;
+        }
+        while (p < end && *p != ',') {
+            if (*p == '"') {
+                f[n].quoted = true;
+            } else if (*p != ' ' && len < NETREG_FIELD_MAX - 1) {
+                f[n].txt[len++] = *p;
+            }
+            p++;
+        }
+        f[n++].txt[len] = '\0';
+        p++;
+    }
+    return n;
+}
+
+static inline uint8_t nr_u8(const nr_field_t *f)
+{
+    return (uint8_t)strtoul(f->txt, NULL, 10);
+}
+
+static inline bool nr_is_reg(uint8_t stat)
+{
+    return stat == 1 || stat == 5;
+}
+
+//Linha ja interpretada, aplicada ao modelo depois sob nr_lock
+typedef struct {
+    nr_kind_t kind;
+    bool eps;                       //+CEREG (senao +CGREG)
+    bool loc;                       //Trouxe TAC e celula
+    bool has_act;
+    uint8_t stat;                   //Stat do registro ou estado do PDP/MQTT
+    uint8_t act;
+    uint32_t tac;
+    uint32_t ci;
+} nr_upd_t;
+
+//Sem lock: separa e converte os campos; devolve false se a linha nao interessa
+static bool nr_parse(const char *line, size_t len, nr_upd_t *u)
+{
+    const char *end = line + len;
+    nr_field_t f[NETREG_FIELDS];
+    int n, loc;
+
+    memset(u, 0, sizeof(*u));
+    if (strncmp(line, "+CEREG:", 7) == 0 || strncmp(line, "+CGREG:", 7) == 0) {
+        n = nr_split(line + 7, end, f, NETREG_FIELDS);
+        if (n < 1) {
+            return false;
+        }
+        u->kind = NR_REG;
+        u->eps = (line[2] == 'E');
+        //Resposta da consulta: <n>,<stat>,...
+        loc = (n >= 2 && !f[1].quoted) ? 1 : 0;
+        u->stat = nr_u8(&f[loc]);
+        loc++;
+        if (n >= loc + 2 && f[loc].quoted) {
+            u->loc = true;
+            u->tac = strtoul(f[loc].txt, NULL, 16);
+            u->ci = strtoul(f[loc + 1].txt, NULL, 16);
+            if (u->eps && n >= loc + 3) {
+                u->has_act = true;
+                u->act = nr_u8(&f[loc + 2]);
+            }
+        }
+    } else if (strncmp(line, "+APP PDP: 0,", 12) == 0) {
+        u->kind = NR_PDP;
+        u->stat = (strncmp(line + 12, "ACTIVE", 6) == 0);
+    } else if (strncmp(line, "+CNACT: 0,", 10) == 0) {
+        n = nr_split(line + 10, end, f, 1);
+        u->kind = NR_PDP;
+        u->stat = (n == 1 && nr_u8(&f[0]) == 1);
+    } else if (strncmp(line, "+SMSTATE:", 9) == 0 && nr_split(line + 9, end, f, 1) == 1) {
+        u->kind = NR_MQTT;
+        u->stat = (nr_u8(&f[0]) != 0);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+//Chamada com nr_lock; devolve true se algum campo mudou
+static bool nr_apply(const nr_upd_t *u)
+{
+    uint8_t *stat;
+    bool changed;
+
+    switch (u->kind) {
+    case NR_REG:
+        stat = u->eps ? &nr.eps : &nr.gprs;
+        changed = (*stat != u->stat);
+        *stat = u->stat;
+        if (u->loc) {
+            changed |= (u->tac != nr.tac || u->ci != nr.ci);
+            nr.tac = u->tac;
+            nr.ci = u->ci;
+        }
+        if (u->has_act) {
+            nr.act = u->act;
+        }
+        return changed;
+    case NR_PDP:
+        //Sem contexto a sessao MQTT tambem caiu
+        changed = (nr.pdp != u->stat);
+        nr.pdp = u->stat;
+        if (!u->stat && nr.mqtt != 0) {
+            nr.mqtt = 0;
+            changed = true;
+        }
+        return changed;
+    case NR_MQTT:
+        changed = (nr.mqtt != u->stat);
+        nr.mqtt = u->stat;
+        return changed;
+    }
+    return false;
+}
+
+bool netreg_feed(const char *line, size_t len)
+{
+    nr_upd_t u;
+    netreg_t snap;
+    int64_t now;
+    bool changed;
+
+    if (len < 8 || line[0] != '+' || !nr_parse(line, len, &u)) {
+        return false;
+    }
+    now = esp_timer_get_time();
+    portENTER_CRITICAL(&nr_lock);
+    changed = nr_apply(&u);
+    nr.urcs++;
+    if (changed) {
+        nr.changes++;
+        nr.changed_us = now;
+    }
+    snap = nr;
+    portEXIT_CRITICAL(&nr_lock);
+
+    if (!changed) {
+        return true;
+    }
+    switch (u.kind) {
+    case NR_REG:
+        DLOG(NET_REG, snap.eps, snap.gprs, snap.tac, snap.ci);
+        break;
+    case NR_PDP:
+        DLOG(NET_PDP, snap.pdp);
+        break;
+    case NR_MQTT:
+        DLOG(NET_MQTT, snap.mqtt);
+        break;
+    }
+    if (nr_cb != NULL) {
+        nr_cb(nr_cb_arg);
+    }
+    return true;
+}
+
+esp_err_t netreg_init(void)
+{
+    at_uart_set_urc(netreg_feed);
+    return ESP_OK;
+}
+
+esp_err_t netreg_enable(void)
+{
+    return modem_cfg_apply(&nr_cfg);
+}
+
+void netreg_on_change(void (*cb)(void *arg), void *arg)
+{
+    nr_cb_arg = arg;
+    nr_cb = cb;
+}
+
+void netreg_modem_reset(void)
+{
+    portENTER_CRITICAL(&nr_lock);
+    nr.eps = NETREG_UNKNOWN;
+    nr.gprs = NETREG_UNKNOWN;
+    nr.act = NETREG_UNKNOWN;
+    nr.pdp = NETREG_UNKNOWN;
+    nr.mqtt = NETREG_UNKNOWN;
+    portEXIT_CRITICAL(&nr_lock);
+}
+
+void netreg_set_mqtt(uint8_t state)
+{
+    portENTER_CRITICAL(&nr_lock);
+    nr.mqtt = state;
+    portEXIT_CRITICAL(&nr_lock);
+}
+
+void netreg_get(netreg_t *out)
+{
+    portENTER_CRITICAL(&nr_lock);
+    *out = nr;
+    portEXIT_CRITICAL(&nr_lock);
+}
+
+uint8_t netreg_registered(void)
+{
+    uint8_t eps, gprs;
+
+    portENTER_CRITICAL(&nr_lock);
+    eps = nr.eps;
+    gprs = nr.gprs;
+    portEXIT_CRITICAL(&nr_lock);
+    if (nr_is_reg(eps) || nr_is_reg(gprs)) {
+        return 1;
+    }
+    return (eps == NETREG_UNKNOWN && gprs == NETREG_UNKNOWN) ? NETREG_UNKNOWN : 0;
+}
+
+uint8_t netreg_pdp(void)
+{
+    uint8_t pdp;
+
+    portENTER_CRITICAL(&nr_lock);
+    pdp = nr.pdp;
+    portEXIT_CRITICAL(&nr_lock);
+    return pdp;
+}
+
+uint8_t netreg_mqtt(void)
+{
+    uint8_t mqtt;
+
+    portENTER_CRITICAL(&nr_lock);
+    mqtt = nr.mqtt;
+    portEXIT_CRITICAL(&nr_lock);
+    return mqtt;
+}
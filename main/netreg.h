@@ -0,0 +1,85 @@
+/* Registro na rede, PDP e sessao MQTT acompanhados pelas URCs do modem
+
+   Com AT+CEREG=2 e AT+CGREG=2 o SIM7070 avisa sozinho cada mudanca do
+   registro, com TAC/LAC e celula; o contexto avisa "+APP PDP: 0,ACTIVE" e
+   "+APP PDP: 0,DEACTIVE" e o cliente MQTT "+SMSTATE: 0" quando cai. A task
+   leitora da UART passa cada linha por netreg_feed(): as URCs atualizam o
+   modelo e chamam o aviso registrado na hora, sem consulta periodica. As
+   respostas das consultas (+CEREG: <n>,<stat>, +CNACT: 0,<status>,
+   +SMSTATE: <n>) tem o mesmo prefixo e tambem alimentam o modelo.
+
+   Cada campo e desconhecido (NETREG_UNKNOWN) ate a primeira URC ou
+   consulta: no boot, depois do deep sleep (RAM perdida) e depois de um
+   reset do modem. Quem espera decide consultar o modem nesse caso.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define NETREG_UNKNOWN      0xFF    //Campo ainda nao informado pelo modem
+
+typedef struct {
+    uint8_t eps;                //Stat do +CEREG (1 casa, 5 roaming), NETREG_UNKNOWN
+    uint8_t gprs;               //Stat do +CGREG
+    uint8_t act;                //Tecnologia do +CEREG (7 CAT-M, 9 NB-IoT), NETREG_UNKNOWN
+    uint8_t pdp;                //Contexto 0 ativo (1) ou nao (0)
+    uint8_t mqtt;               //Sessao MQTT conectada (1) ou nao (0)
+    uint32_t tac;               //TAC/LAC da ultima URC com localizacao
+    uint32_t ci;                //Celula
+    uint32_t urcs;              //Linhas aplicadas ao modelo
+    uint32_t changes;           //Linhas que mudaram algum campo
+    int64_t changed_us;         //esp_timer da ultima mudanca
+} netreg_t;
+
+/**
+ * @brief   Registra netreg_feed() na leitora da UART. Depois de
+ *          at_uart_init().
+ */
+esp_err_t netreg_init(void);
+
+/**
+ * @brief   Liga as URCs de registro no modem (perfil do modem_cfg: so o
+ *          que difere e enviado). Depois de at_cmd_init() e
+ *          modem_cfg_init(); bloqueia ate o fim das consultas.
+ */
+esp_err_t netreg_enable(void);
+
+/**
+ * @brief   Aviso a cada mudanca do modelo, chamado pela task leitora da
+ *          UART: deve so sinalizar (fsm_post, notificacao).
+ */
+void netreg_on_change(void (*cb)(void *arg), void *arg);
+
+/**
+ * @brief   Aplica uma linha recebida do modem.
+ *
+ * @return  true se a linha e do modelo (URC ou resposta de consulta)
+ */
+bool netreg_feed(const char *line, size_t len);
+
+/**
+ * @brief   Modem reiniciado (PWRKEY): tudo volta a desconhecido e as URCs
+ *          precisam ser ligadas de novo.
+ */
+void netreg_modem_reset(void);
+
+/**
+ * @brief   Estado da sessao MQTT apurado por quem a abriu ou fechou
+ *          (SMCONN, SMDISC); NETREG_UNKNOWN manda consultar de novo.
+ */
+void netreg_set_mqtt(uint8_t state);
+
+void netreg_get(netreg_t *out);
+
+/**
+ * @brief   Registrado (1) em EPS ou GPRS, nao registrado (0) ou
+ *          NETREG_UNKNOWN sem nenhum dos dois informado.
+ */
+uint8_t netreg_registered(void);
+
+uint8_t netreg_pdp(void);
+
+uint8_t netreg_mqtt(void);
@@ -0,0 +1,333 @@
+/* Gerenciamento de energia entre as janelas de relatorio
+
+   Os tempos do ciclo sao medidos com o esp_timer, que para no deep sleep;
+   a duracao do deep sleep vem do relogio do sistema (mantido pelo RTC),
+   com o instante de entrada guardado na memoria RTC.
+*/
+
+#include <stdio.h>
+#include <sys/time.h>
+#include "string.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "driver/rtc_io.h"
+#include "sdkconfig.h"
+#include "imu.h"
+#include "rtstats.h"
+#include "power.h"
+
+#define POWER_RTC_MAGIC     0x52575031  //"PWR1"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t cycles;
+    uint32_t deep_sleeps;
+    int64_t sleep_at_us;            //Relogio do sistema na entrada do deep sleep
+    uint32_t sleep_ms;              //Duracao pedida
+    bool modem_asleep;              //Modem em sleep pelo DTR durante o deep sleep
+    bool tlog_ok;
+    tlog_cursor_t tlog;
+    power_cycle_t last;
+} power_rtc_t;
+
+static RTC_DATA_ATTR power_rtc_t pw_rtc;
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t pw_lock;    //APB no maximo e sem light sleep com o modem acordado
+#endif
+static power_wake_t pw_wake;
+static bool pw_kept;
+static bool pw_modem_awake;
+static bool pw_gnss_on;
+static int64_t pw_span_us;              //Inicio do ciclo (fim da janela anterior ou boot)
+static int64_t pw_window_us;
+static int64_t pw_next_us;              //Inicio da proxima janela
+static int64_t pw_modem_at;
+static int64_t pw_modem_ready;          //DTR baixado: UART do modem responde a partir daqui
+static int64_t pw_gnss_at;
+static int64_t pw_modem_us;             //Acumulados no ciclo
+static int64_t pw_gnss_us;
+static uint64_t pw_busy0;
+static uint32_t pw_deep_ms;             //Deep sleep antes do primeiro ciclo deste boot
+static volatile TickType_t pw_motion_tick;
+
+static int64_t power_wall_us(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void power_lock(bool take)
+{
+#if CONFIG_PM_ENABLE
+    if (pw_lock != NULL) {
+        if (take) {
+            esp_pm_lock_acquire(pw_lock);
+        } else {
+            esp_pm_lock_release(pw_lock);
+        }
+    }
+#endif
+}
+
+esp_err_t power_init(void)
+{
+    esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+    gpio_config_t io = {
+        .pin_bit_mask = 1ULL << POWER_DTR_GPIO,
+        .mode = GPIO_MODE_OUTPUT,
+    };
+    esp_err_t ret;
+
+    pw_wake = (cause == ESP_SLEEP_WAKEUP_TIMER) ? POWER_WAKE_TIMER :
+              (cause == ESP_SLEEP_WAKEUP_EXT0) ? POWER_WAKE_MOTION : POWER_WAKE_BOOT;
+    if (pw_wake == POWER_WAKE_BOOT || pw_rtc.magic != POWER_RTC_MAGIC) {
+        memset(&pw_rtc, 0, sizeof(pw_rtc));
+        pw_rtc.magic = POWER_RTC_MAGIC;
+        pw_wake = POWER_WAKE_BOOT;
+    } else {
+        int64_t dt = power_wall_us() - pw_rtc.sleep_at_us;
+
+        pw_deep_ms = dt > 0 ? (uint32_t)(dt / 1000) : 0;
+        printf("Despertar por %s apos %u ms de deep sleep (pedido %u ms), ciclo %u\n",
+               pw_wake == POWER_WAKE_TIMER ? "timer" : "movimento", pw_deep_ms, pw_rtc.sleep_ms, pw_rtc.cycles);
+    }
+    if (pw_wake == POWER_WAKE_MOTION) {
+        pw_motion_tick = xTaskGetTickCount();
+    }
+
+    //Depois do deep sleep o DTR segue alto (modem dormindo) ate power_modem_wake()
+    pw_kept = (pw_wake != POWER_WAKE_BOOT && pw_rtc.modem_asleep);
+    pw_modem_awake = !pw_kept;
+    ret = gpio_config(&io);
+    gpio_set_level(POWER_DTR_GPIO, pw_modem_awake ? 0 : 1);
+    //O GPIO do PWRKEY ja foi configurado pelo app_main
+    gpio_set_level(POWER_PWRKEY_GPIO, 0);
+    gpio_hold_dis(POWER_DTR_GPIO);
+    gpio_hold_dis(POWER_PWRKEY_GPIO);
+    gpio_deep_sleep_hold_dis();
+
+#if CONFIG_PM_ENABLE
+    esp_pm_config_esp32_t pm = {
+        .max_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = POWER_CPU_MIN_MHZ,
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        .light_sleep_enable = true,
+#endif
+    };
+    if (ret == ESP_OK) {
+        ret = esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "modem", &pw_lock);
+    }
+    if (ret == ESP_OK) {
+        ret = esp_pm_configure(&pm);
+    }
+    if (ret == ESP_OK && pw_modem_awake) {
+        power_lock(true);
+    }
+#endif
+    pw_modem_at = esp_timer_get_time();
+    return ret;
+}
+
+power_wake_t power_wake_cause(void)
+{
+    return pw_wake;
+}
+
+bool power_modem_kept(void)
+{
+    return pw_kept;
+}
+
+void power_modem_sleep(void)
+{
+    if (!pw_modem_awake) {
+        return;
+    }
+    pw_modem_us += esp_timer_get_time() - pw_modem_at;
+    gpio_set_level(POWER_DTR_GPIO, 1);
+    pw_modem_awake = false;
+    power_lock(false);
+}
+
+void power_modem_wake(void)
+{
+    if (pw_modem_awake) {
+        return;
+    }
+    power_lock(true);
+    gpio_set_level(POWER_DTR_GPIO, 0);
+    pw_modem_awake = true;
+    pw_modem_at = esp_timer_get_time();
+    pw_modem_ready = pw_modem_at + POWER_DTR_WAKE_MS * 1000LL;
+}
+
+uint32_t power_modem_ready_ms(void)
+{
+    int64_t left = pw_modem_ready - esp_timer_get_time();
+
+    return left > 0 ? (uint32_t)((left + 999) / 1000) : 0;
+}
+
+void power_pwrkey(bool on)
+{
+    gpio_set_level(POWER_PWRKEY_GPIO, on ? 1 : 0);
+}
+
+void power_gnss(bool on)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (on == pw_gnss_on) {
+        return;
+    }
+    if (on) {
+        pw_gnss_at = now;
+    } else {
+        pw_gnss_us += now - pw_gnss_at;
+    }
+    pw_gnss_on = on;
+}
+
+void power_note_motion(void)
+{
+    pw_motion_tick = xTaskGetTickCount();
+}
+
+void power_window_begin(void)
+{
+    //Fecha o periodo entre as janelas: o rtstats nao le sozinho enquanto dorme
+    rtstats_mark();
+    pw_window_us = esp_timer_get_time();
+    pw_next_us = pw_window_us + (int64_t)POWER_WINDOW_S * 1000000;
+}
+
+void power_set_next_window(uint32_t next_s)
+{
+    pw_next_us = esp_timer_get_time() + (int64_t)next_s * 1000000;
+}
+
+void power_window_end(power_cycle_t *out)
+{
+    int64_t now = esp_timer_get_time();
+    power_cycle_t *c = &pw_rtc.last;
+    uint64_t busy;
+    uint32_t on;
+    uint32_t awake;
+    uint64_t q;
+
+    //Periodo do rtstats = a janela (rtstats_print() depois daqui mostra ela)
+    rtstats_mark();
+    busy = rtstats_busy_us();
+
+    if (pw_modem_awake) {
+        pw_modem_us += now - pw_modem_at;
+        pw_modem_at = now;
+    }
+    if (pw_gnss_on) {
+        pw_gnss_us += now - pw_gnss_at;
+        pw_gnss_at = now;
+    }
+    on = (uint32_t)((now - pw_span_us) / 1000);
+    c->cycle = ++pw_rtc.cycles;
+    c->window_ms = (uint32_t)((now - pw_window_us) / 1000);
+    c->cpu_ms = (uint32_t)((busy - pw_busy0) / 1000);
+    c->cpu_ms = c->cpu_ms > on ? on : c->cpu_ms;
+    c->modem_ms = (uint32_t)(pw_modem_us / 1000);
+    c->modem_ms = c->modem_ms > on ? on : c->modem_ms;
+    c->gnss_ms = (uint32_t)(pw_gnss_us / 1000);
+#if CONFIG_PM_ENABLE && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    //Fora da CPU e do lock do modem o idle entra em light sleep
+    awake = c->cpu_ms > c->modem_ms ? c->cpu_ms : c->modem_ms;
+#else
+    //Sem esp_pm/tickless o idle nunca dorme: todo o ciclo ligado e acordado
+    awake = on;
+#endif
+    c->light_ms = on - awake;
+    c->deep_ms = pw_deep_ms;
+
+    //Carga em uA.ms: ESP32, IMU e modem ligados no ciclo mais o deep sleep anterior
+    q = (uint64_t)c->cpu_ms * POWER_UA_CPU + (uint64_t)(awake - c->cpu_ms) * POWER_UA_IDLE +
+        (uint64_t)c->light_ms * POWER_UA_LIGHT + (uint64_t)on * POWER_UA_IMU +
+        (uint64_t)c->modem_ms * POWER_UA_MODEM + (uint64_t)(on - c->modem_ms) * POWER_UA_MODEM_SLEEP +
+        (uint64_t)c->gnss_ms * POWER_UA_GNSS +
+        (uint64_t)c->deep_ms * (POWER_UA_DEEP + POWER_UA_IMU_WOM + POWER_UA_MODEM_SLEEP);
+    c->charge_uah = (uint32_t)(q / 3600000);
+    c->avg_ua = (on + c->deep_ms) ? (uint32_t)(q / (on + c->deep_ms)) : 0;
+
+    printf("| Power | Ciclo %u | Janela %u ms | CPU %u ms | Modem %u ms | GNSS %u ms | Light sleep %u ms | Deep sleep %u ms | %u uAh | Media %u uA\n",
+           c->cycle, c->window_ms, c->cpu_ms, c->modem_ms, c->gnss_ms, c->light_ms, c->deep_ms,
+           c->charge_uah, c->avg_ua);
+
+    pw_span_us = now;
+    pw_busy0 = busy;
+    pw_modem_us = 0;
+    pw_gnss_us = 0;
+    pw_deep_ms = 0;
+    if (out != NULL) {
+        *out = *c;
+    }
+}
+
+uint32_t power_next_window_ms(void)
+{
+    int64_t dt = pw_next_us - esp_timer_get_time();
+
+    return dt > 0 ? (uint32_t)(dt / 1000) : 0;
+}
+
+bool power_deep_sleep_ok(void)
+{
+#if CONFIG_LOGQ_DEEP_SLEEP
+    return xTaskGetTickCount() - pw_motion_tick >= pdMS_TO_TICKS(POWER_STILL_S * 1000) &&
+           power_next_window_ms() >= POWER_MIN_SLEEP_S * 1000;
+#else
+    return false;
+#endif
+}
+
+void power_deep_sleep(tlog_t *log)
+{
+    uint32_t ms = power_next_window_ms();
+
+    pw_rtc.tlog_ok = (log != NULL);
+    if (log != NULL) {
+        tlog_get_cursor(log, &pw_rtc.tlog);
+    }
+    power_modem_sleep();
+    pw_rtc.modem_asleep = true;
+    pw_rtc.deep_sleeps++;
+    pw_rtc.sleep_ms = ms;
+
+    esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000);
+    if (imu_sleep() == ESP_OK) {
+        rtc_gpio_pullup_dis(IMU_INT_GPIO);
+        rtc_gpio_pulldown_en(IMU_INT_GPIO);
+        esp_sleep_enable_ext0_wakeup(IMU_INT_GPIO, 1);
+    }
+    //DTR alto e PWRKEY solto durante o sono
+    gpio_hold_en(POWER_DTR_GPIO);
+    gpio_hold_en(POWER_PWRKEY_GPIO);
+    gpio_deep_sleep_hold_en();
+
+    printf("Deep sleep por %u ms (%u ate agora)\n", ms, pw_rtc.deep_sleeps);
+    fflush(stdout);
+    pw_rtc.sleep_at_us = power_wall_us();
+    esp_deep_sleep_start();
+}
+
+const tlog_cursor_t *power_tlog_cursor(void)
+{
+    return (pw_wake != POWER_WAKE_BOOT && pw_rtc.tlog_ok) ? &pw_rtc.tlog : NULL;
+}
+
+void power_get_cycle(power_cycle_t *out)
+{
+    *out = pw_rtc.last;
+}
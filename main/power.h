@@ -0,0 +1,169 @@
+/* Gerenciamento de energia entre as janelas de relatorio
+
+   O ciclo de trabalho e dividido em janelas de relatorio: no inicio de
+   cada uma o modem acorda, faz o fix e publica; no fim ele volta a dormir
+   (AT+CSCLK=1 e DTR alto) ate a janela seguinte. O intervalo e
+   POWER_WINDOW_S ou o escolhido pela politica de relatorio (report.h).
+   Entre as janelas:
+     - com o veiculo em movimento o ESP32 segue ligado (IMU e eventos) e
+       entra em light sleep automatico sempre que as tasks ficam ociosas
+       (esp_pm com tickless idle); enquanto o modem esta acordado um lock do
+       esp_pm mantem o APB no maximo, sem light sleep, para nao perder a
+       UART;
+     - parado ha POWER_STILL_S, entra em deep sleep ate a proxima janela. A
+       IMU fica em wake-on-motion e o pino INT (ext0) acorda antes se o
+       veiculo voltar a se mover. O modem segue em sleep, com o DTR e o
+       PWRKEY travados pelo hold dos pinos RTC.
+
+   A memoria RTC guarda o que o deep sleep apagaria: cursores do log de
+   telemetria, contador de ciclos e as medicoes do ultimo ciclo (o ultimo
+   fix fica no cache do gnss_sess.h).
+
+   Cada ciclo (do fim de uma janela ao fim da seguinte) e medido: tempo de
+   janela, CPU fora do idle (rtstats), modem e GNSS ligados, light sleep e
+   deep sleep; com as correntes POWER_UA_* isso da uma estimativa da carga
+   consumida e da corrente media.
+
+   Requer CONFIG_PM_ENABLE e CONFIG_FREERTOS_USE_TICKLESS_IDLE
+   (sdkconfig.defaults); sem eles so o deep sleep e o sleep do modem atuam.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "tlog.h"
+
+#define POWER_DTR_GPIO      25
+#define POWER_PWRKEY_GPIO   4       //Mesmo pino do gsm_pwrkey()
+#define POWER_WINDOW_S      (30 * 60)   //Intervalo entre janelas de relatorio
+#define POWER_STILL_S       (10 * 60)   //Sem movimento ha esse tempo: deep sleep entre janelas
+#define POWER_MIN_SLEEP_S   60      //Menos que isso nao compensa o boot
+#define POWER_DTR_WAKE_MS   100     //DTR baixo ate a UART do modem responder
+#define POWER_CPU_MIN_MHZ   40      //Frequencia ociosa do esp_pm (XTAL)
+
+//Correntes estimadas para o balanco de energia (uA), a calibrar na placa
+#define POWER_UA_CPU        40000   //ESP32 executando
+#define POWER_UA_IDLE       15000   //Ocioso sem light sleep (modem acordado)
+#define POWER_UA_LIGHT      1000    //Light sleep automatico
+#define POWER_UA_DEEP       20      //ESP32 em deep sleep, com o ext0
+#define POWER_UA_IMU        3900    //IMU amostrando a 1 kHz
+#define POWER_UA_IMU_WOM    10      //IMU em wake-on-motion
+#define POWER_UA_MODEM      15000   //SIM7070 acordado, media com os picos de TX
+#define POWER_UA_MODEM_SLEEP    1000    //SIM7070 em sleep pelo DTR
+#define POWER_UA_GNSS       30000   //Adicional com o GNSS ligado
+
+typedef enum {
+    POWER_WAKE_BOOT = 0,            //Energizacao ou reset
+    POWER_WAKE_TIMER,               //Deep sleep ate a janela
+    POWER_WAKE_MOTION,              //Deep sleep interrompido pela IMU
+} power_wake_t;
+
+typedef struct {
+    uint32_t cycle;                 //Ciclos desde a energizacao
+    uint32_t window_ms;             //Tempo acordado na janela (inicio ate o modem dormir)
+    uint32_t cpu_ms;                //CPU fora do idle no ciclo
+    uint32_t modem_ms;              //Modem acordado no ciclo
+    uint32_t gnss_ms;
+    uint32_t light_ms;              //Ligado sem CPU nem modem: light sleep automatico (0 sem PM/tickless)
+    uint32_t deep_ms;               //Deep sleep antes desta janela
+    uint32_t charge_uah;            //Estimativa do ciclo inteiro
+    uint32_t avg_ua;
+} power_cycle_t;
+
+/**
+ * @brief   Identifica o despertar, restaura o estado da memoria RTC,
+ *          configura o DTR e liga o light sleep automatico.
+ *
+ * Deve ser chamada antes das tasks do modem e da IMU. No primeiro boot o
+ * modem comeca acordado; depois de um deep sleep ele continua dormindo ate
+ * power_modem_wake().
+ *
+ * @return  ESP_OK ou o erro do esp_pm/GPIO (o resto segue funcionando)
+ */
+esp_err_t power_init(void);
+
+power_wake_t power_wake_cause(void);
+
+/**
+ * @brief   O modem ficou ligado em sleep durante o deep sleep (nao precisa
+ *          de reset nem de nova configuracao de energia).
+ */
+bool power_modem_kept(void);
+
+/**
+ * @brief   Coloca o modem em sleep (DTR alto) e libera o light sleep.
+ *          Requer AT+CSCLK=1 enviado depois de ligar o modem.
+ */
+void power_modem_sleep(void);
+
+/**
+ * @brief   Acorda o modem (DTR baixo), sem esperar a UART. Sem efeito se ja
+ *          acordado.
+ */
+void power_modem_wake(void);
+
+/**
+ * @brief   Milissegundos ate a UART do modem responder depois do ultimo
+ *          power_modem_wake() (0: pronta). Quem vai enviar AT arma esse
+ *          prazo em vez de bloquear.
+ */
+uint32_t power_modem_ready_ms(void);
+
+/**
+ * @brief   Nivel do PWRKEY do modem (true: pressionado). Os pulsos e as
+ *          esperas ficam com o GSM_C.
+ */
+void power_pwrkey(bool on);
+
+/**
+ * @brief   Contabiliza o GNSS ligado/desligado.
+ */
+void power_gnss(bool on);
+
+/**
+ * @brief   Movimento detectado (interrupcao da IMU ou evento).
+ */
+void power_note_motion(void);
+
+/**
+ * @brief   Marca o inicio de uma janela de relatorio.
+ */
+void power_window_begin(void);
+
+/**
+ * @brief   Proxima janela daqui a next_s segundos, no lugar de
+ *          POWER_WINDOW_S. Vale ate a janela seguinte comecar.
+ */
+void power_set_next_window(uint32_t next_s);
+
+/**
+ * @brief   Fecha o ciclo no fim da janela, imprime e guarda as medicoes.
+ */
+void power_window_end(power_cycle_t *out);
+
+/**
+ * @brief   Milissegundos ate o inicio da proxima janela (0 se ja passou).
+ */
+uint32_t power_next_window_ms(void);
+
+/**
+ * @brief   Parado ha POWER_STILL_S e com tempo ate a janela para valer um
+ *          deep sleep (e CONFIG_LOGQ_DEEP_SLEEP ligado).
+ */
+bool power_deep_sleep_ok(void);
+
+/**
+ * @brief   Dorme ate a proxima janela ou ate movimento na IMU. Nao retorna:
+ *          o despertar e um boot, com o estado em power_init().
+ *
+ * @param   log     Log de telemetria aberto, para guardar os cursores (pode ser NULL)
+ */
+void power_deep_sleep(tlog_t *log);
+
+/**
+ * @brief   Cursores do log guardados antes do deep sleep, ou NULL.
+ */
+const tlog_cursor_t *power_tlog_cursor(void);
+
+void power_get_cycle(power_cycle_t *out);
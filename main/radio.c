@@ -0,0 +1,103 @@
+/* Escalonador do radio do SIM7070: janelas de GNSS e de LTE por ciclo
+
+   Os tempos sao do esp_timer; a fase corrente so e somada na troca ou no
+   fim do ciclo.
+*/
+
+#include <stdio.h>
+#include "string.h"
+#include "esp_timer.h"
+#include "radio.h"
+
+static radio_plan_t rd_plan;
+static radio_cycle_t rd_cycle;
+static radio_phase_t rd_phase;
+static int64_t rd_t0;                   //Inicio do ciclo
+static int64_t rd_at;                   //Inicio da fase corrente
+static int64_t rd_gnss_at;              //Ultima vez que o GNSS ligou
+static uint32_t rd_gnss_ms;             //Duracao da ultima janela de GNSS
+static uint32_t rd_cycles;
+
+static const char *const rd_names[RADIO_PHASES] = {"Idle", "GNSS", "Troca", "Registro", "MQTT"};
+
+void radio_cycle_begin(radio_plan_t *plan, bool boot, bool lte_up)
+{
+    rd_plan.gnss_first = !boot;
+    rd_plan.lte_up = lte_up;
+    memset(&rd_cycle, 0, sizeof(rd_cycle));
+    rd_cycle.cycle = ++rd_cycles;
+    rd_t0 = esp_timer_get_time();
+    rd_at = rd_t0;
+    rd_phase = RADIO_IDLE;
+    rd_gnss_ms = 0;
+    if (plan != NULL) {
+        *plan = rd_plan;
+    }
+}
+
+uint16_t radio_gnss_budget(bool hot, uint16_t timeout_s)
+{
+    //Fix hot sai em segundos; mais que isso nao compensa refazer registro e PDP
+    return (rd_plan.lte_up && hot && timeout_s > RADIO_KEEP_S) ? RADIO_KEEP_S : timeout_s;
+}
+
+void radio_set(radio_phase_t phase)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (phase == rd_phase || phase >= RADIO_PHASES) {
+        return;
+    }
+    rd_cycle.phase_ms[rd_phase] += (uint32_t)((now - rd_at) / 1000);
+    if (phase == RADIO_GNSS) {
+        rd_gnss_at = now;
+        rd_cycle.switches += (rd_phase != RADIO_IDLE);
+    } else if (rd_phase == RADIO_GNSS) {
+        rd_gnss_ms = (uint32_t)((now - rd_gnss_at) / 1000);
+        rd_cycle.switches++;
+    }
+    rd_phase = phase;
+    rd_at = now;
+}
+
+radio_phase_t radio_phase(void)
+{
+    return rd_phase;
+}
+
+bool radio_lte_keep(void)
+{
+    return rd_plan.lte_up && rd_gnss_ms <= RADIO_KEEP_S * 1000u;
+}
+
+void radio_note_kept(bool kept)
+{
+    rd_cycle.lte_kept = kept;
+    rd_plan.lte_up = kept;
+}
+
+void radio_note_prepared(uint32_t records)
+{
+    rd_cycle.prepared += records;
+}
+
+void radio_cycle_end(radio_cycle_t *out)
+{
+    int64_t now = esp_timer_get_time();
+    radio_cycle_t *c = &rd_cycle;
+
+    c->phase_ms[rd_phase] += (uint32_t)((now - rd_at) / 1000);
+    rd_at = now;
+    rd_phase = RADIO_IDLE;
+    c->total_ms = (uint32_t)((now - rd_t0) / 1000);
+
+    printf("| Radio | Ciclo %u | Total %u ms |", c->cycle, c->total_ms);
+    for (int p = RADIO_GNSS; p < RADIO_PHASES; p++) {
+        printf(" %s %u ms |", rd_names[p], c->phase_ms[p]);
+    }
+    printf(" Trocas %u | Codificados na troca %u | LTE mantido %s\n", c->switches, c->prepared,
+           c->lte_kept ? "sim" : "nao");
+    if (out != NULL) {
+        *out = *c;
+    }
+}
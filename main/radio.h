@@ -0,0 +1,85 @@
+/* Escalonador do radio do SIM7070: janelas de GNSS e de LTE por ciclo
+
+   GNSS e LTE dividem o caminho de RF do SIM7070 e nao operam juntos. A
+   cada janela de relatorio o plano define a ordem das janelas (fix antes
+   da publicacao; no boot, publicacao antes) e quanto tempo o GNSS pode
+   ocupar o radio:
+     - o registro na rede e o contexto PDP nao sao derrubados para ligar o
+       GNSS; com o LTE ativo antes e uma janela de GNSS curta (ate
+       RADIO_KEEP_S, caso do hot start), o LTE e so conferido ao desligar o
+       GNSS (AT+CNACT?) em vez de refazer registro e PDP;
+     - o tempo da troca (GNSS desligado ate o LTE ter servico) e usado para
+       ler e codificar os payloads do tlog (mqtt_pub_prepare()).
+
+   Cada ciclo mede o tempo em cada fase e o total, impressos em
+   radio_cycle_end(). Nao guarda nada entre deep sleeps.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RADIO_KEEP_S        60      //GNSS ate este tempo: registro e PDP ainda valem
+#define RADIO_POLL_MS       1500    //Espera entre consultas do estado do radio
+
+typedef enum {
+    RADIO_IDLE = 0,             //Modem sem uso do radio (fora das janelas)
+    RADIO_GNSS,                 //GNSS ligado
+    RADIO_SWITCH,               //GNSS desligado, esperando servico LTE
+    RADIO_ATTACH,               //Bandas, PDP e registro
+    RADIO_DATA,                 //MQTT
+    RADIO_PHASES,
+} radio_phase_t;
+
+typedef struct {
+    bool gnss_first;            //Fix antes da publicacao
+    bool lte_up;                //LTE com PDP ativo no inicio da janela
+} radio_plan_t;
+
+typedef struct {
+    uint32_t cycle;
+    uint32_t total_ms;          //Inicio da janela ate o fim da publicacao
+    uint32_t phase_ms[RADIO_PHASES];
+    uint32_t switches;          //Trocas GNSS <-> LTE
+    uint32_t prepared;          //Registros codificados durante a troca
+    bool lte_kept;              //LTE reaproveitado depois do GNSS
+} radio_cycle_t;
+
+/**
+ * @brief   Inicia o ciclo de uma janela e monta o plano.
+ *
+ * @param   boot        Energizacao: publica antes do fix
+ * @param   lte_up      Registro e PDP ativos antes da janela
+ */
+void radio_cycle_begin(radio_plan_t *plan, bool boot, bool lte_up);
+
+/**
+ * @brief   Prazo da sessao de GNSS no ciclo: com o LTE ativo e partida hot,
+ *          limitado a RADIO_KEEP_S para nao perder o registro.
+ */
+uint16_t radio_gnss_budget(bool hot, uint16_t timeout_s);
+
+/**
+ * @brief   Muda de fase, somando o tempo da fase anterior.
+ */
+void radio_set(radio_phase_t phase);
+
+radio_phase_t radio_phase(void);
+
+/**
+ * @brief   Com o GNSS recem-desligado: o LTE do inicio da janela deve ter
+ *          sobrevivido (janela de GNSS ate RADIO_KEEP_S).
+ */
+bool radio_lte_keep(void);
+
+/**
+ * @brief   Resultado da conferencia do LTE depois do GNSS.
+ */
+void radio_note_kept(bool kept);
+
+void radio_note_prepared(uint32_t records);
+
+/**
+ * @brief   Fecha o ciclo e imprime o tempo por fase.
+ */
+void radio_cycle_end(radio_cycle_t *out);
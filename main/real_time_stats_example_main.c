@@ -9,44 +9,73 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include "string.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "nvs_flash.h"
+#include "hal/cpu_hal.h"
 #include "driver/gpio.h"
 #include "sdkconfig.h"
 //#include "TinyGsmClient.h"
 #include "driver/uart.h"
+#include "at_uart.h"
+#include "at_cmd.h"
+#include "tlog.h"
+#include "telem.h"
+#include "mqtt_pub.h"
+#include "imu.h"
+#include "vib.h"
+#include "evt.h"
+#include "rtstats.h"
+#include "bench.h"
+#include "power.h"
+#include "modem_cfg.h"
+#include "dlog.h"
+#include "ring.h"
+#include "fsm.h"
+#include "netreg.h"
+#include "report.h"
+#include "gsm.h"
 
-#define NUM_OF_SPIN_TASKS   6
-#define SPIN_ITER           500000  //Actual CPU cycles used will depend on compiler optimization
-#define SPIN_TASK_PRIO      2
 #define STATS_TASK_PRIO     3
 #define STATS_TASK_PRIOO     1
-#define STATS_TICKS         pdMS_TO_TICKS(1000)
-#define ARRAY_SIZE_OFFSET   5   //Increase this if print_real_time_stats returns ESP_ERR_INVALID_SIZE
+#define STATS_REPORT_S      (30 * 60)   //Intervalo minimo do registro de estatisticas na telemetria
+#define VIB_TASK_PRIO       5       //Abaixo da aquisicao, acima das tasks do modem
+#define VIB_REPORT_S        (30 * 60)   //Periodo de cada resumo de vibracao
+#define VIB_MOTION_POST_S   60      //Movimento repassado ao GSM_C no maximo a cada
+#define BENCH_TASK_PRIO     2       //Build de benchmark
+#define BENCH_TASK_CORE     1
+#define BENCH_PERIOD_MS     10000   //Intervalo entre execucoes do conjunto
 #define BLINK_GPIO          12
-#define DTR_GPIO            25
+#define BLINK_ON_MS         20      //Pulso curto do LED: nao segura o light sleep
 
 //Define para SIM7070
 
-#define TINY_GSM_MODEM_SIM7070
 //#define UART_BAUD           115200
 #define PIN_TX              27
 #define PIN_RX              26
-#define BUF_SIZE (1024)
 //int16_t msg_GSM[1024];
 //int16_t *datap = msg_GSM;
 //char *datap = (char *) malloc(1024);
 
-static char task_names[NUM_OF_SPIN_TASKS][configMAX_TASK_NAME_LEN];
-static SemaphoreHandle_t sync_spin_task;
 static SemaphoreHandle_t sync_stats_task;
-QueueHandle_t xQueueCaboGPS;
+static TaskHandle_t stats_task_handle;
+static TaskHandle_t blink_task_handle;
+static uint32_t heap_at_boot;
+static tlog_t telemetria;                     //Registros aguardando envio ao broker
+static bool telemetria_ok;
+static uint32_t vib_ciclos_amostra;           //Custo medio do ultimo periodo de vibracao
+
+_Static_assert(VIB_RATE_HZ == IMU_RATE_HZ && VIB_LSB_PER_G == IMU_ACCEL_LSB_PER_G, "vib.h fora de sincronia com imu.h");
 
 uart_config_t uart_config = {
-    .baud_rate = 9600,
+    .baud_rate = 9600,                      //Inicial; o at_link negocia o definitivo
     .data_bits = UART_DATA_8_BITS,
     .parity    = UART_PARITY_DISABLE,
     .stop_bits = UART_STOP_BITS_1,
@@ -54,1016 +83,391 @@ uart_config_t uart_config = {
 };
 
 /**
- * @brief   Function to print the CPU usage of tasks over a given duration.
- *
- * This function will measure and print the CPU usage of tasks over a specified
- * number of ticks (i.e. real time stats). This is implemented by simply calling
- * uxTaskGetSystemState() twice separated by a delay, then calculating the
- * differences of task run times before and after the delay.
- *
- * @note    If any tasks are added or removed during the delay, the stats of
- *          those tasks will not be printed.
- * @note    This function should be called from a high priority task to minimize
- *          inaccuracies with delays.
- * @note    When running in dual core mode, each core will correspond to 50% of
- *          the run time.
+ * @brief   Print heap usage counters next to the real time stats.
  *
- * @param   xTicksToWait    Period of stats measurement
- *
- * @return
- *  - ESP_OK                Success
- *  - ESP_ERR_NO_MEM        Insufficient memory to allocated internal arrays
- *  - ESP_ERR_INVALID_SIZE  Insufficient array size for uxTaskGetSystemState. Trying increasing ARRAY_SIZE_OFFSET
- *  - ESP_ERR_INVALID_STATE Delay duration too short
+ * The free heap is compared against the value sampled in app_main before any
+ * task was created, so a leak shows up as a steadily growing "Used since boot"
+ * figure over a long run.
  */
-static esp_err_t print_real_time_stats(TickType_t xTicksToWait)
+static void print_heap_stats(void)
 {
-    TaskStatus_t *start_array = NULL, *end_array = NULL;
-    UBaseType_t start_array_size, end_array_size;
-    uint32_t start_run_time, end_run_time;
-    esp_err_t ret;
-
-    //Allocate array to store current task states
-    start_array_size = uxTaskGetNumberOfTasks() + ARRAY_SIZE_OFFSET;
-    start_array = malloc(sizeof(TaskStatus_t) * start_array_size);
-    if (start_array == NULL) {
-        ret = ESP_ERR_NO_MEM;
-        goto exit;
-    }
-    //Get current task states
-    start_array_size = uxTaskGetSystemState(start_array, start_array_size, &start_run_time);
-    if (start_array_size == 0) {
-        ret = ESP_ERR_INVALID_SIZE;
-        goto exit;
-    }
-
-    vTaskDelay(xTicksToWait);
-
-    //Allocate array to store tasks states post delay
-    end_array_size = uxTaskGetNumberOfTasks() + ARRAY_SIZE_OFFSET;
-    end_array = malloc(sizeof(TaskStatus_t) * end_array_size);
-    if (end_array == NULL) {
-        ret = ESP_ERR_NO_MEM;
-        goto exit;
-    }
-    //Get post delay task states
-    end_array_size = uxTaskGetSystemState(end_array, end_array_size, &end_run_time);
-    if (end_array_size == 0) {
-        ret = ESP_ERR_INVALID_SIZE;
-        goto exit;
-    }
-
-    //Calculate total_elapsed_time in units of run time stats clock period.
-    uint32_t total_elapsed_time = (end_run_time - start_run_time);
-    if (total_elapsed_time == 0) {
-        ret = ESP_ERR_INVALID_STATE;
-        goto exit;
-    }
-
-    printf("| Task | Run Time | Percentage\n");
-    //Match each task in start_array to those in the end_array
-    for (int i = 0; i < start_array_size; i++) {
-        int k = -1;
-        for (int j = 0; j < end_array_size; j++) {
-            if (start_array[i].xHandle == end_array[j].xHandle) {
-                k = j;
-                //Mark that task have been matched by overwriting their handles
-                start_array[i].xHandle = NULL;
-                end_array[j].xHandle = NULL;
-                break;
-            }
-        }
-        //Check if matching task found
-        if (k >= 0) {
-            uint32_t task_elapsed_time = end_array[k].ulRunTimeCounter - start_array[i].ulRunTimeCounter;
-            uint32_t percentage_time = (task_elapsed_time * 100UL) / (total_elapsed_time * portNUM_PROCESSORS);
-            printf("| %s | %d | %d%%\n", start_array[i].pcTaskName, task_elapsed_time, percentage_time);
-        }
-    }
-
-    //Print unmatched tasks
-    for (int i = 0; i < start_array_size; i++) {
-        if (start_array[i].xHandle != NULL) {
-            printf("| %s | Deleted\n", start_array[i].pcTaskName);
-        }
-    }
-    for (int i = 0; i < end_array_size; i++) {
-        if (end_array[i].xHandle != NULL) {
-            printf("| %s | Created\n", end_array[i].pcTaskName);
-        }
-    }
-    ret = ESP_OK;
-
-exit:    //Common return path
-    free(start_array);
-    free(end_array);
-    return ret;
+    at_uart_stats_t at_stats;
+    imu_stats_t imu;
+    uint32_t free_now = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+    at_uart_get_stats(&at_stats);
+    printf("| Heap | Free %u | Min free %u | Largest block %u | Used since boot %d\n",
+           free_now,
+           heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+           heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+           (int)(heap_at_boot - free_now));
+    printf("| AT lines | Received %u | URCs %u | Dropped %u | Pool min free %u | GSM msg dropped %u\n",
+           at_stats.lines, at_stats.urcs, at_stats.dropped, at_stats.pool_min_free, gsm_msg_dropped());
+    imu_get_stats(&imu);
+    printf("| IMU | Samples %u | FIFO overflows %u | Ring dropped %u | Ring high water %u | I2C errors %u\n",
+           imu.samples, imu.fifo_overflows, imu.ring_dropped, imu.ring_high_water, imu.i2c_errors);
+    printf("| Vib | Cycles/sample %u\n", vib_ciclos_amostra);
 }
 
-static void spin_task(void *arg)
+//Pede a impressao das estatisticas (fim da janela ou sob demanda), sem esperar
+static void stats_request(void)
 {
-    xSemaphoreTake(sync_spin_task, portMAX_DELAY);
-    while (1) {
-        //Consume CPU cycles
-        for (int i = 0; i < SPIN_ITER; i++) {
-            __asm__ __volatile__("NOP");
-        }
-        vTaskDelay(pdMS_TO_TICKS(100));
+    if (stats_task_handle != NULL) {
+        xTaskNotifyGive(stats_task_handle);
     }
 }
 
 static void stats_task(void *arg)
 {
+    //Partida em sequencia: libera a proxima task
     xSemaphoreTake(sync_stats_task, portMAX_DELAY);
+    xSemaphoreGive(sync_stats_task);
 
-    //Start all the spin tasks
-    for (int i = 0; i < NUM_OF_SPIN_TASKS; i++) {
-        xSemaphoreGive(sync_spin_task);
-    }
-
-    //Print real time stats periodically
+    //Sem periodo: imprime o ultimo periodo do rtstats (a janela) a cada stats_request()
+    TickType_t ultimo_registro = xTaskGetTickCount();
     while (1) {
-        printf("\n\nGetting real time stats over %d ticks\n", STATS_TICKS);
-        if (print_real_time_stats(STATS_TICKS) == ESP_OK) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (rtstats_print() == ESP_OK) {
             printf("Real time stats obtained\n");
         } else {
             printf("Error getting real time stats\n");
         }
-        xSemaphoreGive(sync_stats_task);
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        print_heap_stats();
+        if (xTaskGetTickCount() - ultimo_registro >= pdMS_TO_TICKS(STATS_REPORT_S * 1000)) {
+            telem_stats_t reg;
+            telem_enc_t enc;
+            uint8_t bin[1 + TELEM_ENTRY_MAX];
+
+            ultimo_registro = xTaskGetTickCount();
+            if (rtstats_to_telem(&reg, (uint32_t)time(NULL)) == ESP_OK) {
+                //Mesmo registro que vai ao broker, em hexadecimal no console
+                telem_enc_init(&enc, bin, sizeof(bin));
+                telem_enc_stats(&enc, &reg);
+                printf("| Stats record | %u bytes |", enc.len);
+                for (size_t i = 0; i < enc.len; i++) {
+                    printf(" %02x", bin[i]);
+                }
+                printf("\n");
+                if (telemetria_ok && tlog_append(&telemetria, TELEM_TYPE_STATS, &reg, sizeof(reg)) != ESP_OK) {
+                    printf("Falha ao gravar estatisticas\n");
+                }
+            }
+        }
     }
 }
 
-//Task Blink para teste (OMM)
-static void blink_tsk(void *arg)
+#if CONFIG_LOGQ_BENCHMARK
+static uint32_t bench_cycles(void)
 {
-    xSemaphoreTake(sync_stats_task, portMAX_DELAY);
-
-    //Inicio das tasks tipo spin
-    for (int i = 0; i< NUM_OF_SPIN_TASKS; i++){
-        xSemaphoreGive(sync_spin_task);
-    }
+    return cpu_hal_get_cycle_count();
+}
 
-    //Blink de LED
-    gpio_reset_pin(BLINK_GPIO);
-    gpio_set_direction(BLINK_GPIO, GPIO_MODE_DEF_OUTPUT);
-    while (1)
-    {
-        /* code */
-        //printf("Turning off the LED\n");
-        gpio_set_level(BLINK_GPIO,0);
-        xSemaphoreGive(sync_stats_task);
-        vTaskDelay(pdMS_TO_TICKS(500));
-        //printf("Turning on the LED\n");
-        gpio_set_level(BLINK_GPIO,1);
-        xSemaphoreGive(sync_stats_task);
-        vTaskDelay(pdMS_TO_TICKS(500));
-        
-    }
+static uint64_t bench_time_ns(void)
+{
+    return (uint64_t)esp_timer_get_time() * 1000;
 }
 
-typedef struct GPS_Inf
+static int32_t bench_heap_used(void)
 {
- char UTCdt[18];
- char latit[10];
- char longi[11];
- char status[256];
-} GPSDados;
+    return (int32_t)(heap_at_boot - heap_caps_get_free_size(MALLOC_CAP_8BIT));
+}
 
-typedef enum{
-    COMPARE_NONE=0,
-    COMPARE_EQUAL,
-    COMPARE_RETURN,
-    COMPARE_CONTAINS,
-}COMPARE;
-char recBuff[512];
-#define sendReceiveBuff() (char *)&recBuff[0]
-int sendReceive(char * sendCmd, char * waitResp, int trys, COMPARE bCompare)
+#define BENCH_QUEUE_N       256     //Mensagens por repeticao
+#define BENCH_QUEUE_MSG     554     //Item do antigo xQueueCaboGPS (duas posicoes de 277 bytes)
+
+/**
+ * Entrega de uma resposta ao GSM_C pela fila do FreeRTOS, copiando o item
+ * do antigo xQueueCaboGPS na entrada e na saida, e pelo ring_mpsc_t, que
+ * so leva o indice do slot (o consumidor le a linha no pool). Mesma task
+ * envia e recebe: custo por mensagem sem troca de contexto.
+ */
+static size_t bench_queues(bench_result_t *out)
 {
-    int len;
-    int idx = 0; 
-    int trysTmp=0;
-    char *recStr=0;
-    //GPSDados envio;
-    GPSDados *pvEnvio = malloc(sizeof(GPSDados));
-    
-    len = strlen(sendCmd);
-    if (len > 256) {
-        return -1;
+    static uint8_t msg[BENCH_QUEUE_MSG];
+    static ring_cell_t cells[RING_CAP(GSM_MSG_SLOTS)];
+    static ring_mpsc_t r;
+    static QueueHandle_t q;
+    uint32_t best[2] = {UINT32_MAX, UINT32_MAX};
+    uint32_t chk[2] = {0, 0};
+    uint32_t v;
+
+    if (q == NULL && (q = xQueueCreate(GSM_MSG_SLOTS, BENCH_QUEUE_MSG)) == NULL) {
+        return 0;
     }
-    if (len == 0) {
-        return -2;
+    ring_mpsc_init(&r, cells, RING_CAP(GSM_MSG_SLOTS));
+    for (int rep = 0; rep < BENCH_REPEAT; rep++) {
+        uint32_t c0 = cpu_hal_get_cycle_count();
+        for (int i = 0; i < BENCH_QUEUE_N; i++) {
+            msg[0] = (uint8_t)i;
+            xQueueSend(q, msg, 0);
+            xQueueReceive(q, msg, 0);
+            chk[0] += msg[0];
+        }
+        uint32_t c1 = cpu_hal_get_cycle_count();
+        for (int i = 0; i < BENCH_QUEUE_N; i++) {
+            ring_mpsc_push(&r, i % GSM_MSG_SLOTS);
+            ring_mpsc_pop(&r, &v);
+            chk[1] += v;
+        }
+        uint32_t c2 = cpu_hal_get_cycle_count();
+        best[0] = (c1 - c0) < best[0] ? (c1 - c0) : best[0];
+        best[1] = (c2 - c1) < best[1] ? (c2 - c1) : best[1];
     }
-
-    len = strlen(waitResp);
-    if (len > 256) {
-        return -3;
+    for (int k = 0; k < 2; k++) {
+        out[k].name = k == 0 ? "xqueue" : "mpsc";
+        out[k].ops = BENCH_QUEUE_N;
+        out[k].cycles_op = best[k] / BENCH_QUEUE_N;
+        out[k].ns_op = (uint32_t)((uint64_t)out[k].cycles_op * 1000 / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+        out[k].heap_op = 0;
+        out[k].checksum = chk[k];
     }
+    return 2;
+}
 
-    if (bCompare > COMPARE_CONTAINS)
-        return -4;
-    
-    // Envia
-    uart_flush(UART_NUM_2);
-    printf("%s\n", sendCmd);
-    uart_write_bytes(UART_NUM_2, sendCmd, strlen(sendCmd));
-    uart_wait_tx_done(UART_NUM_2, pdMS_TO_TICKS(100));
-
-    do {
-
-        trysTmp++;
-
-        // Pega byte a byte e trata
-        while (uart_read_bytes(UART_NUM_2, (char *)&recBuff[idx], 1, pdMS_TO_TICKS(50)) > 0) {
-            if ((recBuff[idx]=='\r') || (recBuff[idx]=='\n') || (recBuff[idx]=='\0')) {
-                if (idx>1) {
-                    recBuff[idx] = '\0';
-                    printf("\t%s\n", recBuff);
-                    strcpy(pvEnvio->status, recBuff);
-                    xQueueSend(xQueueCaboGPS, pvEnvio, 1000);
-
-                    // Cai fora quandoi receber qualquer coisa e não queira esperar algo
-                    if ((bCompare == COMPARE_NONE) || (strlen(waitResp) == 0)) {
-                        return 0;
-                    }
-                    
-                    // Compara o recebido com o esperado
-                    else if (bCompare == COMPARE_EQUAL) {
-                        if (strcmp(recBuff, waitResp) == 0) {
-                            return (int)strlen(recBuff);
-                        }
-                    }
+/**
+ * Roda o conjunto de cargas do bench.c periodicamente e imprime os
+ * resultados (mesmo formato do tools/bench_host.c) seguidos do periodo do
+ * rtstats, com a carga da task e os minimos de pilha e heap.
+ */
+static void bench_tsk(void *arg)
+{
+    static const bench_port_t port = {
+        .cycles = bench_cycles,
+        .time_ns = bench_time_ns,
+        .heap_used = bench_heap_used,
+    };
+    bench_result_t res[BENCH_MAX + 2];
 
-                    // Compara o recebido com o esperado
-                    else if (bCompare == COMPARE_CONTAINS) {
-                        recStr = strstr(recBuff, waitResp);
-                        if (recStr != 0) {
-                            return (int)strlen(recBuff);
-                        }
-                    }
+    while (1) {
+        size_t n = bench_run(&port, res, BENCH_MAX);
+        n += bench_queues(&res[n]);
+        for (size_t i = 0; i < n; i++) {
+            bench_print(&res[i]);
+        }
+        //Periodo do rtstats = a rodada do conjunto
+        rtstats_mark();
+        rtstats_print();
+        print_heap_stats();
+        vTaskDelay(pdMS_TO_TICKS(BENCH_PERIOD_MS));
+    }
+}
+#endif
 
-                    //Retorna a resposta para ser tratada.
-                    else if (bCompare == COMPARE_RETURN){
-                        //strcpy(pvEnvio->status, recBuff);
-                        printf("\t%s\n", recBuff);
-                        //xQueueSend(xQueueCaboGPS, pvEnvio, 1000);                        
-                        return (int)strlen(recBuff);
+/**
+ * Consome as amostras da IMU e, a cada VIB_REPORT_S, grava no log de
+ * telemetria um resumo de vibracao por eixo. O horario vem do relogio do
+ * sistema, acertado pelo GNSS (antes do primeiro fix e o tempo desde o boot).
+ * Movimento e eventos seguem para a politica de relatorio do GSM_C.
+ */
+static void vib_tsk(void *arg)
+{
+    static vib_t vib;
+    static evt_t evt;
+    static const vib_cfg_t vib_conf = VIB_CFG_DEFAULT;
+    static const evt_cfg_t evt_conf = EVT_CFG_DEFAULT;
+    imu_sample_t amostras[64];
+    telem_vib_t resumo[VIB_AXES];
+    telem_evt_t ev;
+    TickType_t inicio = xTaskGetTickCount();
+    TickType_t movimento = inicio - pdMS_TO_TICKS(VIB_MOTION_POST_S * 1000);
+    uint64_t ciclos = 0;
+    uint32_t total = 0;
+    size_t n;
+
+    vib_init(&vib, &vib_conf);
+    evt_init(&evt, &evt_conf);
+    imu_set_consumer(xTaskGetCurrentTaskHandle());
+    while (1) {
+        uint32_t aviso = 0;
+
+        //Interrupcao de movimento da IMU ou ring pela metade; sem leitura periodica
+        xTaskNotifyWait(0, UINT32_MAX, &aviso, portMAX_DELAY);
+        if (aviso & IMU_NOTIFY_MOTION) {
+            power_note_motion();
+            //Politica de relatorio: basta um aviso por periodo para seguir em movimento
+            if (xTaskGetTickCount() - movimento >= pdMS_TO_TICKS(VIB_MOTION_POST_S * 1000)) {
+                movimento = xTaskGetTickCount();
+                gsm_motion(false);
+            }
+        }
+        while ((n = imu_read(amostras, 64)) > 0) {
+            uint32_t c0 = cpu_hal_get_cycle_count();
+            for (size_t i = 0; i < n; i++) {
+                vib_add(&vib, amostras[i].acc);
+                if (evt_add(&evt, amostras[i].acc, amostras[i].t_us, &ev)) {
+                    ev.utc = (uint32_t)time(NULL);
+                    //Sem printf aqui: o console bloquearia o consumidor da IMU
+                    DLOG(EVT, ev.kind, ev.peak_mg, ev.fall_ms, ev.tilt_deg);
+                    if (mqtt_pub_urgent(TELEM_TYPE_EVT, &ev, sizeof(ev)) != ESP_OK && telemetria_ok) {
+                        tlog_append(&telemetria, TELEM_TYPE_EVT, &ev, sizeof(ev));
                     }
+                    gsm_motion(true);
                 }
-
-                // Recebeu o que não queria, reinicia
-                idx=0;
-
-            // Incrementa byte a string de recebimento
-            } else {
-                idx++;
             }
+            ciclos += cpu_hal_get_cycle_count() - c0;
+            total += n;
         }
-
-        // Aguarda e faz timeout
-        xSemaphoreGive(sync_stats_task);
-        vTaskDelay(pdMS_TO_TICKS(100));
-        if (trysTmp >= trys) {
-            return -5;
-        } else {
-            printf("\t(Tentativa %d)\n", trysTmp);
+        if (xTaskGetTickCount() - inicio < pdMS_TO_TICKS(VIB_REPORT_S * 1000)) {
+            continue;
         }
-    }while(1);
-    return -99;
+        inicio += pdMS_TO_TICKS(VIB_REPORT_S * 1000);
+        vib_ciclos_amostra = total ? (uint32_t)(ciclos / total) : 0;
+        ciclos = 0;
+        total = 0;
+        n = vib_report(&vib, (uint32_t)time(NULL), resumo);
+        for (size_t i = 0; i < n; i++) {
+            if (telemetria_ok && tlog_append(&telemetria, TELEM_TYPE_VIB, &resumo[i], sizeof(resumo[i])) != ESP_OK) {
+                printf("Falha ao gravar resumo de vibracao\n");
+            }
+        }
+    }
 }
 
-
-void GSM_Reset(int tock)
+//Pede um pulso do LED (inicio e fim da janela), sem esperar
+static void blink_request(void)
 {
-    if(tock == 2)
-    {
-        gpio_set_level(4,1);
-        xSemaphoreGive(sync_stats_task);
-        vTaskDelay(pdMS_TO_TICKS(1500));
-        gpio_set_level(4,0);
-        printf("\rReset Modem GSM\n");
-        xSemaphoreGive(sync_stats_task);
-        vTaskDelay(pdMS_TO_TICKS(5000));
-        gpio_set_level(4,1);
-        xSemaphoreGive(sync_stats_task);
-        vTaskDelay(pdMS_TO_TICKS(1500));
-        gpio_set_level(4,0);
-        xSemaphoreGive(sync_stats_task);
-        vTaskDelay(pdMS_TO_TICKS(1000));
-    }
-    else if (tock == 1)
-    {
-        printf("\rTurn ON/OFF Modem GSM\n");
-        gpio_set_level(4,1);
-        xSemaphoreGive(sync_stats_task);
-        vTaskDelay(pdMS_TO_TICKS(1500));
-        gpio_set_level(4,0);
-        xSemaphoreGive(sync_stats_task);
-        vTaskDelay(pdMS_TO_TICKS(1000));
-    }
-    else
-    {
-        printf("\rInvalid Reset\n");
+    if (blink_task_handle != NULL) {
+        xTaskNotifyGive(blink_task_handle);
     }
 }
 
-static void GSM_C(void *arg)
+//Task Blink para teste (OMM)
+static void blink_tsk(void *arg)
 {
+    //Partida em sequencia: libera a proxima task
     xSemaphoreTake(sync_stats_task, portMAX_DELAY);
-    int16_t *datap = (int16_t *) malloc(BUF_SIZE);
-    //Inicio das tasks tipo spin
-    for (int i = 0; i< NUM_OF_SPIN_TASKS; i++){
-        xSemaphoreGive(sync_spin_task);
-    }
-    printf("p1\n");
-    int errc = 0;
-
-    // Set serial ESP32 e SIM7070G       
-    uart_param_config(UART_NUM_2, &uart_config);
-    uart_set_pin(UART_NUM_2, PIN_TX, PIN_RX, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
-    uart_driver_install(UART_NUM_2, BUF_SIZE * 2, 0, 0, NULL, 0);
-    
-    //Reset Modem GSM
-    //gpio_reset_pin(4);
-    //gpio_set_direction(4, GPIO_MODE_DEF_OUTPUT);
-    /*
-    gpio_set_level(4,1);
-    xSemaphoreGive(sync_stats_task);
-    vTaskDelay(pdMS_TO_TICKS(1500));
-    gpio_set_level(4,0);
-    printf("\rReset Modem GSM\n");
-    xSemaphoreGive(sync_stats_task);
-    vTaskDelay(pdMS_TO_TICKS(5000));
-    gpio_set_level(4,1);
-    xSemaphoreGive(sync_stats_task);
-    vTaskDelay(pdMS_TO_TICKS(1500));
-    gpio_set_level(4,0);
-
-    xSemaphoreGive(sync_stats_task);
-    vTaskDelay(pdMS_TO_TICKS(1000));
-    */
-
-    GSM_Reset(2);
-    
-    printf("p2\n");
-    int len = 0;
-    uint8_t redeb = 0;
-    char mensagem[256];
-    sprintf(mensagem, "AT+IPR=9600\r");
-    len = uart_read_bytes(UART_NUM_2, datap, BUF_SIZE, pdMS_TO_TICKS(100));
-
-    //Set Baud rate
-    errc = 0;
-    printf("Set auto-baud rate");
-    while (redeb == 0)
-    {
-        uart_write_bytes(UART_NUM_2, (char *) mensagem, strlen(mensagem));        
-        len = uart_read_bytes(UART_NUM_2, datap, BUF_SIZE, pdMS_TO_TICKS(100));
-        if (len > 0)
-        {
-            printf("Leitura: %d\n", len);      
-            printf("%ls \n", datap);            
-            printf("Set auto-baud rate\n");
-            bzero(datap,1024);
-            len = uart_read_bytes(UART_NUM_2, datap, BUF_SIZE, pdMS_TO_TICKS(100));
-            printf("Leitura: %d\n", len);
-            redeb = 1;
-        }
-        else if(errc == 50)
-            GSM_Reset(1);
-        else
-        {
-            printf(" .");
-            errc++;
-        }        
-        xSemaphoreGive(sync_stats_task);
-        vTaskDelay(pdMS_TO_TICKS(2500));
-    }
-    printf("Baud rate configurado.\n");        
     xSemaphoreGive(sync_stats_task);
-    vTaskDelay(pdMS_TO_TICKS(50));
-    //uart_write_bytes(UART_NUM_2, (const char *) "AT+IPR=9600\n", 12);
-    //int men = 0;
-    //int tent = 0;
-    //int tentdf = 0;
-    // Desativar ECHO (eco)
-    sprintf(mensagem, "ATE0\r");
-    printf("Escrita ECHO");
-    errc = 0;
-    redeb = 0;
-    len = 0;
-    while (redeb == 0)
-    {
-        uart_write_bytes(UART_NUM_2, (char *) mensagem, strlen(mensagem));
-        uart_wait_tx_done(UART_NUM_2, pdMS_TO_TICKS(500));
-        //men = 1;        
-        //tent = 0;
-        if (len > 0)
-        {
-            printf("Leitura: %d\n", len);      
-            printf("%ls", datap);            
-            bzero(datap,1024);
-            len = uart_read_bytes(UART_NUM_2, datap, BUF_SIZE, pdMS_TO_TICKS(100));
-            printf("Leitura: %d\n", len);
-            redeb = 1;
-        }
-        else if( errc == 15)
-            GSM_Reset(1);
-        else
-        {
-            printf(" .");
-            errc++;
-        }
-        len = uart_read_bytes(UART_NUM_2, datap, BUF_SIZE, pdMS_TO_TICKS(100));
-        xSemaphoreGive(sync_stats_task);
-        vTaskDelay(pdMS_TO_TICKS(1000));                 
-    }
 
-    // Inicio principais funções
-    errc = 0;
 
-    int ack=0;
-    int state=0;    
-    GPSDados *caboGPS = malloc(sizeof(GPSDados));
-    char *verif = 0;    
-    int col = 0;
-    int bg = 0;
-    int vtst = 0;
-    int ret = 0;
-    char data[25];
-    char netp[25];
-    char bands[50];
-    char ver[25];     
-    struct datasimpl
-    {
-        char latitu[25];
-        char longitu[25];
-        char ano[5];
-        char mes[3];
-        char dia[3];
-        char horap[6];
-    };
-    struct datasimpl GPSuser;
-    printf("p3\n");
-    state = 3;
+    //Blink de LED: um pulso curto a cada blink_request(), sem periodo que acorde o light sleep
+    gpio_reset_pin(BLINK_GPIO);
+    gpio_set_direction(BLINK_GPIO, GPIO_MODE_DEF_OUTPUT);
     while (1)
     {
-        xSemaphoreGive(sync_stats_task);
-        vTaskDelay(pdMS_TO_TICKS(1500));        
-        switch (state)
-        {
-        case 0:
-            ack = sendReceive("AT+CGNSPWR?\r", "",3, COMPARE_RETURN);
-            //ack = sendReceive("AT+CPSI?\r", "", 3, COMPARE_NONE);
-            xQueueReceive(xQueueCaboGPS, caboGPS, 300);
-            printf("Status GPS:\n%s\n", caboGPS->status);
-            verif = strstr(caboGPS->status, "0");
-            if(verif != 0)
-            {
-                ack = sendReceive("AT+CGNSPWR=1\r", "",3, COMPARE_NONE);
-                verif = 0;
-            }
-            else
-                state = 1;
-            break;
-        case 1:
-            ack = sendReceive("AT+CGNSINF\r", "",3, COMPARE_RETURN);
-            xQueueReceive(xQueueCaboGPS, caboGPS, 300);
-            //printf("Status GPS:\n%s\n", caboGPS->status);
-            //sprintf(mensagem, "ATE0\r");
-            //
-            //
-            state = 2;
-            break;
-        case 2:
-            sprintf(mensagem, caboGPS->status);
-            
-            if(mensagem[6] == 'N')
-            {
-                col = 0;
-                bg = 0;
-                // Tratamento baseado na mesagem padrão enviada pelo módulo, segue exemplo modificado abaixo:
-                // +CGNSINF: 1,1,20220212223745.000,-00.000000,-00.000000,591.395,0.00,,0,,1.0,1.4,0.9,,10,,3.6,4.0
-                for(int i = 0; mensagem[i] != '\0'; i++ )
-                {
-                    if(mensagem[i] == ',')
-                    {                        
-                        col++;
-                        bg = i + 1;                        
-                    }
-                    else if (col == 2)
-                    {
-                        data[i - bg] = mensagem[i];
-                        if(mensagem[i+1] == ',')
-                        {                        
-                            data[i + 1 - bg] = '\0';                   
-                        }                
-                    }
-                    else if (col == 3)
-                    {
-                        GPSuser.latitu[i - bg] = mensagem[i];
-                        if(mensagem[i+1] == ',')
-                        {                        
-                            GPSuser.latitu[i + 1 - bg] = '\0';                   
-                        } 
-                    }
-                    else if (col == 4)
-                    {
-                        GPSuser.longitu[i - bg] = mensagem[i];
-                        if(mensagem[i+1] == ',')
-                        {                        
-                            GPSuser.longitu[i + 1 - bg] = '\0';                   
-                        } 
-                    }
-                }
-                if(strlen(data) != 18)
-                {
-                    printf("Sincronizando GPS...\n");
-                }
-                else
-                {
-                    for(int i = 0; i < 14; i++)
-                    {
-                        if(i <= 3)
-                        {
-                            GPSuser.ano[i] = data[i];
-                            if(i + 1 == 4)
-                            {
-                                GPSuser.ano[i + 1] = '\0';
-                            }
-                        }
-                        else if (i > 3 && i < 6)
-                        {
-                            GPSuser.mes[i-4] = data[i];
-                            if(i + 1 == 6)
-                            {
-                                GPSuser.mes[i - 3] = '\0';
-                            }
-                        }
-                        else if (i > 5 && i < 8)
-                        {
-                            GPSuser.dia[i-6] = data[i];
-                            if(i + 1 == 8)
-                            {
-                                GPSuser.dia[i - 5] = '\0';
-                            }
-                        }
-                        else if (i > 7)
-                        {
-                            GPSuser.horap[i-8] = data[i];
-                            if(i + 1 == 14)
-                            {
-                                GPSuser.horap[i - 7] = '\0';
-                            }
-                        }
-                    }
-                    // Linhas de Teste
-                    printf("Dados: \n");
-                    //printf("Data: %s \n", data);
-                    printf("Hora, Dia, Mes, Ano \n %s %s/%s/%s \n", GPSuser.horap, GPSuser.dia, GPSuser.mes, GPSuser.ano);
-                    printf("Latitude: %s \n", GPSuser.latitu);
-                    printf("Longitude: %s \n", GPSuser.longitu);
-                    vtst++;
-                    //     
-                }
-            }
-            else
-                printf("FAIL\n");
-            if(vtst == 3)
-            {
-                state = 3;
-                vtst = 0;
-            }                
-            else                      
-                state = 1;
-            break;
-        case 3:
-            // Desligamento do GPS para trabalhar com LTE.
-            ack = sendReceive("AT+CGNSPWR?\r", "",3, COMPARE_RETURN);            
-            xQueueReceive(xQueueCaboGPS, caboGPS, 300);
-            printf("Status LTE:\n%s\n", caboGPS->status);
-            verif = strstr(caboGPS->status, "1");
-            if(verif != 0)
-            {
-                ack = sendReceive("AT+CGNSPWR=0\r", "",3, COMPARE_NONE);
-                verif = 0;
-            }
-            else
-                state = 4;
-            break;
-        case 4:
-            // Verificação LTE.
-            ack = sendReceive("AT+CGNSPWR?\r", "",3, COMPARE_RETURN);            
-            xQueueReceive(xQueueCaboGPS, caboGPS, 300);
-            printf("Status GPS:\n%s\n", caboGPS->status);
-            verif = strstr(caboGPS->status, "1");
-            if(verif != 0)
-            {
-                ack = sendReceive("AT+CGNSPWR=0\r", "",3, COMPARE_NONE);
-                verif = 0;
-            }
-            else
-                state = 5;
-            break;
-        case 5:
-            col = 0;
-            bg = 0;
-            ack = sendReceive("AT+CPSI?\r", "",3, COMPARE_RETURN);
-            xQueueReceive(xQueueCaboGPS, caboGPS, 300);
-            printf("Status GPS:\n%s\n", caboGPS->status);
-            sprintf(mensagem, caboGPS->status);
-            for(int i = 0; mensagem[i] != '\0'; i++ )
-            {
-                if(mensagem[i] == ':')
-                {
-                    col++;
-                    bg = i;                    
-                }
-                else if(mensagem[i+2] == ',')
-                {
-                    col++;
-                }
-                if(col == 1)
-                {
-                    netp[i - bg] = mensagem[i+2];
-                    if(mensagem[i+3] == ',')
-                    {                        
-                        netp[i + 1 - bg] = '\0';                   
-                    }
-                }
-                else if (col == 2)
-                {                    
-                    //state = 5;
-                    ret = strcmp(netp,"NO SERVICE");
-                    if(ret == 0)
-                    {
-                        state = 5;
-                        printf("Msg: %s\n", netp);
-                    }
-                        
-                    else
-                    {
-                        state = 6;
-                        printf("No Compare %s\n", netp);
-                    }
-                        
-                }
-                    
-
-            }
-            /*if(vtst == 3)
-            {
-                //state =5;
-                vtst = 0;
-            }                
-            else
-                vtst++;*/
-            break;
-        case 6:
-            col = 0;
-            bg = 0;
-            ack = sendReceive("AT+CBANDCFG?\r", "",3, COMPARE_RETURN);
-            xQueueReceive(xQueueCaboGPS, caboGPS, 300);
-            printf("Status GPS:\n%s\n", caboGPS->status);
-            sprintf(mensagem, caboGPS->status);
-            for(int i = 0; mensagem[i] != '\0'; i++ )
-            {
-                if(mensagem[i] == ':')
-                {
-                    col++;
-                    bg = i;                    
-                }
-                else if(mensagem[i+2] == ',' && col == 1)
-                {
-                    col++;
-                }
-                if(col == 1)
-                {
-                    ver[i - bg] = mensagem[i+2];
-                    if(mensagem[i+3] == ',')
-                    {                        
-                        ver[i + 1 - bg] = '\0';                   
-                    }
-                }
-                else if (col == 2)
-                {
-                    ret = 0;
-                    //state = 5;
-                    ret = strcmp(ver,"\"CAT-M\"");
-                    if(ret == 0)
-                    {
-                        state = 5;
-                        printf("Msg: %s\n", ver);
-                        
-                    }
-                        
-                    else
-                    {
-                        state = 5;
-                        printf("No Compare %s\n", ver);
-                    }
-                        
-                }
-            }
-            //state = 5;
-            break;
-        case 7:
-            /*col = 0;
-            bg = 0;
-            ack = sendReceive("AT+CBANDCFG?\r", "",3, COMPARE_RETURN);
-            xQueueReceive(xQueueCaboGPS, caboGPS, 300);
-            sprintf(mensagem, caboGPS->status);
-            printf("NetWork:\n%s\n", caboGPS->status);
-             for(int i = 0; mensagem[i] != '\0'; i++ )
-            {
-                if(mensagem[i] == ',')
-                {
-                    bg = i;
-                    netp[i - bg] = mensagem[i -1];
-                    netp[i - bg + 1] = mensagem[i];
-                    netp[i - bg + 2] = mensagem[i + 2];
-                    netp[i - bg + 3] = '\0';
-                        if(mensagem[i+1] == ',' || mensagem[i+2] == '\0')
-                        {                        
-                            data[i + 1 - bg] = '\0';                   
-                        }
-                }
-            }*/
-            
-            ack = sendReceive("AT+CFUN=1,0\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(703));
-            ack = sendReceive("AT+CGDCONT=1,\"IP\",\"java.claro.com.br\",\"0.0.0.0\"\r", "",3, COMPARE_RETURN);
-            //ack = sendReceive("AT+CNACT=0,1\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(703));
-            ack = sendReceive("AT+CGPADDR\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(703));
-            ack = sendReceive("AT+CGDCONT?\r", "",3, COMPARE_RETURN);
-            //vTaskDelay(pdMS_TO_TICKS(703));
-            //ack = sendReceive("AT+CACID=0\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(703));
-            ack = sendReceive("AT+CNCFG=0,1,\"IoTLog\"\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            ack = sendReceive("AT+CGACT=1,1\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            ack = sendReceive("AT+CGACT?\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            ack = sendReceive("AT+CPSI?\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            ack = sendReceive("AT+CGPADDR\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            ack = sendReceive("AT+CNACT=0,1\r", "",3, COMPARE_RETURN);
-            
-            /*
-            //ack = sendReceive("AT+CFUN=0\r", "",3, COMPARE_RETURN);
-            //vTaskDelay(pdMS_TO_TICKS(2703));
-            ack = sendReceive("AT+CGDCONT=1,\"IP\",\"IoTLog\" \r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            //ack = sendReceive("AT+CFUN=1,0\r", "",3, COMPARE_RETURN);
-            //vTaskDelay(pdMS_TO_TICKS(2703));
-            ack = sendReceive("AT+CGATT?\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(1503));
-            ack = sendReceive("AT+CGNAPN\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            ack = sendReceive("AT+CNCFG=0,1,\"IoTLog\"\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            ack = sendReceive("AT+CGNAPN\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            ack = sendReceive("AT+CNACT=0,1\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            ack = sendReceive("AT+CNACT?\r", "",3, COMPARE_RETURN);
-            */
-            /*
-            ack = sendReceive("AT+CPIN?\r", "READY",3, COMPARE_EQUAL);
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            ack = sendReceive("AT+CSQ\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            ack = sendReceive("AT+CGATT?\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            ack = sendReceive("AT+COPS?\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            ack = sendReceive("AT+CGNAPN\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            ack = sendReceive("AT+CNCFG=0,1,\"IoTLog\"\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            ack = sendReceive("AT+CNACT=0,1\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            ack = sendReceive("AT+CNACT? \r", "",3, COMPARE_RETURN);
-            */
-
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            ack = sendReceive("AT+SNPDPID=0\r", "",3, COMPARE_RETURN);
-            for(int i = 0; i<2;i++)
-            {
-                vTaskDelay(pdMS_TO_TICKS(1703));
-                ack = sendReceive("AT+SNPING4=\"8.8.8.8\",5,1,20000\r", "",3, COMPARE_RETURN);
-            }
-            if(vtst >= 0)
-            {
-                state =8;
-                vtst = 0;
-            }                
-            else
-                vtst++;
-            break;
-        case 8:
-            ack = sendReceive("AT+CGREG?\r", "",3, COMPARE_RETURN);
-            if(vtst >= 0)
-            {
-                state =10;
-                vtst = 0;
-            }                
-            else
-                vtst++;
-            break; 
-        case 9:
-            //ack = sendReceive("AT+SMCONF?\r", "",3, COMPARE_RETURN);
-            //ack = sendReceive("AT+SMCONF=?\r", "",3, COMPARE_RETURN);
-            vTaskDelay(pdMS_TO_TICKS(503));            
-            if(vtst == 0)
-            {
-                ack = sendReceive("AT+SMCONF=\"URL\",\"mqtt3.thingspeak.com\",\"1883\"\r", "",3, COMPARE_RETURN);             
-            }
-            else if(vtst == 1)
-            {
-                ack = sendReceive("AT+SMCONF=\"KEEPTIME\",60\r", "",3, COMPARE_RETURN);             
-            }
-            else if(vtst == 2)
-            {
-                ack = sendReceive("AT+SMCONF=\"CLEANSS\",1\r", "",3, COMPARE_RETURN);                
-            }
-            else if(vtst == 3)
-            {
-                ack = sendReceive("AT+SMCONF=\"CLIENTID\",\"Exw1Ni8LOS8IKQsVCzAtNQY\"\r", "",3, COMPARE_RETURN);         
-            }
-            else if(vtst == 4)
-            {
-                ack = sendReceive("AT+SMCONF=\"QOS\",0\r", "",3, COMPARE_RETURN);             
-            } 
-            else if(vtst == 5)
-            {
-                ack = sendReceive("AT+SMCONF=\"TOPIC\",\"channels/1639540/publish\"\r", "",3, COMPARE_RETURN);                            
-            }
-            else if(vtst == 6)
-            {
-                ack = sendReceive("AT+SMCONF=\"USERNAME\",\"Exw1Ni8LOS8IKQsVCzAtNQY\"\r", "",3, COMPARE_RETURN);             
-            }
-            else if(vtst == 7)
-            {
-                ack = sendReceive("AT+SMCONF=\"PASSWORD\",\"WBaqO3TrzAwA5e75ScpKVL12\"\r", "",3, COMPARE_RETURN);            
-            }
-            else if(vtst == 8)
-            {
-                state = 10;
-                vtst = 0;          
-            }                   
-            else
-            {
-                vtst = -1;
-            }                
-            vtst++;
-            break;
-         case 10:
-            //ack = sendReceive("AT+CGNAPN\r", "",3, COMPARE_RETURN);
-            ack = sendReceive("AT+CNACT?\r", "",3, COMPARE_RETURN);    
-            vTaskDelay(pdMS_TO_TICKS(1703));
-            //ack = sendReceive("AT+SMCONN\r", "",3, COMPARE_RETURN);
-            ack = sendReceive("AT+CPSI?\r", "",3, COMPARE_RETURN);
-            if(vtst >= 0)
-            {
-                state = 11;
-                vtst = 0;
-            }                
-            else
-                vtst++;
-            break;
-        case 11:
-            //ack = sendReceive("AT+SMCONN\r", "",3, COMPARE_RETURN);
-            if(vtst >= 0)
-            {
-                state =5;
-                vtst = 0;
-            }                
-            else
-                vtst++;
-            break;
-        default:
-            state=0;
-            continue;
-        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        gpio_set_level(BLINK_GPIO,1);
+        vTaskDelay(pdMS_TO_TICKS(BLINK_ON_MS));
+        gpio_set_level(BLINK_GPIO,0);
     }
-    
-    
-    /*while (1) {    
-        xSemaphoreGive(sync_stats_task);
-        vTaskDelay(pdMS_TO_TICKS(1500));    
-        switch (state) {
-            case 0:
-                ack = sendReceive("ATE0\r", "OK", 2, COMPARE_EQUAL);
-                break;
-            case 1:
-                ack = sendReceive("AT+CGNSPWR=0\r", "OK", 2, COMPARE_EQUAL);
-                break;
-            case 2:
-                ack = sendReceive("AT+CGSN\r", "", 5, COMPARE_NONE);
-                break;
-            case 3:
-                ack = sendReceive("AT+COPS?\r", "COPS", 3, COMPARE_CONTAINS);
-                break;
-            case 4:
-                ack = sendReceive("AT+CSQ\r", "CSQ", 3, COMPARE_CONTAINS);
-                if (ack > 0) {
-                    printf("Meu retorno do CSQ = %s\n", sendReceiveBuff());
-                }
-                break;
-            case 5:
-                //ack = sendReceive("AT+CGNAPN=?\r", "", 3, COMPARE_NONE);
-                ack = sendReceive("AT+CPSI?\r", "", 3, COMPARE_NONE);
-                break;
-            case 6:
-                ack = sendReceive("AT+CMNB?\r", "", 3, COMPARE_NONE);
-                break;
-            case 7:
-                ack = sendReceive("AT+CNMP=38\r", "", 3, COMPARE_NONE);
-                break;
-            case 8:
-                ack = sendReceive("AT+CMNB=1\r", "", 3, COMPARE_NONE);
-                break;
-            case 9:
-                ack = sendReceive("AT+CGNSINF\r", "CGNSINF", 3, COMPARE_CONTAINS);
-                state=2;
-                break;
-            default:
-                state=2;
-                continue;
-        }
-        if (ack>=0) {
-            state++;
-        }
-        else {
-            printf("Erro = %d\n", ack);
-        }   
-    }*/
+}
 
+static const mqtt_pub_cfg_t mqtt_conf = {
+    .url = CONFIG_LOGQ_MQTT_URL,
+    .port = CONFIG_LOGQ_MQTT_PORT,
+    .client_id = CONFIG_LOGQ_MQTT_CLIENT_ID,
+    .username = CONFIG_LOGQ_MQTT_USERNAME,
+    .password = CONFIG_LOGQ_MQTT_PASSWORD,
+    .topic = CONFIG_LOGQ_MQTT_TOPIC,
+    .keepalive_s = 60,
+    .qos = CONFIG_LOGQ_MQTT_QOS,
+};
+//Pulso do LED no inicio e no fim da janela; no fim, log diferido e estatisticas de execucao
+//saem agora (as tasks nao tem periodo)
+static void gsm_janela(bool fim, void *arg)
+{
+    blink_request();
+    if (fim) {
+        dlog_flush();
+        stats_request();
+    }
 }
 
-void xTaskFunction (void * pvParameters)
+static void GSM_C(void *arg)
 {
+    gsm_cfg_t conf = {
+        //Criterio de parada da sessao de GNSS (menuconfig: LogQ)
+        .gnss = {
+            .hdop_max_x100 = CONFIG_LOGQ_GNSS_HDOP_MAX_X10 * 10,
+            .sats_min = CONFIG_LOGQ_GNSS_SATS_MIN,
+            .timeout_s = CONFIG_LOGQ_GNSS_TIMEOUT_S,
+        },
+        .report = REPORT_CFG_DEFAULT,
+        .window = gsm_janela,
+    };
+
+    //Partida em sequencia: libera a proxima task
     xSemaphoreTake(sync_stats_task, portMAX_DELAY);
     xSemaphoreGive(sync_stats_task);
-    for(;;)
-    {
-        printf("Hello Wolrd\n");
-        //xSemaphoreGive(sync_stats_task);
-        vTaskDelay(pdMS_TO_TICKS(1803));
-    }    
-}
 
+    // Set serial ESP32 e SIM7070G
+    if (at_uart_init(UART_NUM_2, &uart_config, PIN_TX, PIN_RX) != ESP_OK || at_cmd_init() != ESP_OK ||
+        netreg_init() != ESP_OK) {
+        printf("Erro ao iniciar UART do modem\n");
+    }
+    if (modem_cfg_init(power_modem_kept()) != ESP_OK || mqtt_pub_init(&mqtt_conf) != ESP_OK) {
+        printf("Erro ao iniciar o MQTT\n");
+    }
+    //Depois de um deep sleep os cursores vem da memoria RTC, sem varrer a particao
+    telemetria_ok = (tlog_open_cached(&telemetria, TLOG_PARTITION_LABEL, power_tlog_cursor()) == ESP_OK);
+    if (!telemetria_ok) {
+        printf("Erro ao abrir o log de telemetria\n");
+    }
+    conf.log = telemetria_ok ? &telemetria : NULL;
+#if CONFIG_LOGQ_REPORT_ADAPTIVE
+    conf.report.fence_lat_e6 = CONFIG_LOGQ_FENCE_LAT_E6;
+    conf.report.fence_lon_e6 = CONFIG_LOGQ_FENCE_LON_E6;
+    conf.report.fence_m = CONFIG_LOGQ_FENCE_RADIUS_M;
+#endif
+    gsm_init(&conf);
+    fsm_run(gsm_machine());
+}
 
 void app_main(void)
 {
     
     //Allow other core to finish initialization
     vTaskDelay(pdMS_TO_TICKS(100));   
+    heap_at_boot = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    if (rtstats_start(RTSTATS_PERIOD_MS) != ESP_OK) {
+        printf("Erro ao iniciar as estatisticas de execucao\n");
+    }
 
     gpio_reset_pin(4);
     gpio_set_direction(4, GPIO_MODE_DEF_OUTPUT); 
 
     //Create semaphores to synchronize
-    sync_spin_task = xSemaphoreCreateCounting(NUM_OF_SPIN_TASKS, 0);
     sync_stats_task = xSemaphoreCreateBinary();
 
-    //Create spin tasks
-    for (int i = 0; i < NUM_OF_SPIN_TASKS; i++) {
-        snprintf(task_names[i], configMAX_TASK_NAME_LEN, "spin%d", i);
-        xTaskCreatePinnedToCore(spin_task, task_names[i], 1024, NULL, SPIN_TASK_PRIO, NULL, tskNO_AFFINITY);
+#if CONFIG_LOGQ_BENCHMARK
+    //Build de benchmark: so as cargas e as estatisticas, sem modem nem IMU
+    xTaskCreatePinnedToCore(bench_tsk, "bench", 4096, NULL, BENCH_TASK_PRIO, NULL, BENCH_TASK_CORE);
+    return;
+#endif
+    //Log diferido do AT e do GSM_C (no build de benchmark os rings sao lidos pela carga "dlog")
+    if (dlog_start() != ESP_OK) {
+        printf("Erro ao iniciar o dlog\n");
     }
-    // Criacão Queues    
-    struct GPS_Inf *pxMessage;
 
-    xQueueCaboGPS = xQueueCreate(100, 2*sizeof(struct GPS_Inf));
-    if(xQueueCaboGPS == 0){
-        for(;;){printf("\nERROR QUEUE CABOGPS CREATE\n");}   
+    //NVS: cache do GNSS
+    esp_err_t nvs_ret = nvs_flash_init();
+    if (nvs_ret == ESP_ERR_NVS_NO_FREE_PAGES || nvs_ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        nvs_flash_erase();
+        nvs_ret = nvs_flash_init();
+    }
+    if (nvs_ret != ESP_OK) {
+        printf("Erro ao iniciar a NVS\n");
+    }
+    //Antes das tasks: estado do deep sleep, DTR e light sleep automatico
+    if (power_init() != ESP_OK) {
+        printf("Erro ao iniciar o gerenciamento de energia\n");
+    }
+    if (imu_init() != ESP_OK) {
+        printf("Erro ao iniciar a IMU\n");
+    } else {
+        xTaskCreatePinnedToCore(vib_tsk, "vib", 4096, NULL, VIB_TASK_PRIO, NULL, IMU_TASK_CORE);
     }
-
-    printf("\nQUEUE PASS\n");
     
     //Criacão de Tasks
 
-    //xTaskCreate(xTaskFunction,"TaskTest", 16000, NULL, STATS_TASK_PRIO, NULL );    
     //Create and start stats task
-    xTaskCreatePinnedToCore(blink_tsk, "blinkOMM1", 4096, NULL, STATS_TASK_PRIO, NULL, tskNO_AFFINITY);
-    //xTaskCreatePinnedToCore(stats_task, "stats", 4096, NULL, STATS_TASK_PRIO, NULL, tskNO_AFFINITY);
+    xTaskCreatePinnedToCore(blink_tsk, "blinkOMM1", 4096, NULL, STATS_TASK_PRIO, &blink_task_handle, tskNO_AFFINITY);
+    xTaskCreatePinnedToCore(stats_task, "stats", 4096, NULL, STATS_TASK_PRIO, &stats_task_handle, tskNO_AFFINITY);
     xTaskCreatePinnedToCore(GSM_C, "GSM", 4096, NULL, STATS_TASK_PRIO, NULL, tskNO_AFFINITY);
 
-    printf("TASK CREATE PASS\n");
-    
+
     xSemaphoreGive(sync_stats_task);
     //vTaskStartScheduler();
-    while (1)
-    {
-        vTaskDelay(pdMS_TO_TICKS(10));
-    }
-    
+    //Retorna: a task principal e apagada e nao acorda mais o sistema
 }
 
 
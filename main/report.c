@@ -0,0 +1,177 @@
+/* Politica de relatorio: quando fazer o fix e quando transmitir
+
+   A distancia usa a projecao equirretangular em float: entre fixes de um
+   mesmo trajeto (alguns km) o erro fica muito abaixo do HDOP.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include "string.h"
+#include "report.h"
+
+#define REPORT_M_PER_E6     0.1111949f      //Metros por micrograu de latitude
+#define REPORT_RAD_PER_E6   1.745329e-8f
+#define REPORT_COURSE_NONE  0xFFFF          //Ultimo fix publicado sem curso valido
+
+static uint32_t report_since(uint32_t now_s, uint32_t then_s)
+{
+    return now_s >= then_s ? now_s - then_s : 0;
+}
+
+static uint32_t report_dist_m(int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2)
+{
+    float k = cosf(((float)lat1 + (float)lat2) * 0.5f * REPORT_RAD_PER_E6);
+    float dy = (float)(lat2 - lat1) * REPORT_M_PER_E6;
+    float dx = (float)(lon2 - lon1) * REPORT_M_PER_E6 * k;
+
+    return (uint32_t)sqrtf(dx * dx + dy * dy);
+}
+
+static uint16_t report_turn_deg(uint16_t a_x100, uint16_t b_x100)
+{
+    int32_t d = abs((int32_t)a_x100 - (int32_t)b_x100) % 36000;
+
+    return (uint16_t)((d > 18000 ? 36000 - d : d) / 100);
+}
+
+static bool report_weak(const report_t *r)
+{
+    return r->rsrp != REPORT_RSRP_NONE && r->rsrp < r->cfg.rsrp_min;
+}
+
+void report_init(report_t *r, const report_cfg_t *cfg, uint32_t now_s)
+{
+    memset(r, 0, sizeof(*r));
+    r->cfg = *cfg;
+    r->mode = REPORT_PARKED;
+    r->sent_mode = REPORT_PARKED;
+    r->sent_s = now_s;
+    r->sent_course_x100 = REPORT_COURSE_NONE;
+    r->fence_in = -1;
+    r->rsrp = REPORT_RSRP_NONE;
+}
+
+report_mode_t report_mode(report_t *r, uint32_t now_s)
+{
+    uint32_t left = report_since(r->burst_until_s, now_s);
+
+    if (left > 0 && left <= r->cfg.burst_s) {
+        r->mode = REPORT_BURST;
+    } else if (r->moved && report_since(now_s, r->motion_s) < r->cfg.still_s) {
+        r->mode = REPORT_MOVING;
+    } else {
+        r->mode = REPORT_PARKED;
+    }
+    return r->mode;
+}
+
+bool report_motion(report_t *r, uint32_t now_s)
+{
+    bool parked = (report_mode(r, now_s) == REPORT_PARKED);
+
+    r->motion_s = now_s;
+    r->moved = true;
+    report_mode(r, now_s);
+    return parked;
+}
+
+bool report_event(report_t *r, uint32_t now_s)
+{
+    bool burst = (report_mode(r, now_s) == REPORT_BURST);
+
+    if (!burst) {
+        r->stats.bursts++;
+    }
+    r->burst_until_s = now_s + r->cfg.burst_s;
+    r->motion_s = now_s;
+    r->moved = true;
+    r->mode = REPORT_BURST;
+    return !burst;
+}
+
+void report_link(report_t *r, bool up, int16_t rsrp)
+{
+    r->unsent = !up;
+    if (up && rsrp != REPORT_RSRP_NONE) {
+        r->rsrp = rsrp;
+    }
+}
+
+bool report_fix(report_t *r, const gnss_fix_t *fix, uint32_t now_s)
+{
+    bool pos = fix != NULL && fix->fix && (fix->present & (GNSS_HAS_LAT | GNSS_HAS_LON)) == (GNSS_HAS_LAT | GNSS_HAS_LON);
+    bool fast = pos && (fix->present & GNSS_HAS_SPEED) && fix->speed_kmh_x100 >= r->cfg.moving_kmh_x100;
+    uint32_t since = report_since(now_s, r->sent_s);
+    report_mode_t mode;
+    bool send;
+
+    if (fast) {
+        r->motion_s = now_s;
+        r->moved = true;
+    }
+    if (pos && r->cfg.fence_m > 0) {
+        int8_t in = report_dist_m(r->cfg.fence_lat_e6, r->cfg.fence_lon_e6, fix->lat_e6, fix->lon_e6) <= r->cfg.fence_m;
+
+        //Travessia vira rajada: o fix da travessia e os seguintes saem
+        if (r->fence_in >= 0 && in != r->fence_in) {
+            r->stats.fences++;
+            report_event(r, now_s);
+        }
+        r->fence_in = in;
+    }
+    mode = report_mode(r, now_s);
+
+    if (!pos) {
+        //Sem fix: so o prazo do modo, para o lote pendente nao envelhecer
+        send = mode == REPORT_BURST || r->unsent || since >= (mode == REPORT_PARKED ? r->cfg.parked_s : r->cfg.max_s);
+    } else {
+        r->stats.fixes++;
+        if (r->sent_ok) {
+            r->dist_m = report_dist_m(r->sent_lat_e6, r->sent_lon_e6, fix->lat_e6, fix->lon_e6);
+        }
+        //Primeiro fix, rajada, partida, parada e os fixes raros de parado
+        send = !r->sent_ok || r->unsent || mode != REPORT_MOVING || r->sent_mode != REPORT_MOVING;
+        if (!send) {
+            send = r->dist_m >= r->cfg.dist_m || since >= r->cfg.max_s ||
+                   (fast && r->sent_course_x100 != REPORT_COURSE_NONE &&
+                    report_turn_deg(fix->course_x100, r->sent_course_x100) >= r->cfg.heading_deg);
+        }
+    }
+    if (send && mode != REPORT_BURST && !r->unsent && r->sent_ok && report_weak(r) && since < r->cfg.defer_s) {
+        r->stats.deferred++;
+        send = false;
+    }
+    if (!send) {
+        return false;
+    }
+    r->sent_s = now_s;
+    r->sent_mode = mode;
+    r->stats.sent++;
+    if (pos) {
+        r->sent_ok = true;
+        r->sent_lat_e6 = fix->lat_e6;
+        r->sent_lon_e6 = fix->lon_e6;
+        r->sent_course_x100 = fast && (fix->present & GNSS_HAS_COURSE) ? fix->course_x100 : REPORT_COURSE_NONE;
+        r->dist_m = 0;
+    }
+    return true;
+}
+
+uint32_t report_next_s(report_t *r, uint32_t now_s)
+{
+    switch (report_mode(r, now_s)) {
+    case REPORT_BURST:
+        return r->cfg.burst_fix_s;
+    case REPORT_MOVING:
+        return r->cfg.moving_s;
+    default:
+        return r->cfg.parked_s;
+    }
+}
+
+const char *report_mode_name(report_mode_t mode)
+{
+    static const char *const names[] = {"parado", "movimento", "rajada"};
+
+    return mode <= REPORT_BURST ? names[mode] : "-";
+}
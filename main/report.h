@@ -0,0 +1,130 @@
+/* Politica de relatorio: quando fazer o fix e quando transmitir
+
+   No lugar da janela fixa de POWER_WINDOW_S, o intervalo ate o proximo fix
+   e a decisao de publicar saem do estado do veiculo:
+     - parado (sem movimento na IMU ha still_s e abaixo de moving_kmh_x100
+       no ultimo fix): fix a cada parked_s, sempre publicado;
+     - em movimento: fix a cada moving_s, publicado quando a distancia ao
+       ultimo fix publicado passa de dist_m, quando o curso muda mais de
+       heading_deg (so acima de moving_kmh_x100, o curso parado e ruido) ou
+       no maximo a cada max_s. A partida e a parada sao publicadas;
+     - rajada: evento da IMU ou travessia da cerca (circulo de fence_m em
+       torno de fence_lat_e6/fence_lon_e6; fence_m = 0 desliga) passam
+       burst_s com fix a cada burst_fix_s, todos publicados.
+
+   Com o enlace fraco (RSRP da ultima conexao abaixo de rsrp_min) a
+   publicacao fora da rajada e adiada ate defer_s desde a ultima: o
+   transmissor gasta mais na borda da celula e os fixes seguem no tlog
+   para o lote seguinte. Sem rede na ultima tentativa o lote ficou no tlog
+   e a janela seguinte tenta de novo.
+
+   O tempo e em segundos de 32 bits passados pelo chamador (relogio do
+   sistema, que o RTC mantem no deep sleep); um relogio que volta (acerto
+   pelo GNSS) so zera os intervalos. Nao depende do ESP-IDF.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gnss.h"
+
+#define REPORT_RSRP_NONE    0       //Enlace sem medida (nenhuma conexao ainda)
+
+#define REPORT_CFG_DEFAULT  { .still_s = 10 * 60, .parked_s = 4 * 3600, .moving_s = 60, \
+                              .max_s = 10 * 60, .dist_m = 2000, .heading_deg = 30, \
+                              .moving_kmh_x100 = 500, .burst_s = 5 * 60, .burst_fix_s = 30, \
+                              .rsrp_min = -115, .defer_s = 5 * 60 }
+
+typedef enum {
+    REPORT_PARKED = 0,
+    REPORT_MOVING,
+    REPORT_BURST,
+} report_mode_t;
+
+typedef struct {
+    uint32_t still_s;           //Sem movimento ha esse tempo: parado
+    uint32_t parked_s;          //Intervalo entre fixes parado
+    uint32_t moving_s;          //Intervalo entre fixes em movimento
+    uint32_t max_s;             //Em movimento: publica ao menos a cada
+    uint32_t dist_m;
+    uint16_t heading_deg;
+    uint16_t moving_kmh_x100;   //Velocidade do fix que conta como movimento
+    uint32_t burst_s;
+    uint32_t burst_fix_s;
+    int16_t rsrp_min;           //dBm
+    uint32_t defer_s;           //Enlace fraco: adia a publicacao ate
+    int32_t fence_lat_e6;
+    int32_t fence_lon_e6;
+    uint32_t fence_m;           //0: sem cerca
+} report_cfg_t;
+
+typedef struct {
+    uint32_t fixes;
+    uint32_t sent;              //Fixes que pediram publicacao
+    uint32_t deferred;          //Adiados pelo enlace
+    uint32_t bursts;
+    uint32_t fences;            //Travessias da cerca
+} report_stats_t;
+
+typedef struct {
+    report_cfg_t cfg;
+    report_mode_t mode;
+    report_mode_t sent_mode;    //Modo da ultima publicacao (partida e parada)
+    uint32_t motion_s;          //Ultimo movimento (IMU ou velocidade)
+    uint32_t burst_until_s;
+    uint32_t sent_s;            //Ultima publicacao pedida
+    int32_t sent_lat_e6;        //Fix da ultima publicacao
+    int32_t sent_lon_e6;
+    uint16_t sent_course_x100;
+    bool sent_ok;               //Ja houve publicacao com fix
+    bool moved;                 //Movimento desde o inicio (motion_s valido)
+    int8_t fence_in;            //-1 desconhecido, 0 fora, 1 dentro
+    int16_t rsrp;               //dBm da ultima conexao, REPORT_RSRP_NONE
+    bool unsent;                //Ultima tentativa sem rede: publica na proxima janela
+    uint32_t dist_m;            //Do ultimo fix ate o da ultima publicacao
+    report_stats_t stats;
+} report_t;
+
+/**
+ * @brief   Prepara a politica; o primeiro fix e sempre publicado.
+ */
+void report_init(report_t *r, const report_cfg_t *cfg, uint32_t now_s);
+
+/**
+ * @brief   Movimento na IMU.
+ *
+ * @return  true se saiu de parado (o proximo fix deve ser antecipado)
+ */
+bool report_motion(report_t *r, uint32_t now_s);
+
+/**
+ * @brief   Evento da IMU: entra em rajada por burst_s.
+ *
+ * @return  true se nao estava em rajada
+ */
+bool report_event(report_t *r, uint32_t now_s);
+
+/**
+ * @brief   Resultado da ultima conexao: rede encontrada e RSRP (dBm,
+ *          REPORT_RSRP_NONE sem medida).
+ */
+void report_link(report_t *r, bool up, int16_t rsrp);
+
+/**
+ * @brief   Aplica o fix da janela (NULL ou sem posicao: so o tempo conta).
+ *
+ * @return  true se a janela deve publicar
+ */
+bool report_fix(report_t *r, const gnss_fix_t *fix, uint32_t now_s);
+
+/**
+ * @brief   Modo no instante now_s (rajada e movimento expiram).
+ */
+report_mode_t report_mode(report_t *r, uint32_t now_s);
+
+/**
+ * @brief   Segundos ate o proximo fix, conforme o modo.
+ */
+uint32_t report_next_s(report_t *r, uint32_t now_s);
+
+const char *report_mode_name(report_mode_t mode);
@@ -0,0 +1,148 @@
+/* Buffers circulares sem trava
+
+   head e tail crescem livremente e sao reduzidos pela mascara so na hora
+   de indexar; head - tail e sempre a ocupacao, mesmo apos dar a volta.
+   Copias que atravessam o fim do vetor sao feitas em dois memcpy.
+
+   No ring_mpsc_t a sequencia de cada celula diz de quem ela e: igual a
+   posicao, livre para o produtor que reservar essa posicao; posicao + 1,
+   publicada para o consumidor, que a devolve com posicao + capacidade
+   (livre para a proxima volta).
+*/
+
+#include "string.h"
+#include "ring.h"
+
+bool ring_init(ring_t *r, void *buf, size_t elem_size, size_t cap)
+{
+    if (cap == 0 || (cap & (cap - 1)) != 0) {
+        return false;
+    }
+    memset(r, 0, sizeof(*r));
+    r->buf = buf;
+    r->elem_size = elem_size;
+    r->mask = cap - 1;
+    return true;
+}
+
+//Copia n elementos de/para o ring a partir da posicao pos (com volta)
+static void ring_copy(const ring_t *r, uint32_t pos, void *ext, size_t n, bool to_ring)
+{
+    size_t idx = pos & r->mask;
+    size_t first = ring_capacity(r) - idx;
+    uint8_t *e = ext;
+
+    if (first > n) {
+        first = n;
+    }
+    if (to_ring) {
+        memcpy(r->buf + idx * r->elem_size, e, first * r->elem_size);
+        memcpy(r->buf, e + first * r->elem_size, (n - first) * r->elem_size);
+    } else {
+        memcpy(e, r->buf + idx * r->elem_size, first * r->elem_size);
+        memcpy(e + first * r->elem_size, r->buf, (n - first) * r->elem_size);
+    }
+}
+
+size_t ring_push(ring_t *r, const void *elems, size_t n)
+{
+    uint32_t head = r->head;
+    uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    size_t used = head - tail;
+    size_t room = ring_capacity(r) - used;
+
+    if (n > room) {
+        r->dropped += n - room;
+        n = room;
+    }
+    if (n > 0) {
+        ring_copy(r, head, (void *)elems, n, true);
+        __atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+    }
+    if (used + n > r->high_water) {
+        r->high_water = used + n;
+    }
+    return n;
+}
+
+size_t ring_pop(ring_t *r, void *out, size_t max)
+{
+    uint32_t tail = r->tail;
+    uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    size_t n = head - tail;
+
+    if (n > max) {
+        n = max;
+    }
+    if (n > 0) {
+        ring_copy(r, tail, out, n, false);
+        __atomic_store_n(&r->tail, tail + n, __ATOMIC_RELEASE);
+    }
+    return n;
+}
+
+size_t ring_count(const ring_t *r)
+{
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+bool ring_mpsc_init(ring_mpsc_t *r, ring_cell_t *cells, size_t cap)
+{
+    if (cap == 0 || (cap & (cap - 1)) != 0) {
+        return false;
+    }
+    memset(r, 0, sizeof(*r));
+    r->cells = cells;
+    r->mask = cap - 1;
+    for (uint32_t i = 0; i < cap; i++) {
+        cells[i].seq = i;
+    }
+    return true;
+}
+
+bool ring_mpsc_push(ring_mpsc_t *r, uint32_t val)
+{
+    uint32_t pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    ring_cell_t *c;
+
+    while (1) {
+        c = &r->cells[pos & r->mask];
+        int32_t dif = (int32_t)(__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) - pos);
+
+        if (dif == 0) {
+            //Celula livre nesta volta: tenta reservar
+            if (__atomic_compare_exchange_n(&r->head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            //Celula ainda da volta anterior: cheio
+            __atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+            return false;
+        } else {
+            //Outro produtor reservou esta posicao
+            pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+        }
+    }
+    c->val = val;
+    __atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool ring_mpsc_pop(ring_mpsc_t *r, uint32_t *val)
+{
+    uint32_t pos = r->tail;
+    ring_cell_t *c = &r->cells[pos & r->mask];
+
+    if (__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+        return false;
+    }
+    *val = c->val;
+    __atomic_store_n(&c->seq, pos + r->mask + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&r->tail, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+size_t ring_mpsc_count(const ring_mpsc_t *r)
+{
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,116 @@
+/* Buffers circulares sem trava
+
+   ring_t (um produtor, um consumidor): elementos de tamanho fixo em um
+   vetor com capacidade potencia de 2. O produtor so escreve head e o
+   consumidor so escreve tail; cada lado le o indice do outro com semantica
+   acquire e publica o seu com release, entao nao ha secao critica nem
+   chamada ao FreeRTOS. O produtor pode ser uma ISR ou uma task de
+   prioridade alta.
+
+   ring_mpsc_t (varios produtores, um consumidor): descritores de 32 bits
+   (indices de um pool, nao a mensagem) em celulas com numero de sequencia.
+   O produtor reserva a posicao com um compare-and-swap no head e publica a
+   celula com release; o consumidor so le celulas publicadas. Produtores
+   podem ser tasks de qualquer nucleo ou ISRs. Um produtor interrompido
+   entre a reserva e a publicacao segura o consumidor nessa posicao (ele ve
+   o ring vazio) ate voltar a rodar.
+
+   Nao depende do ESP-IDF, compila tambem no host.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef ESP_PLATFORM
+#define RING_CACHE_LINE     32      //Linha de cache do ESP32
+#else
+#define RING_CACHE_LINE     64
+#endif
+
+//Menor potencia de 2 >= n (n ate 256), para dimensionar rings pelo Kconfig
+#define RING_CAP(n)     ((n) <= 1 ? 1 : (n) <= 2 ? 2 : (n) <= 4 ? 4 : (n) <= 8 ? 8 : (n) <= 16 ? 16 : \
+                         (n) <= 32 ? 32 : (n) <= 64 ? 64 : (n) <= 128 ? 128 : 256)
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t elem_size;
+    uint32_t mask;              //Capacidade - 1
+    uint32_t head;              //Proxima escrita (so o produtor altera)
+    uint32_t tail;              //Proxima leitura (so o consumidor altera)
+    uint32_t dropped;           //Elementos recusados por ring cheio
+    uint32_t high_water;        //Maior ocupacao observada pelo produtor
+} ring_t;
+
+/**
+ * @brief   Prepara o ring sobre um buffer de cap * elem_size bytes.
+ *
+ * @return  false se cap nao for potencia de 2
+ */
+bool ring_init(ring_t *r, void *buf, size_t elem_size, size_t cap);
+
+/**
+ * @brief   Produtor: copia ate n elementos; os que nao cabem sao contados
+ *          em dropped.
+ *
+ * @return  Elementos escritos
+ */
+size_t ring_push(ring_t *r, const void *elems, size_t n);
+
+/**
+ * @brief   Consumidor: copia ate max elementos para out.
+ *
+ * @return  Elementos lidos
+ */
+size_t ring_pop(ring_t *r, void *out, size_t max);
+
+/**
+ * @brief   Elementos disponiveis para o consumidor.
+ */
+size_t ring_count(const ring_t *r);
+
+static inline size_t ring_capacity(const ring_t *r)
+{
+    return r->mask + 1;
+}
+
+typedef struct {
+    uint32_t seq;               //Posicao + 1 quando publicada; posicao + capacidade quando livre
+    uint32_t val;
+} ring_cell_t;
+
+typedef struct {
+    ring_cell_t *cells;         //Somente leitura apos ring_mpsc_init()
+    uint32_t mask;
+    uint32_t head __attribute__((aligned(RING_CACHE_LINE)));    //Proxima reserva (produtores)
+    uint32_t dropped;           //Descritores recusados por ring cheio
+    uint32_t tail __attribute__((aligned(RING_CACHE_LINE)));    //Proxima leitura (so o consumidor)
+} ring_mpsc_t;
+
+/**
+ * @brief   Prepara o ring sobre cap celulas.
+ *
+ * @return  false se cap nao for potencia de 2
+ */
+bool ring_mpsc_init(ring_mpsc_t *r, ring_cell_t *cells, size_t cap);
+
+/**
+ * @brief   Produtor (qualquer task ou ISR): publica um descritor.
+ *
+ * @return  false com o ring cheio (contado em dropped)
+ */
+bool ring_mpsc_push(ring_mpsc_t *r, uint32_t val);
+
+/**
+ * @brief   Consumidor: retira o descritor mais antigo publicado.
+ *
+ * @return  false se nao ha descritor publicado
+ */
+bool ring_mpsc_pop(ring_mpsc_t *r, uint32_t *val);
+
+/**
+ * @brief   Descritores reservados e ainda nao lidos (aproximado com
+ *          produtores em andamento).
+ */
+size_t ring_mpsc_count(const ring_mpsc_t *r);
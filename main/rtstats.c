@@ -0,0 +1,303 @@
+/* Estatisticas de execucao em tempo real (CPU por task, pilha e heap)
+
+   A leitura roda na task do esp_timer ou na de quem chama rtstats_mark(),
+   uma por vez (rt_mutex): uxTaskGetSystemState() suspende o escalonador
+   so durante a copia dos TCBs, e o resto e O(n) sobre o snapshot. O
+   resultado e montado fora da secao critica e apenas copiado para o
+   buffer publicado dentro dela.
+*/
+
+#include <stdio.h>
+#include "string.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "rtstats.h"
+
+#define RTSTATS_HASH_MASK   (RTSTATS_HASH_LEN - 1)
+
+_Static_assert((RTSTATS_HASH_LEN & RTSTATS_HASH_MASK) == 0, "RTSTATS_HASH_LEN deve ser potencia de 2");
+_Static_assert(RTSTATS_HASH_LEN >= 2 * RTSTATS_MAX_TASKS, "tabela hash pequena demais");
+_Static_assert(sizeof(telem_stats_t) <= 48, "telem_stats_t nao cabe em um registro do tlog");
+
+typedef struct {
+    TaskHandle_t handle;        //NULL = livre
+    uint32_t run;               //ulRunTimeCounter da leitura anterior
+} rtstats_slot_t;
+
+static esp_timer_handle_t rt_timer;
+static SemaphoreHandle_t rt_mutex;      //Uma leitura por vez (timer ou rtstats_mark())
+static uint64_t rt_period_us;
+static int64_t rt_last_us;              //Instante da ultima leitura
+static portMUX_TYPE rt_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskStatus_t rt_snap[RTSTATS_MAX_TASKS];
+static rtstats_slot_t rt_hash[RTSTATS_HASH_LEN];
+static TaskHandle_t rt_idle[portNUM_PROCESSORS];
+static uint32_t rt_gen;                 //Leituras feitas
+static uint32_t rt_prev_total;
+static uint32_t rt_live;                //Slots ocupados na tabela
+static rtstats_t rt_work;               //Montado pela leitura
+static rtstats_t rt_pub;                //Ultimo periodo completo
+static rtstats_t rt_copy;               //Area do rtstats_print() (uma task por vez)
+
+static inline uint32_t rtstats_hash(TaskHandle_t h)
+{
+    //TCBs sao alinhados: descarta os bits baixos e espalha (Fibonacci)
+    return ((((uint32_t)(uintptr_t)h >> 2) * 2654435761u) >> 16) & RTSTATS_HASH_MASK;
+}
+
+//Devolve o slot da task, inserindo se ainda nao existe (*is_new = true)
+static rtstats_slot_t *rtstats_slot(TaskHandle_t h, bool *is_new)
+{
+    uint32_t i = rtstats_hash(h);
+
+    while (rt_hash[i].handle != NULL && rt_hash[i].handle != h) {
+        i = (i + 1) & RTSTATS_HASH_MASK;
+    }
+    *is_new = (rt_hash[i].handle == NULL);
+    if (*is_new) {
+        rt_hash[i].handle = h;
+        rt_live++;
+    }
+    return &rt_hash[i];
+}
+
+//Remove as tasks que nao apareceram neste periodo reconstruindo a tabela
+static void rtstats_rebuild(UBaseType_t n)
+{
+    bool dummy;
+
+    memset(rt_hash, 0, sizeof(rt_hash));
+    rt_live = 0;
+    for (UBaseType_t i = 0; i < n; i++) {
+        rtstats_slot_t *s = rtstats_slot(rt_snap[i].xHandle, &dummy);
+        s->run = rt_snap[i].ulRunTimeCounter;
+    }
+}
+
+static void rtstats_read(void)
+{
+    int64_t t0 = esp_timer_get_time();
+    rtstats_t *w = &rt_work;
+    uint32_t idle_us[portNUM_PROCESSORS] = {0};
+    uint32_t total;
+    uint32_t elapsed;
+    uint32_t busy = 0;
+    UBaseType_t n;
+    bool first = (rt_gen == 0);
+
+    n = uxTaskGetSystemState(rt_snap, RTSTATS_MAX_TASKS, &total);
+    if (n == 0) {
+        //Mais tasks que o snapshot comporta: o periodo segue para a proxima
+        portENTER_CRITICAL(&rt_lock);
+        rt_pub.overflows++;
+        portEXIT_CRITICAL(&rt_lock);
+        return;
+    }
+    rt_last_us = t0;
+    rt_gen++;
+    elapsed = total - rt_prev_total;
+    rt_prev_total = total;
+
+    w->created = 0;
+    w->stack_min = UINT16_MAX;
+    w->stack_min_idx = 0;
+    w->ntasks = (uint8_t)n;
+    for (UBaseType_t i = 0; i < n; i++) {
+        const TaskStatus_t *t = &rt_snap[i];
+        rtstats_task_t *o = &w->task[i];
+        bool is_new;
+        rtstats_slot_t *s = rtstats_slot(t->xHandle, &is_new);
+        uint32_t hwm;
+
+        //Task nova: o contador inteiro e deste periodo
+        o->run_us = t->ulRunTimeCounter - (is_new ? 0 : s->run);
+        s->run = t->ulRunTimeCounter;
+        w->created += (is_new && !first);
+
+        strncpy(o->name, t->pcTaskName, sizeof(o->name) - 1);
+        o->name[sizeof(o->name) - 1] = '\0';
+        o->load_x10 = elapsed ? (uint16_t)((uint64_t)o->run_us * 1000 / elapsed) : 0;
+        hwm = t->usStackHighWaterMark;
+        o->stack_free = hwm > UINT16_MAX ? UINT16_MAX : (uint16_t)hwm;
+        o->prio = (uint8_t)t->uxCurrentPriority;
+        o->core = (t->xCoreID == tskNO_AFFINITY) ? -1 : (int8_t)t->xCoreID;
+        o->idle = false;
+        for (int c = 0; c < portNUM_PROCESSORS; c++) {
+            if (t->xHandle == rt_idle[c]) {
+                idle_us[c] = o->run_us;
+                o->idle = true;
+            }
+        }
+        if (o->stack_free < w->stack_min) {
+            w->stack_min = o->stack_free;
+            w->stack_min_idx = (uint8_t)i;
+        }
+    }
+    //Slots ocupados alem das tasks vistas sao tasks apagadas
+    w->deleted = (uint8_t)(rt_live - n);
+    if (rt_live > n) {
+        rtstats_rebuild(n);
+    }
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        uint32_t idle = elapsed ? (uint32_t)((uint64_t)idle_us[c] * 1000 / elapsed) : 1000;
+        w->load_x10[c] = idle >= 1000 ? 0 : (uint16_t)(1000 - idle);
+        if (elapsed > idle_us[c] && elapsed - idle_us[c] > busy) {
+            busy = elapsed - idle_us[c];
+        }
+    }
+    w->heap_free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    w->heap_min = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    w->heap_largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    w->period_us = elapsed;
+    w->sample_us = (uint32_t)(esp_timer_get_time() - t0);
+    if (first) {
+        //Sem leitura anterior os tempos sao desde o boot
+        return;
+    }
+
+    portENTER_CRITICAL(&rt_lock);
+    w->periods = rt_pub.periods + 1;
+    w->overflows = rt_pub.overflows;
+    w->busy_us = rt_pub.busy_us + busy;
+    memcpy(&rt_pub, w, sizeof(rt_pub));
+    portEXIT_CRITICAL(&rt_lock);
+}
+
+static void rtstats_sample(void *arg)
+{
+    xSemaphoreTake(rt_mutex, portMAX_DELAY);
+    //Disparo que esperou um rtstats_mark(): o periodo acabou de ser fechado
+    if (esp_timer_get_time() - rt_last_us >= (int64_t)rt_period_us / 2) {
+        rtstats_read();
+    }
+    xSemaphoreGive(rt_mutex);
+}
+
+void rtstats_mark(void)
+{
+    if (rt_timer == NULL) {
+        return;
+    }
+    xSemaphoreTake(rt_mutex, portMAX_DELAY);
+    esp_timer_stop(rt_timer);
+    rtstats_read();
+    esp_timer_start_periodic(rt_timer, rt_period_us);
+    xSemaphoreGive(rt_mutex);
+}
+
+esp_err_t rtstats_start(uint32_t period_ms)
+{
+    const esp_timer_create_args_t args = {
+        .callback = rtstats_sample,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "rtstats",
+    };
+    esp_err_t ret;
+
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        rt_idle[c] = xTaskGetIdleTaskHandleForCPU(c);
+    }
+    rt_mutex = xSemaphoreCreateMutex();
+    if (rt_mutex == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    rt_period_us = (uint64_t)period_ms * 1000;
+    //Primeira leitura: so a base das diferencas
+    rtstats_read();
+    ret = esp_timer_create(&args, &rt_timer);
+    if (ret == ESP_OK) {
+        ret = esp_timer_start_periodic(rt_timer, rt_period_us);
+    }
+    return ret;
+}
+
+esp_err_t rtstats_get(rtstats_t *out)
+{
+    portENTER_CRITICAL(&rt_lock);
+    memcpy(out, &rt_pub, sizeof(*out));
+    portEXIT_CRITICAL(&rt_lock);
+    return out->periods ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+uint64_t rtstats_busy_us(void)
+{
+    uint64_t busy;
+
+    portENTER_CRITICAL(&rt_lock);
+    busy = rt_pub.busy_us;
+    portEXIT_CRITICAL(&rt_lock);
+    return busy;
+}
+
+esp_err_t rtstats_print(void)
+{
+    rtstats_t *r = &rt_copy;
+
+    if (rtstats_get(r) != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    printf("| Task | Core | Prio | Run Time | Load | Stack free\n");
+    for (int i = 0; i < r->ntasks; i++) {
+        const rtstats_task_t *t = &r->task[i];
+        printf("| %s | %d | %u | %u | %u.%u%% | %u\n", t->name, t->core, t->prio, t->run_us,
+               t->load_x10 / 10, t->load_x10 % 10, t->stack_free);
+    }
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        printf("| Core %d | Load %u.%u%%\n", c, r->load_x10[c] / 10, r->load_x10[c] % 10);
+    }
+    printf("| Tasks | %u | Created %u | Deleted %u | Min stack %u (%s) | Sample %u us | Overflows %u\n",
+           r->ntasks, r->created, r->deleted, r->stack_min, r->task[r->stack_min_idx].name,
+           r->sample_us, r->overflows);
+    return ESP_OK;
+}
+
+esp_err_t rtstats_to_telem(telem_stats_t *out, uint32_t utc)
+{
+    rtstats_t *r = &rt_copy;
+    esp_err_t ret = rtstats_get(r);
+
+    memset(out, 0, sizeof(*out));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    out->utc = utc;
+    out->heap_free = r->heap_free;
+    out->heap_min = r->heap_min;
+    out->heap_largest = r->heap_largest;
+    for (int c = 0; c < portNUM_PROCESSORS && c < 2; c++) {     //telem_stats_t tem dois nucleos
+        out->load_x10[c] = r->load_x10[c];
+    }
+    out->stack_min = r->stack_min;
+    out->ntasks = r->ntasks;
+    memcpy(out->stack_task, r->task[r->stack_min_idx].name, TELEM_STATS_NAME);
+
+    //Maiores cargas fora das tasks idle (ja contadas na carga dos nucleos)
+    for (int i = 0; i < r->ntasks; i++) {
+        const rtstats_task_t *t = &r->task[i];
+        int k = out->ntop;
+
+        if (t->idle || t->load_x10 == 0) {
+            continue;
+        }
+        if (k == TELEM_STATS_TOP) {
+            if (out->top[k - 1].load_x10 >= t->load_x10) {
+                continue;
+            }
+            k--;                //Substitui a menor
+        } else {
+            out->ntop++;
+        }
+        //Insercao ordenada, da maior para a menor carga
+        while (k > 0 && out->top[k - 1].load_x10 < t->load_x10) {
+            out->top[k] = out->top[k - 1];
+            k--;
+        }
+        memcpy(out->top[k].name, t->name, TELEM_STATS_NAME);
+        out->top[k].load_x10 = t->load_x10;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,100 @@
+/* Estatisticas de execucao em tempo real (CPU por task, pilha e heap)
+
+   Cada leitura copia o estado das tasks para um snapshot estatico e
+   calcula a diferenca para a leitura anterior; ninguem espera a janela de
+   medicao e nada e alocado depois do inicio. As leituras vem de
+   rtstats_mark(), chamada pelo dono do ciclo (inicio e fim de cada janela
+   do modem, uma rodada do benchmark), e de um esp_timer de periodo longo
+   que so impede o contador de execucao (us em 32 bits, volta em ~71 min)
+   de dar a volta entre duas leituras: entre as janelas nada acorda o
+   sistema para medir. As tasks sao casadas pelo
+   handle numa tabela hash de enderecamento aberto, que guarda o contador de
+   execucao da leitura anterior de cada uma.
+
+   O resultado do ultimo periodo fica disponivel por rtstats_get(), pode ser
+   impresso no console e resumido no registro TELEM_TYPE_STATS.
+
+   Requer CONFIG_FREERTOS_USE_TRACE_FACILITY e
+   CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS (sdkconfig.defaults).
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "telem.h"
+
+#define RTSTATS_MAX_TASKS   32      //Capacidade do snapshot
+#define RTSTATS_HASH_LEN    64      //Potencia de 2, ao menos o dobro de RTSTATS_MAX_TASKS
+#define RTSTATS_PERIOD_MS   (30 * 60 * 1000)    //Maximo entre leituras, abaixo da volta do contador
+
+typedef struct {
+    char name[configMAX_TASK_NAME_LEN];
+    uint32_t run_us;            //Tempo de CPU no ultimo periodo
+    uint16_t load_x10;          //Por mil de um nucleo
+    uint16_t stack_free;        //Menor folga de pilha desde a criacao, bytes
+    uint8_t prio;
+    int8_t core;                //-1 = sem afinidade
+    bool idle;                  //Task idle de um nucleo
+} rtstats_task_t;
+
+typedef struct {
+    uint32_t periods;           //Periodos medidos desde o inicio
+    uint32_t period_us;         //Duracao do ultimo periodo
+    uint32_t sample_us;         //Custo da ultima leitura
+    uint16_t load_x10[portNUM_PROCESSORS];  //100% - idle de cada nucleo, por mil
+    uint32_t heap_free;
+    uint32_t heap_min;
+    uint32_t heap_largest;
+    uint16_t stack_min;         //Menor folga de pilha entre as tasks
+    uint8_t stack_min_idx;      //Indice da task com essa folga em task[]
+    uint8_t ntasks;
+    uint8_t created;            //Tasks novas no ultimo periodo
+    uint8_t deleted;            //Tasks que sumiram no ultimo periodo
+    uint32_t overflows;         //Leituras perdidas por excesso de tasks
+    uint64_t busy_us;           //Acumulado: tempo fora do idle do nucleo mais ocupado de cada periodo
+    rtstats_task_t task[RTSTATS_MAX_TASKS];
+} rtstats_t;
+
+/**
+ * @brief   Inicia as leituras: a primeira agora, as seguintes em
+ *          rtstats_mark() ou, sem ela, a cada period_ms.
+ *
+ * @return  ESP_OK, ESP_ERR_NO_MEM ou o erro do esp_timer
+ */
+esp_err_t rtstats_start(uint32_t period_ms);
+
+/**
+ * @brief   Fecha o periodo agora (o proximo rtstats_get() e desde a
+ *          leitura anterior) e recomeca a contagem do period_ms.
+ */
+void rtstats_mark(void);
+
+/**
+ * @brief   Copia o resultado do ultimo periodo.
+ *
+ * @return  ESP_OK ou ESP_ERR_INVALID_STATE se nenhum periodo foi medido
+ */
+esp_err_t rtstats_get(rtstats_t *out);
+
+/**
+ * @brief   Tempo de CPU acumulado (rtstats_t.busy_us) sem copiar o periodo.
+ *
+ * Com o light sleep automatico o tempo idle inclui o sono, entao a
+ * diferenca entre duas leituras aproxima o tempo acordado no intervalo.
+ */
+uint64_t rtstats_busy_us(void);
+
+/**
+ * @brief   Imprime o ultimo periodo no console (tasks, nucleos e pilha).
+ *
+ * @return  ESP_OK ou ESP_ERR_INVALID_STATE se nenhum periodo foi medido
+ */
+esp_err_t rtstats_print(void);
+
+/**
+ * @brief   Resume o ultimo periodo no registro de telemetria.
+ */
+esp_err_t rtstats_to_telem(telem_stats_t *out, uint32_t utc);
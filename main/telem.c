@@ -0,0 +1,465 @@
+/* Formato binario da telemetria enviada ao broker
+
+   Cada entrada e montada primeiro em um buffer local e so copiada para o
+   lote se couber inteira, para que um lote cheio continue decodificavel.
+*/
+
+#include "string.h"
+#include "telem.h"
+
+_Static_assert(1 + 5 + 5 * 3 + 1 + TELEM_AT_TOP * (2 * TELEM_AT_NAME + 5 * 3) <= TELEM_ENTRY_MAX,
+               "registro de saude do modem maior que TELEM_ENTRY_MAX");
+
+static size_t telem_put_uvar(uint8_t *p, uint32_t v)
+{
+    size_t n = 0;
+
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static size_t telem_put_svar(uint8_t *p, int32_t v)
+{
+    //Zigzag: 0, -1, 1, -2 ... -> 0, 1, 2, 3 ...
+    return telem_put_uvar(p, ((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+}
+
+static int telem_get_uvar(telem_dec_t *dec, uint32_t *v)
+{
+    uint32_t r = 0;
+
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (dec->p >= dec->end) {
+            return TELEM_ERR_TRUNC;
+        }
+        uint8_t b = *dec->p++;
+        r |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *v = r;
+            return 0;
+        }
+    }
+    return TELEM_ERR_TRUNC;
+}
+
+static int telem_get_svar(telem_dec_t *dec, int32_t *v)
+{
+    uint32_t u;
+    int ret = telem_get_uvar(dec, &u);
+
+    if (ret < 0) {
+        return ret;
+    }
+    *v = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+    return ret;
+}
+
+static int telem_commit(telem_enc_t *enc, const uint8_t *tmp, size_t n)
+{
+    if (enc->len + n > enc->cap) {
+        return TELEM_ERR_FULL;
+    }
+    memcpy(enc->buf + enc->len, tmp, n);
+    enc->len += n;
+    enc->count++;
+    return (int)n;
+}
+
+void telem_fix_from_gnss(telem_fix_t *out, const gnss_fix_t *fix)
+{
+    out->utc = fix->utc;
+    out->lat_e6 = fix->lat_e6;
+    out->lon_e6 = fix->lon_e6;
+    out->alt_cm = fix->alt_cm;
+    out->speed_kmh_x100 = fix->speed_kmh_x100;
+    out->course_x100 = fix->course_x100;
+    out->hdop_x100 = fix->hdop_x100;
+    //SIM7070 nao informa satelites usados; fica o total em vista
+    out->sats = (fix->present & GNSS_HAS_GPS_USED) ? fix->sats_gps_used + fix->sats_gln_used : fix->sats_view;
+    out->fix_mode = fix->fix_mode;
+}
+
+int telem_enc_init(telem_enc_t *enc, uint8_t *buf, size_t cap)
+{
+    memset(enc, 0, sizeof(*enc));
+    if (cap == 0) {
+        return TELEM_ERR_FULL;
+    }
+    enc->buf = buf;
+    enc->cap = cap;
+    enc->buf[enc->len++] = TELEM_VERSION;
+    return 0;
+}
+
+int telem_enc_fix(telem_enc_t *enc, const telem_fix_t *fix)
+{
+    uint8_t tmp[TELEM_ENTRY_MAX];
+    size_t n = 0;
+    int ret;
+
+    tmp[n++] = TELEM_TYPE_FIX;
+    n += telem_put_svar(tmp + n, (int32_t)(fix->utc - enc->prev_utc));
+    n += telem_put_svar(tmp + n, fix->lat_e6 - enc->prev_lat);
+    n += telem_put_svar(tmp + n, fix->lon_e6 - enc->prev_lon);
+    n += telem_put_svar(tmp + n, fix->alt_cm - enc->prev_alt);
+    n += telem_put_uvar(tmp + n, fix->speed_kmh_x100);
+    n += telem_put_uvar(tmp + n, fix->course_x100);
+    n += telem_put_uvar(tmp + n, fix->hdop_x100);
+    n += telem_put_uvar(tmp + n, fix->sats);
+    n += telem_put_uvar(tmp + n, fix->fix_mode);
+
+    ret = telem_commit(enc, tmp, n);
+    if (ret > 0) {
+        enc->prev_utc = fix->utc;
+        enc->prev_lat = fix->lat_e6;
+        enc->prev_lon = fix->lon_e6;
+        enc->prev_alt = fix->alt_cm;
+    }
+    return ret;
+}
+
+int telem_enc_vib(telem_enc_t *enc, const telem_vib_t *vib)
+{
+    uint8_t tmp[TELEM_ENTRY_MAX];
+    size_t n = 0;
+    uint8_t nbands = vib->nbands > TELEM_VIB_BANDS ? TELEM_VIB_BANDS : vib->nbands;
+    int ret;
+
+    tmp[n++] = TELEM_TYPE_VIB;
+    n += telem_put_svar(tmp + n, (int32_t)(vib->utc - enc->prev_utc));
+    n += telem_put_uvar(tmp + n, vib->axis);
+    n += telem_put_uvar(tmp + n, vib->rms_mg);
+    n += telem_put_uvar(tmp + n, vib->peak_mg);
+    n += telem_put_uvar(tmp + n, vib->crest_x100);
+    n += telem_put_uvar(tmp + n, vib->kurtosis_x100);
+    for (int i = 0; i < TELEM_VIB_SHOCKS; i++) {
+        n += telem_put_uvar(tmp + n, vib->shocks[i]);
+    }
+    n += telem_put_uvar(tmp + n, nbands);
+    for (int i = 0; i < nbands; i++) {
+        n += telem_put_uvar(tmp + n, vib->band[i]);
+    }
+
+    ret = telem_commit(enc, tmp, n);
+    if (ret > 0) {
+        enc->prev_utc = vib->utc;
+    }
+    return ret;
+}
+
+int telem_enc_evt(telem_enc_t *enc, const telem_evt_t *evt)
+{
+    uint8_t tmp[TELEM_ENTRY_MAX];
+    size_t n = 0;
+    int ret;
+
+    tmp[n++] = TELEM_TYPE_EVT;
+    n += telem_put_svar(tmp + n, (int32_t)(evt->utc - enc->prev_utc));
+    n += telem_put_uvar(tmp + n, evt->kind);
+    n += telem_put_uvar(tmp + n, evt->peak_mg);
+    n += telem_put_uvar(tmp + n, evt->fall_ms);
+    n += telem_put_uvar(tmp + n, evt->tilt_deg);
+    n += telem_put_uvar(tmp + n, evt->age_ms);
+    n += telem_put_uvar(tmp + n, TELEM_EVT_TRACE);
+    for (int i = 0; i < TELEM_EVT_TRACE; i++) {
+        n += telem_put_uvar(tmp + n, evt->trace[i]);
+    }
+
+    ret = telem_commit(enc, tmp, n);
+    if (ret > 0) {
+        enc->prev_utc = evt->utc;
+    }
+    return ret;
+}
+
+int telem_enc_stats(telem_enc_t *enc, const telem_stats_t *st)
+{
+    uint8_t tmp[TELEM_ENTRY_MAX];
+    size_t n = 0;
+    uint8_t ntop = st->ntop > TELEM_STATS_TOP ? TELEM_STATS_TOP : st->ntop;
+    int ret;
+
+    tmp[n++] = TELEM_TYPE_STATS;
+    n += telem_put_svar(tmp + n, (int32_t)(st->utc - enc->prev_utc));
+    n += telem_put_uvar(tmp + n, st->heap_free);
+    n += telem_put_uvar(tmp + n, st->heap_min);
+    n += telem_put_uvar(tmp + n, st->heap_largest);
+    n += telem_put_uvar(tmp + n, st->load_x10[0]);
+    n += telem_put_uvar(tmp + n, st->load_x10[1]);
+    n += telem_put_uvar(tmp + n, st->ntasks);
+    n += telem_put_uvar(tmp + n, st->stack_min);
+    for (int c = 0; c < TELEM_STATS_NAME; c++) {
+        n += telem_put_uvar(tmp + n, (uint8_t)st->stack_task[c]);
+    }
+    n += telem_put_uvar(tmp + n, ntop);
+    for (int i = 0; i < ntop; i++) {
+        for (int c = 0; c < TELEM_STATS_NAME; c++) {
+            n += telem_put_uvar(tmp + n, (uint8_t)st->top[i].name[c]);
+        }
+        n += telem_put_uvar(tmp + n, st->top[i].load_x10);
+    }
+
+    ret = telem_commit(enc, tmp, n);
+    if (ret > 0) {
+        enc->prev_utc = st->utc;
+    }
+    return ret;
+}
+
+int telem_enc_at(telem_enc_t *enc, const telem_at_t *at)
+{
+    uint8_t tmp[TELEM_ENTRY_MAX];
+    size_t n = 0;
+    uint8_t nfam = at->nfam > TELEM_AT_TOP ? TELEM_AT_TOP : at->nfam;
+    int ret;
+
+    tmp[n++] = TELEM_TYPE_AT;
+    n += telem_put_svar(tmp + n, (int32_t)(at->utc - enc->prev_utc));
+    n += telem_put_uvar(tmp + n, at->resets);
+    n += telem_put_uvar(tmp + n, at->cmds);
+    n += telem_put_uvar(tmp + n, at->timeouts);
+    n += telem_put_uvar(tmp + n, at->errors);
+    n += telem_put_uvar(tmp + n, at->retries);
+    n += telem_put_uvar(tmp + n, nfam);
+    for (int i = 0; i < nfam; i++) {
+        for (int c = 0; c < TELEM_AT_NAME; c++) {
+            n += telem_put_uvar(tmp + n, (uint8_t)at->fam[i].name[c]);
+        }
+        n += telem_put_uvar(tmp + n, at->fam[i].n);
+        n += telem_put_uvar(tmp + n, at->fam[i].p50_ms);
+        n += telem_put_uvar(tmp + n, at->fam[i].p95_ms);
+        n += telem_put_uvar(tmp + n, at->fam[i].max_ms);
+        n += telem_put_uvar(tmp + n, at->fam[i].fails);
+    }
+
+    ret = telem_commit(enc, tmp, n);
+    if (ret > 0) {
+        enc->prev_utc = at->utc;
+    }
+    return ret;
+}
+
+int telem_enc_record(telem_enc_t *enc, uint8_t type, const void *data, size_t len)
+{
+    if (type == TELEM_TYPE_FIX && len == sizeof(telem_fix_t)) {
+        telem_fix_t fix;
+        memcpy(&fix, data, sizeof(fix));
+        return telem_enc_fix(enc, &fix);
+    }
+    if (type == TELEM_TYPE_VIB && len == sizeof(telem_vib_t)) {
+        telem_vib_t vib;
+        memcpy(&vib, data, sizeof(vib));
+        return telem_enc_vib(enc, &vib);
+    }
+    if (type == TELEM_TYPE_EVT && len == sizeof(telem_evt_t)) {
+        telem_evt_t evt;
+        memcpy(&evt, data, sizeof(evt));
+        return telem_enc_evt(enc, &evt);
+    }
+    if (type == TELEM_TYPE_STATS && len == sizeof(telem_stats_t)) {
+        telem_stats_t st;
+        memcpy(&st, data, sizeof(st));
+        return telem_enc_stats(enc, &st);
+    }
+    if (type == TELEM_TYPE_AT && len == sizeof(telem_at_t)) {
+        telem_at_t at;
+        memcpy(&at, data, sizeof(at));
+        return telem_enc_at(enc, &at);
+    }
+    return TELEM_ERR_TYPE;
+}
+
+int telem_dec_init(telem_dec_t *dec, const uint8_t *buf, size_t len)
+{
+    memset(dec, 0, sizeof(*dec));
+    if (len == 0) {
+        return TELEM_ERR_TRUNC;
+    }
+    if (buf[0] != TELEM_VERSION) {
+        return TELEM_ERR_VERSION;
+    }
+    dec->p = buf + 1;
+    dec->end = buf + len;
+    return 0;
+}
+
+int telem_dec_next(telem_dec_t *dec, telem_entry_t *e)
+{
+    uint32_t u[8 + TELEM_STATS_NAME];      //Maior entrada fixa: estatisticas
+    int32_t s[4];
+    int ret = 0;
+
+    memset(e, 0, sizeof(*e));
+    if (dec->p >= dec->end) {
+        return 0;
+    }
+    e->type = *dec->p++;
+
+    switch (e->type) {
+    case TELEM_TYPE_FIX:
+        for (int i = 0; i < 4 && ret == 0; i++) {
+            ret = telem_get_svar(dec, &s[i]);
+        }
+        for (int i = 0; i < 5 && ret == 0; i++) {
+            ret = telem_get_uvar(dec, &u[i]);
+        }
+        if (ret != 0) {
+            return ret;
+        }
+        dec->prev_utc += (uint32_t)s[0];
+        dec->prev_lat += s[1];
+        dec->prev_lon += s[2];
+        dec->prev_alt += s[3];
+        e->fix.utc = dec->prev_utc;
+        e->fix.lat_e6 = dec->prev_lat;
+        e->fix.lon_e6 = dec->prev_lon;
+        e->fix.alt_cm = dec->prev_alt;
+        e->fix.speed_kmh_x100 = (uint16_t)u[0];
+        e->fix.course_x100 = (uint16_t)u[1];
+        e->fix.hdop_x100 = (uint16_t)u[2];
+        e->fix.sats = (uint8_t)u[3];
+        e->fix.fix_mode = (uint8_t)u[4];
+        return TELEM_TYPE_FIX;
+    case TELEM_TYPE_VIB:
+        ret = telem_get_svar(dec, &s[0]);
+        for (int i = 0; i < 6 + TELEM_VIB_SHOCKS && ret == 0; i++) {
+            ret = telem_get_uvar(dec, &u[i]);
+        }
+        if (ret != 0) {
+            return ret;
+        }
+        if (u[5 + TELEM_VIB_SHOCKS] > TELEM_VIB_BANDS) {
+            return TELEM_ERR_TRUNC;
+        }
+        for (uint32_t i = 0; i < u[5 + TELEM_VIB_SHOCKS] && ret == 0; i++) {
+            uint32_t b = 0;
+            ret = telem_get_uvar(dec, &b);
+            e->vib.band[i] = (uint16_t)b;
+        }
+        if (ret != 0) {
+            return ret;
+        }
+        dec->prev_utc += (uint32_t)s[0];
+        e->vib.utc = dec->prev_utc;
+        e->vib.axis = (uint8_t)u[0];
+        e->vib.rms_mg = (uint16_t)u[1];
+        e->vib.peak_mg = (uint16_t)u[2];
+        e->vib.crest_x100 = (uint16_t)u[3];
+        e->vib.kurtosis_x100 = (uint16_t)u[4];
+        for (int i = 0; i < TELEM_VIB_SHOCKS; i++) {
+            e->vib.shocks[i] = (uint16_t)u[5 + i];
+        }
+        e->vib.nbands = (uint8_t)u[5 + TELEM_VIB_SHOCKS];
+        return TELEM_TYPE_VIB;
+    case TELEM_TYPE_EVT:
+        ret = telem_get_svar(dec, &s[0]);
+        for (int i = 0; i < 6 && ret == 0; i++) {
+            ret = telem_get_uvar(dec, &u[i]);
+        }
+        if (ret != 0) {
+            return ret;
+        }
+        if (u[5] > TELEM_EVT_TRACE) {
+            return TELEM_ERR_TRUNC;
+        }
+        for (uint32_t i = 0; i < u[5] && ret == 0; i++) {
+            uint32_t b = 0;
+            ret = telem_get_uvar(dec, &b);
+            e->evt.trace[i] = (uint8_t)b;
+        }
+        if (ret != 0) {
+            return ret;
+        }
+        dec->prev_utc += (uint32_t)s[0];
+        e->evt.utc = dec->prev_utc;
+        e->evt.kind = (uint8_t)u[0];
+        e->evt.peak_mg = (uint16_t)u[1];
+        e->evt.fall_ms = (uint16_t)u[2];
+        e->evt.tilt_deg = (uint8_t)u[3];
+        e->evt.age_ms = (uint16_t)u[4];
+        return TELEM_TYPE_EVT;
+    case TELEM_TYPE_STATS:
+        ret = telem_get_svar(dec, &s[0]);
+        for (int i = 0; i < 8 + TELEM_STATS_NAME && ret == 0; i++) {
+            ret = telem_get_uvar(dec, &u[i]);
+        }
+        if (ret != 0) {
+            return ret;
+        }
+        if (u[7 + TELEM_STATS_NAME] > TELEM_STATS_TOP) {
+            return TELEM_ERR_TRUNC;
+        }
+        for (uint32_t i = 0; i < u[7 + TELEM_STATS_NAME] && ret == 0; i++) {
+            uint32_t v = 0;
+            for (int c = 0; c <= TELEM_STATS_NAME && ret == 0; c++) {
+                ret = telem_get_uvar(dec, &v);
+                if (c < TELEM_STATS_NAME) {
+                    e->stats.top[i].name[c] = (char)v;
+                } else {
+                    e->stats.top[i].load_x10 = (uint16_t)v;
+                }
+            }
+        }
+        if (ret != 0) {
+            return ret;
+        }
+        dec->prev_utc += (uint32_t)s[0];
+        e->stats.utc = dec->prev_utc;
+        e->stats.heap_free = u[0];
+        e->stats.heap_min = u[1];
+        e->stats.heap_largest = u[2];
+        e->stats.load_x10[0] = (uint16_t)u[3];
+        e->stats.load_x10[1] = (uint16_t)u[4];
+        e->stats.ntasks = (uint8_t)u[5];
+        e->stats.stack_min = (uint16_t)u[6];
+        for (int c = 0; c < TELEM_STATS_NAME; c++) {
+            e->stats.stack_task[c] = (char)u[7 + c];
+        }
+        e->stats.ntop = (uint8_t)u[7 + TELEM_STATS_NAME];
+        return TELEM_TYPE_STATS;
+    case TELEM_TYPE_AT:
+        ret = telem_get_svar(dec, &s[0]);
+        for (int i = 0; i < 6 && ret == 0; i++) {
+            ret = telem_get_uvar(dec, &u[i]);
+        }
+        if (ret != 0) {
+            return ret;
+        }
+        if (u[5] > TELEM_AT_TOP) {
+            return TELEM_ERR_TRUNC;
+        }
+        for (uint32_t i = 0; i < u[5] && ret == 0; i++) {
+            uint32_t v[TELEM_AT_NAME + 5];
+
+            for (int k = 0; k < TELEM_AT_NAME + 5 && ret == 0; k++) {
+                ret = telem_get_uvar(dec, &v[k]);
+            }
+            if (ret != 0) {
+                return ret;
+            }
+            for (int c = 0; c < TELEM_AT_NAME; c++) {
+                e->at.fam[i].name[c] = (char)v[c];
+            }
+            e->at.fam[i].n = (uint16_t)v[TELEM_AT_NAME];
+            e->at.fam[i].p50_ms = (uint16_t)v[TELEM_AT_NAME + 1];
+            e->at.fam[i].p95_ms = (uint16_t)v[TELEM_AT_NAME + 2];
+            e->at.fam[i].max_ms = (uint16_t)v[TELEM_AT_NAME + 3];
+            e->at.fam[i].fails = (uint16_t)v[TELEM_AT_NAME + 4];
+        }
+        dec->prev_utc += (uint32_t)s[0];
+        e->at.utc = dec->prev_utc;
+        e->at.resets = (uint16_t)u[0];
+        e->at.cmds = (uint16_t)u[1];
+        e->at.timeouts = (uint16_t)u[2];
+        e->at.errors = (uint16_t)u[3];
+        e->at.retries = (uint16_t)u[4];
+        e->at.nfam = (uint8_t)u[5];
+        return TELEM_TYPE_AT;
+    default:
+        return TELEM_ERR_TYPE;
+    }
+}
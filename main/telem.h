@@ -0,0 +1,213 @@
+/* Formato binario da telemetria enviada ao broker
+
+   Um payload e um lote de entradas precedido pelo byte de versao:
+
+     [versao] [entrada] [entrada] ...
+
+   Cada entrada comeca com o tipo (TELEM_TYPE_*) seguido de varints (LEB128).
+   Inteiros com sinal usam zigzag. O horario de cada entrada e a diferenca em
+   segundos para a entrada anterior do lote (a primeira e absoluta, epoca
+   Unix) e latitude, longitude e altitude de um fix sao diferencas para o fix
+   anterior do mesmo lote. Um lote pode ser decodificado sozinho.
+
+   Fix (TELEM_TYPE_FIX):
+     dt, dlat_e6, dlon_e6, dalt_cm, speed_kmh_x100, course_x100, hdop_x100,
+     sats, fix_mode
+   Vibracao (TELEM_TYPE_VIB, uma entrada por eixo):
+     dt, axis, rms_mg, peak_mg, crest_x100, kurtosis_x100,
+     shocks[0..TELEM_VIB_SHOCKS-1], nbands, band[0..nbands-1]
+   Evento (TELEM_TYPE_EVT):
+     dt, kind, peak_mg, fall_ms, tilt_deg, age_ms, ntrace, trace[0..ntrace-1]
+   Estatisticas do sistema (TELEM_TYPE_STATS):
+     dt, heap_free, heap_min, heap_largest, load_x10[0..1], ntasks,
+     stack_min, stack_task[0..3], ntop, {name[0..3], load_x10}[0..ntop-1]
+     (os nomes vao um caractere por varint; ASCII ocupa um byte)
+   Saude do modem (TELEM_TYPE_AT, periodo desde o registro anterior):
+     dt, resets, cmds, timeouts, errors, retries, nfam,
+     {name[0..5], n, p50_ms, p95_ms, max_ms, fails}[0..nfam-1]
+
+   O mesmo codigo compila no host (sem dependencias do ESP-IDF), para
+   decodificacao e para o benchmark em tools/telem_bench.c.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "gnss.h"
+
+#define TELEM_VERSION       1
+#define TELEM_VIB_BANDS     8
+#define TELEM_VIB_SHOCKS    3   //Niveis de limiar de choque
+#define TELEM_EVT_TRACE     32  //Pontos do perfil de aceleracao de um evento
+#define TELEM_STATS_TOP     3   //Tasks de maior carga no registro de estatisticas
+#define TELEM_STATS_NAME    4   //Caracteres do nome de cada task
+#define TELEM_AT_TOP        2   //Familias de comando AT no registro de saude do modem
+#define TELEM_AT_NAME       6   //Caracteres do nome de cada familia
+
+//Tipos de entrada; tambem usados como tipo de registro no tlog
+#define TELEM_TYPE_FIX      1
+#define TELEM_TYPE_VIB      2
+#define TELEM_TYPE_EVT      3
+#define TELEM_TYPE_STATS    4
+#define TELEM_TYPE_AT       5
+
+//Causas de um evento (kind, combinaveis)
+#define TELEM_EVT_SHOCK     0x01
+#define TELEM_EVT_FREEFALL  0x02
+#define TELEM_EVT_TILT      0x04
+
+//Codigos de retorno negativos
+#define TELEM_ERR_FULL      -1  //Entrada nao cabe no buffer (nada foi escrito)
+#define TELEM_ERR_VERSION   -2  //Versao desconhecida
+#define TELEM_ERR_TRUNC     -3  //Payload termina no meio de uma entrada
+#define TELEM_ERR_TYPE      -4  //Tipo de entrada desconhecido
+
+//Limite para a maior entrada codificada (qualquer tipo)
+#define TELEM_ENTRY_MAX     (1 + 5 * (7 + TELEM_VIB_SHOCKS + TELEM_VIB_BANDS) + 2 * TELEM_EVT_TRACE)
+
+typedef struct {
+    uint32_t utc;               //Segundos desde 1970-01-01 UTC
+    int32_t lat_e6;
+    int32_t lon_e6;
+    int32_t alt_cm;
+    uint16_t speed_kmh_x100;
+    uint16_t course_x100;
+    uint16_t hdop_x100;
+    uint8_t sats;
+    uint8_t fix_mode;
+} telem_fix_t;
+
+typedef struct {
+    uint32_t utc;
+    uint8_t axis;               //0 = x, 1 = y, 2 = z
+    uint16_t rms_mg;            //Aceleracao RMS em mili-g (sem a componente continua)
+    uint16_t peak_mg;
+    uint16_t crest_x100;        //Fator de crista (pico / RMS)
+    uint16_t kurtosis_x100;
+    uint16_t shocks[TELEM_VIB_SHOCKS];  //Eventos acima de cada limiar no periodo
+    uint8_t nbands;
+    uint16_t band[TELEM_VIB_BANDS];     //RMS por banda do espectro, mili-g
+} telem_vib_t;
+
+typedef struct {
+    uint32_t utc;
+    uint32_t t_us;              //Inicio fisico do evento (esp_timer, local; nao vai no payload)
+    uint16_t peak_mg;           //Maior aceleracao dinamica apos o gatilho
+    uint16_t fall_ms;           //Duracao da queda livre
+    uint16_t age_ms;            //Do inicio do evento ate a montagem do payload (0 = desconhecido)
+    uint8_t kind;               //TELEM_EVT_*
+    uint8_t tilt_deg;           //Inclinacao em relacao a posicao de repouso
+    uint8_t trace[TELEM_EVT_TRACE];     //Pico de |a| a cada 16 ms, unidades de 64 mg
+} telem_evt_t;
+
+typedef struct {
+    uint32_t utc;
+    uint32_t heap_free;         //Bytes livres no heap de 8 bits
+    uint32_t heap_min;          //Menor valor livre desde o boot
+    uint32_t heap_largest;      //Maior bloco alocavel
+    uint16_t load_x10[2];       //Carga de cada nucleo, por mil
+    uint16_t stack_min;         //Menor folga de pilha entre as tasks, bytes
+    uint8_t ntasks;
+    uint8_t ntop;
+    char stack_task[TELEM_STATS_NAME];  //Task com a menor folga (sem terminador)
+    struct {
+        char name[TELEM_STATS_NAME];
+        uint16_t load_x10;      //Por mil de um nucleo
+    } top[TELEM_STATS_TOP];
+} telem_stats_t;
+
+//Contadores saturam em 65535
+typedef struct {
+    uint32_t utc;
+    uint16_t resets;            //Resets do modem
+    uint16_t cmds;              //Comandos AT concluidos
+    uint16_t timeouts;
+    uint16_t errors;
+    uint16_t retries;           //Tentativas repetidas
+    uint8_t nfam;
+    struct {
+        char name[TELEM_AT_NAME];       //Ex.: "CPSI" (sem terminador)
+        uint16_t n;
+        uint16_t p50_ms;        //Limite da faixa do histograma (potencia de 2)
+        uint16_t p95_ms;
+        uint16_t max_ms;
+        uint16_t fails;         //Timeouts e ERROR
+    } fam[TELEM_AT_TOP];
+} telem_at_t;
+
+typedef struct {
+    uint8_t type;
+    union {
+        telem_fix_t fix;
+        telem_vib_t vib;
+        telem_evt_t evt;
+        telem_stats_t stats;
+        telem_at_t at;
+    };
+} telem_entry_t;
+
+//Estado da codificacao de um lote
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    uint32_t count;
+    uint32_t prev_utc;
+    int32_t prev_lat;
+    int32_t prev_lon;
+    int32_t prev_alt;
+} telem_enc_t;
+
+//Estado da decodificacao de um lote
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint32_t prev_utc;
+    int32_t prev_lat;
+    int32_t prev_lon;
+    int32_t prev_alt;
+} telem_dec_t;
+
+/**
+ * @brief   Converte o fix decodificado do modem para o registro de telemetria.
+ */
+void telem_fix_from_gnss(telem_fix_t *out, const gnss_fix_t *fix);
+
+/**
+ * @brief   Inicia um lote em buf (escreve o byte de versao).
+ *
+ * @return  0 ou TELEM_ERR_FULL se cap == 0
+ */
+int telem_enc_init(telem_enc_t *enc, uint8_t *buf, size_t cap);
+
+/**
+ * @brief   Acrescenta uma entrada ao lote.
+ *
+ * @return  Bytes escritos ou TELEM_ERR_FULL (o lote continua valido)
+ */
+int telem_enc_fix(telem_enc_t *enc, const telem_fix_t *fix);
+int telem_enc_vib(telem_enc_t *enc, const telem_vib_t *vib);
+int telem_enc_evt(telem_enc_t *enc, const telem_evt_t *evt);
+int telem_enc_stats(telem_enc_t *enc, const telem_stats_t *st);
+int telem_enc_at(telem_enc_t *enc, const telem_at_t *at);
+
+/**
+ * @brief   Acrescenta um registro do tlog, conforme o tipo.
+ *
+ * @return  Bytes escritos, TELEM_ERR_FULL ou TELEM_ERR_TYPE
+ */
+int telem_enc_record(telem_enc_t *enc, uint8_t type, const void *data, size_t len);
+
+/**
+ * @brief   Inicia a leitura de um lote.
+ *
+ * @return  0 ou TELEM_ERR_VERSION / TELEM_ERR_TRUNC
+ */
+int telem_dec_init(telem_dec_t *dec, const uint8_t *buf, size_t len);
+
+/**
+ * @brief   Le a proxima entrada do lote.
+ *
+ * @return  Tipo da entrada, 0 no fim do lote ou TELEM_ERR_*
+ */
+int telem_dec_next(telem_dec_t *dec, telem_entry_t *e);
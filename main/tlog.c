@@ -0,0 +1,491 @@
+/* Registro persistente de telemetria (store-and-forward)
+
+   Layout de cada segmento (um setor):
+     slot 0       cabecalho: magic, seq do segmento, apagamentos, crc
+     slots 1..63  registros: magic, tipo, tamanho, seq, dados, crc, ack
+
+   O registro e gravado de uma vez ate o crc; o byte ack fica em 0xFF e so e
+   zerado na confirmacao. Os slots sao enderecados por um indice linear
+   (segmento * TLOG_SLOTS_PER_SEG + slot) que da a volta na particao.
+*/
+
+#include <stdio.h>
+#include "string.h"
+#include "tlog.h"
+
+#define TLOG_SEG_MAGIC      0x31474C54  //"TLG1"
+#define TLOG_REC_MAGIC      0x524C      //"LR"
+#define TLOG_ACK_PENDING    0xFF
+#define TLOG_ACK_DONE       0x00
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t erase_count;
+    uint32_t crc;
+} tlog_seg_hdr_t;
+
+typedef struct {
+    uint16_t magic;
+    uint8_t type;
+    uint8_t len;
+    uint32_t seq;
+    uint8_t data[TLOG_PAYLOAD_MAX];
+    uint32_t crc;                       //Sobre todos os campos anteriores
+    uint8_t ack;                        //Fora do crc: gravado depois
+    uint8_t pad[3];
+} tlog_slot_t;
+
+_Static_assert(sizeof(tlog_slot_t) == TLOG_RECORD_SIZE, "tlog_slot_t deve ocupar um slot");
+
+#define TLOG_CRC_LEN        offsetof(tlog_slot_t, crc)
+
+typedef enum {
+    TLOG_SLOT_ERASED,
+    TLOG_SLOT_PENDING,
+    TLOG_SLOT_ACKED,
+    TLOG_SLOT_CORRUPT,
+} tlog_slot_state_t;
+
+static uint32_t tlog_crc32(const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    uint32_t crc = 0xFFFFFFFF;
+
+    while (len--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static uint32_t tlog_total(const tlog_t *log)
+{
+    return log->nseg * TLOG_SLOTS_PER_SEG;
+}
+
+static size_t tlog_slot_addr(uint32_t idx)
+{
+    return (idx / TLOG_SLOTS_PER_SEG) * TLOG_SEGMENT_SIZE + (idx % TLOG_SLOTS_PER_SEG + 1) * TLOG_RECORD_SIZE;
+}
+
+static bool tlog_hdr_valid(const tlog_seg_hdr_t *h)
+{
+    return h->magic == TLOG_SEG_MAGIC && h->crc == tlog_crc32(h, offsetof(tlog_seg_hdr_t, crc));
+}
+
+static esp_err_t tlog_read_hdr(tlog_t *log, uint32_t seg, tlog_seg_hdr_t *h)
+{
+    return esp_partition_read(log->part, seg * TLOG_SEGMENT_SIZE, h, sizeof(*h));
+}
+
+static tlog_slot_state_t tlog_read_slot(tlog_t *log, uint32_t idx, tlog_slot_t *s)
+{
+    const uint8_t *b = (const uint8_t *)s;
+    size_t i;
+
+    if (esp_partition_read(log->part, tlog_slot_addr(idx), s, sizeof(*s)) != ESP_OK) {
+        return TLOG_SLOT_CORRUPT;
+    }
+    if (s->magic == TLOG_REC_MAGIC && s->len <= TLOG_PAYLOAD_MAX && s->crc == tlog_crc32(s, TLOG_CRC_LEN)) {
+        //Ack interrompido pode deixar qualquer valor diferente de 0xFF
+        return s->ack == TLOG_ACK_PENDING ? TLOG_SLOT_PENDING : TLOG_SLOT_ACKED;
+    }
+    for (i = 0; i < sizeof(*s) && b[i] == 0xFF; i++) {
+    }
+    return i == sizeof(*s) ? TLOG_SLOT_ERASED : TLOG_SLOT_CORRUPT;
+}
+
+//Slots entre o cursor de leitura e o de escrita
+static uint32_t tlog_span(const tlog_t *log)
+{
+    uint32_t total = tlog_total(log);
+    uint32_t span = (log->wr + total - log->rd) % total;
+
+    return (span == 0 && log->stats.pending > 0) ? total : span;
+}
+
+//Apaga o segmento e grava o cabecalho; so depois ele passa a ser valido
+static esp_err_t tlog_format_seg(tlog_t *log, uint32_t seg, uint32_t seq, uint32_t erase_count)
+{
+    tlog_seg_hdr_t h = {
+        .magic = TLOG_SEG_MAGIC,
+        .seq = seq,
+        .erase_count = erase_count,
+    };
+    esp_err_t ret;
+
+    h.crc = tlog_crc32(&h, offsetof(tlog_seg_hdr_t, crc));
+    ret = esp_partition_erase_range(log->part, seg * TLOG_SEGMENT_SIZE, TLOG_SEGMENT_SIZE);
+    if (ret == ESP_OK) {
+        ret = esp_partition_write(log->part, seg * TLOG_SEGMENT_SIZE, &h, sizeof(h));
+    }
+    if (ret == ESP_OK) {
+        log->head_seg = seg;
+        log->head_seg_seq = seq;
+        log->wr = seg * TLOG_SLOTS_PER_SEG;
+        if (erase_count > log->stats.max_erase_count) {
+            log->stats.max_erase_count = erase_count;
+        }
+    }
+    return ret;
+}
+
+//Segmento de escrita cheio: reaproveita o mais antigo
+static esp_err_t tlog_rotate(tlog_t *log)
+{
+    uint32_t seg = (log->head_seg + 1) % log->nseg;
+    uint32_t first = seg * TLOG_SLOTS_PER_SEG;
+    tlog_seg_hdr_t h;
+    tlog_slot_t s;
+    esp_err_t ret;
+
+    ret = tlog_read_hdr(log, seg, &h);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    //Pendentes do segmento mais antigo serao perdidos
+    if (log->stats.pending > 0 && log->rd / TLOG_SLOTS_PER_SEG == seg) {
+        for (uint32_t i = log->rd; i < first + TLOG_SLOTS_PER_SEG; i++) {
+            if (tlog_read_slot(log, i, &s) == TLOG_SLOT_PENDING) {
+                log->stats.pending--;
+                log->stats.overwritten++;
+            }
+        }
+        log->rd = (first + TLOG_SLOTS_PER_SEG) % tlog_total(log);
+    }
+    ret = tlog_format_seg(log, seg, log->head_seg_seq + 1, tlog_hdr_valid(&h) ? h.erase_count + 1 : 1);
+    if (ret == ESP_OK && log->stats.pending == 0) {
+        log->rd = log->wr;
+    }
+    return ret;
+}
+
+static esp_err_t tlog_scan(tlog_t *log)
+{
+    tlog_seg_hdr_t h;
+    tlog_slot_t s;
+    bool found = false;
+    bool rd_found = false;
+    esp_err_t ret;
+
+    //Segmento de escrita: o de maior sequencia
+    for (uint32_t seg = 0; seg < log->nseg; seg++) {
+        ret = tlog_read_hdr(log, seg, &h);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        if (!tlog_hdr_valid(&h)) {
+            continue;
+        }
+        if (h.erase_count > log->stats.max_erase_count) {
+            log->stats.max_erase_count = h.erase_count;
+        }
+        if (!found || h.seq > log->head_seg_seq) {
+            log->head_seg = seg;
+            log->head_seg_seq = h.seq;
+            found = true;
+        }
+    }
+    if (!found) {
+        printf("tlog: particao sem segmentos validos, formatando\n");
+        ret = tlog_format_seg(log, 0, 1, 1);
+        log->rd = log->wr;
+        return ret;
+    }
+
+    //Percorre do mais antigo (logo apos o de escrita) ate o de escrita
+    log->wr = log->head_seg * TLOG_SLOTS_PER_SEG + TLOG_SLOTS_PER_SEG;
+    for (uint32_t k = 1; k <= log->nseg; k++) {
+        uint32_t seg = (log->head_seg + k) % log->nseg;
+        bool head = (seg == log->head_seg);
+
+        if (!head) {
+            ret = tlog_read_hdr(log, seg, &h);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+            if (!tlog_hdr_valid(&h)) {
+                continue;
+            }
+        }
+        for (uint32_t i = seg * TLOG_SLOTS_PER_SEG; i < (seg + 1) * TLOG_SLOTS_PER_SEG; i++) {
+            tlog_slot_state_t st = tlog_read_slot(log, i, &s);
+
+            if (st == TLOG_SLOT_ERASED) {
+                if (head) {
+                    log->wr = i;
+                    break;
+                }
+                continue;
+            }
+            if (st == TLOG_SLOT_CORRUPT) {
+                log->stats.corrupt++;
+                continue;
+            }
+            if (s.seq >= log->next_seq) {
+                log->next_seq = s.seq + 1;
+            }
+            if (st == TLOG_SLOT_PENDING) {
+                log->stats.pending++;
+                if (!rd_found) {
+                    log->rd = i;
+                    rd_found = true;
+                }
+            }
+        }
+    }
+    if (!rd_found) {
+        log->rd = log->wr % tlog_total(log);
+    }
+    return ESP_OK;
+}
+
+//Cursores guardados antes de um deep sleep: confere os pontos que mudam a cada escrita
+static bool tlog_check_cursor(tlog_t *log, const tlog_cursor_t *cur)
+{
+    uint32_t first = cur->head_seg * TLOG_SLOTS_PER_SEG;
+    tlog_seg_hdr_t h;
+    tlog_slot_t s;
+    tlog_slot_state_t st;
+
+    if (cur->head_seg >= log->nseg || cur->wr < first || cur->wr > first + TLOG_SLOTS_PER_SEG ||
+            cur->rd >= tlog_total(log) || cur->pending > tlog_total(log)) {
+        return false;
+    }
+    if (tlog_read_hdr(log, cur->head_seg, &h) != ESP_OK || !tlog_hdr_valid(&h) || h.seq != cur->head_seg_seq) {
+        return false;
+    }
+    //Nada foi gravado depois do cursor
+    if (cur->wr < first + TLOG_SLOTS_PER_SEG && tlog_read_slot(log, cur->wr, &s) != TLOG_SLOT_ERASED) {
+        return false;
+    }
+    if (cur->wr > first) {
+        st = tlog_read_slot(log, cur->wr - 1, &s);
+        if ((st != TLOG_SLOT_PENDING && st != TLOG_SLOT_ACKED) || s.seq + 1 != cur->next_seq) {
+            return false;
+        }
+    }
+    //Nem confirmado depois dele
+    if (cur->pending > 0) {
+        return tlog_read_slot(log, cur->rd, &s) == TLOG_SLOT_PENDING;
+    }
+    return cur->rd == cur->wr % tlog_total(log);
+}
+
+esp_err_t tlog_open(tlog_t *log, const char *label)
+{
+    return tlog_open_cached(log, label, NULL);
+}
+
+esp_err_t tlog_open_cached(tlog_t *log, const char *label, const tlog_cursor_t *cur)
+{
+    esp_err_t ret;
+
+    memset(log, 0, sizeof(*log));
+    log->part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, TLOG_PARTITION_SUBTYPE, label);
+    if (log->part == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    log->nseg = log->part->size / TLOG_SEGMENT_SIZE;
+    if (log->nseg < 2) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    log->lock = xSemaphoreCreateMutex();
+    if (log->lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (cur != NULL && tlog_check_cursor(log, cur)) {
+        log->next_seq = cur->next_seq;
+        log->head_seg = cur->head_seg;
+        log->head_seg_seq = cur->head_seg_seq;
+        log->wr = cur->wr;
+        log->rd = cur->rd;
+        log->stats.pending = cur->pending;
+        log->stats.max_erase_count = cur->max_erase_count;
+        printf("tlog: cursores restaurados, %u pendentes, seq %u\n", log->stats.pending, log->next_seq);
+        return ESP_OK;
+    }
+    log->next_seq = 1;
+    ret = tlog_scan(log);
+    printf("tlog: %u segmentos, %u pendentes, %u corrompidos, seq %u\n", log->nseg,
+           log->stats.pending, log->stats.corrupt, log->next_seq);
+    return ret;
+}
+
+void tlog_get_cursor(tlog_t *log, tlog_cursor_t *cur)
+{
+    xSemaphoreTake(log->lock, portMAX_DELAY);
+    cur->next_seq = log->next_seq;
+    cur->head_seg = log->head_seg;
+    cur->head_seg_seq = log->head_seg_seq;
+    cur->wr = log->wr;
+    cur->rd = log->rd;
+    cur->pending = log->stats.pending;
+    cur->max_erase_count = log->stats.max_erase_count;
+    xSemaphoreGive(log->lock);
+}
+
+esp_err_t tlog_append(tlog_t *log, uint8_t type, const void *data, size_t len)
+{
+    tlog_slot_t s;
+    esp_err_t ret = ESP_OK;
+
+    if (len > TLOG_PAYLOAD_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memset(&s, 0xFF, sizeof(s));
+    s.magic = TLOG_REC_MAGIC;
+    s.type = type;
+    s.len = (uint8_t)len;
+    memcpy(s.data, data, len);
+    memset(s.data + len, 0, TLOG_PAYLOAD_MAX - len);
+
+    xSemaphoreTake(log->lock, portMAX_DELAY);
+    if (log->wr == (log->head_seg + 1) * TLOG_SLOTS_PER_SEG) {
+        ret = tlog_rotate(log);
+    }
+    if (ret == ESP_OK) {
+        s.seq = log->next_seq;
+        s.crc = tlog_crc32(&s, TLOG_CRC_LEN);
+        //Grava ate o crc; o ack continua apagado
+        ret = esp_partition_write(log->part, tlog_slot_addr(log->wr), &s, offsetof(tlog_slot_t, ack));
+        //Mesmo com erro o slot pode estar sujo: nao e reutilizado
+        log->wr++;
+        if (ret == ESP_OK) {
+            log->next_seq++;
+            log->stats.pending++;
+            log->stats.appended++;
+        }
+    }
+    xSemaphoreGive(log->lock);
+    return ret;
+}
+
+/**
+ * Percorre os pendentes a partir do cursor. Com out != NULL copia ate max
+ * registros; sem out marca como confirmados os de seq ate last, desde que o
+ * primeiro pendente ainda seja first.
+ */
+static esp_err_t tlog_walk(tlog_t *log, tlog_rec_t *out, size_t max, uint32_t first, uint32_t last, size_t *n)
+{
+    uint32_t total = tlog_total(log);
+    uint32_t span = tlog_span(log);
+    uint32_t i = log->rd;
+    tlog_slot_t s;
+    const uint8_t done = TLOG_ACK_DONE;
+    esp_err_t ret = ESP_OK;
+    bool leading = true;
+
+    *n = 0;
+    for (; span > 0 && *n < max; span--, i = (i + 1) % total) {
+        tlog_slot_state_t st = tlog_read_slot(log, i, &s);
+
+        if (st != TLOG_SLOT_PENDING) {
+            //Confirmados ou corrompidos antes do primeiro pendente saem do caminho
+            if (leading) {
+                log->rd = (i + 1) % total;
+            }
+            continue;
+        }
+        if (out == NULL) {
+            //Lote lido antes de uma rotacao: os pendentes ja nao sao os enviados
+            if (leading && s.seq != first) {
+                log->stats.stale++;
+                ret = ESP_ERR_INVALID_STATE;
+                break;
+            }
+            //Seq cresce com o slot: o resto do caminho nao foi enviado
+            if (s.seq - first > last - first) {
+                break;
+            }
+        }
+        leading = false;
+        if (out == NULL) {
+            ret = esp_partition_write(log->part, tlog_slot_addr(i) + offsetof(tlog_slot_t, ack), &done, 1);
+            if (ret != ESP_OK) {
+                break;
+            }
+            log->stats.pending--;
+            log->stats.acked++;
+            log->rd = (i + 1) % total;
+        } else {
+            out[*n].seq = s.seq;
+            out[*n].type = s.type;
+            out[*n].len = s.len;
+            memcpy(out[*n].data, s.data, s.len);
+        }
+        (*n)++;
+    }
+    if (log->stats.pending == 0) {
+        log->rd = log->wr % total;
+    }
+    return ret;
+}
+
+esp_err_t tlog_peek(tlog_t *log, tlog_rec_t *out, size_t max, size_t *n)
+{
+    esp_err_t ret;
+
+    xSemaphoreTake(log->lock, portMAX_DELAY);
+    ret = tlog_walk(log, out, max, 0, 0, n);
+    xSemaphoreGive(log->lock);
+    return ret;
+}
+
+esp_err_t tlog_ack(tlog_t *log, uint32_t first_seq, uint32_t last_seq)
+{
+    size_t done;
+    esp_err_t ret;
+
+    xSemaphoreTake(log->lock, portMAX_DELAY);
+    ret = tlog_walk(log, NULL, SIZE_MAX, first_seq, last_seq, &done);
+    xSemaphoreGive(log->lock);
+    return ret;
+}
+
+esp_err_t tlog_drain(tlog_t *log, tlog_rec_t *buf, size_t batch,
+                     tlog_send_cb_t cb, void *arg, size_t *sent)
+{
+    size_t n;
+    size_t used;
+    size_t total = 0;
+    esp_err_t ret;
+    esp_err_t ack;
+
+    for (;;) {
+        ret = tlog_peek(log, buf, batch, &n);
+        if (ret != ESP_OK || n == 0) {
+            break;
+        }
+        used = 0;
+        ret = cb(buf, n, &used, arg);
+        if (used > n) {
+            used = n;
+        }
+        //Broker confirmou: so agora o cursor anda, ate o ultimo seq enviado
+        ack = (used > 0) ? tlog_ack(log, buf[0].seq, buf[used - 1].seq) : ESP_OK;
+        if (ack == ESP_OK) {
+            total += used;
+        }
+        if (ret == ESP_OK) {
+            ret = ack;
+        }
+        if (ret != ESP_OK || used == 0) {
+            break;
+        }
+    }
+    if (sent != NULL) {
+        *sent = total;
+    }
+    return ret;
+}
+
+void tlog_get_stats(tlog_t *log, tlog_stats_t *stats)
+{
+    xSemaphoreTake(log->lock, portMAX_DELAY);
+    *stats = log->stats;
+    xSemaphoreGive(log->lock);
+}
@@ -0,0 +1,166 @@
+/* Registro persistente de telemetria (store-and-forward)
+
+   Log somente de acrescimo em uma particao de dados da flash ("tlog").
+   A particao e dividida em segmentos do tamanho de um setor; cada segmento
+   comeca com um cabecalho (numero de sequencia e contador de apagamentos) e
+   guarda registros de tamanho fixo protegidos por CRC.
+
+   Ao enviar, o registro nao e apagado: apenas o byte de confirmacao e
+   gravado (bits 1 -> 0, sem apagar o setor) depois que o broker confirma o
+   lote. Um segmento so e apagado quando a escrita da a volta na particao,
+   sempre o mais antigo, o que distribui o desgaste por todos os setores.
+
+   Queda de energia no meio de uma escrita deixa no maximo um registro com
+   CRC invalido, que e ignorado na leitura; uma confirmacao interrompida so
+   faz o registro ser reenviado.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#define TLOG_PARTITION_LABEL    "tlog"
+#define TLOG_PARTITION_SUBTYPE  0x40    //Subtipo de dados livre para aplicacao
+
+#define TLOG_RECORD_SIZE        64      //Registro e cabecalho de segmento
+#define TLOG_PAYLOAD_MAX        48
+#define TLOG_SEGMENT_SIZE       4096    //Um setor da flash
+#define TLOG_SLOTS_PER_SEG      (TLOG_SEGMENT_SIZE / TLOG_RECORD_SIZE - 1)
+
+typedef struct {
+    uint32_t seq;                       //Sequencia global, crescente
+    uint8_t type;
+    uint8_t len;
+    uint8_t data[TLOG_PAYLOAD_MAX];
+} tlog_rec_t;
+
+typedef struct {
+    uint32_t pending;                   //Registros gravados e ainda nao confirmados
+    uint32_t appended;                  //Desde o boot
+    uint32_t acked;                     //Desde o boot
+    uint32_t overwritten;               //Pendentes perdidos por falta de espaco
+    uint32_t corrupt;                   //Registros com CRC invalido encontrados
+    uint32_t stale;                     //Confirmacoes descartadas (pendentes mudaram desde o peek)
+    uint32_t max_erase_count;           //Maior contador de apagamentos entre os segmentos
+} tlog_stats_t;
+
+typedef struct {
+    const esp_partition_t *part;
+    SemaphoreHandle_t lock;
+    uint32_t nseg;
+    uint32_t next_seq;                  //Sequencia do proximo registro
+    uint32_t head_seg;                  //Segmento de escrita
+    uint32_t head_seg_seq;
+    uint32_t wr;                        //Proximo slot livre (indice linear, ate o fim do segmento de escrita)
+    uint32_t rd;                        //Primeiro candidato a pendente
+    tlog_stats_t stats;
+} tlog_t;
+
+/**
+ * Copia dos cursores de um log aberto, para reabrir sem varrer a particao
+ * (ex.: guardada na memoria RTC durante um deep sleep).
+ */
+typedef struct {
+    uint32_t next_seq;
+    uint32_t head_seg;
+    uint32_t head_seg_seq;
+    uint32_t wr;
+    uint32_t rd;
+    uint32_t pending;
+    uint32_t max_erase_count;
+} tlog_cursor_t;
+
+/**
+ * @brief   Abre o log na particao indicada e reconstroi os cursores.
+ *
+ * Varre os cabecalhos de segmento e os registros para achar o ponto de
+ * escrita e o primeiro registro nao confirmado. Particao vazia ou sem
+ * nenhum segmento valido e formatada.
+ *
+ * @return
+ *  - ESP_OK                Sucesso
+ *  - ESP_ERR_NOT_FOUND     Particao inexistente
+ *  - ESP_ERR_INVALID_SIZE  Particao menor que dois segmentos
+ *  - ESP_ERR_NO_MEM        Falha ao criar o mutex
+ *  - Outros                Erros de leitura/escrita da flash
+ */
+esp_err_t tlog_open(tlog_t *log, const char *label);
+
+/**
+ * @brief   Como tlog_open(), partindo de cursores salvos com tlog_get_cursor().
+ *
+ * Os cursores so sao usados se o cabecalho do segmento de escrita e os
+ * slots em volta de wr e rd ainda baterem com eles (nada gravado nem
+ * confirmado depois); senao a particao e varrida normalmente. Com cur NULL
+ * equivale a tlog_open(). O contador de corrompidos so e refeito na
+ * varredura.
+ */
+esp_err_t tlog_open_cached(tlog_t *log, const char *label, const tlog_cursor_t *cur);
+
+/**
+ * @brief   Copia os cursores atuais do log.
+ */
+void tlog_get_cursor(tlog_t *log, tlog_cursor_t *cur);
+
+/**
+ * @brief   Acrescenta um registro ao log.
+ *
+ * Se a escrita alcancar o segmento mais antigo ainda pendente, esse
+ * segmento e descartado (contado em stats.overwritten).
+ *
+ * @return  ESP_OK, ESP_ERR_INVALID_SIZE se len > TLOG_PAYLOAD_MAX ou erro da flash
+ */
+esp_err_t tlog_append(tlog_t *log, uint8_t type, const void *data, size_t len);
+
+/**
+ * @brief   Le, sem consumir, ate max registros pendentes a partir do cursor.
+ *
+ * Chamadas repetidas devolvem os mesmos registros ate tlog_ack().
+ *
+ * @param   out     Vetor de saida
+ * @param   max     Capacidade de out
+ * @param   n       Registros lidos
+ */
+esp_err_t tlog_peek(tlog_t *log, tlog_rec_t *out, size_t max, size_t *n);
+
+/**
+ * @brief   Confirma os registros pendentes de first_seq ate last_seq e avanca o cursor.
+ *
+ * Deve ser chamada so depois que o broker confirmou o lote obtido com
+ * tlog_peek(). Se o primeiro pendente ja nao for first_seq (uma rotacao
+ * descartou o segmento durante o envio), nada e confirmado: os registros
+ * que sobraram sao reenviados.
+ *
+ * @return  ESP_OK, ESP_ERR_INVALID_STATE se os pendentes mudaram ou erro da flash
+ */
+esp_err_t tlog_ack(tlog_t *log, uint32_t first_seq, uint32_t last_seq);
+
+/**
+ * @brief   Envio em lote: chamado com ate batch registros pendentes.
+ *
+ * Deve informar em used quantos registros do inicio de recs o broker
+ * confirmou (pode ser menos que n, por exemplo se o payload encheu) e
+ * retornar ESP_OK para continuar o esvaziamento.
+ */
+typedef esp_err_t (*tlog_send_cb_t)(const tlog_rec_t *recs, size_t n, size_t *used, void *arg);
+
+/**
+ * @brief   Esvazia o log em lotes de ate batch registros.
+ *
+ * Para quando o log esvazia, quando a callback retorna erro ou quando nao
+ * confirma nenhum registro; o que foi confirmado ate ali fica consumido.
+ * Se os pendentes mudarem durante o envio (tlog_ack() descarta a
+ * confirmacao) retorna ESP_ERR_INVALID_STATE e o lote fica para a proxima.
+ *
+ * @param   buf     Area de trabalho com batch registros
+ * @param   sent    Registros confirmados (pode ser NULL)
+ */
+esp_err_t tlog_drain(tlog_t *log, tlog_rec_t *buf, size_t batch,
+                     tlog_send_cb_t cb, void *arg, size_t *sent);
+
+void tlog_get_stats(tlog_t *log, tlog_stats_t *stats);
@@ -0,0 +1,310 @@
+/* Extracao de caracteristicas de vibracao
+
+   Janela de cada eixo (N = VIB_FFT_N):
+     mean = (soma + N/2) >> log2(N);  d = clamp(x - mean, +-32767)
+     s    = -1 se pico >= 16384, senao o maior s com pico << s < 16384
+     in   = (d * hann + 2^(14-s)) >> (15-s)    (bloco flutuante: usa os 14 bits)
+   A FFT e radix-2 com decimacao no tempo sobre a entrada em ordem de bits
+   invertidos, em Q15 com escala 1/2 por estagio:
+     t = (w * b + 2^14) >> 15 (por componente);  a' = (a + t) >> 1;  b' = (a - t) >> 1
+   com twiddles em Q15 onde 32768 = 1,0, entao w = 1 e w = -j sao exatos.
+   Os dois primeiros estagios so usam esses twiddles e sao feitos juntos,
+   sem multiplicacao (passo radix-4); o resultado e o mesmo bit a bit.
+
+   Potencia da banda (LSB^2, Q16), com correcao da janela de Hann (8/3) e
+   do espectro de um lado (2):
+     P = (soma(re^2 + im^2) << 22) / (3 << (2s + 2))
+   A soma de d^4 do periodo tem 128 bits (hi, lo); a curtose usa
+     n * (ldexp(hi, 64) + lo) / sum2^2   em double.
+*/
+
+#include <math.h>
+#include "string.h"
+#include "vib.h"
+
+#define VIB_HALF            (VIB_FFT_N / 2)
+#define VIB_QUARTER         (VIB_FFT_N / 4)
+#define VIB_BIN(hz)         (((hz) * VIB_FFT_N + VIB_RATE_HZ / 2) / VIB_RATE_HZ)
+#define VIB_IN_MAX          16384   //Entrada da FFT abaixo de 2^14: sem estouro nos estagios
+#define VIB_U16_MAX         65535
+
+//Bandas de oitava de 2 Hz a Nyquist (o ultimo bin entra na ultima banda)
+const uint16_t vib_band_edge[TELEM_VIB_BANDS + 1] = {
+    VIB_BIN(2), VIB_BIN(4), VIB_BIN(8), VIB_BIN(16), VIB_BIN(32),
+    VIB_BIN(64), VIB_BIN(128), VIB_BIN(256), VIB_HALF + 1,
+};
+
+//round(32768 * sin(2 * pi * i / 512)), i = 0..128
+const uint16_t vib_sin_q15[VIB_FFT_N / 4 + 1] = {
+        0,   402,   804,  1206,  1608,  2009,  2411,  2811,  3212,  3612,  4011,  4410,
+     4808,  5205,  5602,  5998,  6393,  6787,  7180,  7571,  7962,  8351,  8740,  9127,
+     9512,  9896, 10279, 10660, 11039, 11417, 11793, 12167, 12540, 12910, 13279, 13646,
+    14010, 14373, 14733, 15091, 15447, 15800, 16151, 16500, 16846, 17190, 17531, 17869,
+    18205, 18538, 18868, 19195, 19520, 19841, 20160, 20475, 20788, 21097, 21403, 21706,
+    22006, 22302, 22595, 22884, 23170, 23453, 23732, 24008, 24279, 24548, 24812, 25073,
+    25330, 25583, 25833, 26078, 26320, 26557, 26791, 27020, 27246, 27467, 27684, 27897,
+    28106, 28311, 28511, 28707, 28899, 29086, 29269, 29448, 29622, 29792, 29957, 30118,
+    30274, 30425, 30572, 30715, 30853, 30986, 31114, 31238, 31357, 31471, 31581, 31686,
+    31786, 31881, 31972, 32058, 32138, 32214, 32286, 32352, 32413, 32470, 32522, 32568,
+    32610, 32647, 32679, 32706, 32729, 32746, 32758, 32766, 32768,
+};
+
+//Tabelas derivadas, comuns a todas as instancias
+static uint16_t vib_bitrev[VIB_FFT_N];
+static uint16_t vib_hann[VIB_FFT_N];
+static int32_t vib_tw[VIB_HALF][2];     //cos, -sin de 2*pi*k/N
+static uint8_t vib_tables_ok;
+
+static int32_t vib_sin(uint32_t k)
+{
+    k &= VIB_FFT_N - 1;
+    if (k <= VIB_QUARTER) {
+        return vib_sin_q15[k];
+    }
+    if (k <= VIB_HALF) {
+        return vib_sin_q15[VIB_HALF - k];
+    }
+    if (k <= 3 * VIB_QUARTER) {
+        return -(int32_t)vib_sin_q15[k - VIB_HALF];
+    }
+    return -(int32_t)vib_sin_q15[VIB_FFT_N - k];
+}
+
+static void vib_tables(void)
+{
+    for (uint32_t n = 0; n < VIB_FFT_N; n++) {
+        uint32_t r = 0;
+        for (int b = 0; b < VIB_FFT_LOG2; b++) {
+            r |= ((n >> b) & 1) << (VIB_FFT_LOG2 - 1 - b);
+        }
+        vib_bitrev[n] = (uint16_t)r;
+        vib_hann[n] = (uint16_t)((32768 - vib_sin(n + VIB_QUARTER)) >> 1);
+    }
+    for (uint32_t k = 0; k < VIB_HALF; k++) {
+        vib_tw[k][0] = vib_sin(k + VIB_QUARTER);
+        vib_tw[k][1] = -vib_sin(k);
+    }
+    vib_tables_ok = 1;
+}
+
+void vib_init(vib_t *v, const vib_cfg_t *cfg)
+{
+    if (!vib_tables_ok) {
+        vib_tables();
+    }
+    memset(v, 0, sizeof(*v));
+    for (int l = 0; l < TELEM_VIB_SHOCKS; l++) {
+        v->thr_lsb[l] = (uint16_t)(((uint32_t)cfg->shock_mg[l] * VIB_LSB_PER_G + 500) / 1000);
+    }
+    for (int a = 0; a < VIB_AXES; a++) {
+        v->axis[a].armed = (1 << TELEM_VIB_SHOCKS) - 1;
+    }
+}
+
+//FFT in-place sobre v->fft (ja em ordem de bits invertidos)
+static void vib_fft(int16_t *x)
+{
+    //Estagios 1 e 2: twiddles 1 e -j, sem multiplicacao
+    for (int i = 0; i < 2 * VIB_FFT_N; i += 8) {
+        int32_t ar = (x[i] + x[i + 2]) >> 1, ai = (x[i + 1] + x[i + 3]) >> 1;
+        int32_t br = (x[i] - x[i + 2]) >> 1, bi = (x[i + 1] - x[i + 3]) >> 1;
+        int32_t cr = (x[i + 4] + x[i + 6]) >> 1, ci = (x[i + 5] + x[i + 7]) >> 1;
+        int32_t dr = (x[i + 4] - x[i + 6]) >> 1, di = (x[i + 5] - x[i + 7]) >> 1;
+
+        x[i] = (int16_t)((ar + cr) >> 1);
+        x[i + 1] = (int16_t)((ai + ci) >> 1);
+        x[i + 4] = (int16_t)((ar - cr) >> 1);
+        x[i + 5] = (int16_t)((ai - ci) >> 1);
+        //d * -j = (di, -dr)
+        x[i + 2] = (int16_t)((br + di) >> 1);
+        x[i + 3] = (int16_t)((bi - dr) >> 1);
+        x[i + 6] = (int16_t)((br - di) >> 1);
+        x[i + 7] = (int16_t)((bi + dr) >> 1);
+    }
+
+    for (int half = 4, step = VIB_FFT_N / 8; half < VIB_FFT_N; half <<= 1, step >>= 1) {
+        for (int j = 0; j < half; j++) {
+            const int32_t wr = vib_tw[j * step][0];
+            const int32_t wi = vib_tw[j * step][1];
+            for (int i = j; i < VIB_FFT_N; i += 2 * half) {
+                int16_t *a = &x[2 * i];
+                int16_t *b = &x[2 * (i + half)];
+                int32_t tr = (wr * b[0] - wi * b[1] + 16384) >> 15;
+                int32_t ti = (wr * b[1] + wi * b[0] + 16384) >> 15;
+                int32_t ar = a[0], ai = a[1];
+
+                a[0] = (int16_t)((ar + tr) >> 1);
+                a[1] = (int16_t)((ai + ti) >> 1);
+                b[0] = (int16_t)((ar - tr) >> 1);
+                b[1] = (int16_t)((ai - ti) >> 1);
+            }
+        }
+    }
+}
+
+//Processa a janela completa de um eixo
+static void vib_window_axis(vib_t *v, int a)
+{
+    vib_axis_t *ax = &v->axis[a];
+    int16_t *x = v->win[a];
+    int32_t sum = 0;
+    int32_t mean;
+    uint32_t peak = 0;
+    uint64_t sum2 = 0;
+    int s;
+
+    for (int n = 0; n < VIB_FFT_N; n++) {
+        sum += x[n];
+    }
+    mean = (sum + VIB_HALF) >> VIB_FFT_LOG2;
+
+    for (int n = 0; n < VIB_FFT_N; n++) {
+        int32_t d = x[n] - mean;
+        uint32_t ad, sq;
+        uint64_t q;
+
+        d = d > 32767 ? 32767 : (d < -32767 ? -32767 : d);
+        x[n] = (int16_t)d;
+        ad = (uint32_t)(d < 0 ? -d : d);
+        sq = ad * ad;
+        peak = ad > peak ? ad : peak;
+        sum2 += sq;
+        q = (uint64_t)sq * sq;
+        ax->sum4_lo += q;
+        ax->sum4_hi += (ax->sum4_lo < q);
+
+        for (int l = 0; l < TELEM_VIB_SHOCKS; l++) {
+            if ((ax->armed & (1 << l)) && ad >= v->thr_lsb[l]) {
+                ax->shocks[l]++;
+                ax->armed &= ~(1 << l);
+            } else if (!(ax->armed & (1 << l)) && ad < (uint32_t)(v->thr_lsb[l] >> 1)) {
+                ax->armed |= 1 << l;
+            }
+        }
+    }
+    ax->sum2 += sum2;
+    if (peak > ax->peak) {
+        ax->peak = (uint16_t)peak;
+    }
+    if (peak == 0) {
+        return;
+    }
+
+    //Bloco flutuante: escala a janela para usar os 14 bits da entrada
+    if (peak >= VIB_IN_MAX) {
+        s = -1;
+    } else {
+        for (s = 0; (peak << (s + 1)) < VIB_IN_MAX; s++) {
+        }
+    }
+    {
+        const int shift = 15 - s;
+        const int32_t half = 1 << (shift - 1);
+        for (int n = 0; n < VIB_FFT_N; n++) {
+            int16_t *c = &v->fft[2 * vib_bitrev[n]];
+            c[0] = (int16_t)((x[n] * (int32_t)vib_hann[n] + half) >> shift);
+            c[1] = 0;
+        }
+    }
+    vib_fft(v->fft);
+
+    for (int b = 0; b < TELEM_VIB_BANDS; b++) {
+        uint64_t e = 0;
+        for (int k = vib_band_edge[b]; k < vib_band_edge[b + 1]; k++) {
+            int32_t re = v->fft[2 * k], im = v->fft[2 * k + 1];
+            e += (uint32_t)(re * re + im * im);
+        }
+        ax->band_q16[b] += (e << 22) / ((uint64_t)3 << (2 * s + 2));
+    }
+}
+
+void vib_add(vib_t *v, const int16_t acc[VIB_AXES])
+{
+    for (int a = 0; a < VIB_AXES; a++) {
+        v->win[a][v->fill] = acc[a];
+    }
+    if (++v->fill < VIB_FFT_N) {
+        return;
+    }
+    for (int a = 0; a < VIB_AXES; a++) {
+        vib_window_axis(v, a);
+    }
+    v->fill = 0;
+    v->windows++;
+}
+
+static uint32_t vib_isqrt(uint64_t x)
+{
+    uint64_t r = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > x) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (x >= r + bit) {
+            x -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)r;
+}
+
+static uint16_t vib_sat16(uint64_t x)
+{
+    return x > VIB_U16_MAX ? VIB_U16_MAX : (uint16_t)x;
+}
+
+//LSB com frac bits fracionarios -> mili-g arredondado
+static uint16_t vib_mg(uint64_t lsb, int frac)
+{
+    const uint64_t div = (uint64_t)VIB_LSB_PER_G << frac;
+    return vib_sat16((lsb * 1000 + div / 2) / div);
+}
+
+size_t vib_report(vib_t *v, uint32_t utc, telem_vib_t out[VIB_AXES])
+{
+    const uint64_t nsamp = (uint64_t)v->windows * VIB_FFT_N;
+
+    if (v->windows == 0) {
+        return 0;
+    }
+    for (int a = 0; a < VIB_AXES; a++) {
+        vib_axis_t *ax = &v->axis[a];
+        telem_vib_t *o = &out[a];
+        uint32_t rms_q4 = vib_isqrt((ax->sum2 << 8) / nsamp);
+        double k;
+
+        memset(o, 0, sizeof(*o));
+        o->utc = utc;
+        o->axis = (uint8_t)a;
+        o->rms_mg = vib_mg(rms_q4, 4);
+        o->peak_mg = vib_mg(ax->peak, 0);
+        o->crest_x100 = rms_q4 ? vib_sat16(((uint64_t)ax->peak * 1600 + rms_q4 / 2) / rms_q4) : 0;
+        if (ax->sum2 > 0) {
+            k = (ldexp((double)ax->sum4_hi, 64) + (double)ax->sum4_lo) * (double)nsamp /
+                ((double)ax->sum2 * (double)ax->sum2);
+            o->kurtosis_x100 = vib_sat16((uint64_t)(k * 100 + 0.5));
+        }
+        for (int l = 0; l < TELEM_VIB_SHOCKS; l++) {
+            o->shocks[l] = vib_sat16(ax->shocks[l]);
+        }
+        o->nbands = TELEM_VIB_BANDS;
+        for (int b = 0; b < TELEM_VIB_BANDS; b++) {
+            o->band[b] = vib_mg(vib_isqrt(ax->band_q16[b] / v->windows), 8);
+        }
+
+        //Estado dos detectores de choque continua no proximo periodo
+        ax->sum2 = 0;
+        ax->sum4_hi = 0;
+        ax->sum4_lo = 0;
+        ax->peak = 0;
+        memset(ax->band_q16, 0, sizeof(ax->band_q16));
+        memset(ax->shocks, 0, sizeof(ax->shocks));
+    }
+    v->windows = 0;
+    return VIB_AXES;
+}
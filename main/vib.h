@@ -0,0 +1,91 @@
+/* Extracao de caracteristicas de vibracao a partir das amostras da IMU
+
+   As amostras do acelerometro sao agrupadas em janelas fixas de VIB_FFT_N
+   amostras (~0,5 s a 1 kHz), sem sobreposicao. Em cada janela e em cada
+   eixo a componente continua (gravidade, inclinacao) e removida e sao
+   acumulados:
+     - soma de d^2 e de d^4 (RMS e curtose do periodo);
+     - pico de |d|;
+     - choques: |d| cruza um limiar de baixo para cima (rearma abaixo da
+       metade do limiar), um contador por nivel configurado;
+     - energia em TELEM_VIB_BANDS bandas de oitava (2-500 Hz) por uma FFT
+       radix-2 em ponto fixo Q15 com janela de Hann.
+
+   vib_report() reduz o periodo (tipicamente 30 min) a uma entrada
+   telem_vib_t por eixo, algumas dezenas de bytes depois de codificadas.
+
+   Toda a aritmetica e inteira (so a curtose final usa double), entao o
+   resultado e identico bit a bit no ESP32 e no host. O modulo nao depende
+   do ESP-IDF; tools/vib_bench.c compara com uma implementacao de
+   referencia e mede ciclos por amostra.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telem.h"
+
+#define VIB_RATE_HZ         1000    //Taxa das amostras (IMU_RATE_HZ)
+#define VIB_LSB_PER_G       4096    //Escala do acelerometro (IMU_ACCEL_LSB_PER_G)
+#define VIB_AXES            3
+#define VIB_FFT_LOG2        9
+#define VIB_FFT_N           (1 << VIB_FFT_LOG2)
+
+//Limiares de choque padrao em mili-g, um por nivel (TELEM_VIB_SHOCKS)
+#define VIB_CFG_DEFAULT     { .shock_mg = {1000, 2000, 4000} }
+
+typedef struct {
+    uint16_t shock_mg[TELEM_VIB_SHOCKS];
+} vib_cfg_t;
+
+//Acumuladores do periodo de um eixo
+typedef struct {
+    uint64_t sum2;                      //Soma de d^2 (LSB^2)
+    uint64_t sum4_hi;                   //Soma de d^4 em 128 bits
+    uint64_t sum4_lo;
+    uint64_t band_q16[TELEM_VIB_BANDS]; //Soma das potencias por banda (LSB^2, Q16)
+    uint32_t shocks[TELEM_VIB_SHOCKS];
+    uint16_t peak;                      //Maior |d| em LSB
+    uint8_t armed;                      //Bit por nivel: pronto para contar um choque
+} vib_axis_t;
+
+typedef struct {
+    uint16_t thr_lsb[TELEM_VIB_SHOCKS];
+    uint32_t fill;                      //Amostras na janela corrente
+    uint32_t windows;                   //Janelas completas no periodo
+    int16_t win[VIB_AXES][VIB_FFT_N];
+    int16_t fft[2 * VIB_FFT_N] __attribute__((aligned(16)));   //re, im intercalados
+    vib_axis_t axis[VIB_AXES];
+} vib_t;
+
+/**
+ * @brief   Prepara o estado e as tabelas da FFT.
+ */
+void vib_init(vib_t *v, const vib_cfg_t *cfg);
+
+/**
+ * @brief   Acrescenta uma amostra (x, y, z em LSB); processa a janela quando
+ *          completa.
+ */
+void vib_add(vib_t *v, const int16_t acc[VIB_AXES]);
+
+/**
+ * @brief   Fecha o periodo: uma entrada por eixo em out e zera os
+ *          acumuladores. A janela incompleta continua no proximo periodo.
+ *
+ * Os acumuladores de banda comportam periodos de ate ~2 h.
+ *
+ * @return  Entradas escritas (VIB_AXES), ou 0 se nao houve janela completa
+ */
+size_t vib_report(vib_t *v, uint32_t utc, telem_vib_t out[VIB_AXES]);
+
+/**
+ * @brief   Limites das bandas em bins da FFT: banda b cobre
+ *          [vib_band_edge[b], vib_band_edge[b + 1]).
+ */
+extern const uint16_t vib_band_edge[TELEM_VIB_BANDS + 1];
+
+/**
+ * @brief   Seno em Q15 (32768 = 1,0) de 2*pi*i/VIB_FFT_N, i = 0..N/4.
+ */
+extern const uint16_t vib_sin_q15[VIB_FFT_N / 4 + 1];
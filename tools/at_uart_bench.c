@@ -0,0 +1,388 @@
+/* Leitura byte a byte contra montagem por eventos (main/at_line.c), no host
+
+   Uma UART simulada entrega as respostas de um ciclo tipico do SIM7070
+   (AT, CSQ, CPSI, CGNSINF, CNACT com o +APP PDP atrasado, SMCONN) no
+   tempo de fio do baud escolhido. O driver e modelado como o do ESP-IDF:
+   os bytes so ficam visiveis para a task quando a FIFO passa de
+   RX_FULL_THRESH, quando a linha fica ociosa por RX_TOUT_SYMBOLS ou, com
+   a deteccao de padrao, no '\n'. Cada troca passa pelos dois leitores:
+     - antes: o laco do antigo sendReceive(), um uart_read_bytes() de 1
+       byte com 50 ms de prazo por chamada e vTaskDelay(100 ms) a cada
+       tentativa sem a resposta esperada;
+     - depois: a task leitora do at_uart, que a cada evento le o que
+       chegou de uma vez e passa ao at_line_feed(); o consumidor espera
+       linhas inteiras com prazo de 150 ms por tentativa.
+   O tempo do ciclo e virtual; a latencia e do terminador da linha
+   esperada no fio ate o consumidor recebe-la. Chamadas ao driver e
+   despertares de task sao contados, e o tempo de CPU do host e medido
+   repetindo o ciclo (a leitura simulada toma e devolve um mutex, como o
+   rx_mux e o ringbuffer do driver).
+
+   gcc -O2 -pthread -Imain tools/at_uart_bench.c main/at_line.c -o at_uart_bench
+   ./at_uart_bench [baud]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include "at_line.h"
+
+#define WIRE_MAX            1024
+#define RX_FULL_THRESH      120         //UART_FULL_THRESH_DEFAULT
+#define RX_TOUT_SYMBOLS     10          //UART_TOUT_THRESH_DEFAULT
+#define OLD_BYTE_TOUT_US    50000.0     //uart_read_bytes(..., 1, pdMS_TO_TICKS(50))
+#define OLD_RETRY_US        100000.0    //vTaskDelay(pdMS_TO_TICKS(100)) por tentativa
+#define NEW_TRY_US          150000.0    //AT_TRY_TICKS
+#define TRYS                30
+#define POOL                8
+#define REPEAT              2000
+
+typedef struct {
+    uint32_t delay_ms;                  //Apos o fim do comando
+    const char *txt;
+} part_t;
+
+typedef struct {
+    const char *name;
+    const char *cmd;
+    const char *wait;
+    bool contains;                      //COMPARE_CONTAINS, senao COMPARE_EQUAL
+    part_t parts[3];
+} xch_t;
+
+static const xch_t script[] = {
+    {"AT", "AT\r", "OK", false, {{3, "\r\nOK\r\n"}}},
+    {"AT+CSQ", "AT+CSQ\r", "OK", false, {{10, "\r\n+CSQ: 18,99\r\n\r\nOK\r\n"}}},
+    {"AT+CPSI?", "AT+CPSI?\r", "OK", false,
+     {{40, "\r\n+CPSI: LTE CAT-M1,Online,724-05,0x2B0C,27447571,147,EUTRAN-BAND28,9410,3,3,-11,-94,-66,14\r\n\r\nOK\r\n"}}},
+    {"AT+CGNSINF", "AT+CGNSINF\r", "OK", false,
+     {{15, "\r\n+CGNSINF: 1,1,20261016121500.000,-23.550520,-46.633308,760.000,0.00,0.0,1,,0.9,1.2,0.8,,12,9,,,42,,\r\n\r\nOK\r\n"}}},
+    {"AT+CEREG?", "AT+CEREG?\r", "OK", false, {{20, "\r\n+CEREG: 0,1\r\n\r\nOK\r\n"}}},
+    {"AT+CNACT=0,1", "AT+CNACT=0,1\r", "+APP PDP: 0,ACTIVE", true,
+     {{8, "\r\nOK\r\n"}, {1400, "\r\n+APP PDP: 0,ACTIVE\r\n"}}},
+    {"AT+SMCONN", "AT+SMCONN\r", "OK", false, {{2300, "\r\nOK\r\n"}}},
+};
+
+#define N_XCH   (sizeof(script) / sizeof(script[0]))
+
+//Bytes de uma troca no fio e quando cada um fica visivel para a task
+typedef struct {
+    uint8_t wire[WIRE_MAX];
+    double t_us[WIRE_MAX];              //Fim do stop bit, a partir do fim do comando
+    double vis_us[WIRE_MAX];
+    size_t n;
+    size_t rd;
+    double term_us;                     //Terminador da linha esperada
+    pthread_mutex_t mux;
+} sim_uart_t;
+
+typedef struct {
+    double done_us;                     //Consumidor recebeu a linha esperada
+    uint32_t calls;
+    uint32_t wakeups;
+    bool ok;
+    char line[AT_LINE_MAX];
+} res_t;
+
+static sim_uart_t uarts[2][N_XCH];      //[0] sem, [1] com deteccao de padrao
+
+static bool resp_match(const xch_t *x, const char *line)
+{
+    return x->contains ? strstr(line, x->wait) != NULL : strcmp(line, x->wait) == 0;
+}
+
+/* --- UART simulada --- */
+
+static void sim_build(sim_uart_t *u, const xch_t *x, double byte_us, bool pattern)
+{
+    double tout = RX_TOUT_SYMBOLS * byte_us;
+    size_t fifo = 0;
+    size_t first = 0;
+    size_t start;
+    char line[AT_LINE_MAX];
+    size_t len = 0;
+
+    memset(u, 0, sizeof(*u));
+    pthread_mutex_init(&u->mux, NULL);
+    u->term_us = -1;
+    for (int p = 0; p < 3 && x->parts[p].txt != NULL; p++) {
+        double t = x->parts[p].delay_ms * 1000.0;
+
+        if (u->n > 0 && t < u->t_us[u->n - 1]) {
+            t = u->t_us[u->n - 1];
+        }
+        for (const char *c = x->parts[p].txt; *c != '\0' && u->n < WIRE_MAX; c++) {
+            t += byte_us;
+            u->wire[u->n] = (uint8_t)*c;
+            u->t_us[u->n] = t;
+            //Linha esperada: o primeiro terminador que a fecha
+            if (*c == '\r' || *c == '\n') {
+                line[len] = '\0';
+                if (len > 0 && u->term_us < 0 && resp_match(x, line)) {
+                    u->term_us = t;
+                }
+                len = 0;
+            } else if (len < AT_LINE_MAX - 1) {
+                line[len++] = *c;
+            }
+            u->n++;
+        }
+    }
+    //Driver: FIFO cheia, ociosidade ou '\n' passam os bytes para o buffer da task
+    for (size_t i = 0; i < u->n; i++) {
+        double flush = -1;
+
+        fifo++;
+        if (pattern && u->wire[i] == '\n') {
+            flush = u->t_us[i];
+        } else if (fifo >= RX_FULL_THRESH) {
+            flush = u->t_us[i];
+        } else if (i + 1 == u->n || u->t_us[i + 1] - u->t_us[i] > tout) {
+            flush = u->t_us[i] + tout;
+        }
+        if (flush >= 0) {
+            for (start = first; start <= i; start++) {
+                u->vis_us[start] = flush;
+            }
+            first = i + 1;
+            fifo = 0;
+        }
+    }
+}
+
+//uart_read_bytes() sem espera: so o que o driver ja entregou ate now
+static size_t sim_read(sim_uart_t *u, uint8_t *dst, size_t max, double now)
+{
+    size_t n = 0;
+
+    pthread_mutex_lock(&u->mux);
+    while (n < max && u->rd + n < u->n && u->vis_us[u->rd + n] <= now) {
+        n++;
+    }
+    memcpy(dst, &u->wire[u->rd], n);
+    u->rd += n;
+    pthread_mutex_unlock(&u->mux);
+    return n;
+}
+
+static double sim_next(const sim_uart_t *u)
+{
+    return u->rd < u->n ? u->vis_us[u->rd] : INFINITY;
+}
+
+/* --- Antes: o laco do sendReceive() antigo --- */
+
+static void old_exchange(const xch_t *x, sim_uart_t *u, res_t *r)
+{
+    char recBuff[512];
+    int idx = 0;
+    double now = 0;
+
+    u->rd = 0;
+    for (int trys = 1; ; trys++) {
+        for (;;) {
+            //uart_read_bytes(UART_NUM_2, &recBuff[idx], 1, pdMS_TO_TICKS(50))
+            r->calls++;
+            if (sim_read(u, (uint8_t *)&recBuff[idx], 1, now) == 0) {
+                double next = sim_next(u);
+
+                r->wakeups++;
+                if (next > now + OLD_BYTE_TOUT_US) {
+                    now += OLD_BYTE_TOUT_US;
+                    break;
+                }
+                now = next;
+                sim_read(u, (uint8_t *)&recBuff[idx], 1, now);
+            }
+            if (recBuff[idx] == '\r' || recBuff[idx] == '\n' || recBuff[idx] == '\0') {
+                if (idx > 1) {
+                    recBuff[idx] = '\0';
+                    if (resp_match(x, recBuff)) {
+                        r->done_us = now;
+                        r->ok = true;
+                        strcpy(r->line, recBuff);
+                        return;
+                    }
+                }
+                idx = 0;
+            } else if (idx < (int)sizeof(recBuff) - 1) {
+                idx++;
+            }
+        }
+        //Aguarda e faz timeout
+        now += OLD_RETRY_US;
+        r->wakeups++;
+        if (trys >= TRYS) {
+            r->done_us = now;
+            return;
+        }
+    }
+}
+
+/* --- Depois: task leitora com at_line_feed() e consumidor de linhas --- */
+
+typedef struct {
+    at_line_t pool[POOL];
+    at_line_t *free[POOL];
+    int nfree;
+    at_line_t *ready[POOL];
+    int nready;
+} new_ctx_t;
+
+static at_line_t *new_get(void *arg)
+{
+    new_ctx_t *c = arg;
+
+    if (c->nfree == 0) {
+        return NULL;
+    }
+    c->free[c->nfree - 1]->len = 0;
+    return c->free[--c->nfree];
+}
+
+static bool new_emit(at_line_t *line, void *arg)
+{
+    new_ctx_t *c = arg;
+
+    c->ready[c->nready++] = line;
+    return true;
+}
+
+static void new_exchange(const xch_t *x, sim_uart_t *u, res_t *r)
+{
+    static new_ctx_t ctx;
+    at_line_asm_t a;
+    uint8_t ring[WIRE_MAX];
+    double waited = 0;                  //Ultima vez que o consumidor acordou
+    int trys = 1;
+
+    ctx.nfree = POOL;
+    ctx.nready = 0;
+    for (int i = 0; i < POOL; i++) {
+        ctx.free[i] = &ctx.pool[i];
+    }
+    at_line_init(&a, new_get, new_emit, &ctx);
+    u->rd = 0;
+    while (u->rd < u->n) {
+        double now = sim_next(u);
+        size_t n;
+
+        //Consumidor: cada prazo de 150 ms sem linha e uma tentativa
+        while (now - waited > NEW_TRY_US) {
+            waited += NEW_TRY_US;
+            r->wakeups++;
+            if (trys++ >= TRYS) {
+                r->done_us = waited;
+                return;
+            }
+        }
+        //Evento do driver: leitora acorda, le tudo e monta
+        r->wakeups++;
+        r->calls++;                     //uart_read_bytes()
+        n = sim_read(u, ring, sizeof(ring), now);
+        if (n > 0 && ring[n - 1] == '\n') {
+            r->calls++;                 //uart_pattern_pop_pos()
+        }
+        at_line_feed(&a, ring, n);
+        for (int i = 0; i < ctx.nready; i++) {
+            at_line_t *line = ctx.ready[i];
+
+            r->wakeups++;
+            waited = now;
+            if (!r->ok && line->len > 1 && resp_match(x, line->txt)) {
+                r->done_us = now;
+                r->ok = true;
+                strcpy(r->line, line->txt);
+            }
+            ctx.free[ctx.nfree++] = line;
+        }
+        ctx.nready = 0;
+        if (r->ok) {
+            return;
+        }
+    }
+}
+
+static double cpu_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned baud = (argc > 1) ? (unsigned)atoi(argv[1]) : 115200;
+    double byte_us = 10.0 * 1e6 / baud;
+    res_t res[2][N_XCH];
+    res_t scratch;
+    double cpu[2];
+    double sum_lat[2] = {0, 0};
+    double cycle[2] = {0, 0};
+    uint32_t calls[2] = {0, 0};
+    uint32_t wakeups[2] = {0, 0};
+    int fails = 0;
+
+    for (size_t i = 0; i < N_XCH; i++) {
+        sim_build(&uarts[0][i], &script[i], byte_us, false);
+        sim_build(&uarts[1][i], &script[i], byte_us, true);
+    }
+    memset(res, 0, sizeof(res));
+    for (size_t i = 0; i < N_XCH; i++) {
+        old_exchange(&script[i], &uarts[0][i], &res[0][i]);
+        new_exchange(&script[i], &uarts[1][i], &res[1][i]);
+    }
+
+    //CPU do host: o ciclo inteiro repetido em cada leitor
+    for (int m = 0; m < 2; m++) {
+        double t0 = cpu_s();
+
+        for (int k = 0; k < REPEAT; k++) {
+            for (size_t i = 0; i < N_XCH; i++) {
+                memset(&scratch, 0, sizeof(scratch));
+                if (m == 0) {
+                    old_exchange(&script[i], &uarts[0][i], &scratch);
+                } else {
+                    new_exchange(&script[i], &uarts[1][i], &scratch);
+                }
+            }
+        }
+        cpu[m] = (cpu_s() - t0) / REPEAT;
+    }
+
+    printf("UART simulada a %u baud (%.1f us por byte), %u trocas por ciclo\n\n", baud, byte_us, (unsigned)N_XCH);
+    printf("%-14s %22s %18s %16s\n", "troca", "latencia ms ant/dep", "chamadas ant/dep", "despert. ant/dep");
+    for (size_t i = 0; i < N_XCH; i++) {
+        double lat[2];
+
+        for (int m = 0; m < 2; m++) {
+            lat[m] = (res[m][i].done_us - uarts[m][i].term_us) / 1000.0;
+            sum_lat[m] += lat[m];
+            cycle[m] += res[m][i].done_us;
+            calls[m] += res[m][i].calls;
+            wakeups[m] += res[m][i].wakeups;
+        }
+        printf("%-14s %10.2f / %-9.2f %8u / %-7u %7u / %-6u\n", script[i].name, lat[0], lat[1],
+               res[0][i].calls, res[1][i].calls, res[0][i].wakeups, res[1][i].wakeups);
+        if (!res[0][i].ok || !res[1][i].ok || strcmp(res[0][i].line, res[1][i].line) != 0) {
+            printf("  %s: resposta diferente ou nao recebida\n", script[i].name);
+            fails++;
+        } else if (lat[1] > lat[0]) {
+            printf("  %s: latencia maior depois\n", script[i].name);
+            fails++;
+        }
+    }
+    printf("\n%-26s %12s %12s\n", "por resposta", "antes", "depois");
+    printf("%-26s %12.2f %12.2f\n", "latencia media (ms)", sum_lat[0] / N_XCH, sum_lat[1] / N_XCH);
+    printf("%-26s %12.1f %12.1f\n", "chamadas ao driver", (double)calls[0] / N_XCH, (double)calls[1] / N_XCH);
+    printf("%-26s %12.1f %12.1f\n", "despertares de task", (double)wakeups[0] / N_XCH, (double)wakeups[1] / N_XCH);
+    printf("%-26s %12.2f %12.2f\n", "CPU do host (us)", cpu[0] * 1e6 / N_XCH, cpu[1] * 1e6 / N_XCH);
+    printf("%-26s %12.0f %12.0f\n", "ciclo inteiro (ms)", cycle[0] / 1000.0, cycle[1] / 1000.0);
+    printf("\n%s\n", fails ? "FALHOU" : "OK");
+    return fails;
+}
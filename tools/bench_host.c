@@ -0,0 +1,99 @@
+/* Variante de host do benchmark do firmware (main/bench.c)
+
+   Roda as mesmas cargas, com as mesmas entradas, que o build de benchmark
+   do ESP32 (CONFIG_LOGQ_BENCHMARK) e imprime no mesmo formato; os checksums
+   devem coincidir com os do console da placa. Os ciclos sao do TSC quando
+   disponivel. Com --check <arquivo> compara com uma execucao anterior
+   salva (saida deste programa) e falha se alguma carga ficou mais de 10%
+   mais lenta ou mudou de checksum.
+
+   gcc -O2 -Imain tools/bench_host.c main/bench.c main/at_decode.c main/gnss.c \
+       main/telem.c main/vib.c main/evt.c main/ring.c main/dlog.c -lm -o bench_host && ./bench_host
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC    1
+#endif
+#include "bench.h"
+
+#define SLOWER_PCT  10
+
+static uint32_t host_cycles(void)
+{
+#ifdef HAVE_TSC
+    return (uint32_t)__rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static uint64_t host_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+//Compara com a saida salva de uma execucao anterior
+static int check(const char *path, const bench_result_t *res, size_t n)
+{
+    FILE *f = fopen(path, "r");
+    char line[256];
+    int fails = 0;
+
+    if (f == NULL) {
+        perror(path);
+        return 1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char name[32];
+        unsigned ops, cyc, ns, chk;
+        int heap;
+
+        if (sscanf(line, "| Bench | %31s | ops %u | cycles/op %u | ns/op %u | heap/op %d | chk %x",
+                   name, &ops, &cyc, &ns, &heap, &chk) != 6) {
+            continue;
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (strcmp(name, res[i].name) != 0) {
+                continue;
+            }
+            if (chk != res[i].checksum) {
+                printf("%s: checksum %08x, antes %08x\n", name, res[i].checksum, chk);
+                fails++;
+            }
+            if (res[i].ns_op * 100 > ns * (100 + SLOWER_PCT)) {
+                printf("%s: %u ns/op, antes %u (+%u%%)\n", name, res[i].ns_op, ns,
+                       (res[i].ns_op - ns) * 100 / (ns ? ns : 1));
+                fails++;
+            }
+        }
+    }
+    fclose(f);
+    printf("%s\n", fails ? "REGRESSAO" : "sem regressao");
+    return fails ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    const bench_port_t port = {
+        .cycles = host_cycles,
+        .time_ns = host_time_ns,
+        .heap_used = NULL,
+    };
+    bench_result_t res[BENCH_MAX];
+    size_t n = bench_run(&port, res, BENCH_MAX);
+
+    for (size_t i = 0; i < n; i++) {
+        bench_print(&res[i]);
+    }
+    if (argc == 3 && strcmp(argv[1], "--check") == 0) {
+        return check(argv[2], res, n);
+    }
+    return 0;
+}
@@ -0,0 +1,141 @@
+#!/usr/bin/env python
+"""Decodificador da saida binaria do dlog (CONFIG_LOGQ_DLOG_BINARY).
+
+Le os quadros que a task do dlog escreve no console e os formata com a
+tabela de main/dlog_fmt.h, a mesma do firmware. O resto do console (printf
+que nao passa pelo dlog, boot do ESP-IDF) sai como veio.
+
+Quadro: A5 5A, nucleo (1 byte), tamanho dos dados (1 byte), tick (4 bytes),
+id (2 bytes, bit 15 = dados sao uma string), dados; little-endian. Sem
+string, os dados sao argumentos de 32 bits.
+
+Exemplos:
+    python tools/dlog_decode.py captura.bin
+    python tools/dlog_decode.py --port /dev/ttyUSB0
+"""
+
+from __future__ import print_function
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+SYNC = b'\xa5\x5a'
+HDR_LEN = 10
+ID_STR = 0x8000
+PAYLOAD_MAX = 116       # DLOG_PAYLOAD_MAX
+CORES = 2
+TICK_HZ = 100           # CONFIG_FREERTOS_HZ
+
+FMT_RE = re.compile(r'^\s*DLOG_FMT\(\s*(\w+)\s*,\s*(\w+)\s*,\s*(\w+)\s*,\s*("(?:[^"\\]|\\.)*")\s*\)', re.M)
+SPEC_RE = re.compile(r'%[-+ #0]*\d*(?:\.\d+)?[hlzj]*([diuxXcs%])')
+
+
+def load_fmts(path):
+    """Lista de (id, modulo, formato) na ordem de dlog_fmt.h."""
+    with open(path) as f:
+        text = f.read()
+    fmts = []
+    for m in FMT_RE.finditer(text):
+        fmt = m.group(4)[1:-1].encode('latin-1').decode('unicode_escape')
+        fmts.append((m.group(1), m.group(2), fmt))
+    return fmts
+
+
+def format_rec(fmts, rid, data):
+    if rid & ~ID_STR >= len(fmts):
+        return 'dlog: id %u desconhecido' % (rid & ~ID_STR)
+    name, mod, fmt = fmts[rid & ~ID_STR]
+    if rid & ID_STR:
+        return fmt.replace('%s', data.decode('latin-1'), 1)
+    args = list(struct.unpack('<%dI' % (len(data) // 4), data[:len(data) // 4 * 4]))
+    vals = []
+    for conv in SPEC_RE.findall(fmt):
+        if conv == '%':
+            continue
+        v = args.pop(0) if args else 0
+        if conv in 'di':
+            v = v - (1 << 32) if v & 0x80000000 else v
+        elif conv == 'c':
+            v = chr(v & 0xff)
+        vals.append(v)
+    # Python nao conhece os modificadores de tamanho do C
+    return re.sub(r'(%[-+ #0]*\d*(?:\.\d+)?)[hlzj]+', r'\1', fmt) % tuple(vals)
+
+
+def decode(fmts, buf, out, hz, final=False):
+    """Decodifica o que der de buf; devolve o que sobrou (quadro incompleto)."""
+    while buf:
+        i = buf.find(SYNC)
+        if i < 0:
+            # Pode ser o inicio de um sync partido
+            keep = 1 if buf.endswith(SYNC[:1]) and not final else 0
+            out.write(buf[:len(buf) - keep].decode('latin-1'))
+            return buf[len(buf) - keep:]
+        if i > 0:
+            out.write(buf[:i].decode('latin-1'))
+            buf = buf[i:]
+        if len(buf) < HDR_LEN:
+            if final:
+                out.write(buf.decode('latin-1'))
+                return b''
+            return buf
+        core, dlen, tick, rid = struct.unpack_from('<BBIH', buf, 2)
+        if core >= CORES or dlen > PAYLOAD_MAX:
+            # Nao e quadro: os bytes eram texto
+            out.write(buf[:1].decode('latin-1'))
+            buf = buf[1:]
+            continue
+        if len(buf) < HDR_LEN + dlen:
+            if final:
+                out.write(buf.decode('latin-1'))
+                return b''
+            return buf
+        line = format_rec(fmts, rid, buf[HDR_LEN:HDR_LEN + dlen])
+        out.write('[%10.3f %u] %s\n' % (tick / float(hz), core, line))
+        buf = buf[HDR_LEN + dlen:]
+    return buf
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('file', nargs='?', help='Captura binaria (padrao: stdin)')
+    ap.add_argument('--port', help='Porta serial do console do ESP32')
+    ap.add_argument('--baud', type=int, default=115200)
+    ap.add_argument('--fmt', default=os.path.join(here, '..', 'main', 'dlog_fmt.h'),
+                    help='Tabela de formatos (padrao: main/dlog_fmt.h)')
+    ap.add_argument('--hz', type=int, default=TICK_HZ, help='Ticks por segundo do FreeRTOS')
+    args = ap.parse_args()
+
+    fmts = load_fmts(args.fmt)
+    if not fmts:
+        sys.exit('Nenhum DLOG_FMT em %s' % args.fmt)
+
+    if args.port:
+        import serial
+        src = serial.Serial(args.port, args.baud, timeout=0.2)
+        read = lambda: src.read(4096)
+    else:
+        src = open(args.file, 'rb') if args.file else getattr(sys.stdin, 'buffer', sys.stdin)
+        read = lambda: src.read(4096)
+
+    buf = b''
+    try:
+        while True:
+            chunk = read()
+            if not chunk:
+                if args.port:
+                    continue
+                break
+            buf = decode(fmts, buf + chunk, sys.stdout, args.hz)
+            sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+    decode(fmts, buf, sys.stdout, args.hz, final=True)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,158 @@
+/* Simulacao dos cenarios de evento (main/evt.c) no host
+
+   Gera aceleracao a 1 kHz para cada cenario (queda com impacto, choque,
+   tombamento, estrada sem evento) e entrega as amostras ao detector em
+   rajadas, como a task da IMU: a cada IMU_BURST_MS ou, com a interrupcao de
+   movimento, logo apos a amostra que a dispara. Mostra, para cada evento,
+   o erro do instante de inicio informado e a latencia do inicio fisico
+   ate o gatilho e ate o evento pronto para publicar (fim da janela
+   pos-gatilho). A parte do modem (montagem do payload ate o OK do
+   AT+SMPUB) e medida pelo tools/sim7070_sim.py a partir do age_ms.
+
+   gcc -O2 -Imain tools/evt_sim.c main/evt.c -lm -o evt_sim && ./evt_sim
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "evt.h"
+
+#define RATE        VIB_RATE_HZ
+#define G           VIB_LSB_PER_G
+#define BURST_MS    20          //IMU_BURST_MS
+#define MOTION_MG   256         //IMU_MOTION_MG
+#define SETTLE_S    3
+
+typedef struct {
+    const char *name;
+    double onset_s;             //Inicio fisico do evento
+    double len_s;
+    uint8_t expect;             //TELEM_EVT_* esperado (0 = nenhum)
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+    {"queda de 30 cm",     SETTLE_S + 1.0, 6, TELEM_EVT_FREEFALL | TELEM_EVT_SHOCK},
+    {"choque lateral 4 g", SETTLE_S + 1.0, 6, TELEM_EVT_SHOCK},
+    {"tombamento 90 graus", SETTLE_S + 1.0, 8, TELEM_EVT_TILT},
+    {"estrada (sem evento)", SETTLE_S + 1.0, 60, 0},
+};
+
+static uint32_t lcg = 7;
+
+static double noise(double amp)
+{
+    lcg = lcg * 1664525 + 1013904223;
+    return ((lcg >> 8) / 16777216.0 * 2 - 1) * amp;
+}
+
+static int16_t clamp16(double v)
+{
+    return v > 32767 ? 32767 : v < -32768 ? -32768 : (int16_t)lrint(v);
+}
+
+//Aceleracao (g) do cenario no instante t
+static void accel(int sc, double t, double a[3])
+{
+    double dt = t - scenarios[sc].onset_s;
+
+    a[0] = noise(0.01);
+    a[1] = noise(0.01);
+    a[2] = 1 + noise(0.01);
+    switch (sc) {
+    case 0:
+        //Queda livre de 30 cm (~247 ms) e impacto de 10 ms com 8 g
+        if (dt >= 0 && dt < 0.247) {
+            a[0] = a[1] = a[2] = noise(0.02);
+        } else if (dt >= 0.247 && dt < 0.257) {
+            a[2] += 8 * sin(M_PI * (dt - 0.247) / 0.010);
+        }
+        break;
+    case 1:
+        if (dt >= 0 && dt < 0.006) {
+            a[1] += 4 * sin(M_PI * dt / 0.006);
+        }
+        break;
+    case 2:
+        //Gira 90 graus em torno de x em 0,8 s e fica deitado
+        if (dt >= 0) {
+            double ang = dt < 0.8 ? M_PI / 2 * dt / 0.8 : M_PI / 2;
+            a[1] += sin(ang);
+            a[2] += cos(ang) - 1;
+        }
+        break;
+    case 3:
+        for (int k = 0; k < 3; k++) {
+            a[k] += 0.2 * sin(2 * M_PI * 12 * t + k) + 0.1 * sin(2 * M_PI * 47 * t + 2 * k) + noise(0.05);
+        }
+        break;
+    }
+}
+
+int main(void)
+{
+    const evt_cfg_t cfg = EVT_CFG_DEFAULT;
+    int fails = 0;
+
+    for (int sc = 0; sc < (int)(sizeof(scenarios) / sizeof(scenarios[0])); sc++) {
+        const scenario_t *s = &scenarios[sc];
+        int n = (int)((s->onset_s + s->len_s) * RATE);
+        int16_t (*buf)[3] = malloc(n * sizeof(*buf));
+        static evt_t e;
+        int delivered = 0;
+        int events = 0;
+        double trig_s = -1;
+        telem_evt_t ev;
+
+        evt_init(&e, &cfg);
+        for (int i = 0; i < n; i++) {
+            double a[3];
+            accel(sc, (double)i / RATE, a);
+            for (int k = 0; k < 3; k++) {
+                buf[i][k] = clamp16(a[k] * G);
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            //A IMU le a FIFO a cada rajada ou logo apos uma interrupcao de movimento
+            int delta = 0;
+            for (int k = 0; k < 3 && i > 0; k++) {
+                delta |= abs(buf[i][k] - buf[i - 1][k]) * 1000 / G >= MOTION_MG;
+            }
+            if ((i + 1) % (BURST_MS * RATE / 1000) != 0 && !delta && i != n - 1) {
+                continue;
+            }
+            for (; delivered <= i; delivered++) {
+                uint32_t t_us = (uint32_t)((uint64_t)delivered * 1000000 / RATE);
+                uint8_t before = e.post_left;
+                if (evt_add(&e, buf[delivered], t_us, &ev)) {
+                    double ready_s = (double)(i + 1) / RATE;
+                    events++;
+                    printf("%-22s kind 0x%02x, inicio %+.0f ms, gatilho %.0f ms, pronto %.0f ms, "
+                           "pico %u mg, queda %u ms, inclinacao %u graus\n",
+                           s->name, ev.kind, (ev.t_us / 1e6 - s->onset_s) * 1000,
+                           (trig_s - s->onset_s) * 1000, (ready_s - s->onset_s) * 1000,
+                           ev.peak_mg, ev.fall_ms, ev.tilt_deg);
+                    printf("%-22s perfil (64 mg):", "");
+                    for (int b = 0; b < TELEM_EVT_TRACE; b++) {
+                        printf(" %u", ev.trace[b]);
+                    }
+                    printf("\n");
+                    if (events == 1 && ev.kind != s->expect) {
+                        printf("  esperado kind 0x%02x\n", s->expect);
+                        fails++;
+                    }
+                } else if (before == 0 && e.post_left != 0) {
+                    trig_s = (double)(i + 1) / RATE;
+                }
+            }
+        }
+        if ((events == 0) != (s->expect == 0)) {
+            printf("%-22s %d eventos, esperado %s\n", s->name, events, s->expect ? "1" : "nenhum");
+            fails++;
+        } else if (events == 0) {
+            printf("%-22s nenhum evento\n", s->name);
+        }
+        free(buf);
+    }
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,225 @@
+/* Teste do decodificador +CGNSINF (main/gnss.c) no host
+
+   1. Linhas com o resultado esperado: os dois layouts e o GNSS desligado,
+      e cada codigo GNSS_ERR_* (prefixo, poucos campos, caractere invalido,
+      campos demais, data e hora invalidas, valores fora da faixa e nos
+      limites dela, numeros que estouram 32 bits).
+   2. Cada linha valida cortada em todos os tamanhos, de 0 ao inteiro: o
+      corte antes do fim do prefixo da GNSS_ERR_PREFIX, com menos campos
+      que o layout minimo GNSS_ERR_TRUNC, e nenhum corte le fora da linha
+      (cada corte fica em um buffer do tamanho exato; com -fsanitize=address
+      uma leitura a mais derruba o teste).
+
+   gcc -O1 -g -fsanitize=address,undefined -Imain tools/gnss_test.c main/gnss.c -o gnss_test && ./gnss_test
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gnss.h"
+
+#define PREFIX_LEN  9               //"+CGNSINF:"
+#define MIN_FIELDS  18
+
+typedef struct {
+    const char *line;
+    int ret;
+    const char *why;
+} gnss_case_t;
+
+#define SIM7070_OK  "+CGNSINF: 1,1,20220212223745.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0"
+#define SIM7000_OK  "+CGNSINF: 1,1,20220212223815.000,-23.549980,-46.632101,758.400,51.02,179.9,1,,0.8,1.2,0.9,,12,8,,,33,,"
+#define NO_FIX_OK   "+CGNSINF: 1,0,,,,,,,,,,,,,,,,"
+
+static const gnss_case_t cases[] = {
+    {SIM7070_OK, GNSS_OK, "SIM7070, 18 campos"},
+    {SIM7000_OK, GNSS_OK, "SIM7000, 21 campos"},
+    {NO_FIX_OK, GNSS_OK, "sem fix"},
+    {"+CGNSINF: 0", GNSS_OK, "GNSS desligado"},
+    {"+CGNSINF: 1,1,20220212223745.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0\r\n", GNSS_OK, "com terminador"},
+    {"+CGNSINF: 1,1,20220212223745,90.000000,-180.000000,-1000000.00,655.35,360.00,255,,655.35,655.35,655.35,,255,,6553.5,6553.5",
+     GNSS_OK, "valores nos limites"},
+
+    {"", GNSS_ERR_PREFIX, "linha vazia"},
+    {"+CGNSINF 1,1", GNSS_ERR_PREFIX, "sem dois pontos"},
+    {"+CGPSINF: 1,1,20220212223745.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_PREFIX, "outro comando"},
+    {"OK", GNSS_ERR_PREFIX, "resposta final"},
+
+    {"+CGNSINF:", GNSS_ERR_TRUNC, "so o prefixo"},
+    {"+CGNSINF: 1", GNSS_ERR_TRUNC, "ligado sem campos"},
+    {"+CGNSINF: x", GNSS_ERR_TRUNC, "campo unico invalido"},
+    {"+CGNSINF: 1,1,20220212223745.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6",
+     GNSS_ERR_TRUNC, "17 campos"},
+    {"+CGNSINF: 1,1,20220212223745.000,-23.55", GNSS_ERR_TRUNC, "cortada na latitude"},
+
+    {"+CGNSINF: 1,1,20220212223745.000,-23.5x0520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_FIELD, "letra na latitude"},
+    {"+CGNSINF: 1,1,20220212223745.000,-23.550.520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_FIELD, "dois pontos decimais"},
+    {"+CGNSINF: 1,1,20220212223745.000,-,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_FIELD, "so o sinal"},
+    {"+CGNSINF: 1,1,20220212223745.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0,,,,,,,",
+     GNSS_ERR_FIELD, "campos demais"},
+    {"+CGNSINF: 1,1,2022021222374.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_FIELD, "hora curta"},
+    {"+CGNSINF: 1,1,2022021222374a.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_FIELD, "letra na hora"},
+    {"+CGNSINF: 1,1,20220212223745:000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_FIELD, "separador da fracao de segundo"},
+    {"+CGNSINF: 1,1,20220212223745.0x0,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_FIELD, "letra na fracao de segundo"},
+    {"+CGNSINF: 1,1,20220212223745.000,-23.550520,-46.633308,99999999999,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_FIELD, "altitude estoura 32 bits"},
+    {"+CGNSINF: 1,1,20220212223745.000,-23.550520,-46.633308,21474836.48,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_FIELD, "altitude estoura 32 bits na escala"},
+    {"+CGNSINF: 1,1,20220212223745.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,1 0,,3.6,4.0",
+     GNSS_ERR_FIELD, "espaco dentro do campo"},
+
+    {"+CGNSINF: 2,1,20220212223745.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_RANGE, "run 2"},
+    {"+CGNSINF: 1,-1,20220212223745.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_RANGE, "fix negativo"},
+    {"+CGNSINF: 1,1,20220212223745.000,90.000001,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_RANGE, "latitude acima de 90"},
+    {"+CGNSINF: 1,1,20220212223745.000,-23.550520,-180.000001,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_RANGE, "longitude abaixo de -180"},
+    {"+CGNSINF: 1,1,20220212223745.000,-23.550520,-46.633308,1000000.01,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_RANGE, "altitude acima de 1000 km"},
+    {"+CGNSINF: 1,1,20220212223745.000,-23.550520,-46.633308,760.100,655.36,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_RANGE, "velocidade nao cabe em 16 bits"},
+    {"+CGNSINF: 1,1,20220212223745.000,-23.550520,-46.633308,760.100,-1.00,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_RANGE, "velocidade negativa"},
+    {"+CGNSINF: 1,1,20220212223745.000,-23.550520,-46.633308,760.100,48.20,360.01,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_RANGE, "curso acima de 360"},
+    {"+CGNSINF: 1,1,20220212223745.000,-23.550520,-46.633308,760.100,48.20,181.3,256,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_RANGE, "modo de fix 256"},
+    {"+CGNSINF: 1,1,20220212223745.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,655.36,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_RANGE, "HDOP nao cabe em 16 bits"},
+    {"+CGNSINF: 1,1,20220212223745.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,300,,3.6,4.0",
+     GNSS_ERR_RANGE, "satelites em vista 300"},
+    {"+CGNSINF: 1,1,20220212223745.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,6553.6,4.0",
+     GNSS_ERR_RANGE, "HPA nao cabe em 16 bits"},
+    {"+CGNSINF: 1,1,20220212223815.000,-23.549980,-46.632101,758.400,51.02,179.9,1,,0.8,1.2,0.9,,12,8,,,256,,",
+     GNSS_ERR_RANGE, "C/N0 256 (SIM7000)"},
+    {"+CGNSINF: 1,1,19791231235959.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_RANGE, "ano antes de 1980"},
+    {"+CGNSINF: 1,1,20221312223745.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_RANGE, "mes 13"},
+    {"+CGNSINF: 1,1,20220200223745.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_RANGE, "dia 0"},
+    {"+CGNSINF: 1,1,20220212243745.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_RANGE, "hora 24"},
+    {"+CGNSINF: 1,1,20220212226045.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_RANGE, "minuto 60"},
+    {"+CGNSINF: 1,1,20220212223761.000,-23.550520,-46.633308,760.100,48.20,181.3,1,,1.0,1.4,0.9,,10,,3.6,4.0",
+     GNSS_ERR_RANGE, "segundo 61"},
+};
+
+static const char *const valid[] = {SIM7070_OK, SIM7000_OK, NO_FIX_OK, "+CGNSINF: 0"};
+
+static const char *ret_name(int ret)
+{
+    switch (ret) {
+    case GNSS_OK:           return "OK";
+    case GNSS_ERR_PREFIX:   return "PREFIX";
+    case GNSS_ERR_TRUNC:    return "TRUNC";
+    case GNSS_ERR_FIELD:    return "FIELD";
+    case GNSS_ERR_RANGE:    return "RANGE";
+    default:                return "?";
+    }
+}
+
+//Copia exata, sem '\0': o decodificador nao pode passar de len
+static int parse_exact(const char *line, size_t len, gnss_fix_t *fix)
+{
+    char *buf = malloc(len > 0 ? len : 1);
+    int ret;
+
+    memcpy(buf, line, len);
+    ret = gnss_parse_cgnsinf(buf, len, fix);
+    free(buf);
+    return ret;
+}
+
+static int check_cases(void)
+{
+    const size_t n = sizeof(cases) / sizeof(cases[0]);
+    gnss_fix_t fix;
+    int seen[5] = {0};
+    int bad = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        int ret = parse_exact(cases[i].line, strlen(cases[i].line), &fix);
+
+        if (ret != cases[i].ret) {
+            printf("  %s: %s, esperado %s\n", cases[i].why, ret_name(ret), ret_name(cases[i].ret));
+            bad++;
+        }
+        seen[-cases[i].ret]++;
+    }
+    //Valores decodificados de uma linha de cada layout
+    parse_exact(SIM7070_OK, strlen(SIM7070_OK), &fix);
+    if (fix.lat_e6 != -23550520 || fix.lon_e6 != -46633308 || fix.alt_cm != 76010 || fix.utc != 1644705465 ||
+            fix.utc_ms != 0 || fix.speed_kmh_x100 != 4820 || fix.course_x100 != 18130 || fix.hdop_x100 != 100 ||
+            fix.sats_view != 10 || fix.hpa_dm != 36 || fix.vpa_dm != 40 || (fix.present & GNSS_HAS_CN0)) {
+        printf("  valores do layout SIM7070 errados\n");
+        bad++;
+    }
+    parse_exact(SIM7000_OK, strlen(SIM7000_OK), &fix);
+    if (fix.sats_view != 12 || fix.sats_gps_used != 8 || fix.cn0_max != 33 || !(fix.present & GNSS_HAS_CN0) ||
+            (fix.present & (GNSS_HAS_GLN_USED | GNSS_HAS_HPA | GNSS_HAS_VPA))) {
+        printf("  valores do layout SIM7000 errados\n");
+        bad++;
+    }
+    printf("%u linhas (OK %d, PREFIX %d, TRUNC %d, FIELD %d, RANGE %d): %s\n", (unsigned)n,
+           seen[0], seen[1], seen[2], seen[3], seen[4], bad ? "FALHOU" : "OK");
+    return bad;
+}
+
+static int check_cuts(void)
+{
+    const size_t n = sizeof(valid) / sizeof(valid[0]);
+    gnss_fix_t fix;
+    unsigned cuts = 0;
+    int bad = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        size_t len = strlen(valid[i]);
+
+        for (size_t k = 0; k <= len; k++) {
+            int ret = parse_exact(valid[i], k, &fix);
+            int expect = -99;
+            int fields = 1;
+
+            //Campos ate o corte: virgulas + 1
+            for (size_t j = PREFIX_LEN; j < k; j++) {
+                fields += (valid[i][j] == ',');
+            }
+            if (k < PREFIX_LEN) {
+                expect = GNSS_ERR_PREFIX;
+            } else if (k == len) {
+                expect = GNSS_OK;
+            } else if (fields < MIN_FIELDS) {
+                expect = GNSS_ERR_TRUNC;
+            }
+            //Corte no ultimo campo: so precisa ser um codigo valido
+            if (ret > GNSS_OK || ret < GNSS_ERR_RANGE || (expect != -99 && ret != expect)) {
+                printf("  \"%.*s\" (%u de %u bytes): %s\n", (int)k, valid[i], (unsigned)k, (unsigned)len, ret_name(ret));
+                bad++;
+            }
+            cuts++;
+        }
+    }
+    printf("%u cortes de %u linhas validas: %s\n", cuts, (unsigned)n, bad ? "FALHOU" : "OK");
+    return bad;
+}
+
+int main(void)
+{
+    int fails = 0;
+
+    fails += check_cases();
+    fails += check_cuts();
+    return fails;
+}
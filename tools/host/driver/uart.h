@@ -0,0 +1,8 @@
+/* driver/uart.h minimo para o host: so os tipos das declaracoes do at_uart.h (tools/) */
+#pragma once
+
+typedef int uart_port_t;
+
+typedef struct {
+    int baud_rate;
+} uart_config_t;
@@ -0,0 +1,6 @@
+/* esp_attr.h minimo para o host: sem memoria RTC, as variaveis ficam na RAM (tools/) */
+#pragma once
+
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define IRAM_ATTR
@@ -0,0 +1,6 @@
+/* esp_timer.h minimo para o host: o relogio e implementado pela ferramenta */
+#pragma once
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,22 @@
+/* FreeRTOS.h minimo para o host: so tipos e constantes (tools/) */
+#pragma once
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE         0
+#define pdTRUE          1
+#define pdPASS          pdTRUE
+#define portMAX_DELAY   ((TickType_t)0xFFFFFFFF)
+
+//Ferramentas de uma thread so: a secao critica nao precisa travar nada
+typedef struct {
+    int owner;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    {0}
+#define portENTER_CRITICAL(m)           ((void)(m))
+#define portEXIT_CRITICAL(m)            ((void)(m))
@@ -0,0 +1,10 @@
+/* semphr.h minimo para o host: o mutex e implementado pela ferramenta */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_mutex *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
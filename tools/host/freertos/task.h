@@ -0,0 +1,4 @@
+/* task.h minimo para o host: nenhuma task, so o que os modulos incluem (tools/) */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
@@ -0,0 +1,21 @@
+/* nvs.h minimo para o host: as funcoes ficam com a ferramenta (tools/) */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define ESP_ERR_NVS_NOT_FOUND   0x1102
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE,
+} nvs_open_mode_t;
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *out);
+esp_err_t nvs_get_blob(nvs_handle_t h, const char *key, void *out, size_t *len);
+esp_err_t nvs_set_blob(nvs_handle_t h, const char *key, const void *value, size_t len);
+esp_err_t nvs_commit(nvs_handle_t h);
+void nvs_close(nvs_handle_t h);
@@ -0,0 +1,11 @@
+/* sdkconfig.h do host: opcoes do menu LogQ em escala das ferramentas (tools/) */
+#pragma once
+
+#define CONFIG_LOGQ_GNSS_HDOP_MAX_X10   20
+#define CONFIG_LOGQ_GNSS_SATS_MIN       5
+#define CONFIG_LOGQ_GNSS_TIMEOUT_S      60
+#define CONFIG_LOGQ_MODEM_BAUD_MAX      115200
+#define CONFIG_LOGQ_MODEM_RTS_GPIO      -1
+#define CONFIG_LOGQ_MODEM_CTS_GPIO      -1
+#define CONFIG_LOGQ_GSM_MSG_SLOTS       4
+#define CONFIG_LOGQ_REPORT_ADAPTIVE     1
@@ -0,0 +1,890 @@
+/* GSM_C no host contra o simulador (tools/sim7070_sim.py)
+
+   Monta a maquina do GSM_C de main/gsm.c, com as mesmas tabelas, acoes e
+   parsers do firmware, e os modulos que nao dependem do ESP-IDF (fsm,
+   at_line, at_decode, gnss, gnss_sess, telem, report, radio, netreg,
+   at_health e dlog). O simulador e iniciado pelo proprio programa num
+   pseudo-terminal e o ciclo e o do firmware: partida pelo PWRKEY, enlace,
+   eco, CSCLK e URCs de registro, sessao de GNSS (partidas hot/warm/cold e
+   cache), troca para o LTE, bandas, PDP, publicacao, celula e XTRA.
+
+   Os modulos que falam com o ESP-IDF tem aqui corpos proprios: o motor AT
+   (at_cmd) e uma fila com um comando por vez sobre a UART do pty, com o
+   mesmo termino do at_cmd_exec() e as URCs passando antes pelo netreg;
+   modem_cfg envia os comandos de escrita do perfil uma vez por partida do
+   modem; at_link so confere o AT; mqtt_pub publica os registros do tlog (em
+   RAM) um AT+SMPUB por vez; power nao dorme (o modem nunca fica mantido,
+   cada execucao parte do PWRKEY) e a NVS nao guarda nada. O intervalo ate
+   a janela seguinte vem do report_next_s() com a configuracao em escala de
+   segundos de HOST_REPORT_CFG; o veiculo esta em movimento desde a
+   partida, como a IMU avisaria.
+
+   Cada janela imprime o tempo do inicio ate o primeiro fix e ate o fim da
+   publicacao e os bytes na UART medidos deste lado; o simulador imprime o
+   relatorio dele (linhas "[sim]") no mesmo terminal, contado do
+   AT+CGNSPWR=1. Os registros do dlog saem como no console do firmware. Sem
+   argumentos do simulador usa HOST_SIM_ARGS; a saida e 1 quando alguma
+   janela consultou o GNSS sem chegar ao fix, pediu a publicacao sem
+   concluir ou nenhuma publicou.
+
+   gcc -O2 -Itools/host -Imain tools/modem_host.c main/gsm.c main/fsm.c main/ring.c main/at_line.c \
+       main/at_decode.c main/gnss.c main/gnss_sess.c main/telem.c main/report.c main/radio.c \
+       main/netreg.c main/at_health.c main/dlog.c -lm -o modem_host
+   ./modem_host [janelas] [argumentos do simulador]     (na raiz do repositorio)
+   ./modem_host 4 --fix-after 5 --speed 40 --drop 0.001
+*/
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#include "esp_timer.h"
+#include "nvs.h"
+#include "at_line.h"
+#include "at_cmd.h"
+#include "at_link.h"
+#include "at_health.h"
+#include "modem_cfg.h"
+#include "mqtt_pub.h"
+#include "netreg.h"
+#include "power.h"
+#include "telem.h"
+#include "tlog.h"
+#include "dlog.h"
+#include "fsm.h"
+#include "gsm.h"
+
+#define HOST_SIM            "tools/sim7070_sim.py"
+#define HOST_SIM_ARGS       "--fix-after", "3", "--service-after", "2", "--pdp-delay", "300", \
+                            "--mqtt-connect-ms", "300", "--speed", "40", "--course", "90"
+#define HOST_SIM_MAX_ARGS   32
+#define HOST_WINDOWS        3
+#define HOST_POLL_MS        1000        //Maior espera sem olhar a UART
+#define HOST_LINK_TRIES     3           //AT sem resposta antes do at_link_start() desistir
+#define HOST_LINK_MS        1000
+#define HOST_PENDING        64          //Registros do tlog em RAM
+#define PAYLOAD_MAX         1024        //MQTT_PAYLOAD_MAX
+#define MQTT_CONNECT_MS     30000       //MQTT_CONNECT_TIMEOUT_MS
+#define MQTT_PUB_MS         15000       //MQTT_PUB_TIMEOUT_MS
+#define URL                 "test.mosquitto.org"    //Padroes do Kconfig (CONFIG_LOGQ_MQTT_*)
+#define PORT                "1883"
+#define CLIENT_ID           "logq"
+#define TOPIC               "logq/telem"
+#define QOS                 1
+
+//report_cfg_t em escala do host: em movimento, fix a cada 4 s e publicacao ao menos a cada 12 s
+#define HOST_REPORT_CFG     { .still_s = 60, .parked_s = 20, .moving_s = 4, \
+                              .max_s = 12, .dist_m = 2000, .heading_deg = 30, \
+                              .moving_kmh_x100 = 500, .burst_s = 30, .burst_fix_s = 2, \
+                              .rsrp_min = -115, .defer_s = 30 }
+
+//Motor AT: fila e um comando em andamento, como a task do at_cmd
+typedef struct {
+    int fd;
+    at_line_asm_t lines;
+    at_line_t slot;
+    at_uart_urc_t urc;
+    at_cmd_t queue[AT_CMD_QUEUE_LEN];
+    uint32_t head;
+    uint32_t n;
+    at_cmd_t cur;
+    bool busy;
+    bool data_sent;
+    bool info_kept;
+    at_result_t res;
+    char info[AT_LINE_MAX];
+    uint32_t t0_ms;
+    uint32_t deadline_ms;
+    bool link;                  //at_link_start(): o GSM_C conta o enlace na saude
+    uint32_t tx_bytes;          //Host -> modem
+    uint32_t rx_bytes;
+} host_at_t;
+
+//Janela em andamento e totais da execucao
+typedef struct {
+    uint32_t window;
+    uint32_t windows;
+    bool done;
+    bool gnss;                  //Janela consultou o AT+CGNSINF
+    bool fix;
+    bool pub_wanted;            //mqtt_pub_prepare() ou mqtt_pub_connect() na janela
+    bool pub_ok;                //mqtt_pub_drain() concluiu
+    uint32_t t0_ms;
+    uint32_t ttff_ms;
+    uint32_t pub_ms;
+    uint32_t sent;              //Registros publicados na janela
+    uint32_t tx0;
+    uint32_t rx0;
+    uint32_t failed;            //Janelas sem fix ou sem a publicacao pedida
+    uint32_t published;         //Janelas que publicaram
+} host_ctx_t;
+
+static host_at_t at;
+static host_ctx_t host;
+static tlog_t telemetria;       //So identifica o log; os registros ficam em host_recs
+static tlog_rec_t host_recs[HOST_PENDING];
+static uint32_t host_npend;
+static uint32_t host_cfg_gen = 1;   //Partidas do modem (modem_cfg_t.gen 0: nunca aplicado)
+static int64_t host_next_us;
+static mqtt_pub_stats_t host_mqtt;
+static uint8_t host_payload[PAYLOAD_MAX];
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t host_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+//---------------------------------------------------------------- Simulador
+
+static pid_t sim_pid;
+static int sim_out = -1;
+
+//Inicia o simulador e devolve a UART do pseudo-terminal dele
+static int sim_start(int argc, char **argv)
+{
+    static const char *const defaults[] = {HOST_SIM_ARGS};
+    const char *args[HOST_SIM_MAX_ARGS + 4] = {"python3", "-u", HOST_SIM};
+    int nargs = 3;
+    int p[2];
+    char line[256];
+    FILE *f;
+
+    if (argc > 0) {
+        for (int i = 0; i < argc && i < HOST_SIM_MAX_ARGS; i++) {
+            args[nargs++] = argv[i];
+        }
+    } else {
+        for (size_t i = 0; i < sizeof(defaults) / sizeof(defaults[0]); i++) {
+            args[nargs++] = defaults[i];
+        }
+    }
+    if (pipe(p) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    sim_pid = fork();
+    if (sim_pid == 0) {
+        dup2(p[1], STDOUT_FILENO);
+        close(p[0]);
+        close(p[1]);
+        execvp(args[0], (char *const *)args);
+        perror(args[0]);
+        _exit(127);
+    }
+    close(p[1]);
+    if (sim_pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    //Primeira linha: "[sim] SIM7070 simulado em <pty>"
+    f = fdopen(dup(p[0]), "r");
+    if (f == NULL || fgets(line, sizeof(line), f) == NULL || strstr(line, " em ") == NULL) {
+        fprintf(stderr, "Simulador nao iniciou (%s)\n", HOST_SIM);
+        return -1;
+    }
+    fclose(f);
+    fputs(line, stdout);
+    line[strcspn(line, "\r\n")] = '\0';
+    sim_out = p[0];
+
+    int fd = open(strstr(line, " em ") + 4, O_RDWR | O_NOCTTY);
+    struct termios tio;
+
+    if (fd < 0 || tcgetattr(fd, &tio) != 0) {
+        perror("pty");
+        return -1;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(fd, TCSANOW, &tio);
+    return fd;
+}
+
+//Repassa as linhas do simulador (relatorio dos ciclos)
+static bool sim_relay(void)
+{
+    char buf[1024];
+    ssize_t n = read(sim_out, buf, sizeof(buf));
+
+    if (n <= 0) {
+        return false;
+    }
+    fwrite(buf, 1, (size_t)n, stdout);
+    fflush(stdout);
+    return true;
+}
+
+//SIGTERM grava o relatorio do ultimo ciclo; le ate o fim da saida
+static void sim_stop(void)
+{
+    if (sim_pid <= 0) {
+        return;
+    }
+    kill(sim_pid, SIGTERM);
+    while (sim_out >= 0 && sim_relay()) {
+    }
+    waitpid(sim_pid, NULL, 0);
+}
+
+//---------------------------------------------------------------- Motor AT (at_cmd)
+
+static void host_write(const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+
+    while (len > 0) {
+        ssize_t n = write(at.fd, p, len);
+
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            perror("write");
+            exit(2);
+        }
+        at.tx_bytes += (uint32_t)n;
+        p += n;
+        len -= (size_t)n;
+    }
+}
+
+static esp_err_t host_at_enqueue(const char *cmd, at_final_t final, const char *prefix,
+                                 const uint8_t *data, size_t data_len, bool retry,
+                                 uint32_t timeout_ms, at_cmd_cb_t cb, void *arg)
+{
+    at_cmd_t *c;
+
+    if (strlen(cmd) >= AT_CMD_MAX || (prefix != NULL && strlen(prefix) >= AT_CMD_PREFIX_MAX)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (at.n == AT_CMD_QUEUE_LEN) {
+        return ESP_ERR_NO_MEM;
+    }
+    c = &at.queue[(at.head + at.n) % AT_CMD_QUEUE_LEN];
+    memset(c, 0, sizeof(*c));
+    strcpy(c->cmd, cmd);
+    if (prefix != NULL) {
+        strcpy(c->prefix, prefix);
+    }
+    c->final = final;
+    c->timeout_ms = timeout_ms;
+    c->cb = cb;
+    c->arg = arg;
+    c->data = data;
+    c->data_len = data_len;
+    c->retry = retry;
+    at.n++;
+    return ESP_OK;
+}
+
+esp_err_t at_cmd_submit(const char *cmd, at_final_t final, const char *prefix,
+                        uint32_t timeout_ms, at_cmd_cb_t cb, void *arg)
+{
+    return host_at_enqueue(cmd, final, prefix, NULL, 0, false, timeout_ms, cb, arg);
+}
+
+esp_err_t at_cmd_submit_retry(const char *cmd, at_final_t final, const char *prefix,
+                              uint32_t timeout_ms, bool retry, at_cmd_cb_t cb, void *arg)
+{
+    return host_at_enqueue(cmd, final, prefix, NULL, 0, retry, timeout_ms, cb, arg);
+}
+
+esp_err_t at_cmd_submit_data(const char *cmd, const uint8_t *data, size_t data_len,
+                             uint32_t timeout_ms, at_cmd_cb_t cb, void *arg)
+{
+    return host_at_enqueue(cmd, AT_FINAL_OK, NULL, data, data_len, false, timeout_ms, cb, arg);
+}
+
+//Fila sem concorrencia: os cancelados saem na hora, os demais seguem na ordem
+void at_cmd_cancel(at_cmd_cb_t cb)
+{
+    uint32_t n = at.n;
+
+    at.n = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        at_cmd_t cmd = at.queue[(at.head + i) % AT_CMD_QUEUE_LEN];
+
+        if (cmd.cb != NULL && cmd.cb == cb) {
+            cmd.cb(&cmd, AT_RES_CANCELLED, "", cmd.arg);
+        } else {
+            at.queue[(at.head + at.n++) % AT_CMD_QUEUE_LEN] = cmd;
+        }
+    }
+}
+
+void at_uart_set_urc(at_uart_urc_t urc)
+{
+    at.urc = urc;
+}
+
+//Proximo da fila, se o motor esta livre
+static void host_at_next(void)
+{
+    if (at.busy || at.n == 0) {
+        return;
+    }
+    at.cur = at.queue[at.head];
+    at.head = (at.head + 1) % AT_CMD_QUEUE_LEN;
+    at.n--;
+    at.busy = true;
+    at.data_sent = false;
+    at.info_kept = false;
+    at.res = AT_RES_TIMEOUT;
+    at.info[0] = '\0';
+    at.lines.prompt = at.cur.data != NULL;
+    at.t0_ms = host_ms();
+    at.deadline_ms = at.t0_ms + at.cur.timeout_ms;
+    if (strncmp(at.cur.cmd, "AT+CGNSINF", 10) == 0) {
+        host.gnss = true;
+    }
+    host_write(at.cur.cmd, strlen(at.cur.cmd));
+}
+
+static void host_at_finish(void)
+{
+    uint32_t ms = host_ms() - at.t0_ms;
+    at_cmd_t cmd = at.cur;
+
+    at.busy = false;
+    at.lines.prompt = false;
+    if (!at.link) {
+        at_health_record(cmd.cmd, at.res, ms, cmd.retry);
+    }
+    if (cmd.cb != NULL) {
+        cmd.cb(&cmd, at.res, at.info, cmd.arg);
+    }
+}
+
+static at_line_t *host_at_slot(void *arg)
+{
+    (void)arg;
+    at.slot.len = 0;
+    return &at.slot;
+}
+
+//Mesmo termino do at_cmd_exec(); URC consumida pelo netreg sem comando em andamento fica so com ele
+static bool host_at_line(at_line_t *line, void *arg)
+{
+    const char *t = line->txt;
+    size_t plen = strlen(at.cur.prefix);
+
+    (void)arg;
+    if (at.urc != NULL && at.urc(t, line->len) && !at.busy) {
+        return false;
+    }
+    if (!at.busy) {
+        return false;
+    }
+    if (at.cur.data != NULL && !at.data_sent && strcmp(t, ">") == 0) {
+        host_write(at.cur.data, at.cur.data_len);
+        at.data_sent = true;
+    } else if (strcmp(t, "ERROR") == 0 || strncmp(t, "+CME ERROR", 10) == 0 || strncmp(t, "+CMS ERROR", 10) == 0) {
+        memcpy(at.info, t, line->len + 1);
+        at.res = AT_RES_ERROR;
+    } else if (at.cur.final == AT_FINAL_PREFIX) {
+        if (strncmp(t, at.cur.prefix, plen) == 0) {
+            memcpy(at.info, t, line->len + 1);
+            at.res = AT_RES_OK;
+        }
+    } else if (strcmp(t, "OK") == 0) {
+        at.res = AT_RES_OK;
+    } else if (line->len > 1 && !at.info_kept) {
+        memcpy(at.info, t, line->len + 1);
+        at.info_kept = (plen > 0 && strncmp(t, at.cur.prefix, plen) == 0);
+    }
+    if (at.res != AT_RES_TIMEOUT) {
+        host_at_finish();
+    }
+    return false;
+}
+
+//Espera ate wait_ms pela UART e pelo simulador; conclui o comando no prazo e envia o proximo
+static bool host_pump(uint32_t wait_ms)
+{
+    uint32_t now;
+
+    host_at_next();
+    now = host_ms();
+    if (at.busy && at.deadline_ms - now < wait_ms) {
+        wait_ms = (int32_t)(at.deadline_ms - now) > 0 ? at.deadline_ms - now : 0;
+    }
+    wait_ms = wait_ms > HOST_POLL_MS ? HOST_POLL_MS : wait_ms;
+
+    struct timeval tv = {wait_ms / 1000, (wait_ms % 1000) * 1000};
+    fd_set rd;
+    FD_ZERO(&rd);
+    FD_SET(at.fd, &rd);
+    if (sim_out >= 0) {
+        FD_SET(sim_out, &rd);
+    }
+    if (select((at.fd > sim_out ? at.fd : sim_out) + 1, &rd, NULL, NULL, &tv) < 0) {
+        if (errno == EINTR) {
+            return true;
+        }
+        perror("select");
+        return false;
+    }
+    if (sim_out >= 0 && FD_ISSET(sim_out, &rd) && !sim_relay()) {
+        fprintf(stderr, "Simulador encerrou\n");
+        sim_out = -1;
+        return false;
+    }
+    if (FD_ISSET(at.fd, &rd)) {
+        uint8_t buf[512];
+        ssize_t n = read(at.fd, buf, sizeof(buf));
+
+        if (n > 0) {
+            at.rx_bytes += (uint32_t)n;
+            at_line_feed(&at.lines, buf, (size_t)n);
+        }
+    }
+    if (at.busy && (int32_t)(host_ms() - at.deadline_ms) >= 0) {
+        host_at_finish();
+    }
+    host_at_next();
+    return true;
+}
+
+typedef struct {
+    bool done;
+    at_result_t res;
+} host_wait_t;
+
+static void host_exec_done(const at_cmd_t *cmd, at_result_t res, const char *info, void *arg)
+{
+    host_wait_t *w = arg;
+
+    (void)cmd;
+    (void)info;
+    w->res = res;
+    w->done = true;
+}
+
+//Comando bloqueante, como as chamadas do modem_cfg e do mqtt_pub: atras do que ja esta na fila
+static at_result_t host_exec(const char *cmd, uint32_t timeout_ms, const uint8_t *data, size_t data_len)
+{
+    host_wait_t w = {0};
+    esp_err_t ret = data != NULL ? at_cmd_submit_data(cmd, data, data_len, timeout_ms, host_exec_done, &w)
+                                 : at_cmd_submit(cmd, AT_FINAL_OK, NULL, timeout_ms, host_exec_done, &w);
+
+    if (ret != ESP_OK) {
+        return AT_RES_ERROR;
+    }
+    while (!w.done) {
+        if (!host_pump(HOST_POLL_MS)) {
+            exit(2);
+        }
+    }
+    return w.res;
+}
+
+//---------------------------------------------------------------- Perfis e enlace (modem_cfg, at_link)
+
+void modem_cfg_modem_reset(void)
+{
+    host_cfg_gen++;
+}
+
+//Sem NVS nem consulta: os comandos de escrita saem uma vez por partida do modem
+esp_err_t modem_cfg_apply(modem_cfg_t *cfg)
+{
+    if (cfg->n > MODEM_CFG_ITEMS_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (cfg->gen == host_cfg_gen) {
+        return ESP_OK;
+    }
+    for (uint8_t i = 0; i < cfg->n; i++) {
+        if (host_exec(cfg->items[i].set, MODEM_CFG_SET_MS, NULL, 0) != AT_RES_OK) {
+            return ESP_FAIL;
+        }
+    }
+    cfg->gen = host_cfg_gen;
+    return ESP_OK;
+}
+
+void modem_cfg_invalidate(modem_cfg_t *cfg)
+{
+    cfg->gen = 0;
+}
+
+//O pty nao tem baud rate: so confere que o modem responde
+esp_err_t at_link_start(uint32_t max_baud, int rts, int cts)
+{
+    esp_err_t ret = ESP_FAIL;
+
+    (void)max_baud;
+    (void)rts;
+    (void)cts;
+
+    at.link = true;
+    for (int i = 0; i < HOST_LINK_TRIES && ret != ESP_OK; i++) {
+        if (host_exec("AT\r", HOST_LINK_MS, NULL, 0) == AT_RES_OK) {
+            ret = ESP_OK;
+        }
+    }
+    at.link = false;
+    return ret;
+}
+
+esp_err_t at_link_check(void)
+{
+    return ESP_OK;
+}
+
+//---------------------------------------------------------------- Publicacao (mqtt_pub) e tlog em RAM
+
+static const modem_cfg_item_t mqtt_items[] = {
+    {.set = "AT+SMCONF=\"URL\",\"" URL "\",\"" PORT "\"\r"},
+    {.set = "AT+SMCONF=\"CLIENTID\",\"" CLIENT_ID "\"\r"},
+    {.set = "AT+SMCONF=\"QOS\",1\r"},
+};
+static modem_cfg_t mqtt_profile = {"mqtt", mqtt_items, sizeof(mqtt_items) / sizeof(mqtt_items[0]), 0};
+
+esp_err_t mqtt_pub_connect(void)
+{
+    uint32_t t0 = host_ms();
+
+    host.pub_wanted = true;
+    if (netreg_mqtt() == 1) {
+        host_mqtt.reused++;
+        return ESP_OK;
+    }
+    if (modem_cfg_apply(&mqtt_profile) != ESP_OK ||
+        host_exec("AT+SMCONN\r", MQTT_CONNECT_MS, NULL, 0) != AT_RES_OK) {
+        modem_cfg_invalidate(&mqtt_profile);
+        netreg_set_mqtt(NETREG_UNKNOWN);
+        host_mqtt.errors++;
+        return ESP_FAIL;
+    }
+    netreg_set_mqtt(1);
+    host_mqtt.connects++;
+    host_mqtt.connect_ms += host_ms() - t0;
+    return ESP_OK;
+}
+
+//Um AT+SMPUB por vez com o que couber no payload; o lote aceito sai do log
+esp_err_t mqtt_pub_drain(tlog_t *log, size_t *sent)
+{
+    uint32_t t0 = host_ms();
+    size_t n = 0;
+    esp_err_t ret = ESP_OK;
+
+    while (log != NULL && host_npend > 0) {
+        telem_enc_t enc;
+        char cmd[AT_CMD_MAX];
+        uint32_t used = 0;
+
+        telem_enc_init(&enc, host_payload, sizeof(host_payload));
+        while (used < host_npend &&
+               telem_enc_record(&enc, host_recs[used].type, host_recs[used].data, host_recs[used].len) != TELEM_ERR_FULL) {
+            used++;
+        }
+        snprintf(cmd, sizeof(cmd), "AT+SMPUB=\"" TOPIC "\",%u,%u,0\r", (unsigned)enc.len, QOS);
+        if (host_exec(cmd, MQTT_PUB_MS, host_payload, enc.len) != AT_RES_OK) {
+            netreg_set_mqtt(NETREG_UNKNOWN);
+            host_mqtt.errors++;
+            ret = ESP_FAIL;
+            break;
+        }
+        host_mqtt.publishes++;
+        host_mqtt.records += enc.count;
+        host_mqtt.bytes += enc.len;
+        n += used;
+        host_npend -= used;
+        memmove(host_recs, host_recs + used, host_npend * sizeof(host_recs[0]));
+        log->stats.acked += used;
+        log->stats.pending = host_npend;
+    }
+    host_mqtt.publish_ms += host_ms() - t0;
+    if (ret == ESP_OK && log != NULL) {
+        host.pub_ok = true;
+        host.pub_ms = host_ms() - host.t0_ms;
+        host.sent += (uint32_t)n;
+    }
+    if (sent != NULL) {
+        *sent = n;
+    }
+    return ret;
+}
+
+//Sem preparo antecipado: so registra que a janela vai publicar
+size_t mqtt_pub_prepare(tlog_t *log)
+{
+    (void)log;
+
+    host.pub_wanted = true;
+    return 0;
+}
+
+//Sem fila urgente no host: os alertas vem da IMU
+void mqtt_pub_on_urgent(void (*cb)(void *arg), void *arg)
+{
+    (void)cb;
+    (void)arg;
+}
+
+bool mqtt_pub_urgent_pending(void)
+{
+    return false;
+}
+
+void mqtt_pub_get_stats(mqtt_pub_stats_t *stats)
+{
+    *stats = host_mqtt;
+}
+
+//Log cheio perde o mais antigo, como o tlog
+esp_err_t tlog_append(tlog_t *log, uint8_t type, const void *data, size_t len)
+{
+    tlog_rec_t *r;
+
+    if (len > TLOG_PAYLOAD_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (host_npend == HOST_PENDING) {
+        memmove(host_recs, host_recs + 1, (HOST_PENDING - 1) * sizeof(host_recs[0]));
+        host_npend--;
+        log->stats.overwritten++;
+    }
+    r = &host_recs[host_npend++];
+    r->seq = log->next_seq++;
+    r->type = type;
+    r->len = (uint8_t)len;
+    memcpy(r->data, data, len);
+    log->stats.appended++;
+    log->stats.pending = host_npend;
+    if (type == TELEM_TYPE_FIX && !host.fix) {
+        host.fix = true;
+        host.ttff_ms = host_ms() - host.t0_ms;
+    }
+    return ESP_OK;
+}
+
+//---------------------------------------------------------------- Energia (power) e NVS
+
+power_wake_t power_wake_cause(void)
+{
+    return POWER_WAKE_BOOT;
+}
+
+bool power_modem_kept(void)
+{
+    return false;
+}
+
+//O simulador nao tem DTR nem PWRKEY: responde desde o inicio
+void power_modem_sleep(void)
+{
+}
+
+void power_modem_wake(void)
+{
+}
+
+uint32_t power_modem_ready_ms(void)
+{
+    return 0;
+}
+
+void power_pwrkey(bool on)
+{
+    (void)on;
+}
+
+void power_gnss(bool on)
+{
+    (void)on;
+}
+
+void power_window_begin(void)
+{
+}
+
+void power_set_next_window(uint32_t next_s)
+{
+    host_next_us = esp_timer_get_time() + (int64_t)next_s * 1000000;
+}
+
+void power_window_end(power_cycle_t *out)
+{
+    if (out != NULL) {
+        memset(out, 0, sizeof(*out));
+    }
+}
+
+uint32_t power_next_window_ms(void)
+{
+    int64_t left = host_next_us - esp_timer_get_time();
+
+    return left > 0 ? (uint32_t)(left / 1000) : 0;
+}
+
+bool power_deep_sleep_ok(void)
+{
+    return false;
+}
+
+void power_deep_sleep(tlog_t *log)
+{
+    (void)log;
+}
+
+//Nada persiste entre execucoes: cache do GNSS parte vazio
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *out)
+{
+    (void)name;
+    (void)mode;
+
+    *out = 1;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t h, const char *key, void *out, size_t *len)
+{
+    (void)h;
+    (void)key;
+    (void)out;
+    (void)len;
+
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t h, const char *key, const void *value, size_t len)
+{
+    (void)h;
+    (void)key;
+    (void)value;
+    (void)len;
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t h)
+{
+    (void)h;
+
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t h)
+{
+    (void)h;
+}
+
+//---------------------------------------------------------------- Janelas
+
+static void host_dlog(void)
+{
+    static dlog_rec_t rec;
+    char line[160];
+
+    while (dlog_pop(0, &rec)) {
+        dlog_format(&rec, line, sizeof(line));
+        puts(line);
+    }
+}
+
+//Inicio e fim de cada janela (gsm_cfg_t.window), na mesma chamada do GSM_C
+static void host_window(bool end, void *arg)
+{
+    bool ok;
+
+    (void)arg;
+    if (!end) {
+        host.window++;
+        host.gnss = host.fix = host.pub_wanted = host.pub_ok = false;
+        host.sent = 0;
+        host.t0_ms = host_ms();
+        host.tx0 = at.tx_bytes;
+        host.rx0 = at.rx_bytes;
+        return;
+    }
+    ok = (!host.gnss || host.fix) && (!host.pub_wanted || host.pub_ok);
+    printf("Janela %u: fix ", (unsigned)host.window);
+    if (host.fix) {
+        printf("%u.%03u s", (unsigned)(host.ttff_ms / 1000), (unsigned)(host.ttff_ms % 1000));
+    } else {
+        printf("%s", host.gnss ? "nao" : "-");
+    }
+    printf(", publicacao ");
+    if (host.pub_ok) {
+        printf("%u.%03u s (%u registros)", (unsigned)(host.pub_ms / 1000), (unsigned)(host.pub_ms % 1000),
+               (unsigned)host.sent);
+    } else {
+        printf("%s", host.pub_wanted ? "falhou" : "-");
+    }
+    printf(", %u pendentes, UART %u bytes enviados, %u recebidos%s\n", (unsigned)host_npend,
+           (unsigned)(at.tx_bytes - host.tx0), (unsigned)(at.rx_bytes - host.rx0), ok ? "" : " FALHOU");
+    host.failed += !ok;
+    host.published += host.pub_ok;
+    host.done = host.window >= host.windows;
+}
+
+int main(int argc, char **argv)
+{
+    gsm_cfg_t conf = {
+        .log = &telemetria,
+        .gnss = {
+            .hdop_max_x100 = CONFIG_LOGQ_GNSS_HDOP_MAX_X10 * 10,
+            .sats_min = CONFIG_LOGQ_GNSS_SATS_MIN,
+            .timeout_s = CONFIG_LOGQ_GNSS_TIMEOUT_S,
+        },
+        .report = HOST_REPORT_CFG,
+        .window = host_window,
+    };
+    fsm_t *fsm;
+    int first = 1;
+    bool ok;
+
+    host.windows = HOST_WINDOWS;
+    if (argc > 1 && argv[1][0] != '-') {
+        host.windows = (uint32_t)atoi(argv[1]);
+        first = 2;
+    }
+    //Nada em buffer para o filho herdar
+    fflush(stdout);
+    at.fd = sim_start(argc - first, argv + first);
+    if (at.fd < 0) {
+        sim_stop();
+        return 2;
+    }
+    at_line_init(&at.lines, host_at_slot, host_at_line, NULL);
+    netreg_init();
+    gsm_init(&conf);
+    fsm = gsm_machine();
+    //Veiculo em movimento desde a partida, como a IMU avisaria
+    gsm_motion(false);
+
+    while (!host.done) {
+        fsm_poll(fsm, host_ms());
+        host_dlog();
+        if (host.done || !host_pump(fsm_next_ms(fsm, host_ms()))) {
+            break;
+        }
+    }
+    sim_stop();
+
+    fsm_stats_t st;
+    fsm_get_stats(fsm, &st);
+    ok = host.failed == 0 && host.window == host.windows && host.published > 0;
+    printf("%u janelas, %u publicadas, %u eventos, %u transicoes, %u prazos, %u linhas perdidas: %s\n",
+           (unsigned)host.window, (unsigned)host.published, (unsigned)st.events, (unsigned)st.transitions,
+           (unsigned)st.timeouts, (unsigned)at.lines.dropped, ok ? "OK" : "FALHOU");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,346 @@
+/* Replay de um dia de uso contra a politica de relatorio (main/report.c)
+
+   Gera a trajetoria verdadeira a cada segundo (estacionado em casa, ida ao
+   trabalho por cidade e rodovia com um trecho sem sinal e um buraco no
+   caminho, o dia estacionado, a volta pelo mesmo caminho e a noite) e
+   passa pelos dois escalonadores:
+     - fixo: janela a cada POWER_WINDOW_S, fix e publicacao em todas;
+     - adaptativo: intervalo de report_next_s() e publicacao quando
+       report_fix() pede; a IMU avisa movimento no maximo a cada
+       VIB_MOTION_POST_S com o motor ligado, o buraco e a travessia da
+       cerca (em volta de casa) viram rajada e o RSRP da celula chega a
+       cada conexao.
+   Sem rede (RSRP abaixo de NO_NET_DBM) a janela nao publica e os fixes
+   ficam para a seguinte, nos dois. Cada publicacao leva os fixes
+   pendentes em lotes do formato de telem.h; os bytes contam o payload e o
+   cabecalho do PUBLISH, mais a sessao MQTT (CONNECT/DISCONNECT) uma vez
+   por janela que publica. Os alertas de evento saem pelo mqtt_pub_urgent()
+   nos dois e nao entram na conta. O erro e a distancia da posicao
+   verdadeira ate o ultimo fix publicado, a cada segundo em movimento.
+
+   gcc -O2 -Imain tools/report_replay.c main/report.c main/telem.c -lm -o report_replay && ./report_replay
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "report.h"
+#include "telem.h"
+
+#define WINDOW_S            (30 * 60)   //POWER_WINDOW_S
+#define MOTION_POST_S       60          //VIB_MOTION_POST_S
+#define PAYLOAD_MAX         1024        //MQTT_PAYLOAD_MAX
+#define TOPIC               "logq/telem"        //CONFIG_LOGQ_MQTT_TOPIC
+#define CLIENT_ID           "logq"              //CONFIG_LOGQ_MQTT_CLIENT_ID
+#define PUBLISH_HDR         (2 + 2 + (int)sizeof(TOPIC) - 1 + 2 + 4)    //Cabecalho, topico e id (QoS 1), PUBACK
+#define SESSION_B           (14 + (int)sizeof(CLIENT_ID) - 1 + 4 + 2)   //CONNECT com client id, CONNACK e DISCONNECT
+#define NO_NET_DBM          -120
+#define M_PER_E6            0.1111949
+#define T0                  1700000000u
+#define HOME_LAT_E6         -23550520
+#define HOME_LON_E6         -46633308
+#define FENCE_M             300
+#define MAX_PENDING         4096
+
+enum { G_HOME, G_GO, G_WORK, G_BACK, G_NIGHT, G_N };
+
+static const char *const groups[G_N] = {"parado em casa", "ida", "parado no trabalho", "volta", "parado a noite"};
+
+typedef struct {
+    uint32_t len_s;
+    double kmh;                 //Velocidade de cruzeiro (0: estacionado)
+    uint32_t turn_s;            //Conversao de 90 graus a cada (0: sem)
+    uint32_t stop_s;            //Semaforo de 40 s a cada (0: sem)
+    double curve_dps;           //Curva continua da rodovia
+    int16_t rsrp;
+    uint32_t event_at_s;        //Buraco (0: sem)
+} leg_t;
+
+//Ida; a volta refaz o caminho ao contrario
+static const leg_t trip[] = {
+    {20 * 60, 35,  150, 180, 0,     -98,  0},      //Cidade
+    {15 * 60, 100, 0,   0,   0.02,  -106, 0},      //Rodovia
+    {10 * 60, 100, 0,   0,   0,     -117, 0},      //Rodovia, sinal fraco
+    {15 * 60, 100, 0,   0,   -0.03, -124, 0},      //Rodovia sem sinal
+    {10 * 60, 30,  120, 150, 0,     -101, 300},    //Cidade, buraco
+};
+
+typedef struct {
+    double lat_e6;
+    double lon_e6;
+    double kmh;
+    double course;
+    int16_t rsrp;
+    uint8_t group;
+    bool event;
+    bool engine;                //A IMU ve vibracao
+} truth_t;
+
+typedef struct {
+    const char *name;
+    uint32_t fixes[G_N];
+    uint32_t sessions[G_N];
+    uint32_t bytes[G_N];
+    double err_max[G_N];
+    double err_sum[G_N];
+    uint32_t err_n[G_N];
+    telem_fix_t pending[MAX_PENDING];
+    uint32_t npending;
+    bool pub_ok;
+    int32_t pub_lat_e6;
+    int32_t pub_lon_e6;
+} run_t;
+
+static truth_t *truth;
+static uint32_t n_truth;
+static run_t fixed_run = {.name = "fixo"};
+static run_t adapt_run = {.name = "adaptativo"};
+static report_t rep;
+
+static void park(uint32_t len_s, uint8_t group, double lat, double lon, int16_t rsrp)
+{
+    for (uint32_t s = 0; s < len_s; s++) {
+        truth[n_truth++] = (truth_t) {lat, lon, 0, 0, rsrp, group, false, false};
+    }
+}
+
+static void gen(void)
+{
+    double lat = HOME_LAT_E6, lon = HOME_LON_E6, course = 45;
+    uint32_t go0, go1;
+    size_t total = 6 * 3600 + 9 * 3600 + 8 * 3600;
+
+    for (size_t l = 0; l < sizeof(trip) / sizeof(trip[0]); l++) {
+        total += 2 * trip[l].len_s;
+    }
+    truth = calloc(total, sizeof(*truth));
+    park(6 * 3600, G_HOME, lat, lon, -95);
+    go0 = n_truth;
+    for (size_t l = 0; l < sizeof(trip) / sizeof(trip[0]); l++) {
+        const leg_t *g = &trip[l];
+
+        for (uint32_t s = 0; s < g->len_s; s++) {
+            double kmh = g->kmh * (0.9 + 0.2 * sin(s / 37.0));
+
+            if (g->stop_s && s % g->stop_s >= g->stop_s - 40) {
+                kmh = 0;
+            }
+            if (g->turn_s && s % g->turn_s == g->turn_s / 2) {
+                course += (s / g->turn_s) % 3 == 1 ? -90 : 90;
+            }
+            course = fmod(course + g->curve_dps + 360, 360);
+            lat += kmh / 3.6 * cos(course * M_PI / 180) / M_PER_E6;
+            lon += kmh / 3.6 * sin(course * M_PI / 180) / (M_PER_E6 * cos(lat * 1e-6 * M_PI / 180));
+            truth[n_truth++] = (truth_t) {lat, lon, kmh, course, g->rsrp, G_GO, g->event_at_s && s == g->event_at_s, true};
+        }
+    }
+    go1 = n_truth;
+    park(9 * 3600, G_WORK, lat, lon, -90);
+    for (uint32_t i = go1; i-- > go0;) {
+        truth_t t = truth[i];
+
+        t.course = fmod(t.course + 180, 360);
+        t.group = G_BACK;
+        t.event = false;
+        truth[n_truth++] = t;
+    }
+    park(8 * 3600, G_NIGHT, HOME_LAT_E6, HOME_LON_E6, -95);
+}
+
+static double dist_m(double lat1, double lon1, double lat2, double lon2)
+{
+    double k = cos((lat1 + lat2) * 0.5e-6 * M_PI / 180);
+    double dy = (lat2 - lat1) * M_PER_E6;
+    double dx = (lon2 - lon1) * M_PER_E6 * k;
+
+    return sqrt(dx * dx + dy * dy);
+}
+
+//Fix do modem no instante t (o +CGNSINF arredonda para a unidade do gnss_fix_t)
+static void fix_at(uint32_t t, gnss_fix_t *f)
+{
+    const truth_t *v = &truth[t];
+
+    memset(f, 0, sizeof(*f));
+    f->utc = T0 + t;
+    f->lat_e6 = (int32_t)lrint(v->lat_e6);
+    f->lon_e6 = (int32_t)lrint(v->lon_e6);
+    f->alt_cm = 76000;
+    f->speed_kmh_x100 = (uint16_t)lrint(v->kmh * 100);
+    f->course_x100 = (uint16_t)lrint(v->course * 100) % 36000;
+    f->hdop_x100 = 90;
+    f->sats_view = 9;
+    f->run = 1;
+    f->fix = 1;
+    f->fix_mode = 1;
+    f->present = GNSS_HAS_RUN | GNSS_HAS_FIX | GNSS_HAS_POSITION | GNSS_HAS_ALT | GNSS_HAS_SPEED |
+                 GNSS_HAS_COURSE | GNSS_HAS_HDOP | GNSS_HAS_SATS_VIEW;
+}
+
+static void take_fix(run_t *r, uint32_t t, const gnss_fix_t *f)
+{
+    r->fixes[truth[t].group]++;
+    if (r->npending < MAX_PENDING) {
+        telem_fix_from_gnss(&r->pending[r->npending++], f);
+    }
+}
+
+//Janela que publica: todos os pendentes em lotes de ate PAYLOAD_MAX; false sem rede
+static bool publish(run_t *r, uint32_t t)
+{
+    static uint8_t buf[PAYLOAD_MAX];
+    uint8_t g = truth[t].group;
+    telem_enc_t enc;
+
+    if (truth[t].rsrp < NO_NET_DBM) {
+        return false;
+    }
+    r->sessions[g]++;
+    r->bytes[g] += SESSION_B;
+    for (uint32_t i = 0; i < r->npending;) {
+        telem_enc_init(&enc, buf, sizeof(buf));
+        while (i < r->npending && telem_enc_fix(&enc, &r->pending[i]) > 0) {
+            i++;
+        }
+        r->bytes[g] += enc.len + PUBLISH_HDR;
+    }
+    if (r->npending > 0) {
+        r->pub_ok = true;
+        r->pub_lat_e6 = r->pending[r->npending - 1].lat_e6;
+        r->pub_lon_e6 = r->pending[r->npending - 1].lon_e6;
+    }
+    r->npending = 0;
+    return true;
+}
+
+static void track_error(run_t *r, uint32_t t)
+{
+    const truth_t *v = &truth[t];
+    double e;
+
+    if (!v->engine || !r->pub_ok) {
+        return;
+    }
+    e = dist_m(v->lat_e6, v->lon_e6, r->pub_lat_e6, r->pub_lon_e6);
+    r->err_sum[v->group] += e;
+    r->err_n[v->group]++;
+    if (e > r->err_max[v->group]) {
+        r->err_max[v->group] = e;
+    }
+}
+
+static void run_fixed(void)
+{
+    gnss_fix_t f;
+
+    for (uint32_t t = 0; t < n_truth; t++) {
+        if (t % WINDOW_S == 0) {
+            fix_at(t, &f);
+            take_fix(&fixed_run, t, &f);
+            publish(&fixed_run, t);
+        }
+        track_error(&fixed_run, t);
+    }
+}
+
+//Movimento ou evento no IDLE: a janela so e antecipada (gsm_moved)
+static void antecipa(uint32_t t, uint32_t *next, bool saiu)
+{
+    uint32_t s = report_next_s(&rep, T0 + t);
+
+    if (saiu && t + s < *next) {
+        *next = t + s;
+    }
+}
+
+static void run_adaptive(void)
+{
+    report_cfg_t cfg = REPORT_CFG_DEFAULT;
+    uint32_t next = 0;
+    uint32_t posted = 0;
+    bool posted_ok = false;
+    gnss_fix_t f;
+
+    cfg.fence_lat_e6 = HOME_LAT_E6;
+    cfg.fence_lon_e6 = HOME_LON_E6;
+    cfg.fence_m = FENCE_M;
+    report_init(&rep, &cfg, T0);
+    for (uint32_t t = 0; t < n_truth; t++) {
+        uint32_t now = T0 + t;
+
+        if (truth[t].engine && (!posted_ok || t - posted >= MOTION_POST_S)) {
+            posted = t;
+            posted_ok = true;
+            antecipa(t, &next, report_motion(&rep, now));
+        }
+        if (truth[t].event) {
+            antecipa(t, &next, report_event(&rep, now));
+        }
+        if (t == next) {
+            fix_at(t, &f);
+            take_fix(&adapt_run, t, &f);
+            if (report_fix(&rep, &f, now)) {
+                bool up = publish(&adapt_run, t);
+
+                //gsm_parse_cell ou gsm_no_net
+                report_link(&rep, up, up ? truth[t].rsrp : REPORT_RSRP_NONE);
+            }
+            next = t + report_next_s(&rep, now);
+        }
+        track_error(&adapt_run, t);
+    }
+}
+
+static void print_row(const char *name, const run_t *r, int g)
+{
+    printf("%-20s %-11s %6u %8u %8u %10.0f %10.0f\n", name, r->name, r->fixes[g], r->sessions[g], r->bytes[g],
+           r->err_n[g] ? r->err_sum[g] / r->err_n[g] : 0.0, r->err_max[g]);
+}
+
+static void totals(const run_t *r, uint32_t *fixes, uint32_t *bytes, double *err_max, uint32_t *parked)
+{
+    *fixes = *bytes = *parked = 0;
+    *err_max = 0;
+    for (int g = 0; g < G_N; g++) {
+        *fixes += r->fixes[g];
+        *bytes += r->bytes[g];
+        *err_max = r->err_max[g] > *err_max ? r->err_max[g] : *err_max;
+        if (g == G_HOME || g == G_WORK || g == G_NIGHT) {
+            *parked += r->fixes[g];
+        }
+    }
+}
+
+int main(void)
+{
+    uint32_t ff, fb, fp, af, ab, ap;
+    double fe, ae;
+    double km = 0;
+    bool ok;
+
+    gen();
+    run_fixed();
+    run_adaptive();
+
+    for (uint32_t t = 1; t < n_truth; t++) {
+        km += truth[t].kmh / 3600;
+    }
+    printf("Dia simulado: %u s, %.1f km rodados\n\n", n_truth, km);
+    printf("%-20s %-11s %6s %8s %8s %10s %10s\n", "trecho", "politica", "fixes", "sessoes", "bytes", "erro med m", "erro max m");
+    for (int g = 0; g < G_N; g++) {
+        print_row(groups[g], &fixed_run, g);
+        print_row("", &adapt_run, g);
+    }
+    totals(&fixed_run, &ff, &fb, &fe, &fp);
+    totals(&adapt_run, &af, &ab, &ae, &ap);
+    printf("\n%-20s %-11s %6u %19u %21.0f\n", "total", fixed_run.name, ff, fb, fe);
+    printf("%-20s %-11s %6u %19u %21.0f\n", "", adapt_run.name, af, ab, ae);
+    printf("\nAdaptativo: %u publicacoes pedidas, %u adiadas pelo enlace, %u rajadas, %u travessias da cerca\n",
+           rep.stats.sent, rep.stats.deferred, rep.stats.bursts, rep.stats.fences);
+
+    //Parado faz menos fixes, em movimento o rastro fica mais perto e a cerca e o buraco disparam
+    ok = ap < fp && ae < fe && rep.stats.fences == 2 && rep.stats.bursts >= 3;
+    printf("%s\n", ok ? "OK" : "FALHOU");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,257 @@
+/* Teste de carga do ring_mpsc_t e comparacao com uma fila com copia, no host
+
+   1. Varios produtores publicam sequencias numeradas no mesmo ring_mpsc_t
+      enquanto um consumidor as retira; confere que nenhum descritor se
+      perde, se repete ou sai fora de ordem dentro de um produtor.
+   2. Vazao e latencia da entrega de mensagens do tamanho do antigo GPSDados
+      (277 bytes): pelo ring_mpsc_t, levando so o indice de um slot do pool
+      (que volta ao dono por um ring_t), contra uma fila com mutex que copia
+      a mensagem na entrada e na saida, como a xQueueSend/xQueueReceive. O
+      FreeRTOS nao roda no host: a fila com mutex e o modelo do custo da
+      copia e da secao critica; no ESP32 a comparacao com a fila de verdade
+      esta no build de benchmark (cargas "xqueue" e "mpsc").
+
+   gcc -O2 -pthread -Imain tools/ring_stress.c main/ring.c -o ring_stress
+   ./ring_stress [produtores] [mensagens_por_produtor]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "ring.h"
+
+#define PROD_MAX    8
+#define RING_LEN    64          //RING_CAP(LOGQ_AT_LINE_POOL) com folga
+#define POOL_PER    16          //Slots do pool por produtor
+#define MSG_SIZE    277         //sizeof do antigo GPSDados
+#define QUEUE_LEN   16
+
+typedef struct {
+    uint64_t t_ns;              //Envio, para a latencia
+    uint32_t seq;
+    uint8_t prod;
+    uint8_t body[MSG_SIZE - 13];
+} msg_t;
+
+static int nprod = 4;
+static uint32_t nmsg = 1000000;
+
+static ring_mpsc_t ring;
+static ring_cell_t ring_cells[RING_LEN];
+static uint32_t full_spins;             //Produtor achou o ring cheio
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+//---------------------------------------------------------------- 1. correcao
+
+static void *seq_producer(void *arg)
+{
+    uint32_t id = (uint32_t)(uintptr_t)arg;
+
+    for (uint32_t i = 0; i < nmsg; i++) {
+        while (!ring_mpsc_push(&ring, (id << 24) | (i & 0xFFFFFF))) {
+            __atomic_fetch_add(&full_spins, 1, __ATOMIC_RELAXED);
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static bool test_order(void)
+{
+    pthread_t th[PROD_MAX];
+    uint32_t next[PROD_MAX] = {0};
+    uint32_t got = 0, bad = 0, v;
+    uint64_t t0 = now_ns();
+
+    ring_mpsc_init(&ring, ring_cells, RING_LEN);
+    for (int p = 0; p < nprod; p++) {
+        pthread_create(&th[p], NULL, seq_producer, (void *)(uintptr_t)p);
+    }
+    while (got < nprod * nmsg) {
+        if (!ring_mpsc_pop(&ring, &v)) {
+            sched_yield();
+            continue;
+        }
+        uint32_t p = v >> 24;
+        if (p >= (uint32_t)nprod || (v & 0xFFFFFF) != (next[p] & 0xFFFFFF)) {
+            bad++;
+        }
+        next[p < PROD_MAX ? p : 0]++;
+        got++;
+    }
+    for (int p = 0; p < nprod; p++) {
+        pthread_join(th[p], NULL);
+    }
+    printf("ordem: %d produtores x %u | recebidos %u | fora de ordem %u | ring cheio %u vezes | %.1f Mdesc/s\n",
+           nprod, nmsg, got, bad, full_spins, got * 1e3 / (now_ns() - t0));
+    return bad == 0 && ring_mpsc_count(&ring) == 0 && ring.dropped == full_spins;
+}
+
+//---------------------------------------------------------------- 2. vazao e latencia
+
+static msg_t pool[PROD_MAX][POOL_PER];
+static ring_t pool_free[PROD_MAX];      //Devolucao ao dono: o consumidor produz, o dono consome
+static uint8_t pool_free_buf[PROD_MAX][POOL_PER];
+static uint32_t *lat;
+
+static pthread_mutex_t q_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t q_not_empty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t q_not_full = PTHREAD_COND_INITIALIZER;
+static msg_t q_buf[QUEUE_LEN];
+static uint32_t q_head, q_tail;
+
+static void *pool_producer(void *arg)
+{
+    uint32_t id = (uint32_t)(uintptr_t)arg;
+    uint8_t slot;
+
+    for (uint32_t i = 0; i < nmsg; i++) {
+        while (ring_pop(&pool_free[id], &slot, 1) == 0) {
+            sched_yield();
+        }
+        msg_t *m = &pool[id][slot];
+        m->seq = i;
+        m->prod = (uint8_t)id;
+        m->body[0] = (uint8_t)i;
+        m->t_ns = now_ns();
+        while (!ring_mpsc_push(&ring, id * POOL_PER + slot)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *queue_producer(void *arg)
+{
+    msg_t m;
+
+    memset(&m, 0, sizeof(m));
+    m.prod = (uint8_t)(uintptr_t)arg;
+    for (uint32_t i = 0; i < nmsg; i++) {
+        m.seq = i;
+        m.body[0] = (uint8_t)i;
+        pthread_mutex_lock(&q_lock);
+        while (q_head - q_tail == QUEUE_LEN) {
+            pthread_cond_wait(&q_not_full, &q_lock);
+        }
+        m.t_ns = now_ns();
+        q_buf[q_head++ % QUEUE_LEN] = m;
+        pthread_cond_signal(&q_not_empty);
+        pthread_mutex_unlock(&q_lock);
+    }
+    return NULL;
+}
+
+static void report(const char *name, uint32_t n, uint64_t ns)
+{
+    qsort(lat, n, sizeof(lat[0]), cmp_u32);
+    printf("%-7s: %u mensagens de %u bytes | %6.2f Mmsg/s | latencia p50 %u ns, p99 %u ns, max %u ns\n",
+           name, n, (unsigned)sizeof(msg_t), n * 1e3 / ns, lat[n / 2], lat[(uint64_t)n * 99 / 100], lat[n - 1]);
+}
+
+static bool test_ring(void)
+{
+    pthread_t th[PROD_MAX];
+    uint32_t total = nprod * nmsg, got = 0, bad = 0, v;
+    uint32_t next[PROD_MAX] = {0};
+    uint64_t t0;
+
+    ring_mpsc_init(&ring, ring_cells, RING_LEN);
+    for (int p = 0; p < nprod; p++) {
+        ring_init(&pool_free[p], pool_free_buf[p], 1, POOL_PER);
+        for (uint8_t s = 0; s < POOL_PER; s++) {
+            ring_push(&pool_free[p], &s, 1);
+        }
+    }
+    t0 = now_ns();
+    for (int p = 0; p < nprod; p++) {
+        pthread_create(&th[p], NULL, pool_producer, (void *)(uintptr_t)p);
+    }
+    while (got < total) {
+        if (!ring_mpsc_pop(&ring, &v)) {
+            sched_yield();
+            continue;
+        }
+        uint8_t p = v / POOL_PER, s = v % POOL_PER;
+        const msg_t *m = &pool[p][s];
+
+        lat[got++] = (uint32_t)(now_ns() - m->t_ns);
+        bad += (m->prod != p || m->seq != next[p]++ || m->body[0] != (uint8_t)m->seq);
+        ring_push(&pool_free[p], &s, 1);
+    }
+    for (int p = 0; p < nprod; p++) {
+        pthread_join(th[p], NULL);
+    }
+    report("mpsc", total, now_ns() - t0);
+    return bad == 0;
+}
+
+static bool test_queue(void)
+{
+    pthread_t th[PROD_MAX];
+    uint32_t total = nprod * nmsg, got = 0, bad = 0;
+    uint32_t next[PROD_MAX] = {0};
+    uint64_t t0 = now_ns();
+    msg_t m;
+
+    for (int p = 0; p < nprod; p++) {
+        pthread_create(&th[p], NULL, queue_producer, (void *)(uintptr_t)p);
+    }
+    while (got < total) {
+        pthread_mutex_lock(&q_lock);
+        while (q_head == q_tail) {
+            pthread_cond_wait(&q_not_empty, &q_lock);
+        }
+        m = q_buf[q_tail++ % QUEUE_LEN];
+        pthread_cond_signal(&q_not_full);
+        pthread_mutex_unlock(&q_lock);
+
+        lat[got++] = (uint32_t)(now_ns() - m.t_ns);
+        bad += (m.prod >= nprod || m.seq != next[m.prod]++);
+    }
+    for (int p = 0; p < nprod; p++) {
+        pthread_join(th[p], NULL);
+    }
+    report("fila", total, now_ns() - t0);
+    return bad == 0;
+}
+
+int main(int argc, char **argv)
+{
+    bool ok;
+
+    nprod = argc > 1 ? atoi(argv[1]) : nprod;
+    nmsg = argc > 2 ? (uint32_t)atoi(argv[2]) : nmsg;
+    if (nprod < 1 || nprod > PROD_MAX || nmsg == 0 || nmsg > 0xFFFFFF) {
+        fprintf(stderr, "produtores 1..%d, mensagens 1..%u\n", PROD_MAX, 0xFFFFFF);
+        return 2;
+    }
+    lat = malloc(sizeof(lat[0]) * nprod * nmsg);
+    if (lat == NULL) {
+        return 2;
+    }
+    ok = test_order();
+    ok = test_ring() && ok;
+    ok = test_queue() && ok;
+    printf("%s\n", ok ? "OK" : "FALHOU");
+    free(lat);
+    return ok ? 0 : 1;
+}
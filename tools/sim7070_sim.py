@@ -0,0 +1,759 @@
+#!/usr/bin/env python
+"""Simulador do modem SIM7070 para testar o firmware sem a placa/SIM.
+
+Atende comandos AT por um pseudo-terminal (padrao) ou por uma porta serial
+real (--port), que pode ser ligada a UART2 do ESP32 por um conversor USB-serial.
+Cobre o que o GSM_C usa: GNSS (AT+CGNSPWR/AT+CGNSINF, partidas
+AT+CGNSHOT/WARM/COLD e o XTRA por AT+HTTPTOFS/CGNSCPY/CGNSXTRA), registro (+CPSI com
+transicao NO SERVICE -> LTE CAT-M1, +CGREG, +CEREG), PDP (CGACT/CNACT com a URC
++APP PDP) e MQTT (AT+SM*).
+
+Permite latencia por comando, perda de bytes e URCs periodicas. Ao final de
+cada ciclo (novo AT+CGNSPWR=1) e na saida imprime tempo ate o primeiro fix,
+tempo ate a primeira publicacao, tempo de ponta a ponta do ciclo (GNSS, troca
+para o LTE e publicacao) e bytes trafegados. Uma janela de GNSS curta
+(--lte-keep) mantem o registro e o PDP, como o modem faz.
+
+Comando que chega mais de WAKE_GAP_S depois da ultima saida do modem e
+do comando anterior nao e reacao a uma resposta: e um despertar do
+firmware por prazo (consulta periodica). O relatorio traz esses
+despertares por ciclo e por hora e a demora entre o modem ter servico e a
+primeira consulta ou URC que o mostra (service_seen_lag_s).
+
+Com AT+CEREG=n/AT+CGREG=n (n > 0) cada mudanca do registro sai como URC
+(n = 2 com TAC e celula), menos durante o GNSS, em que o modem guarda o
+registro; o GNSS longo que derruba o PDP e o MQTT avisa "+APP PDP:
+0,DEACTIVE" e "+SMSTATE: 0". As URCs de registro emitidas sao contadas
+(reg_urcs).
+
+Contexto PDP e AT+CNCFG partem dos valores de fabrica; consultas e
+escritas de configuracao (CFUN, CGDCONT, CNCFG, SMCONF) sao contadas por
+ciclo para medir os comandos que o firmware deixa de enviar.
+
+AT+IPR troca a velocidade (na porta real, depois do OK) e AT+IFC liga o
+RTS/CTS. No pseudo-terminal o tempo de fio de cada byte no baud negociado
+e somado as respostas, para comparar 9600 com 921600.
+
+Exemplos:
+    python tools/sim7070_sim.py --fix-after 20 --service-after 5
+    python tools/sim7070_sim.py --port /dev/ttyUSB1 --latency AT+CNACT=2000 --drop 0.001
+"""
+
+from __future__ import print_function
+
+import argparse
+import heapq
+import json
+import os
+import random
+import re
+import select
+import signal
+import sys
+import time
+import tty
+
+DEFAULT_LATENCY_MS = 20
+WAKE_GAP_S = 0.1        # Comando depois disto sem saida do modem: despertar do firmware
+BAUDS = (0, 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600)  # 0 = autobaud
+
+TELEM_VERSION = 1
+TELEM_TYPE_FIX = 1
+TELEM_TYPE_VIB = 2
+TELEM_TYPE_EVT = 3
+TELEM_TYPE_STATS = 4
+TELEM_TYPE_AT = 5
+# varints por entrada; fora o FIX o ultimo e a contagem (bandas/perfil/tasks/familias) que segue
+TELEM_FIELDS = {TELEM_TYPE_FIX: 9, TELEM_TYPE_VIB: 10, TELEM_TYPE_EVT: 7, TELEM_TYPE_STATS: 13, TELEM_TYPE_AT: 7}
+# varints por item contado: nome[4] + carga; nome[6] + n, p50, p95, max, falhas
+TELEM_COUNT_WIDTH = {TELEM_TYPE_STATS: 5, TELEM_TYPE_AT: 11}
+TELEM_EVT_AGE = 5       # indice do age_ms na entrada EVT
+
+# Comandos de configuracao contados por ciclo (consultas '?' e escritas)
+CFG_CMDS = ('AT+CFUN', 'AT+CGDCONT', 'AT+CNCFG', 'AT+SMCONF')
+
+CPSI_LTE = '+CPSI: LTE CAT-M1,Online,724-05,0x5A1E,187214780,257,EUTRAN-BAND28,9410,3,3,-10,-95,-65,12'
+REG_TAC = '5A1E'        # Mesma celula do CPSI_LTE, em hexadecimal
+REG_CI = '0B28A3BC'
+CBANDCFG = ['+CBANDCFG: "CAT-M",1,2,3,4,5,8,12,13,18,19,20,25,26,27,28,66,85',
+            '+CBANDCFG: "NB-IOT",1,2,3,4,5,8,12,13,18,19,20,25,26,28,66,71,85']
+
+
+def telem_count(payload, ages=None):
+    """Conta as entradas de um payload no formato binario do firmware (main/telem.h).
+
+    Se ages for uma lista, recebe o age_ms de cada alerta (entrada EVT).
+    """
+    data = bytearray(payload)
+    if not data or data[0] != TELEM_VERSION:
+        return 0
+    pos, count = 1, 0
+
+    def varint():
+        v, shift = 0, 0
+        while True:
+            b = data[pos + shift // 7]
+            v |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return v, shift // 7
+
+    try:
+        while pos < len(data):
+            kind = data[pos]
+            pos += 1
+            if kind not in TELEM_FIELDS:
+                return count
+            n = TELEM_FIELDS[kind]
+            for i in range(n):
+                v, used = varint()
+                pos += used
+                if kind == TELEM_TYPE_EVT and i == TELEM_EVT_AGE and ages is not None:
+                    ages.append(v)
+                if kind != TELEM_TYPE_FIX and i == n - 1:     # nbands/ntrace/ntop: seguem os valores
+                    for _ in range(v * TELEM_COUNT_WIDTH.get(kind, 1)):
+                        _, used = varint()
+                        pos += used
+            count += 1
+    except IndexError:
+        pass
+    return count
+
+
+class Stats(object):
+    def __init__(self):
+        self.reset(time.time())
+
+    def reset(self, now):
+        self.start = now
+        self.first_fix = None
+        self.gnss_start = None      # Modo pedido pelo firmware na sessao
+        self.gnss_off = None
+        self.lte_kept = None
+        self.first_publish = None
+        self.rx_bytes = 0       # firmware -> modem
+        self.tx_bytes = 0       # modem -> firmware
+        self.commands = 0
+        self.cfg_queries = 0
+        self.cfg_sets = 0
+        self.publishes = 0
+        self.records = 0
+        self.first_pub_records = 0
+        self.pub_first_end = None
+        self.pub_last_end = None
+        self.connect_s = 0.0
+        self.dropped = 0
+        self.alert_latency_ms = []  # Do evento ao OK do AT+SMPUB que o levou
+        self.wakeups = 0
+        self.service_lag = None     # Servico disponivel -> primeira consulta ou URC que o mostrou
+        self.reg_urcs = 0
+
+    def as_dict(self):
+        def rel(t):
+            return None if t is None else round(t - self.start, 3)
+        return {
+            'time_to_first_fix_s': rel(self.first_fix),
+            'gnss_start': self.gnss_start,
+            'gnss_s': None if self.gnss_off is None else round(self.gnss_off - self.start, 3),
+            'switch_to_publish_s': (None if self.gnss_off is None or self.first_publish is None
+                                    else round(self.first_publish - self.gnss_off, 3)),
+            'cycle_s': rel(self.pub_last_end),
+            'lte_kept': self.lte_kept,
+            'time_to_first_publish_s': rel(self.first_publish),
+            'bytes_rx': self.rx_bytes,
+            'bytes_tx': self.tx_bytes,
+            'bytes_total': self.rx_bytes + self.tx_bytes,
+            'commands': self.commands,
+            'cfg_queries': self.cfg_queries,
+            'cfg_sets': self.cfg_sets,
+            'publishes': self.publishes,
+            'records': self.records,
+            'records_per_s': self.records_per_s(),
+            'connect_s_per_record': round(self.connect_s / self.records, 4) if self.records else None,
+            'dropped_bytes': self.dropped,
+            'alerts': len(self.alert_latency_ms),
+            'alert_latency_ms': max(self.alert_latency_ms) if self.alert_latency_ms else None,
+            'wakeups': self.wakeups,
+            'wakeups_per_h': self.wakeups_per_h(),
+            'service_seen_lag_s': None if self.service_lag is None else round(self.service_lag, 3),
+            'reg_urcs': self.reg_urcs,
+        }
+
+    def wakeups_per_h(self):
+        span = time.time() - self.start
+        return round(self.wakeups * 3600.0 / span, 1) if span > 0 else None
+
+    def records_per_s(self):
+        # Do fim da primeira publicacao ao fim da ultima (exclui a primeira)
+        if self.publishes < 2 or self.pub_last_end <= self.pub_first_end:
+            return None
+        return round((self.records - self.first_pub_records) / (self.pub_last_end - self.pub_first_end), 1)
+
+
+class Sim7070(object):
+    def __init__(self, args):
+        self.args = args
+        self.rand = random.Random(args.seed)
+        self.boot = time.time()
+        self.echo = True
+        self.cfun = 1
+        self.csclk = 0                  # Sleep pelo DTR (o pino nao passa pelo pty)
+        self.baud = args.baud
+        self.new_baud = None            # Aplicado na porta depois do OK do AT+IPR
+        self.ifc = '0,0'
+        self.rx_wire = 0                # Bytes recebidos ainda nao cobrados
+        self.gnss_on = False
+        self.gnss_since = None
+        self.gnss_power_at = None
+        self.fix_after = args.fix_after
+        self.last_fix = None            # Efemerides na RAM do modem desde este fix
+        self.xtra = False
+        self.xtra_file = False
+        self.lte_since = self.boot
+        self.pdp_active = False
+        self.ip = '10.170.3.5'
+        self.cgreg_n = 0
+        self.cereg_n = 0
+        self.reg_reported = None        # Ultimo stat avisado por URC
+        self.apn = ''                   # Contexto 1 e CNCFG de fabrica; SMCONF some no reset
+        self.cncfg = '0,"","","",0'
+        self.smconf = {}
+        self.mqtt_connected = False
+        self.pub_pending = None     # bytes restantes do payload do AT+SMPUB
+        self.pub_buf = b''
+        self.pub_cmd_time = 0.0
+        self.rx_line = b''
+        self.last_out = self.boot       # Ultima saida do modem e ultimo comando (despertares)
+        self.last_cmd = self.boot
+        self.events = []            # heap de (instante, seq, bytes)
+        self.seq = 0
+        self.stats = Stats()
+        self.cycles = []
+        self.latency = {}
+        for item in args.latency or []:
+            cmd, ms = item.rsplit('=', 1)
+            self.latency[cmd.upper()] = int(ms)
+        self.urcs = []
+        for item in args.urc or []:
+            text, period = item.rsplit('@', 1)
+            self.urcs.append([text, float(period), time.time() + float(period)])
+
+    # Saida ------------------------------------------------------------
+
+    def schedule(self, delay_ms, data):
+        self.seq += 1
+        heapq.heappush(self.events, (time.time() + delay_ms / 1000.0, self.seq, data))
+
+    def wire_ms(self, nbytes):
+        # Pseudo-terminal nao tem baud: 10 bits por byte no baud negociado
+        return 0 if self.args.port else nbytes * 10000.0 / self.baud
+
+    def reply(self, cmd, lines, final='OK', extra_ms=0):
+        delay = self.latency.get(cmd, self.args.default_latency) + extra_ms
+        out = ''.join('\r\n%s\r\n' % l for l in lines)
+        if final:
+            out += '\r\n%s\r\n' % final
+        delay += self.wire_ms(len(out) + self.rx_wire)
+        self.rx_wire = 0
+        self.schedule(delay, out.encode())
+
+    def urc(self, text, delay_ms=0):
+        self.schedule(delay_ms, ('\r\n%s\r\n' % text).encode())
+
+    def pending_output(self, now):
+        self.reg_urc(now)
+        out = b''
+        while self.events and self.events[0][0] <= now:
+            out += heapq.heappop(self.events)[2]
+        for u in self.urcs:
+            if now >= u[2]:
+                out += ('\r\n%s\r\n' % u[0]).encode()
+                u[2] = now + u[1]
+        if self.args.drop > 0 and out:
+            kept = bytearray()
+            for b in bytearray(out):
+                if self.rand.random() < self.args.drop:
+                    self.stats.dropped += 1
+                else:
+                    kept.append(b)
+            out = bytes(kept)
+        self.stats.tx_bytes += len(out)
+        if out:
+            self.last_out = now
+        return out
+
+    def next_deadline(self):
+        times = [e[0] for e in self.events[:1]] + [u[2] for u in self.urcs]
+        if (self.cereg_n or self.cgreg_n) and not self.gnss_on and self.reg_reported != 1:
+            t = self.lte_since + self.args.service_after
+            if t > time.time():
+                times.append(t)
+        return min(times) if times else None
+
+    # Estado do radio --------------------------------------------------
+
+    def has_service(self, now):
+        # O SIM7070 divide o RF: com GNSS ligado nao ha LTE
+        if self.gnss_on or self.cfun == 0:
+            return False
+        return now - self.lte_since >= self.args.service_after
+
+    def seen_service(self, now):
+        # Consulta de registro: mede quanto o firmware demorou a ver o servico
+        ok = self.has_service(now)
+        if ok:
+            self.note_service_seen(now)
+        return ok
+
+    def note_service_seen(self, now):
+        if self.stats.service_lag is None:
+            since = max(self.lte_since + self.args.service_after, self.stats.start)
+            self.stats.service_lag = max(0.0, now - since)
+
+    def reg_fields(self, n, stat, eps):
+        # <stat>[,"tac","ci"[,AcT]] como na URC; a consulta poe o <n> na frente
+        if n >= 2 and stat in (1, 5):
+            return '%d,"%s","%s"%s' % (stat, REG_TAC, REG_CI, ',7' if eps else '')
+        return '%d' % stat
+
+    def reg_urc(self, now):
+        # Durante o GNSS o modem guarda o registro e nao avisa
+        if self.gnss_on or (self.cereg_n == 0 and self.cgreg_n == 0):
+            return
+        stat = 1 if self.has_service(now) else 2
+        if stat == self.reg_reported:
+            return
+        self.reg_reported = stat
+        if stat == 1:
+            self.note_service_seen(now)
+        if self.cereg_n:
+            self.urc('+CEREG: %s' % self.reg_fields(self.cereg_n, stat, True))
+        if self.cgreg_n:
+            self.urc('+CGREG: %s' % self.reg_fields(self.cgreg_n, stat, False))
+        self.stats.reg_urcs += 1
+
+    def has_fix(self, now):
+        return self.gnss_on and now - self.gnss_since >= self.fix_after
+
+    def cgnsinf(self, now):
+        if not self.gnss_on:
+            return '+CGNSINF: 0,,,,,,,,,,,,,,,,,,,,'
+        if not self.has_fix(now):
+            return '+CGNSINF: 1,0,,,,,,,,,,,,,,,,'
+        if self.stats.first_fix is None:
+            self.stats.first_fix = now
+        self.last_fix = now
+        utc = time.strftime('%Y%m%d%H%M%S', time.gmtime(now)) + '.000'
+        lat = self.args.lat + self.rand.uniform(-1e-4, 1e-4)
+        lon = self.args.lon + self.rand.uniform(-1e-4, 1e-4)
+        return '+CGNSINF: 1,1,%s,%.6f,%.6f,760.100,%.2f,%.1f,1,,1.0,1.4,0.9,,10,,3.6,4.0' % (
+            utc, lat, lon, self.args.speed, self.args.course)
+
+    def end_cycle(self, now):
+        if self.stats.commands:
+            rep = self.stats.as_dict()
+            rep['baud'] = self.baud
+            self.cycles.append(rep)
+            print('[sim] ciclo %d: %s' % (len(self.cycles), json.dumps(rep)))
+        self.stats.reset(now)
+
+    # Entrada ----------------------------------------------------------
+
+    def feed(self, data):
+        self.rx_wire += len(data)
+        for b in bytearray(data):
+            c = bytes(bytearray([b]))
+            if self.pub_pending is not None:
+                self.stats.rx_bytes += 1
+                self.pub_buf += c
+                self.pub_pending -= 1
+                if self.pub_pending == 0:
+                    self.finish_publish()
+                continue
+            if c in (b'\r', b'\n'):
+                line = self.rx_line.decode('ascii', 'replace').strip()
+                nbytes = len(self.rx_line) + 1
+                self.rx_line = b''
+                if line:
+                    self.command(line)
+                # Depois do comando: o AT+CGNSPWR=1 que abre o ciclo conta nele
+                self.stats.rx_bytes += nbytes
+            else:
+                self.rx_line += c
+
+    def finish_publish(self):
+        now = time.time()
+        self.pub_pending = None
+        ages = []
+        records = telem_count(self.pub_buf, ages)
+        # age_ms e preenchido no envio: soma o tempo do comando ate o OK
+        ok_ms = (now - self.pub_cmd_time) * 1000 + self.latency.get('AT+SMPUB', self.args.default_latency)
+        for age in ages:
+            self.stats.alert_latency_ms.append(int(age + ok_ms))
+        self.stats.publishes += 1
+        self.stats.records += records
+        if self.stats.first_publish is None:
+            self.stats.first_publish = now
+            self.stats.pub_first_end = now
+            self.stats.first_pub_records = records
+        self.stats.pub_last_end = now
+        if self.args.verbose:
+            print('[sim] publish %d bytes, %d registros' % (len(self.pub_buf), records))
+        for age in ages:
+            print('[sim] alerta publicado %d ms apos o evento' % (age + ok_ms))
+        self.pub_buf = b''
+        self.reply('AT+SMPUB', [])
+
+    def command(self, line):
+        now = time.time()
+        self.stats.commands += 1
+        if now - max(self.last_out, self.last_cmd) > WAKE_GAP_S:
+            self.stats.wakeups += 1
+        self.last_cmd = now
+        if self.args.verbose:
+            print('[sim] <- %s' % line)
+        if self.echo:
+            self.schedule(0, (line + '\r').encode())
+
+        up = line.upper()
+        m = re.match(r'^(AT[+&]?[A-Z0-9]*)(.*)$', up)
+        if not m:
+            self.reply(up, [], 'ERROR')
+            return
+        cmd, rest = m.group(1), m.group(2)
+        if cmd in CFG_CMDS:
+            if rest == '?':
+                self.stats.cfg_queries += 1
+            else:
+                self.stats.cfg_sets += 1
+        handler = getattr(self, 'cmd_' + re.sub(r'[^A-Z0-9]', '_', cmd[2:].lstrip('+&')), None)
+        if cmd == 'AT':
+            self.reply(cmd, [])
+        elif cmd in ('ATE0', 'ATE1'):
+            self.echo = cmd == 'ATE1'
+            self.reply(cmd, [])
+        elif handler is None:
+            self.reply(cmd, [], 'ERROR')
+        else:
+            handler(cmd, rest, line, now)
+
+    # Comandos ---------------------------------------------------------
+
+    def cmd_IPR(self, cmd, rest, line, now):
+        if rest == '?':
+            self.reply(cmd, ['+IPR: %d' % self.baud])
+            return
+        try:
+            baud = int(rest[1:])
+        except ValueError:
+            baud = -1
+        if baud not in BAUDS:
+            self.reply(cmd, [], 'ERROR')
+            return
+        self.reply(cmd, [])
+        if baud and baud != self.baud:
+            self.new_baud = baud
+
+    def cmd_IFC(self, cmd, rest, line, now):
+        if rest == '?':
+            self.reply(cmd, ['+IFC: %s' % self.ifc])
+        elif rest in ('=0,0', '=2,2'):
+            self.ifc = rest[1:]
+            self.reply(cmd, [])
+        else:
+            self.reply(cmd, [], 'ERROR')
+
+    def cmd_I(self, cmd, rest, line, now):
+        self.reply(cmd, ['SIM7070 R1.0'])
+
+    def cmd_CGNSPWR(self, cmd, rest, line, now):
+        if rest == '?':
+            self.reply(cmd, ['+CGNSPWR: %d' % int(self.gnss_on)])
+        elif rest in ('=1', '=0'):
+            on = rest == '=1'
+            if on and not self.gnss_on:
+                self.end_cycle(now)
+                self.gnss_since = now
+                self.gnss_power_at = now
+                self.fix_after = self.start_fix_after(now, 'hot')
+            if not on and self.gnss_on:
+                self.stats.gnss_off = now
+                # Janela curta: o modem retoma o LTE sem perder registro e PDP
+                kept = self.pdp_active and now - self.gnss_power_at <= self.args.lte_keep
+                self.stats.lte_kept = kept
+                if kept:
+                    self.lte_since = now - self.args.service_after + self.args.lte_resume
+                else:
+                    self.lte_since = now
+                    if self.pdp_active:
+                        self.urc('+APP PDP: 0,DEACTIVE')
+                    if self.mqtt_connected:
+                        self.urc('+SMSTATE: 0')
+                    self.pdp_active = False
+                    self.mqtt_connected = False
+            self.gnss_on = on
+            self.reply(cmd, [])
+        else:
+            self.reply(cmd, [], 'ERROR')
+
+    def start_fix_after(self, now, mode):
+        # Hot so com efemerides validas (4 h); warm com almanaque ou XTRA
+        if mode == 'cold':
+            self.last_fix = None
+        if mode == 'hot' and self.last_fix is not None and now - self.last_fix < 4 * 3600:
+            return self.args.hot_fix_after
+        if mode != 'cold' and (self.last_fix is not None or self.xtra):
+            return self.args.warm_fix_after
+        return self.args.fix_after
+
+    def gnss_restart(self, cmd, mode, now):
+        if not self.gnss_on:
+            self.reply(cmd, [], 'ERROR')
+            return
+        self.gnss_since = now
+        self.fix_after = self.start_fix_after(now, mode)
+        self.stats.gnss_start = mode
+        self.reply(cmd, [])
+
+    def cmd_CGNSHOT(self, cmd, rest, line, now):
+        self.gnss_restart(cmd, 'hot', now)
+
+    def cmd_CGNSWARM(self, cmd, rest, line, now):
+        self.gnss_restart(cmd, 'warm', now)
+
+    def cmd_CGNSCOLD(self, cmd, rest, line, now):
+        self.gnss_restart(cmd, 'cold', now)
+
+    def cmd_HTTPTOFS(self, cmd, rest, line, now):
+        # OK imediato e o resultado do download pela URC
+        self.reply(cmd, [])
+        delay = self.latency.get(cmd, self.args.default_latency) + 3000
+        self.urc('+HTTPTOFS: %s' % ('200,38592' if self.pdp_active else '603,0'), delay)
+        self.xtra_file = self.pdp_active
+
+    def cmd_CGNSCPY(self, cmd, rest, line, now):
+        self.reply(cmd, [], 'OK' if self.xtra_file else 'ERROR')
+
+    def cmd_CGNSXTRA(self, cmd, rest, line, now):
+        if rest == '=1' and self.xtra_file:
+            self.xtra = True
+        self.reply(cmd, ['+CGNSXTRA: %d' % int(self.xtra)] if rest == '?' else [])
+
+    def cmd_CGNSINF(self, cmd, rest, line, now):
+        self.reply(cmd, [self.cgnsinf(now)])
+
+    def cmd_CPSI(self, cmd, rest, line, now):
+        self.reply(cmd, [CPSI_LTE if self.seen_service(now) else '+CPSI: NO SERVICE,Online'])
+
+    def cmd_CBANDCFG(self, cmd, rest, line, now):
+        self.reply(cmd, CBANDCFG if rest == '?' else [])
+
+    def cmd_CSQ(self, cmd, rest, line, now):
+        self.reply(cmd, ['+CSQ: %s' % ('20,99' if self.has_service(now) else '99,99')])
+
+    def reg_stat(self, now):
+        return 1 if self.seen_service(now) else 2
+
+    def cmd_CGREG(self, cmd, rest, line, now):
+        if rest == '?':
+            self.reply(cmd, ['+CGREG: %d,%s' % (self.cgreg_n, self.reg_fields(self.cgreg_n, self.reg_stat(now), False))])
+        else:
+            self.cgreg_n = int(rest[1:] or 0)
+            self.reg_reported = 1 if self.has_service(now) else 2
+            self.reply(cmd, [])
+
+    def cmd_CEREG(self, cmd, rest, line, now):
+        if rest == '?':
+            self.reply(cmd, ['+CEREG: %d,%s' % (self.cereg_n, self.reg_fields(self.cereg_n, self.reg_stat(now), True))])
+        else:
+            self.cereg_n = int(rest[1:] or 0)
+            self.reg_reported = 1 if self.has_service(now) else 2
+            self.reply(cmd, [])
+
+    def cmd_CSCLK(self, cmd, rest, line, now):
+        if rest == '?':
+            self.reply(cmd, ['+CSCLK: %d' % self.csclk])
+        elif rest in ('=0', '=1', '=2'):
+            self.csclk = int(rest[1:])
+            self.reply(cmd, [])
+        else:
+            self.reply(cmd, [], 'ERROR')
+
+    def cmd_CFUN(self, cmd, rest, line, now):
+        if rest == '?':
+            self.reply(cmd, ['+CFUN: %d' % self.cfun])
+            return
+        cfun = int(rest[1:].split(',')[0])
+        if cfun != self.cfun:
+            self.lte_since = now
+        self.cfun = cfun
+        self.reply(cmd, [], extra_ms=500)
+
+    def cmd_CGDCONT(self, cmd, rest, line, now):
+        if rest == '?':
+            self.reply(cmd, ['+CGDCONT: 1,"IP","%s","0.0.0.0",0,0,0,0' % self.apn])
+        else:
+            parts = line.split(',')
+            if len(parts) > 2:
+                self.apn = parts[2].strip('"')
+            self.reply(cmd, [])
+
+    def cmd_CNCFG(self, cmd, rest, line, now):
+        if rest == '?':
+            self.reply(cmd, ['+CNCFG: 0,%s' % self.cncfg] +
+                       ['+CNCFG: %d,0,"","","",0' % i for i in range(1, 4)])
+            return
+        parts = line.split('=', 1)[1].split(',')
+        if parts[0] != '0' or len(parts) < 3:
+            self.reply(cmd, [], 'ERROR')
+            return
+        # Usuario, senha e autenticacao opcionais
+        extra = parts[3:] + ['""', '""', '0'][len(parts[3:]):]
+        self.cncfg = ','.join(parts[1:3] + extra)
+        self.reply(cmd, [])
+
+    def cmd_CGATT(self, cmd, rest, line, now):
+        self.reply(cmd, ['+CGATT: %d' % int(self.has_service(now))] if rest == '?' else [])
+
+    def cmd_CGACT(self, cmd, rest, line, now):
+        if rest == '?':
+            self.reply(cmd, ['+CGACT: 1,%d' % int(self.has_service(now))])
+        else:
+            self.reply(cmd, [], 'OK' if self.has_service(now) else 'ERROR')
+
+    def cmd_CGPADDR(self, cmd, rest, line, now):
+        self.reply(cmd, ['+CGPADDR: 1,"%s"' % (self.ip if self.has_service(now) else '0.0.0.0')])
+
+    def cmd_CNACT(self, cmd, rest, line, now):
+        if rest == '?':
+            ip = self.ip if self.pdp_active else '0.0.0.0'
+            self.reply(cmd, ['+CNACT: 0,%d,"%s"' % (int(self.pdp_active), ip),
+                             '+CNACT: 1,0,"0.0.0.0"', '+CNACT: 2,0,"0.0.0.0"', '+CNACT: 3,0,"0.0.0.0"'])
+            return
+        act = rest[1:].split(',')
+        if len(act) < 2 or not self.has_service(now):
+            self.reply(cmd, [], 'ERROR')
+            return
+        self.pdp_active = act[1] == '1'
+        self.reply(cmd, [])
+        delay = self.latency.get(cmd, self.args.default_latency) + self.args.pdp_delay
+        self.urc('+APP PDP: 0,%s' % ('ACTIVE' if self.pdp_active else 'DEACTIVE'), delay)
+
+    def cmd_SNPDPID(self, cmd, rest, line, now):
+        self.reply(cmd, [])
+
+    def cmd_SNPING4(self, cmd, rest, line, now):
+        if not self.pdp_active:
+            self.reply(cmd, [], 'ERROR')
+            return
+        self.reply(cmd, ['+SNPING4: 1,8.8.8.8,45'], extra_ms=45)
+
+    def cmd_SMCONF(self, cmd, rest, line, now):
+        if rest == '?':
+            self.reply(cmd, ['+SMCONF:'] + ['%s: %s' % kv for kv in sorted(self.smconf.items())])
+            return
+        key, _, val = line.split('=', 1)[1].partition(',')
+        self.smconf[key.strip('"').upper()] = val
+        self.reply(cmd, [])
+
+    def cmd_SMCONN(self, cmd, rest, line, now):
+        if not self.pdp_active or 'URL' not in self.smconf:
+            self.reply(cmd, [], 'ERROR', extra_ms=self.args.mqtt_connect_ms)
+            return
+        self.mqtt_connected = True
+        self.stats.connect_s += (self.latency.get(cmd, self.args.default_latency) + self.args.mqtt_connect_ms) / 1000.0
+        self.reply(cmd, [], extra_ms=self.args.mqtt_connect_ms)
+
+    def cmd_SMPUB(self, cmd, rest, line, now):
+        args = line.split('=', 1)[1].split(',')
+        if not self.mqtt_connected or len(args) < 2:
+            self.reply(cmd, [], 'ERROR')
+            return
+        self.pub_pending = int(args[1])
+        self.pub_cmd_time = now
+        self.schedule(self.latency.get(cmd, self.args.default_latency), b'> ')
+
+    def cmd_SMDISC(self, cmd, rest, line, now):
+        self.mqtt_connected = False
+        self.reply(cmd, [])
+
+    def cmd_SMSTATE(self, cmd, rest, line, now):
+        self.reply(cmd, ['+SMSTATE: %d' % int(self.mqtt_connected)])
+
+
+def open_transport(args):
+    if args.port:
+        import serial
+        ser = serial.Serial(args.port, args.baud, timeout=0)
+        return ser.fileno(), ser.port, ser
+    master, slave = os.openpty()
+    # Sem eco nem traducao de fim de linha, como uma UART
+    tty.setraw(slave)
+    return master, os.ttyname(slave), None
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument('--port', help='Porta serial real (padrao: cria um pseudo-terminal)')
+    ap.add_argument('--baud', type=int, default=9600)
+    ap.add_argument('--fix-after', type=float, default=15.0, help='Segundos de GNSS ligado ate o fix')
+    ap.add_argument('--hot-fix-after', type=float, default=2.0, help='Fix apos AT+CGNSHOT com efemerides validas')
+    ap.add_argument('--warm-fix-after', type=float, default=8.0, help='Fix com almanaque ou XTRA')
+    ap.add_argument('--service-after', type=float, default=5.0, help='Segundos sem GNSS ate sair de NO SERVICE')
+    ap.add_argument('--lte-keep', type=float, default=60.0, help='GNSS ate este tempo mantem registro e PDP')
+    ap.add_argument('--lte-resume', type=float, default=0.5, help='Segundos ate o LTE voltar depois de um GNSS curto')
+    ap.add_argument('--pdp-delay', type=int, default=800, help='ms entre AT+CNACT e a URC +APP PDP')
+    ap.add_argument('--mqtt-connect-ms', type=int, default=1500)
+    ap.add_argument('--default-latency', type=int, default=DEFAULT_LATENCY_MS, help='ms ate a resposta de cada comando')
+    ap.add_argument('--latency', action='append', metavar='CMD=MS', help='Latencia de um comando, ex.: AT+CGACT=3000')
+    ap.add_argument('--drop', type=float, default=0.0, help='Probabilidade de perder cada byte enviado')
+    ap.add_argument('--urc', action='append', metavar='TEXTO@S', help='URC periodica, ex.: "+CGREG: 1@30"')
+    ap.add_argument('--lat', type=float, default=-23.550520)
+    ap.add_argument('--lon', type=float, default=-46.633308)
+    ap.add_argument('--speed', type=float, default=0.0)
+    ap.add_argument('--course', type=float, default=0.0)
+    ap.add_argument('--seed', type=int, default=1)
+    ap.add_argument('--duration', type=float, default=0, help='Encerra apos N segundos (0 = ate Ctrl+C)')
+    ap.add_argument('--report-json', help='Grava o relatorio dos ciclos neste arquivo ao sair')
+    ap.add_argument('-v', '--verbose', action='store_true')
+    args = ap.parse_args()
+
+    fd, name, ser = open_transport(args)
+    sim = Sim7070(args)
+    print('[sim] SIM7070 simulado em %s' % name)
+    sys.stdout.flush()
+
+    #SIGTERM (ex.: encerrado pelo example_test.py) tambem grava o relatorio
+    signal.signal(signal.SIGTERM, lambda *_: sys.exit(0))
+    end = time.time() + args.duration if args.duration else None
+    try:
+        while end is None or time.time() < end:
+            deadline = sim.next_deadline()
+            timeout = 0.5 if deadline is None else max(0.0, min(0.5, deadline - time.time()))
+            r, _, _ = select.select([fd], [], [], timeout)
+            if r:
+                try:
+                    data = os.read(fd, 1024)
+                except OSError:
+                    data = b''
+                if data:
+                    sim.feed(data)
+            out = sim.pending_output(time.time())
+            if out:
+                os.write(fd, out)
+            if sim.new_baud and not sim.events:
+                # OK do AT+IPR ja saiu na velocidade antiga
+                if ser is not None:
+                    ser.baudrate = sim.new_baud
+                sim.baud, sim.new_baud = sim.new_baud, None
+    except (KeyboardInterrupt, SystemExit):
+        pass
+
+    sim.end_cycle(time.time())
+    if args.report_json:
+        with open(args.report_json, 'w') as f:
+            json.dump({'cycles': sim.cycles}, f, indent=2)
+
+
+if __name__ == '__main__':
+    main()
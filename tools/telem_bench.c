@@ -0,0 +1,157 @@
+/* Benchmark do formato binario de telemetria contra JSON equivalente
+
+   Gera uma trilha de fixes (um a cada 30 s, veiculo a ~60 km/h) e resumos de
+   vibracao, codifica em lotes nos dois formatos, confere a decodificacao do
+   binario e mostra bytes por entrada e tempo de codificacao.
+
+   gcc -O2 -Imain tools/telem_bench.c main/telem.c -o telem_bench && ./telem_bench
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "telem.h"
+
+#define N_FIX       2000
+#define BATCH       20
+#define PAYLOAD_MAX 1024
+#define REPEAT      200
+
+static telem_fix_t fixes[N_FIX];
+static telem_vib_t vibs[N_FIX];
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void gen(void)
+{
+    int32_t lat = -23550520, lon = -46633308, alt = 76000;
+    uint32_t t = 1644705465;
+
+    srand(1);
+    for (int i = 0; i < N_FIX; i++) {
+        lat += rand() % 4000 - 1000;
+        lon += rand() % 4000 - 1000;
+        alt += rand() % 200 - 100;
+        t += 30;
+        fixes[i] = (telem_fix_t) {
+            .utc = t, .lat_e6 = lat, .lon_e6 = lon, .alt_cm = alt,
+            .speed_kmh_x100 = 5000 + rand() % 2000, .course_x100 = rand() % 36000,
+            .hdop_x100 = 80 + rand() % 60, .sats = 6 + rand() % 6, .fix_mode = 1,
+        };
+        vibs[i] = (telem_vib_t) {
+            .utc = t + 1, .axis = i % 3, .rms_mg = 40 + rand() % 40, .peak_mg = 200 + rand() % 400,
+            .crest_x100 = 300 + rand() % 300, .kurtosis_x100 = 250 + rand() % 500,
+            .shocks = {rand() % 3, rand() % 2, 0}, .nbands = TELEM_VIB_BANDS,
+        };
+        for (int b = 0; b < TELEM_VIB_BANDS; b++) {
+            vibs[i].band[b] = rand() % 5000;
+        }
+    }
+}
+
+static size_t json_fix(char *p, size_t cap, const telem_fix_t *f)
+{
+    return snprintf(p, cap,
+                    "{\"t\":%u,\"lat\":%.6f,\"lon\":%.6f,\"alt\":%.2f,\"spd\":%.2f,\"crs\":%.2f,\"hdop\":%.2f,\"sats\":%u,\"mode\":%u}",
+                    f->utc, f->lat_e6 / 1e6, f->lon_e6 / 1e6, f->alt_cm / 100.0, f->speed_kmh_x100 / 100.0,
+                    f->course_x100 / 100.0, f->hdop_x100 / 100.0, f->sats, f->fix_mode);
+}
+
+static size_t json_vib(char *p, size_t cap, const telem_vib_t *v)
+{
+    size_t n = snprintf(p, cap, "{\"t\":%u,\"axis\":%u,\"rms\":%u,\"peak\":%u,\"crest\":%.2f,\"kurt\":%.2f,\"shocks\":[%u,%u,%u],\"bands\":[",
+                        v->utc, v->axis, v->rms_mg, v->peak_mg, v->crest_x100 / 100.0, v->kurtosis_x100 / 100.0,
+                        v->shocks[0], v->shocks[1], v->shocks[2]);
+    for (int b = 0; b < v->nbands; b++) {
+        n += snprintf(p + n, cap - n, b ? ",%u" : "%u", v->band[b]);
+    }
+    return n + snprintf(p + n, cap - n, "]}");
+}
+
+//Lotes de BATCH fixes + BATCH resumos de vibracao
+static size_t run_bin(int check)
+{
+    static uint8_t buf[PAYLOAD_MAX * 4];
+    size_t total = 0;
+
+    for (int i = 0; i < N_FIX; i += BATCH) {
+        telem_enc_t enc;
+        telem_enc_init(&enc, buf, sizeof(buf));
+        for (int k = i; k < i + BATCH; k++) {
+            telem_enc_fix(&enc, &fixes[k]);
+            telem_enc_vib(&enc, &vibs[k]);
+        }
+        total += enc.len;
+        if (check) {
+            telem_dec_t dec;
+            telem_entry_t e;
+            telem_dec_init(&dec, buf, enc.len);
+            for (int k = i; k < i + BATCH; k++) {
+                if (telem_dec_next(&dec, &e) != TELEM_TYPE_FIX || memcmp(&e.fix, &fixes[k], sizeof(e.fix)) != 0 ||
+                        telem_dec_next(&dec, &e) != TELEM_TYPE_VIB || memcmp(&e.vib, &vibs[k], sizeof(e.vib)) != 0) {
+                    printf("ERRO de decodificacao no lote %d\n", i / BATCH);
+                    exit(1);
+                }
+            }
+            if (telem_dec_next(&dec, &e) != 0) {
+                printf("ERRO: sobra no lote %d\n", i / BATCH);
+                exit(1);
+            }
+        }
+    }
+    return total;
+}
+
+static size_t run_json(void)
+{
+    static char buf[PAYLOAD_MAX * 16];
+    size_t total = 0;
+
+    for (int i = 0; i < N_FIX; i += BATCH) {
+        size_t n = 0;
+        buf[n++] = '[';
+        for (int k = i; k < i + BATCH; k++) {
+            n += json_fix(buf + n, sizeof(buf) - n, &fixes[k]);
+            buf[n++] = ',';
+            n += json_vib(buf + n, sizeof(buf) - n, &vibs[k]);
+            buf[n++] = (k + 1 < i + BATCH) ? ',' : ']';
+        }
+        total += n;
+    }
+    return total;
+}
+
+int main(void)
+{
+    size_t bin, json;
+    double t0, t_bin, t_json;
+
+    gen();
+    bin = run_bin(1);
+    json = run_json();
+
+    t0 = now_s();
+    for (int r = 0; r < REPEAT; r++) {
+        run_bin(0);
+    }
+    t_bin = now_s() - t0;
+    t0 = now_s();
+    for (int r = 0; r < REPEAT; r++) {
+        run_json();
+    }
+    t_json = now_s() - t0;
+
+    printf("%d fixes + %d resumos de vibracao, lotes de %d pares\n", N_FIX, N_FIX, BATCH);
+    printf("binario: %7zu bytes (%.1f B/entrada), %.0f entradas/s\n",
+           bin, bin / (2.0 * N_FIX), 2.0 * N_FIX * REPEAT / t_bin);
+    printf("JSON:    %7zu bytes (%.1f B/entrada), %.0f entradas/s\n",
+           json, json / (2.0 * N_FIX), 2.0 * N_FIX * REPEAT / t_json);
+    printf("reducao: %.1fx\n", (double)json / bin);
+    return 0;
+}
@@ -0,0 +1,448 @@
+/* Teste de queda de energia do tlog (main/tlog.c) no host
+
+   A particao "tlog" fica em um arquivo, com a semantica da NOR: escrita so
+   leva bits de 1 para 0 e o apagamento volta o setor para 0xFF. Uma carga
+   aleatoria acrescenta registros e confirma lotes (tlog_peek + tlog_ack,
+   as vezes so parte do lote, como o broker) e, em uma operacao da flash
+   sorteada, a energia cai:
+     - escrita de registro, de cabecalho ou de ack: grava ate um byte
+       sorteado, que fica parcialmente programado;
+     - apagamento: apaga so o inicio do setor (o cabecalho primeiro).
+   A "partida" seguinte reabre com tlog_open(), que varre a particao, e
+   confere contra o modelo: todo pendente lido tem o conteudo do seu seq e
+   os seqs crescem; nenhum pendente confirmado volta; nenhum pendente se
+   perde. So o registro da escrita interrompida pode aparecer ou nao, e so
+   os do ack interrompido podem ficar confirmados ou nao. A carga mantem
+   poucos pendentes, para a rotacao nunca descartar um deles.
+
+   Depois confere a confirmacao por seq: um ack com o lote lido antes de
+   uma rotacao que descartou o segmento nao confirma nada.
+
+   gcc -O2 -Itools/host -Imain tools/tlog_powercut.c main/tlog.c -o tlog_powercut
+   ./tlog_powercut [quedas] [semente]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <setjmp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "tlog.h"
+
+#define NSEG            8
+#define PART_SIZE       (NSEG * TLOG_SEGMENT_SIZE)
+#define PART_FILE       "tlog_powercut.bin"
+#define PENDING_MAX     60          //Bem abaixo de um giro da particao
+#define BATCH           16
+#define OPS_MAX         200         //Operacoes da flash ate a queda, no maximo
+#define MODEL_LEN       256
+
+typedef enum {
+    CUT_REC = 0,
+    CUT_HDR,
+    CUT_ACK,
+    CUT_ERASE,
+    CUT_KINDS,
+} cut_kind_t;
+
+static const char *const cut_names[CUT_KINDS] = {"registro", "cabecalho", "ack", "apagamento"};
+
+struct host_mutex {
+    bool held;
+};
+
+static FILE *part_file;
+static esp_partition_t part = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .subtype = TLOG_PARTITION_SUBTYPE,
+    .size = PART_SIZE,
+    .label = TLOG_PARTITION_LABEL,
+};
+static struct host_mutex mutex;
+static jmp_buf cut_jmp;
+static long ops_left = -1;          //-1: sem queda programada
+static cut_kind_t cut_kind;
+static unsigned cuts[CUT_KINDS];
+static int fails;
+
+//Modelo: pendentes que a flash tem de ter, em ordem
+static uint32_t model[MODEL_LEN];
+static size_t model_n;
+static uint32_t maybe_rec;          //Seq da escrita interrompida (0: nenhuma)
+static uint32_t maybe_lo;           //Faixa do ack interrompido
+static uint32_t maybe_hi;
+
+/* --- Particao em arquivo e mutex --- */
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    if (type != part.type || subtype != part.subtype || strcmp(label, part.label) != 0) {
+        return NULL;
+    }
+    return &part;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *p, size_t offset, void *dst, size_t size)
+{
+    if (p != &part || offset + size > PART_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    fseek(part_file, (long)offset, SEEK_SET);
+    return fread(dst, 1, size, part_file) == size ? ESP_OK : ESP_FAIL;
+}
+
+static void part_put(size_t offset, const uint8_t *src, size_t size)
+{
+    fseek(part_file, (long)offset, SEEK_SET);
+    fwrite(src, 1, size, part_file);
+    fflush(part_file);
+}
+
+//Chamada antes de cada operacao: true se a energia cai nesta
+static bool part_cut(cut_kind_t kind)
+{
+    if (ops_left < 0 || --ops_left > 0) {
+        return false;
+    }
+    ops_left = -1;
+    cut_kind = kind;
+    cuts[kind]++;
+    return true;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *p, size_t offset, const void *src, size_t size)
+{
+    const uint8_t *s = src;
+    uint8_t buf[TLOG_SEGMENT_SIZE];
+    size_t done = size;
+    cut_kind_t kind;
+    bool cut;
+
+    if (p != &part || offset + size > PART_SIZE || size > sizeof(buf)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    kind = (size == 1) ? CUT_ACK : (offset % TLOG_SEGMENT_SIZE == 0) ? CUT_HDR : CUT_REC;
+    cut = part_cut(kind);
+    if (cut) {
+        done = (size_t)rand() % size;
+    }
+    esp_partition_read(p, offset, buf, size);
+    for (size_t i = 0; i < done; i++) {
+        buf[i] &= s[i];
+    }
+    if (cut) {
+        //Byte da queda: so parte dos bits programados
+        buf[done] &= s[done] | (uint8_t)rand();
+    }
+    part_put(offset, buf, size);
+    if (cut) {
+        longjmp(cut_jmp, 1);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *p, size_t offset, size_t size)
+{
+    uint8_t buf[TLOG_SEGMENT_SIZE];
+    bool cut;
+
+    if (p != &part || offset % TLOG_SEGMENT_SIZE != 0 || size != TLOG_SEGMENT_SIZE || offset + size > PART_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    cut = part_cut(CUT_ERASE);
+    if (cut) {
+        //Comeca pelo inicio: o cabecalho e o primeiro a sumir
+        size = 1 + (size_t)rand() % (TLOG_SEGMENT_SIZE - 1);
+    }
+    memset(buf, 0xFF, size);
+    part_put(offset, buf, size);
+    if (cut) {
+        longjmp(cut_jmp, 1);
+    }
+    return ESP_OK;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    //Uma queda pode ter deixado o anterior tomado: a partida cria outro
+    mutex.held = false;
+    return &mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    (void)ticks;
+    if (sem->held) {
+        printf("mutex tomado duas vezes\n");
+        exit(1);
+    }
+    sem->held = true;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    sem->held = false;
+    return pdTRUE;
+}
+
+/* --- Carga e conferencia --- */
+
+//Conteudo determinado pelo seq: o registro lido mostra se e o certo
+static size_t rec_make(uint32_t seq, uint8_t *data)
+{
+    size_t len = seq % (TLOG_PAYLOAD_MAX + 1);
+
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (uint8_t)(seq * 31 + i * 7);
+    }
+    return len;
+}
+
+static bool rec_check(const tlog_rec_t *r)
+{
+    uint8_t data[TLOG_PAYLOAD_MAX];
+    size_t len = rec_make(r->seq, data);
+
+    return r->type == (uint8_t)r->seq && r->len == len && memcmp(r->data, data, len) == 0;
+}
+
+static void fail(unsigned cut, const char *what, uint32_t seq)
+{
+    if (fails++ < 10) {
+        printf("  queda %u (%s): %s, seq %u\n", cut, cut_names[cut_kind], what, seq);
+    }
+}
+
+//tlog_open imprime a cada partida: silencia durante as milhares de reaberturas
+static esp_err_t open_quiet(tlog_t *log)
+{
+    int out = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    esp_err_t ret;
+
+    fflush(stdout);
+    dup2(null, STDOUT_FILENO);
+    ret = tlog_open(log, TLOG_PARTITION_LABEL);
+    fflush(stdout);
+    dup2(out, STDOUT_FILENO);
+    close(null);
+    close(out);
+    return ret;
+}
+
+static bool in_model(uint32_t seq)
+{
+    for (size_t i = 0; i < model_n; i++) {
+        if (model[i] == seq) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//Partida depois da queda: o que a varredura achou bate com o modelo?
+static void recover(tlog_t *log, unsigned cut)
+{
+    static tlog_rec_t recs[MODEL_LEN];
+    tlog_stats_t st;
+    size_t n = 0;
+    size_t k = 0;
+
+    if (open_quiet(log) != ESP_OK || tlog_peek(log, recs, MODEL_LEN, &n) != ESP_OK) {
+        fail(cut, "reabertura falhou", 0);
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint32_t seq = recs[i].seq;
+
+        if (!rec_check(&recs[i])) {
+            fail(cut, "conteudo errado", seq);
+        }
+        if (i > 0 && seq <= recs[i - 1].seq) {
+            fail(cut, "fora de ordem", seq);
+        }
+        if (!in_model(seq) && seq != maybe_rec) {
+            fail(cut, "pendente que nao devia existir", seq);
+        }
+    }
+    for (size_t i = 0; i < model_n; i++) {
+        uint32_t seq = model[i];
+
+        while (k < n && recs[k].seq < seq) {
+            k++;
+        }
+        if ((k == n || recs[k].seq != seq) && !(seq >= maybe_lo && seq <= maybe_hi)) {
+            fail(cut, "pendente perdido", seq);
+        }
+    }
+    tlog_get_stats(log, &st);
+    if (st.pending != n) {
+        fail(cut, "contagem de pendentes", st.pending);
+    }
+    //Daqui em diante o modelo e o que a flash tem
+    model_n = n;
+    for (size_t i = 0; i < n; i++) {
+        model[i] = recs[i].seq;
+    }
+    maybe_rec = 0;
+    maybe_lo = 1;
+    maybe_hi = 0;
+}
+
+static void do_append(tlog_t *log)
+{
+    uint8_t data[TLOG_PAYLOAD_MAX];
+    uint32_t seq = log->next_seq;
+    size_t len = rec_make(seq, data);
+
+    maybe_rec = seq;
+    if (tlog_append(log, (uint8_t)seq, data, len) == ESP_OK) {
+        model[model_n++] = seq;
+    }
+    maybe_rec = 0;
+}
+
+static void do_ack(tlog_t *log, unsigned cut)
+{
+    tlog_rec_t recs[BATCH];
+    size_t n;
+    size_t used;
+
+    if (tlog_peek(log, recs, BATCH, &n) != ESP_OK || n == 0) {
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (i >= model_n || recs[i].seq != model[i]) {
+            fail(cut, "peek diferente do modelo", recs[i].seq);
+            return;
+        }
+    }
+    //Broker aceita o lote todo ou so o inicio
+    used = (rand() % 2) ? n : 1 + (size_t)rand() % n;
+    maybe_lo = recs[0].seq;
+    maybe_hi = recs[used - 1].seq;
+    if (tlog_ack(log, recs[0].seq, recs[used - 1].seq) == ESP_OK) {
+        model_n -= used;
+        memmove(model, model + used, model_n * sizeof(model[0]));
+    } else {
+        fail(cut, "ack recusado", recs[0].seq);
+    }
+    maybe_lo = 1;
+    maybe_hi = 0;
+}
+
+static int powercut(unsigned ncuts)
+{
+    static tlog_t log;
+    volatile unsigned cut = 0;
+
+    if (open_quiet(&log) != ESP_OK) {
+        printf("particao nao abriu\n");
+        return 1;
+    }
+    maybe_lo = 1;
+    maybe_hi = 0;
+    setjmp(cut_jmp);
+    while (cut < ncuts) {
+        if (ops_left < 0) {
+            if (cut > 0) {
+                recover(&log, cut);
+            }
+            ops_left = 1 + rand() % OPS_MAX;
+            cut++;
+        }
+        if (model_n < PENDING_MAX && rand() % 4 != 0) {
+            do_append(&log);
+        } else {
+            do_ack(&log, cut);
+        }
+    }
+    ops_left = -1;
+    recover(&log, cut);
+    return 0;
+}
+
+//Lote lido, segmento descartado pela rotacao durante o envio, ack atrasado
+static int stale_ack(void)
+{
+    static tlog_t log;
+    uint8_t data[TLOG_PAYLOAD_MAX];
+    tlog_rec_t recs[BATCH];
+    tlog_stats_t st;
+    size_t n;
+    int bad = 0;
+
+    for (uint32_t seg = 0; seg < NSEG; seg++) {
+        esp_partition_erase_range(&part, seg * TLOG_SEGMENT_SIZE, TLOG_SEGMENT_SIZE);
+    }
+    open_quiet(&log);
+    for (int i = 0; i < 10; i++) {
+        tlog_append(&log, 0, data, 0);
+    }
+    //Parte do lote: so ate o ultimo seq enviado
+    tlog_peek(&log, recs, 5, &n);
+    if (n != 5 || tlog_ack(&log, recs[0].seq, recs[2].seq) != ESP_OK) {
+        bad++;
+    }
+    tlog_peek(&log, recs, 5, &n);
+    if (n != 5 || recs[0].seq != 4) {
+        bad++;
+    }
+    //Giro inteiro sem ack: o segmento do lote e reaproveitado
+    for (int i = 0; i < NSEG * TLOG_SLOTS_PER_SEG; i++) {
+        tlog_append(&log, 0, data, 0);
+    }
+    if (tlog_ack(&log, recs[0].seq, recs[n - 1].seq) != ESP_ERR_INVALID_STATE) {
+        bad++;
+    }
+    tlog_get_stats(&log, &st);
+    if (st.acked != 3 || st.stale != 1) {
+        bad++;
+    }
+    printf("ack com pendentes trocados: %s\n", bad ? "FALHOU" : "OK");
+    return bad;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned ncuts = (argc > 1) ? (unsigned)atoi(argv[1]) : 2000;
+    unsigned seed = (argc > 2) ? (unsigned)atoi(argv[2]) : 1;
+    uint8_t ff[TLOG_SEGMENT_SIZE];
+    bool all = true;
+
+    srand(seed);
+    part_file = fopen(PART_FILE, "w+b");
+    if (part_file == NULL) {
+        perror(PART_FILE);
+        return 1;
+    }
+    //Flash nova: tudo apagado
+    memset(ff, 0xFF, sizeof(ff));
+    for (int seg = 0; seg < NSEG; seg++) {
+        fwrite(ff, 1, sizeof(ff), part_file);
+    }
+    fflush(part_file);
+
+    if (powercut(ncuts) != 0) {
+        return 1;
+    }
+    printf("%u quedas (semente %u), %d segmentos:", ncuts, seed, NSEG);
+    for (int k = 0; k < CUT_KINDS; k++) {
+        printf(" %s %u", cut_names[k], cuts[k]);
+        all = all && cuts[k] > 0;
+    }
+    printf("\n");
+    if (!all && ncuts >= 500) {
+        printf("  algum tipo de queda nao foi sorteado\n");
+        fails++;
+    }
+    printf("recuperacao apos queda: %s (%d falhas)\n", fails ? "FALHOU" : "OK", fails);
+
+    fails += stale_ack();
+    fclose(part_file);
+    remove(PART_FILE);
+    return fails != 0;
+}
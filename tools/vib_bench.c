@@ -0,0 +1,404 @@
+/* Referencia e benchmark da extracao de vibracao (main/vib.c)
+
+   Implementa de novo, de forma direta (FFT radix-2 generica com twiddle
+   calculado a cada borboleta, inversao de bits por laco, somas em 128 bits
+   nativos), o mesmo algoritmo descrito em main/vib.c. Gera 30 min de
+   aceleracao sintetica a 1 kHz (gravidade, vibracao da estrada, ruido,
+   choques, trechos parado, saturado e quase sem sinal), confere que todos
+   os resumos sao iguais bit a bit aos da referencia e mede o custo por
+   amostra. Por fim mostra o tamanho codificado de um periodo de 30 min e
+   confere os valores de um seno puro.
+
+   gcc -O2 -Imain tools/vib_bench.c main/vib.c main/telem.c -lm -o vib_bench && ./vib_bench
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC    1
+#endif
+#include "vib.h"
+
+#define DURATION_S  1800
+#define N_SAMPLES   (DURATION_S * VIB_RATE_HZ)
+#define REPORT_S    60
+#define N           VIB_FFT_N
+
+static int16_t samples[N_SAMPLES][VIB_AXES];
+
+//---------------------------------------------------------------- referencia
+
+typedef struct {
+    unsigned __int128 sum4;
+    uint64_t sum2;
+    uint64_t band[TELEM_VIB_BANDS];
+    uint32_t shocks[TELEM_VIB_SHOCKS];
+    uint32_t peak;
+    int armed[TELEM_VIB_SHOCKS];
+} ref_axis_t;
+
+typedef struct {
+    uint32_t thr[TELEM_VIB_SHOCKS];
+    int16_t win[VIB_AXES][N];
+    int fill;
+    uint32_t windows;
+    ref_axis_t axis[VIB_AXES];
+} ref_t;
+
+static int32_t ref_sin(int k)
+{
+    k = ((k % N) + N) % N;
+    if (k <= N / 4) return vib_sin_q15[k];
+    if (k <= N / 2) return vib_sin_q15[N / 2 - k];
+    if (k <= 3 * N / 4) return -(int32_t)vib_sin_q15[k - N / 2];
+    return -(int32_t)vib_sin_q15[N - k];
+}
+
+static int ref_bitrev(int n)
+{
+    int r = 0;
+    for (int b = 0; b < VIB_FFT_LOG2; b++) {
+        if (n & (1 << b)) {
+            r |= 1 << (VIB_FFT_LOG2 - 1 - b);
+        }
+    }
+    return r;
+}
+
+static int ref_edge(int b)
+{
+    static const int hz[TELEM_VIB_BANDS] = {2, 4, 8, 16, 32, 64, 128, 256};
+    return b == TELEM_VIB_BANDS ? N / 2 + 1 : (hz[b] * N + VIB_RATE_HZ / 2) / VIB_RATE_HZ;
+}
+
+static void ref_init(ref_t *r, const vib_cfg_t *cfg)
+{
+    memset(r, 0, sizeof(*r));
+    for (int l = 0; l < TELEM_VIB_SHOCKS; l++) {
+        r->thr[l] = (cfg->shock_mg[l] * VIB_LSB_PER_G + 500) / 1000;
+        for (int a = 0; a < VIB_AXES; a++) {
+            r->axis[a].armed[l] = 1;
+        }
+    }
+}
+
+static void ref_window(ref_t *r, int a)
+{
+    ref_axis_t *ax = &r->axis[a];
+    int32_t d[N], re[N], im[N];
+    int32_t sum = 0, mean;
+    uint32_t peak = 0;
+    int s;
+
+    for (int n = 0; n < N; n++) {
+        sum += r->win[a][n];
+    }
+    mean = (int32_t)floor((sum + N / 2) / (double)N);
+    for (int n = 0; n < N; n++) {
+        int32_t v = r->win[a][n] - mean;
+        uint32_t av;
+        d[n] = v > 32767 ? 32767 : v < -32767 ? -32767 : v;
+        av = abs(d[n]);
+        if (av > peak) peak = av;
+        ax->sum2 += (uint64_t)d[n] * d[n];
+        ax->sum4 += (unsigned __int128)((uint64_t)d[n] * d[n]) * ((uint64_t)d[n] * d[n]);
+        for (int l = 0; l < TELEM_VIB_SHOCKS; l++) {
+            if (ax->armed[l] && av >= r->thr[l]) {
+                ax->shocks[l]++;
+                ax->armed[l] = 0;
+            } else if (!ax->armed[l] && av < r->thr[l] / 2) {
+                ax->armed[l] = 1;
+            }
+        }
+    }
+    if (peak > ax->peak) ax->peak = peak;
+    if (peak == 0) return;
+
+    s = -1;
+    if (peak < 16384) {
+        s = 0;
+        while ((peak << (s + 1)) < 16384) s++;
+    }
+    for (int n = 0; n < N; n++) {
+        int32_t hann = (32768 - ref_sin(n + N / 4)) / 2;
+        int64_t p = (int64_t)d[n] * hann;
+        //Arredondamento para +infinito no meio, como o deslocamento aritmetico
+        re[ref_bitrev(n)] = (int32_t)floor((p + ldexp(1, 14 - s)) / ldexp(1, 15 - s));
+        im[ref_bitrev(n)] = 0;
+    }
+    for (int len = 2; len <= N; len *= 2) {
+        for (int i = 0; i < N; i += len) {
+            for (int j = 0; j < len / 2; j++) {
+                int k = j * (N / len);
+                int32_t wr = ref_sin(k + N / 4), wi = -ref_sin(k);
+                int ia = i + j, ib = i + j + len / 2;
+                int32_t tr = (int32_t)floor((wr * (double)re[ib] - wi * (double)im[ib] + 16384) / 32768);
+                int32_t ti = (int32_t)floor((wr * (double)im[ib] + wi * (double)re[ib] + 16384) / 32768);
+                int32_t ar = re[ia], ai = im[ia];
+                re[ia] = (int32_t)floor((ar + tr) / 2.0);
+                im[ia] = (int32_t)floor((ai + ti) / 2.0);
+                re[ib] = (int32_t)floor((ar - tr) / 2.0);
+                im[ib] = (int32_t)floor((ai - ti) / 2.0);
+            }
+        }
+    }
+    for (int b = 0; b < TELEM_VIB_BANDS; b++) {
+        unsigned __int128 e = 0;
+        for (int k = ref_edge(b); k < ref_edge(b + 1); k++) {
+            e += (uint64_t)re[k] * re[k] + (uint64_t)im[k] * im[k];
+        }
+        ax->band[b] += (uint64_t)((e << 22) / ((unsigned __int128)3 << (2 * s + 2)));
+    }
+}
+
+static void ref_add(ref_t *r, const int16_t acc[VIB_AXES])
+{
+    for (int a = 0; a < VIB_AXES; a++) {
+        r->win[a][r->fill] = acc[a];
+    }
+    if (++r->fill == N) {
+        for (int a = 0; a < VIB_AXES; a++) {
+            ref_window(r, a);
+        }
+        r->fill = 0;
+        r->windows++;
+    }
+}
+
+static uint16_t ref_sat(double x)
+{
+    return x > 65535 ? 65535 : (uint16_t)x;
+}
+
+static uint64_t ref_isqrt(uint64_t x)
+{
+    uint64_t r = (uint64_t)sqrtl((long double)x);
+    while (r * r > x) r--;
+    while ((r + 1) * (r + 1) <= x) r++;
+    return r;
+}
+
+static uint16_t ref_mg(uint64_t lsb, int frac)
+{
+    uint64_t div = (uint64_t)VIB_LSB_PER_G << frac;
+    return ref_sat((double)((lsb * 1000 + div / 2) / div));
+}
+
+static size_t ref_report(ref_t *r, uint32_t utc, telem_vib_t out[VIB_AXES])
+{
+    uint64_t n = (uint64_t)r->windows * N;
+
+    if (r->windows == 0) return 0;
+    for (int a = 0; a < VIB_AXES; a++) {
+        ref_axis_t *ax = &r->axis[a];
+        telem_vib_t *o = &out[a];
+        uint64_t rms_q4 = ref_isqrt((ax->sum2 * 256) / n);
+
+        memset(o, 0, sizeof(*o));
+        o->utc = utc;
+        o->axis = a;
+        o->rms_mg = ref_mg(rms_q4, 4);
+        o->peak_mg = ref_mg(ax->peak, 0);
+        o->crest_x100 = rms_q4 ? ref_sat((double)((ax->peak * 1600ULL + rms_q4 / 2) / rms_q4)) : 0;
+        if (ax->sum2) {
+            double s4 = (double)(uint64_t)(ax->sum4 >> 64) * 18446744073709551616.0 + (double)(uint64_t)ax->sum4;
+            double k = s4 * (double)n / ((double)ax->sum2 * (double)ax->sum2);
+            o->kurtosis_x100 = ref_sat(floor(k * 100 + 0.5));
+        }
+        for (int l = 0; l < TELEM_VIB_SHOCKS; l++) {
+            o->shocks[l] = ax->shocks[l] > 65535 ? 65535 : ax->shocks[l];
+        }
+        o->nbands = TELEM_VIB_BANDS;
+        for (int b = 0; b < TELEM_VIB_BANDS; b++) {
+            o->band[b] = ref_mg(ref_isqrt(ax->band[b] / r->windows), 8);
+        }
+        ax->sum2 = 0;
+        ax->sum4 = 0;
+        ax->peak = 0;
+        memset(ax->band, 0, sizeof(ax->band));
+        memset(ax->shocks, 0, sizeof(ax->shocks));
+    }
+    r->windows = 0;
+    return VIB_AXES;
+}
+
+//------------------------------------------------------------------- sinais
+
+static uint32_t lcg = 12345;
+
+static int32_t noise(int amp)
+{
+    lcg = lcg * 1664525 + 1013904223;
+    return (int32_t)(lcg >> 16) % (2 * amp + 1) - amp;
+}
+
+static int16_t clamp16(double v)
+{
+    return v > 32767 ? 32767 : v < -32768 ? -32768 : (int16_t)lrint(v);
+}
+
+static void gen(void)
+{
+    const double g = VIB_LSB_PER_G;
+    int shock_left = 0, shock_axis = 0;
+    double shock_amp = 0;
+
+    for (int i = 0; i < N_SAMPLES; i++) {
+        double t = (double)i / VIB_RATE_HZ;
+        int minute = i / (60 * VIB_RATE_HZ);
+        double v[VIB_AXES] = {0.02 * g, -0.01 * g, g};
+        double road = (minute % 10 == 3) ? 0 : 1;       //Parado
+        double fine = (minute % 10 == 5) ? 0.002 : 1;   //Quase sem sinal
+
+        for (int a = 0; a < VIB_AXES; a++) {
+            v[a] += road * fine * (0.15 * g * sin(2 * M_PI * 12 * t + a) +
+                                   0.08 * g * sin(2 * M_PI * 45 * t + 2 * a) +
+                                   0.03 * g * sin(2 * M_PI * 170 * t + 3 * a));
+            v[a] += road * fine * noise(30);
+        }
+        if (minute % 10 == 7) {
+            //Saturado: onda quadrada de fundo de escala
+            v[0] = ((i / 25) & 1) ? 32767 : -32768;
+        }
+        if (shock_left == 0 && noise(4000) == 0) {
+            shock_left = 8;
+            shock_axis = (lcg >> 8) % VIB_AXES;
+            shock_amp = (1.5 + ((lcg >> 4) % 50) / 10.0) * g;
+        }
+        if (shock_left > 0) {
+            v[shock_axis] += shock_amp * sin(M_PI * (8 - shock_left + 0.5) / 8);
+            shock_left--;
+        }
+        for (int a = 0; a < VIB_AXES; a++) {
+            samples[i][a] = clamp16(v[a]);
+        }
+    }
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t cycles(void)
+{
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void print_vib(const telem_vib_t *o)
+{
+    printf("  eixo %u: rms %u mg, pico %u mg, crista %.2f, curtose %.2f, choques %u/%u/%u, bandas",
+           o->axis, o->rms_mg, o->peak_mg, o->crest_x100 / 100.0, o->kurtosis_x100 / 100.0,
+           o->shocks[0], o->shocks[1], o->shocks[2]);
+    for (int b = 0; b < o->nbands; b++) {
+        printf(" %u", o->band[b]);
+    }
+    printf("\n");
+}
+
+int main(void)
+{
+    static vib_t vib;
+    static ref_t ref;
+    const vib_cfg_t cfg = VIB_CFG_DEFAULT;
+    telem_vib_t out[VIB_AXES], exp[VIB_AXES], full[VIB_AXES];
+    int reports = 0, mismatches = 0;
+    double t_vib = 0, t_ref = 0;
+    uint64_t c_vib = 0, c_ref = 0;
+    uint8_t buf[512];
+    telem_enc_t enc;
+    int fails = 0;
+
+    gen();
+    vib_init(&vib, &cfg);
+    ref_init(&ref, &cfg);
+
+    for (int i = 0; i < N_SAMPLES; i += REPORT_S * VIB_RATE_HZ) {
+        double t0 = now_s();
+        uint64_t c0 = cycles();
+        for (int k = i; k < i + REPORT_S * VIB_RATE_HZ; k++) {
+            vib_add(&vib, samples[k]);
+        }
+        c_vib += cycles() - c0;
+        t_vib += now_s() - t0;
+
+        t0 = now_s();
+        c0 = cycles();
+        for (int k = i; k < i + REPORT_S * VIB_RATE_HZ; k++) {
+            ref_add(&ref, samples[k]);
+        }
+        c_ref += cycles() - c0;
+        t_ref += now_s() - t0;
+
+        size_t n1 = vib_report(&vib, i / VIB_RATE_HZ, out);
+        size_t n2 = ref_report(&ref, i / VIB_RATE_HZ, exp);
+        reports++;
+        if (n1 != n2 || memcmp(out, exp, sizeof(out)) != 0) {
+            mismatches++;
+            if (mismatches <= 3) {
+                printf("divergencia no periodo %d:\n", reports);
+                for (int a = 0; a < VIB_AXES; a++) {
+                    print_vib(&out[a]);
+                    print_vib(&exp[a]);
+                }
+            }
+        }
+        if (reports == 2) {
+            printf("periodo %d (com estrada):\n", reports);
+            for (int a = 0; a < VIB_AXES; a++) {
+                print_vib(&out[a]);
+            }
+        }
+    }
+    printf("%d periodos de %d s x %d eixos: %d divergencias com a referencia\n",
+           reports, REPORT_S, VIB_AXES, mismatches);
+    fails += mismatches != 0;
+
+    printf("custo por amostra (3 eixos): vib %.1f ns", t_vib * 1e9 / N_SAMPLES);
+#ifdef HAVE_TSC
+    printf(" / %.0f ciclos", (double)c_vib / N_SAMPLES);
+#endif
+    printf(", referencia %.1f ns", t_ref * 1e9 / N_SAMPLES);
+#ifdef HAVE_TSC
+    printf(" / %.0f ciclos", (double)c_ref / N_SAMPLES);
+#endif
+    printf("\n");
+
+    //Periodo de 30 min inteiro em um relatorio
+    vib_init(&vib, &cfg);
+    for (int k = 0; k < N_SAMPLES; k++) {
+        vib_add(&vib, samples[k]);
+    }
+    vib_report(&vib, 1644705465, full);
+    telem_enc_init(&enc, buf, sizeof(buf));
+    for (int a = 0; a < VIB_AXES; a++) {
+        telem_enc_vib(&enc, &full[a]);
+    }
+    printf("30 min -> %d entradas, %u bytes codificados\n", VIB_AXES, (unsigned)enc.len);
+
+    //Seno de 50 Hz com 0,5 g de amplitude no eixo x: RMS 354 mg, banda 32-64 Hz
+    vib_init(&vib, &cfg);
+    for (int i = 0; i < 60 * VIB_RATE_HZ; i++) {
+        int16_t s[VIB_AXES] = {clamp16(0.5 * VIB_LSB_PER_G * sin(2 * M_PI * 50 * i / VIB_RATE_HZ)), 0, VIB_LSB_PER_G};
+        vib_add(&vib, s);
+    }
+    vib_report(&vib, 0, out);
+    printf("seno 50 Hz 0,5 g:\n");
+    print_vib(&out[0]);
+    if (abs(out[0].rms_mg - 354) > 3 || abs(out[0].band[4] - 354) > 10 || abs(out[0].kurtosis_x100 - 150) > 2 ||
+            abs(out[0].crest_x100 - 141) > 2 || out[1].rms_mg != 0) {
+        printf("valores do seno fora do esperado\n");
+        fails++;
+    }
+    return fails ? 1 : 0;
+}